@@ -0,0 +1,427 @@
+/*!
+ *  \brief     Benchmark suite of the rgb_triangle tool measuring the internal drawing functions of librgbtri.
+ *  \author    Dawid Sygocki
+ *  \date      2026-10-16
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+//minimal duration of a single benchmark measurement (in seconds)
+#define BENCH_MIN_TIME 0.2
+
+//maximal number of spans recorded for the draw_horizontal_line() benchmark
+#define BENCH_MAX_SPANS (1024 * 1024)
+
+//temporary file written by the save_bitmap() benchmark
+#define BENCH_FILENAME "rgb_triangle_bench.bmp"
+
+#define BENCH_TINY 0
+#define BENCH_RANDOM 1
+#define BENCH_SLIVER 2
+#define BENCH_FULLSCREEN 3
+#define BENCH_DISTRIBUTION_COUNT 4
+
+const char *bench_distributions[BENCH_DISTRIBUTION_COUNT] = {"tiny", "random", "sliver", "fullscreen"};
+
+//canvas sizes swept by the benchmarks
+const LONG bench_sizes[][2] = {{256, 256}, {1920, 1080}, {3840, 2160}};
+#define BENCH_SIZE_COUNT (sizeof(bench_sizes) / sizeof(bench_sizes[0]))
+
+//triangle counts swept by the benchmarks
+const DWORD bench_triangle_counts[] = {16, 4096};
+#define BENCH_TRIANGLE_COUNT_COUNT (sizeof(bench_triangle_counts) / sizeof(bench_triangle_counts[0]))
+
+/*! \brief Describes a span passed to the line drawing function (recorded for the draw_horizontal_line() benchmark).
+ */
+typedef struct BENCHSPAN {
+    DWORD line_y;
+    LONG left_x;
+    LONG right_x;
+    DWORD left_color;
+    DWORD right_color;
+} BENCHSPAN;
+
+/*! \brief Describes the result of a single benchmark measurement.
+ */
+typedef struct BENCHRESULT {
+    const char *function;
+    const char *kernel;
+    const BITMAPINFOHEADER *info_header;
+    //NULL for the benchmarks not drawing triangles
+    const char *distribution;
+    DWORD triangle_count;
+    double seconds;
+    double triangles;
+    double pixels;
+    double cycles;
+    //time of drawing a triangle without filling its spans (negative if not measured)
+    double setup_seconds;
+} BENCHRESULT;
+
+//state of the line drawing functions used for analyzing triangles before the benchmarks
+LONGLONG bench_pixel_count;
+BENCHSPAN *bench_spans;
+DWORD bench_span_count;
+
+/*! \brief Generates a pseudo-random number (xorshift32), so that the benchmarks are repeatable across platforms.
+
+    \param state Pointer to the non-zero generator state.
+ */
+DWORD bench_random(DWORD *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/*! \brief Generates a pseudo-random number from the given range (inclusive).
+ */
+LONG bench_random_range(DWORD *state, const LONG min, const LONG max)
+{
+    return min + (LONG)(bench_random(state) % (DWORD)(max - min + 1));
+}
+
+/*! \brief Generates a set of triangles of the given size distribution.
+
+    \param triangles Pointer to the array for storing the triangles.
+    \param triangle_count Number of triangles.
+    \param width Width of the bitmap.
+    \param height Height of the bitmap.
+    \param distribution One of the BENCH_* distributions: tiny (a few pixels), random (vertices anywhere in the bitmap),
+        sliver (long and at most a few pixels thick) or fullscreen (covering the whole bitmap).
+ */
+void generate_bench_triangles(VERTEXDATA (*triangles)[3], const DWORD triangle_count, const LONG width, const LONG height,
+    const LONG distribution)
+{
+    DWORD state = 0x9e3779b9;
+    for (DWORD i = 0; i < triangle_count; i++) {
+        LONG x = bench_random_range(&state, 0, width - 1),
+            y = bench_random_range(&state, 0, height - 1);
+        for (DWORD j = 0; j < 3; j++) {
+            VERTEXDATA *vertex = &triangles[i][j];
+            switch (distribution) {
+                case BENCH_TINY:
+                    vertex->posX = x + bench_random_range(&state, -2, 2);
+                    vertex->posY = y + bench_random_range(&state, -2, 2);
+                    break;
+                case BENCH_SLIVER:
+                    if (j == 0) {
+                        vertex->posX = bench_random_range(&state, 0, width - 1);
+                        vertex->posY = bench_random_range(&state, 0, height - 1);
+                    } else {
+                        vertex->posX = x + bench_random_range(&state, -1, 1);
+                        vertex->posY = y + bench_random_range(&state, -1, 1);
+                    }
+                    break;
+                case BENCH_FULLSCREEN:
+                    //a right triangle with its legs twice as long as the bitmap sides
+                    vertex->posX = j == 1 ? 2 * width : -1;
+                    vertex->posY = j == 2 ? 2 * height : -1;
+                    break;
+                default:
+                    vertex->posX = bench_random_range(&state, 0, width - 1);
+                    vertex->posY = bench_random_range(&state, 0, height - 1);
+                    break;
+            }
+            DWORD color = bench_random(&state);
+            vertex->colR = color >> 16;
+            vertex->colG = color >> 8;
+            vertex->colB = color;
+        }
+    }
+}
+
+/*! \brief Counts and records the pixels of a span instead of drawing it (see draw_horizontal_line()).
+ */
+void record_bench_span(BYTE *image_data, BITMAPINFOHEADER *info_header, DWORD line_y,
+    LONG left_x, LONG right_x, DWORD left_color, DWORD right_color)
+{
+    (void)image_data;
+    LONG first_x = left_x > 0 ? left_x : 0,
+        last_x = right_x < abs(info_header->biWidth) - 1 ? right_x : abs(info_header->biWidth) - 1;
+    if (first_x <= last_x) {
+        bench_pixel_count += last_x - first_x + 1;
+    }
+    if (bench_spans != NULL && bench_span_count < BENCH_MAX_SPANS) {
+        BENCHSPAN *span = &bench_spans[bench_span_count++];
+        span->line_y = line_y;
+        span->left_x = left_x;
+        span->right_x = right_x;
+        span->left_color = left_color;
+        span->right_color = right_color;
+    }
+}
+
+/*! \brief Ignores a span (used for measuring the cost of triangle setup and edge stepping alone).
+ */
+void skip_bench_span(BYTE *image_data, BITMAPINFOHEADER *info_header, DWORD line_y,
+    LONG left_x, LONG right_x, DWORD left_color, DWORD right_color)
+{
+    (void)image_data;
+    (void)info_header;
+    (void)line_y;
+    (void)left_x;
+    (void)right_x;
+    (void)left_color;
+    (void)right_color;
+}
+
+/*! \brief Prints the result of a benchmark measurement.
+
+    \param result Pointer to the result.
+    \param csv Whether the result should be printed as a line of comma-separated values.
+ */
+void print_bench_result(const BENCHRESULT *result, const bool csv)
+{
+    const char *format = result->info_header->biBitCount == 32 ? "xrgb32" : "rgb24";
+    bool with_triangles = result->distribution != NULL && result->triangles > 0;
+    if (csv) {
+        printf("%s,%s,%s,%d,%d,%s,", result->function, result->kernel, format,
+            abs(result->info_header->biWidth), abs(result->info_header->biHeight),
+            result->distribution != NULL ? result->distribution : "");
+        if (result->distribution != NULL) {
+            printf("%u", result->triangle_count);
+        }
+        printf(",%.6g,", result->seconds);
+        if (with_triangles) {
+            printf("%.6g", result->triangles / result->seconds);
+        }
+        printf(",%.6g,%.6g,", result->pixels / result->seconds, result->pixels > 0 ? result->cycles / result->pixels : 0.0);
+        if (result->setup_seconds >= 0) {
+            printf("%.6g", result->setup_seconds * 1e9);
+        }
+        putchar('\n');
+    } else {
+        char triangle_count[16] = "-";
+        if (result->distribution != NULL) {
+            snprintf(triangle_count, sizeof(triangle_count), "%u", result->triangle_count);
+        }
+        printf("%-20s %-6s %-6s %4dx%-4d %-10s %5s", result->function, result->kernel, format,
+            abs(result->info_header->biWidth), abs(result->info_header->biHeight),
+            result->distribution != NULL ? result->distribution : "-", triangle_count);
+        if (with_triangles) {
+            printf("  %10.4g tri/s", result->triangles / result->seconds);
+        } else {
+            printf("  %16s", "");
+        }
+        printf("  %10.4g px/s  %7.3f cycles/px", result->pixels / result->seconds,
+            result->pixels > 0 ? result->cycles / result->pixels : 0.0);
+        if (result->setup_seconds >= 0) {
+            printf("  %8.1f ns setup/tri", result->setup_seconds * 1e9);
+        }
+        putchar('\n');
+    }
+    fflush(stdout);
+}
+
+/*! \brief Benchmarks the triangle drawing functions using a set of triangles.
+
+    Measures draw_triangle() (one by one), draw_triangles() (binned batch) and draw_horizontal_line()
+    (replaying the spans of the triangles) on the given bitmap.
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param distribution One of the BENCH_* distributions.
+    \param triangle_count Number of triangles in the set.
+    \param kernel Name of the line drawing function.
+    \param csv Whether the results should be printed as comma-separated values.
+
+    \return Zero on success, -2 on memory allocation error.
+ */
+LONG run_triangle_benchmarks(BYTE *image_data, BITMAPINFOHEADER *info_header, const LONG distribution,
+    const DWORD triangle_count, const char *kernel, const bool csv)
+{
+    DRAWLINEPROC line_proc = draw_horizontal_line_proc;
+    VERTEXDATA (*triangles)[3] = malloc(triangle_count * sizeof(*triangles));
+    VERTEXDATA (*batch)[3] = malloc(triangle_count * sizeof(*batch));
+    LONGLONG *triangle_pixels = malloc(triangle_count * sizeof(LONGLONG));
+    bench_spans = malloc(BENCH_MAX_SPANS * sizeof(BENCHSPAN));
+    if (triangles == NULL || batch == NULL || triangle_pixels == NULL || bench_spans == NULL) {
+        free(triangles);
+        free(batch);
+        free(triangle_pixels);
+        free(bench_spans);
+        bench_spans = NULL;
+        return -2;
+    }
+    generate_bench_triangles(triangles, triangle_count, abs(info_header->biWidth), abs(info_header->biHeight), distribution);
+
+    //count the pixels of each triangle and record the spans
+    draw_horizontal_line_proc = record_bench_span;
+    bench_span_count = 0;
+    LONGLONG span_pixels = 0;
+    for (DWORD i = 0; i < triangle_count; i++) {
+        bench_pixel_count = 0;
+        draw_triangle(image_data, info_header, &triangles[i]);
+        triangle_pixels[i] = bench_pixel_count;
+        if (bench_span_count < BENCH_MAX_SPANS) {
+            span_pixels += bench_pixel_count;
+        }
+    }
+
+    //measure setup and edge stepping without filling the spans
+    BENCHRESULT result = {NULL, kernel, info_header, bench_distributions[distribution], triangle_count, 0, 0, 0, 0, 0};
+    draw_horizontal_line_proc = skip_bench_span;
+    double setup_triangles = 0, start_time = get_time_seconds(), seconds;
+    do {
+        for (DWORD i = 0; i < triangle_count; i++) {
+            draw_triangle(image_data, info_header, &triangles[i]);
+        }
+        setup_triangles += triangle_count;
+        seconds = get_time_seconds() - start_time;
+    } while (seconds < BENCH_MIN_TIME);
+    result.setup_seconds = seconds / setup_triangles;
+    draw_horizontal_line_proc = line_proc;
+
+    //draw_triangle(): triangles drawn one by one (at least one, until the minimal time passes)
+    result.function = "draw_triangle";
+    result.triangles = 0;
+    result.pixels = 0;
+    LONGLONG start_cycles = read_tsc();
+    start_time = get_time_seconds();
+    for (DWORD i = 0; ; i = (i + 1) % triangle_count) {
+        draw_triangle(image_data, info_header, &triangles[i]);
+        result.triangles++;
+        result.pixels += triangle_pixels[i];
+        seconds = get_time_seconds() - start_time;
+        if (seconds >= BENCH_MIN_TIME) {
+            break;
+        }
+    }
+    result.cycles = read_tsc() - start_cycles;
+    result.seconds = seconds;
+    print_bench_result(&result, csv);
+
+    //draw_triangles(): the triangles drawn above (up to the whole set) in a single batch
+    DWORD batch_count = result.triangles < triangle_count ? (DWORD)result.triangles : triangle_count;
+    LONGLONG batch_pixels = 0;
+    for (DWORD i = 0; i < batch_count; i++) {
+        batch_pixels += triangle_pixels[i];
+    }
+    result.function = "draw_triangles";
+    result.triangles = 0;
+    result.pixels = 0;
+    start_cycles = read_tsc();
+    start_time = get_time_seconds();
+    do {
+        memcpy(batch, triangles, batch_count * sizeof(*batch));
+        draw_triangles(image_data, info_header, batch, batch_count, NULL, NULL);
+        result.triangles += batch_count;
+        result.pixels += batch_pixels;
+        seconds = get_time_seconds() - start_time;
+    } while (seconds < BENCH_MIN_TIME);
+    result.cycles = read_tsc() - start_cycles;
+    result.seconds = seconds;
+    result.setup_seconds = -1;
+    print_bench_result(&result, csv);
+
+    //draw_horizontal_line(): the recorded spans
+    result.function = "draw_horizontal_line";
+    result.triangles = 0;
+    result.pixels = 0;
+    start_cycles = read_tsc();
+    start_time = get_time_seconds();
+    do {
+        for (DWORD i = 0; i < bench_span_count; i++) {
+            BENCHSPAN *span = &bench_spans[i];
+            line_proc(image_data, info_header, span->line_y, span->left_x, span->right_x, span->left_color, span->right_color);
+        }
+        result.pixels += span_pixels;
+        seconds = get_time_seconds() - start_time;
+    } while (seconds < BENCH_MIN_TIME);
+    result.cycles = read_tsc() - start_cycles;
+    result.seconds = seconds;
+    print_bench_result(&result, csv);
+
+    free(triangles);
+    free(batch);
+    free(triangle_pixels);
+    free(bench_spans);
+    bench_spans = NULL;
+    return 0;
+}
+
+/*! \brief Runs the benchmark suite and prints its results.
+
+    Sweeps the canvas size, internal pixel format, triangle size distribution and triangle count, measuring
+    triangles and pixels per second, time stamp counter cycles per pixel and setup time per triangle
+    of draw_triangle(), draw_triangles(), draw_horizontal_line(), clear_bitmap() and save_bitmap().
+
+    \param kernel Name of the line drawing function in use.
+    \param xrgb Whether the 32-bit internal pixel format should be included (requires SSSE3 support).
+    \param csv Whether the results should be printed as comma-separated values (for tracking regressions).
+
+    \return Zero on success, -2 on memory allocation or file I/O error.
+ */
+LONG run_benchmarks(const char *kernel, const bool xrgb, const bool csv)
+{
+    //the functions are measured with the defaults (see select_line_drawer() and select_rasterizer())
+    use_default_settings();
+    if (csv) {
+        puts("function,kernel,format,width,height,distribution,triangle_count,seconds,"
+            "triangles_per_second,pixels_per_second,cycles_per_pixel,setup_ns_per_triangle");
+    }
+    for (DWORD i = 0; i < BENCH_SIZE_COUNT; i++) {
+        for (WORD bit_count = 24; bit_count <= (xrgb ? 32 : 24); bit_count += 8) {
+            BITMAPINFOHEADER info_header, file_info_header;
+            set_info_header(&info_header, bench_sizes[i][0], bench_sizes[i][1], bit_count);
+            set_info_header(&file_info_header, bench_sizes[i][0], bench_sizes[i][1], 24);
+            BYTE *image_data = malloc(get_image_data_size(&info_header));
+            if (image_data == NULL) {
+                return -2;
+            }
+            double pixels_per_call = (double)bench_sizes[i][0] * bench_sizes[i][1];
+            BENCHRESULT result = {"clear_bitmap", kernel, &info_header, NULL, 0, 0, 0, 0, 0, -1};
+
+            //clear_bitmap()
+            LONGLONG start_cycles = read_tsc();
+            double start_time = get_time_seconds();
+            do {
+                clear_bitmap(image_data, &info_header, 0xff, 0xff, 0xff);
+                result.pixels += pixels_per_call;
+                result.seconds = get_time_seconds() - start_time;
+            } while (result.seconds < BENCH_MIN_TIME);
+            result.cycles = read_tsc() - start_cycles;
+            print_bench_result(&result, csv);
+
+            //save_bitmap() (or its 32-bit variant)
+            BYTE file_header[14];
+            DWORD summed_header_size = sizeof(file_header) + sizeof(file_info_header);
+            set_file_header(&file_header, summed_header_size + file_info_header.biSizeImage, summed_header_size);
+            result.function = "save_bitmap";
+            result.pixels = 0;
+            start_cycles = read_tsc();
+            start_time = get_time_seconds();
+            do {
+                LONG status = bit_count == 32
+                    ? save_xrgb_bitmap(&file_header, &file_info_header, image_data, BENCH_FILENAME)
+                    : save_bitmap(&file_header, &file_info_header, image_data, BENCH_FILENAME);
+                if (status != 0) {
+                    free(image_data);
+                    return -2;
+                }
+                result.pixels += pixels_per_call;
+                result.seconds = get_time_seconds() - start_time;
+            } while (result.seconds < BENCH_MIN_TIME);
+            result.cycles = read_tsc() - start_cycles;
+            remove(BENCH_FILENAME);
+            print_bench_result(&result, csv);
+
+            //triangle drawing
+            for (LONG j = 0; j < BENCH_DISTRIBUTION_COUNT; j++) {
+                for (DWORD k = 0; k < BENCH_TRIANGLE_COUNT_COUNT; k++) {
+                    if (run_triangle_benchmarks(image_data, &info_header, j, bench_triangle_counts[k], kernel, csv) != 0) {
+                        free(image_data);
+                        return -2;
+                    }
+                }
+            }
+            free(image_data);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,13 @@
+/*!
+ *  \brief     Benchmark suite of the rgb_triangle tool (see run_benchmarks()).
+ *  \author    Dawid Sygocki
+ *  \date      2026-10-16
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "rgbtri_private.h"
+
+LONG run_benchmarks(const char *kernel, const bool xrgb, const bool csv);
+
+#endif
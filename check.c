@@ -0,0 +1,254 @@
+/*!
+ *  \brief     Regression checks of librgbtri (run by "make check").
+ *  \author    Dawid Sygocki
+ *  \date      2026-10-16
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "rgbtri.h"
+
+//file written by the checks (removed afterwards)
+#define CHECK_FILENAME "rgb_triangle_check.bmp"
+//reference bitmap drawn by the tool run with --kernel sse2 and no other arguments (with the scanline rasterizer)
+#define REFERENCE_FILENAME "result.bmp"
+//largest difference of a color component drawn by the half-space rasterizer from the reference bitmap
+#define HALFSPACE_MAX_ERROR 9
+
+/*! \brief Reads a whole file.
+
+    \param filename Name of the file.
+    \param size Pointer for storing the size of the file.
+
+    \return Pointer to the contents (to be freed) or NULL on memory allocation or file I/O error.
+ */
+rgbtri_uint8 *read_whole_file(const char *filename, size_t *size)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    rgbtri_uint8 *data = NULL;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long length = ftell(file);
+        data = length >= 0 ? malloc(length > 0 ? length : 1) : NULL;
+        rewind(file);
+        if (data != NULL && fread(data, 1, length, file) != (size_t)length) {
+            free(data);
+            data = NULL;
+        }
+        *size = length;
+    }
+    fclose(file);
+    return data;
+}
+
+/*! \brief Checks if a file holds the bitmap file of the #CANVAS.
+
+    \param canvas Pointer to the canvas.
+    \param filename Name of the file.
+ */
+bool is_canvas_file(CANVAS *canvas, const char *filename)
+{
+    size_t file_size = get_canvas_file_size(canvas), size;
+    rgbtri_uint8 *expected = malloc(file_size);
+    rgbtri_uint8 *data = read_whole_file(filename, &size);
+    bool status_ok = expected != NULL && data != NULL && read_canvas_file(canvas, expected) == 0
+        && size == file_size && memcmp(data, expected, file_size) == 0;
+    free(expected);
+    free(data);
+    return status_ok;
+}
+
+/*! \brief Checks that a file overwritten by someone else between two saves of a canvas is rewritten as a whole
+    rather than updated incrementally (only the scanlines drawn in between would be written then).
+
+    \return True if the check passed.
+ */
+bool check_external_overwrite(void)
+{
+    CANVAS *canvas;
+    if (create_canvas(&canvas, 64, 48, CHECK_FILENAME, 1, false, 0, false) != 0) {
+        return false;
+    }
+    VERTEXDATA triangle[1][3];
+    set_vertex(&triangle[0][0], 4, 4, 0xff, 0, 0);
+    set_vertex(&triangle[0][1], 60, 10, 0, 0xff, 0);
+    set_vertex(&triangle[0][2], 30, 44, 0, 0, 0xff);
+    bool status_ok = draw_canvas_triangles(canvas, triangle, 1) == 0 && save_canvas(canvas, NULL) == 0;
+
+    //the file keeps its size, inode and headers, only the time stamps tell the change
+    //(which have to differ even on file systems with coarse ones)
+    struct timespec delay = {0, 20 * 1000 * 1000};
+    nanosleep(&delay, NULL);
+    size_t size;
+    rgbtri_uint8 *data = read_whole_file(CHECK_FILENAME, &size);
+    FILE *file = fopen(CHECK_FILENAME, "r+b");
+    if (data == NULL || file == NULL) {
+        status_ok = false;
+    } else {
+        memset(data + 54, 0x5a, size - 54);
+        status_ok = status_ok && fwrite(data, size, 1, file) == 1;
+    }
+    if (file != NULL && fclose(file) != 0) {
+        status_ok = false;
+    }
+    free(data);
+
+    //a single scanline is modified
+    set_vertex(&triangle[0][0], 0, 20, 0, 0, 0);
+    set_vertex(&triangle[0][1], 63, 20, 0, 0, 0);
+    set_vertex(&triangle[0][2], 63, 20, 0, 0, 0);
+    status_ok = status_ok && draw_canvas_triangles(canvas, triangle, 1) == 0 && save_canvas(canvas, NULL) == 0
+        && is_canvas_file(canvas, CHECK_FILENAME);
+    destroy_canvas(canvas);
+    remove(CHECK_FILENAME);
+    return status_ok;
+}
+
+/*! \brief Checks that the half-space rasterizer covers the same pixels of the reference bitmap
+    as the scanline one and that its colors differ by at most #HALFSPACE_MAX_ERROR.
+
+    The bitmap is drawn by the tool (so it has to be run from the directory of the built tool).
+
+    \return True if the check passed.
+ */
+bool check_halfspace_rasterizer(void)
+{
+    if (system("./rgb_triangle --kernel sse2 --rasterizer halfspace " CHECK_FILENAME " > /dev/null") != 0) {
+        return false;
+    }
+    size_t size, reference_size;
+    rgbtri_uint8 *data = read_whole_file(CHECK_FILENAME, &size);
+    rgbtri_uint8 *reference = read_whole_file(REFERENCE_FILENAME, &reference_size);
+    remove(CHECK_FILENAME);
+    bool status_ok = data != NULL && reference != NULL && size == reference_size && size >= 54
+        && memcmp(data, reference, 54) == 0;
+    if (status_ok) {
+        //the dimensions and the bit count are read from the info header
+        rgbtri_int32 width, height;
+        uint16_t bit_count;
+        memcpy(&width, reference + 18, sizeof(width));
+        memcpy(&height, reference + 22, sizeof(height));
+        memcpy(&bit_count, reference + 28, sizeof(bit_count));
+        width = abs(width);
+        height = abs(height);
+        size_t stride = ((size_t)width * 3 + 3) & ~(size_t)3;
+        status_ok = bit_count == 24 && size == 54 + stride * height;
+        for (rgbtri_int32 i = 0; i < height && status_ok; i++) {
+            for (rgbtri_int32 j = 0; j < width && status_ok; j++) {
+                const rgbtri_uint8 *pixel = data + 54 + i * stride + 3 * j,
+                    *reference_pixel = reference + 54 + i * stride + 3 * j;
+                //the background is white
+                bool covered = memcmp(pixel, "\xff\xff\xff", 3) != 0,
+                    reference_covered = memcmp(reference_pixel, "\xff\xff\xff", 3) != 0;
+                status_ok = covered == reference_covered;
+                for (rgbtri_int32 k = 0; k < 3; k++) {
+                    status_ok = status_ok && abs(pixel[k] - reference_pixel[k]) <= HALFSPACE_MAX_ERROR;
+                }
+            }
+        }
+    }
+    free(data);
+    free(reference);
+    return status_ok;
+}
+
+/*! \brief Draws a set of triangles on a #CANVAS in batches, alternating with another canvas if given.
+
+    \param canvas Pointer to the canvas.
+    \param other_canvas Pointer to the other canvas (which the same triangles are drawn on) or NULL.
+    \param seed Seed of the triangles.
+
+    \return True on success.
+ */
+bool draw_check_triangles(CANVAS *canvas, CANVAS *other_canvas, rgbtri_uint32 seed)
+{
+    VERTEXDATA triangles[16][3];
+    bool status_ok = true;
+    for (rgbtri_int32 i = 0; i < 32 && status_ok; i++) {
+        for (rgbtri_int32 j = 0; j < 16; j++) {
+            for (rgbtri_int32 k = 0; k < 3; k++) {
+                //the triangles stick out of the bitmap as well
+                seed = seed * 1664525 + 1013904223;
+                set_vertex(&triangles[j][k], (rgbtri_int32)(seed >> 8 & 0xff) - 32,
+                    (rgbtri_int32)(seed >> 16 & 0xff) - 48, seed & 0xff, seed >> 4 & 0xff, seed >> 24);
+            }
+        }
+        VERTEXDATA other_triangles[16][3];
+        memcpy(other_triangles, triangles, sizeof(triangles));
+        status_ok = draw_canvas_triangles(canvas, triangles, 16) == 0
+            && (other_canvas == NULL || draw_canvas_triangles(other_canvas, other_triangles, 16) == 0);
+    }
+    return status_ok;
+}
+
+/*! \brief Checks that canvases with different settings drawn in alternation (one of them with worker threads)
+    give the same bitmaps as when each of them is drawn alone.
+
+    \return True if the check passed.
+ */
+bool check_canvas_settings(void)
+{
+    CANVAS *canvases[2][2] = {{NULL, NULL}, {NULL, NULL}};
+    bool status_ok = true;
+    for (rgbtri_int32 i = 0; i < 2 && status_ok; i++) {
+        status_ok = create_canvas(&canvases[i][0], 192, 160, CHECK_FILENAME, 4, false, 0, false) == 0
+            && create_canvas(&canvases[i][1], 192, 160, CHECK_FILENAME, 1, false, 0, true) == 0
+            && set_canvas_rasterizer(canvases[i][0], RASTERIZER_HALFSPACE) == 0
+            && set_canvas_reverse_order(canvases[i][0], true) == 0
+            && set_canvas_deferred_spans(canvases[i][1], true) == 0;
+    }
+    //the first pair is drawn one canvas after the other, the second one in alternation
+    status_ok = status_ok && draw_check_triangles(canvases[0][0], NULL, 1)
+        && draw_check_triangles(canvases[0][1], NULL, 1) && draw_check_triangles(canvases[1][0], canvases[1][1], 1);
+    size_t file_size = get_canvas_file_size(canvases[0][0]);
+    rgbtri_uint8 *files[2][2] = {{NULL, NULL}, {NULL, NULL}};
+    for (rgbtri_int32 i = 0; i < 2; i++) {
+        for (rgbtri_int32 j = 0; j < 2; j++) {
+            files[i][j] = status_ok ? malloc(file_size) : NULL;
+            status_ok = files[i][j] != NULL && read_canvas_file(canvases[i][j], files[i][j]) == 0;
+        }
+    }
+    status_ok = status_ok && memcmp(files[0][0], files[1][0], file_size) == 0
+        && memcmp(files[0][1], files[1][1], file_size) == 0
+        //the rasterizers differ in colors, so the settings have been applied
+        && memcmp(files[0][0], files[0][1], file_size) != 0;
+    for (rgbtri_int32 i = 0; i < 2; i++) {
+        for (rgbtri_int32 j = 0; j < 2; j++) {
+            free(files[i][j]);
+            destroy_canvas(canvases[i][j]);
+        }
+    }
+    return status_ok;
+}
+
+/*! \brief Runs the checks, printing their results.
+
+    \return EXIT_SUCCESS if all of them passed, EXIT_FAILURE otherwise.
+ */
+int main(void)
+{
+    const struct {
+        const char *name;
+        bool (*proc)(void);
+    } checks[] = {
+        {"external overwrite between saves", check_external_overwrite},
+        {"half-space rasterizer", check_halfspace_rasterizer},
+        {"settings of separate canvases", check_canvas_settings},
+    };
+    int result = EXIT_SUCCESS;
+    for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        bool passed = checks[i].proc();
+        printf("%-40s %s\n", checks[i].name, passed ? "ok" : "FAILED");
+        if (!passed) {
+            result = EXIT_FAILURE;
+        }
+    }
+    return result;
+}
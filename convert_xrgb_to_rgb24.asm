@@ -0,0 +1,77 @@
+; description:   Contains the function for converting a row of X8R8G8B8 pixels to R8G8B8 ones.
+;                Sixteen pixels are packed at once using SSSE3 byte shuffles.
+; author:        Dawid Sygocki
+; last modified: 2026-10-15
+
+section .rodata
+    align 16
+shuffle_rgb24:
+    ; gathers B0 G0 R0 X0 ... B3 G3 R3 X3 into B0 G0 R0 ... B3 G3 R3 (in the low 12 bytes)
+    db 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0x80, 0x80, 0x80, 0x80
+
+section .text
+    global convert_xrgb_to_rgb24
+
+convert_xrgb_to_rgb24:
+    ; function arguments
+    ;  [rdi] BYTE *rgb_data
+    ;  [rsi] const BYTE *xrgb_data
+    ;  [rdx] DWORD pixel_count
+
+    mov edx, edx
+    movdqa xmm7, [rel shuffle_rgb24]
+
+convert_loop:
+    ; general purpose registers layout
+    ;  [rdi] current destination pointer
+    ;  [rsi] current source pointer
+    ;  [rdx] remaining pixel count
+    ; vector registers layout
+    ;  [xmm7] RGB24 shuffle mask
+    cmp rdx, 16
+    jb convert_tail
+
+    movdqu xmm0, [rsi]
+    movdqu xmm1, [rsi+16]
+    movdqu xmm2, [rsi+32]
+    movdqu xmm3, [rsi+48]
+    pshufb xmm0, xmm7
+    pshufb xmm1, xmm7
+    pshufb xmm2, xmm7
+    pshufb xmm3, xmm7
+    ;  [xmm0-3] 12 bytes of pixels 0-3, 4-7, 8-11, 12-15 each
+    ; merge the groups into three full 16-byte chunks
+    movdqa xmm4, xmm1
+    pslldq xmm4, 12
+    por xmm0, xmm4  ; B0 to B5
+    psrldq xmm1, 4
+    movdqa xmm4, xmm2
+    pslldq xmm4, 8
+    por xmm1, xmm4  ; G5 to G10
+    psrldq xmm2, 8
+    pslldq xmm3, 4
+    por xmm2, xmm3  ; R10 to R15
+    movdqu [rdi], xmm0
+    movdqu [rdi+16], xmm1
+    movdqu [rdi+32], xmm2
+
+    add rsi, 64
+    add rdi, 48
+    sub rdx, 16
+    jmp convert_loop
+
+convert_tail:
+    test rdx, rdx
+    jz convert_end
+    ; convert the remaining pixels one by one
+    mov eax, [rsi]
+    mov [rdi], ax  ; store blue and green
+    shr eax, 16
+    mov [rdi+2], al  ; store red
+    add rsi, 4
+    add rdi, 3
+    sub rdx, 1
+    jmp convert_tail
+
+convert_end:
+    ret
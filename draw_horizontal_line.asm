@@ -1,20 +1,26 @@
-; description:   Contains the function for drawing interpolated horizontal lines on R8G8B8 bitmap.
+; description:   Contains the function for drawing interpolated horizontal lines on R8G8B8 (or X8R8G8B8) bitmap.
 ; author:        Dawid Sygocki
-; last modified: 2020-06-12
+; last modified: 2026-10-15
 
 section .text
     global draw_horizontal_line
 
-%macro clamp_0_255 2
+%macro unpack_color 4
     ; parameters:
-    ;  %1 source and destination register (to be clamped)
-    ;  %2 temporary helper register
-    mov %2, 255
-    cmp %1, %2
-    cmovg %1, %2  ; replace %1 with 255 if %1 > 255
-    xor %2, %2
-    test %1, %1
-    cmovs %1, %2  ; replace %1 with 0 if %1 < 0
+    ;  %1 source register containing 0x00RRGGBB color
+    ;  %2 destination register for red (double-precision)
+    ;  %3 destination register for green (double-precision)
+    ;  %4 destination register for blue (double-precision)
+    ; destroys eax and r10d
+    mov eax, %1
+    movzx r10d, al
+    cvtsi2sd %4, r10d
+    shr eax, 8
+    movzx r10d, al
+    cvtsi2sd %3, r10d
+    shr eax, 8
+    movzx r10d, al
+    cvtsi2sd %2, r10d
 %endmacro
 
 draw_horizontal_line:
@@ -22,24 +28,22 @@ draw_horizontal_line:
     ;  [rdi] BYTE *image_data
     ;  [rsi] struct BITMAPINFOHEADER *info_header
     ;  [rdx] DWORD line_y
-    ;  [xmm0] double left_x
-    ;  [xmm1] double left_r
-    ;  [xmm2] double left_g
-    ;  [xmm3] double left_b
-    ;  [xmm4] double right_x
-    ;  [xmm5] double right_r
-    ;  [xmm6] double right_g
-    ;  [xmm7] double right_b
+    ;  [rcx] LONG left_x
+    ;  [r8] LONG right_x
+    ;  [r9] DWORD left_color (0x00RRGGBB)
+    ;  [rsp+8] DWORD right_color (0x00RRGGBB)
 
     ; function prologue
     sub rsp, 8  ; align the stack
 
-    ; move left_x and right_x to general purpose registers
-    mov r11, rdx  ; line_y
-    cvtpd2dq xmm8, xmm0  ; left_x
-    movd ecx, xmm8
-    cvtpd2dq xmm8, xmm4  ; right_x
-    movd edx, xmm8
+    ; convert coordinates and colors to double-precision values
+    mov r11d, edx  ; line_y
+    mov edx, r8d  ; right_x
+    cvtsi2sd xmm0, ecx  ; left_x
+    cvtsi2sd xmm4, edx  ; right_x
+    unpack_color r9d, xmm1, xmm2, xmm3  ; left_r, left_g, left_b
+    mov r9d, [rsp+16]  ; right_color
+    unpack_color r9d, xmm5, xmm6, xmm7  ; right_r, right_g, right_b
 
     ; if right_x < 0, skip drawing
     xor rax, rax
@@ -127,12 +131,12 @@ draw_horizontal_line:
     ; if left_x > right_x, skip drawing
     cmp ecx, edx
     jg draw_end
-    ; calculate stride
-    mov r8d, r9d  ;
-    shl r9d, 1    ;
-    add r9d, r8d  ; multiply r9d by 3
-    add r9d, 3
-    and r9d, 0xfffffffc  ; discard 3 least-significant bits
+    ; calculate stride (in 64 bits, so that it does not overflow for very wide bitmaps)
+    movzx r8d, word [rsi+0xe]  ; info_header->biBitCount
+    shr r8d, 3  ; bytes per pixel (3 or 4)
+    imul r9, r8  ; multiply abs(width) by bytes per pixel
+    add r9, 3
+    and r9, -4  ; discard 2 least-significant bits
 
     ; calculate initial value of current_x, current_r, current_g, current_b
     ;  by adding appropriate step values multiplied by max(0, 0 - left_x)
@@ -147,19 +151,17 @@ draw_horizontal_line:
     ;  [xmm0] current_r, current_x
     ;  [xmm1] current_b, current_g
 
-    ; calculate memory address
-    mov eax, r9d  ; stride
-    mov r9d, edx  ; move min(width - 1, right_x), as edx content is destroyed after multiplication
-    mul r11d  ; edx:eax <- stride * line_y
-    shl rdx, 32
-    or rax, rdx
-    mov edx, ecx  ;
-    shl rdx, 1    ;
-    add rdx, rcx  ; multiply left_x by 3 (bytes per pixel)
-    add rax, rdx
+    ; calculate memory address (64-bit offset)
+    mov eax, r11d  ; line_y
+    imul rax, r9  ; stride * line_y
+    mov r9d, ecx
+    imul r9, r8  ; multiply left_x by bytes per pixel
+    add rax, r9
     add rdi, rax
 
-    mov edx, r9d
+    cmp r8d, 4
+    je horizontal_loop_xrgb
+
 horizontal_loop:
     ; general purpose registers layout
     ;  [rdi] current image data pointer
@@ -173,19 +175,16 @@ horizontal_loop:
     ;  [xmm3] step_b, step_g
 
     ; fetch current color values
+    ;  (no clamping is needed, as the interpolated values never leave the range
+    ;  between the endpoint colors, which are bytes)
     cvtpd2dq xmm4, xmm0
     cvtpd2dq xmm5, xmm1
-    movq r9, xmm5
-    mov rax, r9
+    movq rax, xmm5
+    mov [rdi+1], al  ; store green
     shr rax, 32
-    clamp_0_255 eax, r8d
     mov [rdi], al  ; store blue
-    mov eax, r9d
-    clamp_0_255 eax, r8d
-    mov [rdi+1], al  ; store green
     movq rax, xmm4
     shr rax, 32
-    clamp_0_255 eax, r8d
     mov [rdi+2], al  ; store red
 
     ; perform a linear interpolation step
@@ -196,6 +195,31 @@ horizontal_loop:
     add ecx, 1
     cmp ecx, edx
     jle horizontal_loop
+    jmp draw_end
+
+horizontal_loop_xrgb:
+    ; registers layout as in horizontal_loop
+
+    ; fetch current color values and pack them into a 0x00RRGGBB dword
+    cvtpd2dq xmm4, xmm0
+    cvtpd2dq xmm5, xmm1
+    punpcklqdq xmm5, xmm4
+    ;  [xmm5] current_r, current_x, current_b, current_g (dwords)
+    packssdw xmm5, xmm5
+    pshuflw xmm5, xmm5, 0xb1  ; swap adjacent words: x, r, g, b
+    packuswb xmm5, xmm5  ; clamp to 0-255
+    movd eax, xmm5
+    and eax, 0x00ffffff  ; discard current_x
+    mov [rdi], eax  ; store the whole pixel
+
+    ; perform a linear interpolation step
+    addpd xmm0, xmm2
+    addpd xmm1, xmm3
+
+    add rdi, 4  ; increment memory destination pointer
+    add ecx, 1
+    cmp ecx, edx
+    jle horizontal_loop_xrgb
 
 draw_end:
     xor rax, rax
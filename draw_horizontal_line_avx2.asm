@@ -0,0 +1,270 @@
+; description:   Contains the AVX2 variant of the function for drawing interpolated horizontal lines on R8G8B8 (or X8R8G8B8) bitmap.
+;                Eight pixels are interpolated at once in packed single-precision lanes.
+; author:        Dawid Sygocki
+; last modified: 2026-10-15
+
+section .rodata
+    align 32
+shuffle_bgr:
+    ; gathers B0-3 G0-3 R0-3 (separate byte groups) of each 128-bit lane into B0 G0 R0 ... B3 G3 R3
+    db 0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, 0x80, 0x80, 0x80, 0x80
+    db 0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, 0x80, 0x80, 0x80, 0x80
+shuffle_xrgb:
+    ; gathers B0-3 G0-3 R0-3 0-3 (separate byte groups) of each 128-bit lane into B0 G0 R0 0 ... B3 G3 R3 0
+    db 0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15
+    db 0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15
+lane_offsets:
+    dd 0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0
+lane_count:
+    dd 8.0
+
+section .text
+    global draw_horizontal_line_avx2
+
+%macro unpack_color 4
+    ; parameters:
+    ;  %1 source register containing 0x00RRGGBB color
+    ;  %2 destination register for red (double-precision)
+    ;  %3 destination register for green (double-precision)
+    ;  %4 destination register for blue (double-precision)
+    ; destroys eax and r10d
+    mov eax, %1
+    movzx r10d, al
+    vcvtsi2sd %4, %4, r10d
+    shr eax, 8
+    movzx r10d, al
+    vcvtsi2sd %3, %3, r10d
+    shr eax, 8
+    movzx r10d, al
+    vcvtsi2sd %2, %2, r10d
+%endmacro
+
+%macro interpolate_8_pixels 0
+    ; calculates colors of eight consecutive pixels
+    ;  (left_color + n * step_color, rounded to integers)
+    ; and stores them in ymm9 (blue), ymm10 (green) and ymm11 (red)
+    vmulps ymm9, ymm8, ymm7
+    vaddps ymm9, ymm9, ymm3  ; blue
+    vmulps ymm10, ymm8, ymm6
+    vaddps ymm10, ymm10, ymm2  ; green
+    vmulps ymm11, ymm8, ymm5
+    vaddps ymm11, ymm11, ymm1  ; red
+    vcvtps2dq ymm9, ymm9
+    vcvtps2dq ymm10, ymm10
+    vcvtps2dq ymm11, ymm11
+%endmacro
+
+%macro pack_rgb24 0
+    ; clamps the colors calculated by interpolate_8_pixels to 0-255 and stores them
+    ;  in RGB24 (B, G, R) order in the low 12 bytes of each 128-bit lane of ymm9
+    vpackssdw ymm9, ymm9, ymm10  ; per lane (words): B0-3, G0-3
+    vpackssdw ymm11, ymm11, ymm11  ; per lane (words): R0-3, R0-3
+    vpackuswb ymm9, ymm9, ymm11  ; per lane (bytes, clamped to 0-255): B0-3, G0-3, R0-3, R0-3
+    vpshufb ymm9, ymm9, ymm13
+%endmacro
+
+%macro pack_xrgb 0
+    ; clamps the colors calculated by interpolate_8_pixels to 0-255 and stores them
+    ;  as eight 0x00RRGGBB dwords in ymm9
+    vpackssdw ymm9, ymm9, ymm10  ; per lane (words): B0-3, G0-3
+    vpackssdw ymm11, ymm11, ymm12  ; per lane (words): R0-3, 0-3
+    vpackuswb ymm9, ymm9, ymm11  ; per lane (bytes, clamped to 0-255): B0-3, G0-3, R0-3, 0-3
+    vpshufb ymm9, ymm9, ymm15
+%endmacro
+
+draw_horizontal_line_avx2:
+    ; function arguments
+    ;  [rdi] BYTE *image_data
+    ;  [rsi] struct BITMAPINFOHEADER *info_header
+    ;  [rdx] DWORD line_y
+    ;  [rcx] LONG left_x
+    ;  [r8] LONG right_x
+    ;  [r9] DWORD left_color (0x00RRGGBB)
+    ;  [rsp+8] DWORD right_color (0x00RRGGBB)
+
+    ; function prologue
+    push rbp
+    mov rbp, rsp
+    sub rsp, 32  ; buffer for the last (incomplete) group of pixels
+    and rsp, -32
+
+    ; convert coordinates and colors to double-precision values
+    mov r11d, edx  ; line_y
+    mov edx, r8d  ; right_x
+    vcvtsi2sd xmm0, xmm0, ecx  ; left_x
+    vcvtsi2sd xmm4, xmm4, edx  ; right_x
+    unpack_color r9d, xmm1, xmm2, xmm3  ; left_r, left_g, left_b
+    mov r9d, [rbp+16]  ; right_color
+    unpack_color r9d, xmm5, xmm6, xmm7  ; right_r, right_g, right_b
+
+    ; if right_x < 0, skip drawing
+    test edx, edx
+    js draw_end
+    ; if left_x >= image width, skip drawing
+    mov r10d, [rsi+0x4]  ; info_header->biWidth
+    mov r8d, r10d  ;
+    sar r8d, 31    ;
+    xor r10d, r8d  ;
+    sub r10d, r8d  ; get absolute value of width
+    cmp r10d, ecx
+    jl draw_end
+    ;  [r10d] abs(width)
+
+    ; calculate color steps (zeroed if left_x == right_x)
+    vsubsd xmm8, xmm0, xmm4
+    vsubsd xmm5, xmm1, xmm5
+    vsubsd xmm6, xmm2, xmm6
+    vsubsd xmm7, xmm3, xmm7
+    vxorpd xmm9, xmm9, xmm9
+    vucomisd xmm8, xmm9
+    je zero_steps
+    vdivsd xmm5, xmm5, xmm8
+    vdivsd xmm6, xmm6, xmm8
+    vdivsd xmm7, xmm7, xmm8
+    jmp steps_ready
+zero_steps:
+    vmovapd xmm5, xmm9
+    vmovapd xmm6, xmm9
+    vmovapd xmm7, xmm9
+steps_ready:
+
+    ; broadcast single-precision colors and steps to all lanes
+    vcvtsd2ss xmm1, xmm1, xmm1
+    vcvtsd2ss xmm2, xmm2, xmm2
+    vcvtsd2ss xmm3, xmm3, xmm3
+    vcvtsd2ss xmm5, xmm5, xmm5
+    vcvtsd2ss xmm6, xmm6, xmm6
+    vcvtsd2ss xmm7, xmm7, xmm7
+    vbroadcastss ymm1, xmm1
+    vbroadcastss ymm2, xmm2
+    vbroadcastss ymm3, xmm3
+    vbroadcastss ymm5, xmm5
+    vbroadcastss ymm6, xmm6
+    vbroadcastss ymm7, xmm7
+    ; vector registers layout
+    ;  [ymm1] left_r (x8)
+    ;  [ymm2] left_g (x8)
+    ;  [ymm3] left_b (x8)
+    ;  [ymm5] step_r (x8)
+    ;  [ymm6] step_g (x8)
+    ;  [ymm7] step_b (x8)
+
+    ; prepare general purpose registers for looping
+    xor r8d, r8d
+    mov r9d, r8d
+    sub r9d, ecx
+    cmovg ecx, r8d  ; ecx = max(0, left_x)
+    cmovl r9d, r8d
+    vcvtsi2ss xmm8, xmm8, r9d  ; max(0, 0 - left_x)
+    vbroadcastss ymm8, xmm8
+    vaddps ymm8, ymm8, [rel lane_offsets]
+    ;  [ymm8] distances of the eight current pixels from left_x
+    lea r8d, [r10d-1]
+    cmp edx, r8d
+    cmovg edx, r8d  ; edx = min(width - 1, right_x)
+    ; if left_x > right_x, skip drawing
+    cmp ecx, edx
+    jg draw_end
+    ; calculate stride (in 64 bits, so that it does not overflow for very wide bitmaps)
+    movzx r8d, word [rsi+0xe]  ; info_header->biBitCount
+    shr r8d, 3  ; bytes per pixel (3 or 4)
+    mov r9, r10
+    imul r9, r8
+    add r9, 3
+    and r9, -4
+
+    ; calculate memory address (64-bit offset)
+    mov eax, r11d
+    imul rax, r9  ; stride * line_y
+    add rdi, rax
+    mov eax, ecx
+    imul rax, r8  ; left_x multiplied by bytes per pixel
+    add rdi, rax
+
+    ; calculate pixel count
+    sub edx, ecx
+    add edx, 1
+
+    vbroadcastss ymm14, [rel lane_count]
+    cmp r8d, 4
+    je xrgb_setup
+    vmovdqa ymm13, [rel shuffle_bgr]
+horizontal_loop:
+    ; general purpose registers layout
+    ;  [rdi] current image data pointer
+    ;  [rdx] remaining pixel count
+    ; vector registers layout
+    ;  [ymm8] current distances from left_x
+    ;  [ymm13] RGB24 shuffle mask
+    ;  [ymm14] 8.0 (x8)
+    cmp edx, 8
+    jl horizontal_tail
+
+    interpolate_8_pixels
+    pack_rgb24
+    vmovdqu [rdi], xmm9  ; the last 4 bytes are overwritten below
+    vextracti128 xmm9, ymm9, 1
+    vmovq [rdi+12], xmm9
+    vpextrd [rdi+20], xmm9, 2
+
+    vaddps ymm8, ymm8, ymm14
+    add rdi, 24  ; increment memory destination pointer
+    sub edx, 8
+    jmp horizontal_loop
+
+horizontal_tail:
+    test edx, edx
+    jz draw_end
+    ; interpolate the whole group but copy only the remaining pixels
+    interpolate_8_pixels
+    pack_rgb24
+    vmovdqu [rsp], xmm9
+    vextracti128 xmm9, ymm9, 1
+    vmovdqu [rsp+12], xmm9
+    lea ecx, [edx+edx*2]
+    mov rsi, rsp
+    rep movsb
+    jmp draw_end
+
+xrgb_setup:
+    vpxor ymm12, ymm12, ymm12
+    vmovdqa ymm15, [rel shuffle_xrgb]
+horizontal_loop_xrgb:
+    ; general purpose registers layout
+    ;  [rdi] current image data pointer
+    ;  [rdx] remaining pixel count
+    ; vector registers layout
+    ;  [ymm8] current distances from left_x
+    ;  [ymm12] 0 (x8)
+    ;  [ymm14] 8.0 (x8)
+    ;  [ymm15] XRGB shuffle mask
+    cmp edx, 8
+    jl horizontal_tail_xrgb
+
+    interpolate_8_pixels
+    pack_xrgb
+    vmovdqu [rdi], ymm9
+
+    vaddps ymm8, ymm8, ymm14
+    add rdi, 32  ; increment memory destination pointer
+    sub edx, 8
+    jmp horizontal_loop_xrgb
+
+horizontal_tail_xrgb:
+    test edx, edx
+    jz draw_end
+    ; interpolate the whole group but copy only the remaining pixels
+    interpolate_8_pixels
+    pack_xrgb
+    vmovdqu [rsp], ymm9
+    lea ecx, [edx*4]
+    mov rsi, rsp
+    rep movsb
+
+draw_end:
+    xor rax, rax
+    vzeroupper
+    ; function epilogue
+    mov rsp, rbp
+    pop rbp
+    ret
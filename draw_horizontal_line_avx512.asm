@@ -0,0 +1,292 @@
+; description:   Contains the AVX-512 variant of the function for drawing interpolated horizontal lines on R8G8B8 (or X8R8G8B8) bitmap.
+;                Sixteen pixels are interpolated at once in packed single-precision lanes.
+; author:        Dawid Sygocki
+; last modified: 2026-10-15
+
+section .rodata
+    align 64
+lane_offsets:
+    dd 0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0
+    dd 8.0, 9.0, 10.0, 11.0, 12.0, 13.0, 14.0, 15.0
+lane_count:
+    dd 16.0
+    align 16
+    ; masks distributing 16 blue, green and red bytes over three 16-byte chunks of RGB24 data
+shuffle_b0: db 0, 0x80, 0x80, 1, 0x80, 0x80, 2, 0x80, 0x80, 3, 0x80, 0x80, 4, 0x80, 0x80, 5
+shuffle_g0: db 0x80, 0, 0x80, 0x80, 1, 0x80, 0x80, 2, 0x80, 0x80, 3, 0x80, 0x80, 4, 0x80, 0x80
+shuffle_r0: db 0x80, 0x80, 0, 0x80, 0x80, 1, 0x80, 0x80, 2, 0x80, 0x80, 3, 0x80, 0x80, 4, 0x80
+shuffle_b1: db 0x80, 0x80, 6, 0x80, 0x80, 7, 0x80, 0x80, 8, 0x80, 0x80, 9, 0x80, 0x80, 10, 0x80
+shuffle_g1: db 5, 0x80, 0x80, 6, 0x80, 0x80, 7, 0x80, 0x80, 8, 0x80, 0x80, 9, 0x80, 0x80, 10
+shuffle_r1: db 0x80, 5, 0x80, 0x80, 6, 0x80, 0x80, 7, 0x80, 0x80, 8, 0x80, 0x80, 9, 0x80, 0x80
+shuffle_b2: db 0x80, 11, 0x80, 0x80, 12, 0x80, 0x80, 13, 0x80, 0x80, 14, 0x80, 0x80, 15, 0x80, 0x80
+shuffle_g2: db 0x80, 0x80, 11, 0x80, 0x80, 12, 0x80, 0x80, 13, 0x80, 0x80, 14, 0x80, 0x80, 15, 0x80
+shuffle_r2: db 10, 0x80, 0x80, 11, 0x80, 0x80, 12, 0x80, 0x80, 13, 0x80, 0x80, 14, 0x80, 0x80, 15
+
+section .text
+    global draw_horizontal_line_avx512
+
+%macro unpack_color 4
+    ; parameters:
+    ;  %1 source register containing 0x00RRGGBB color
+    ;  %2 destination register for red (double-precision)
+    ;  %3 destination register for green (double-precision)
+    ;  %4 destination register for blue (double-precision)
+    ; destroys eax and r10d
+    mov eax, %1
+    movzx r10d, al
+    vcvtsi2sd %4, %4, r10d
+    shr eax, 8
+    movzx r10d, al
+    vcvtsi2sd %3, %3, r10d
+    shr eax, 8
+    movzx r10d, al
+    vcvtsi2sd %2, %2, r10d
+%endmacro
+
+%macro interleave_chunk 2
+    ; parameters:
+    ;  %1 destination register
+    ;  %2 chunk index (0-2)
+    vpshufb %1, xmm9, [rel shuffle_b%2]
+    vpshufb xmm4, xmm10, [rel shuffle_g%2]
+    vpor %1, %1, xmm4
+    vpshufb xmm4, xmm11, [rel shuffle_r%2]
+    vpor %1, %1, xmm4
+%endmacro
+
+%macro interpolate_16_pixels 0
+    ; calculates colors of sixteen consecutive pixels
+    ;  (left_color + n * step_color, rounded to integers, negative values replaced with 0)
+    ; and stores them in zmm9 (blue), zmm10 (green) and zmm11 (red)
+    vmulps zmm9, zmm8, zmm7
+    vaddps zmm9, zmm9, zmm3  ; blue
+    vmulps zmm10, zmm8, zmm6
+    vaddps zmm10, zmm10, zmm2  ; green
+    vmulps zmm11, zmm8, zmm5
+    vaddps zmm11, zmm11, zmm1  ; red
+    vcvtps2dq zmm9, zmm9
+    vcvtps2dq zmm10, zmm10
+    vcvtps2dq zmm11, zmm11
+    vpmaxsd zmm9, zmm9, zmm12
+    vpmaxsd zmm10, zmm10, zmm12
+    vpmaxsd zmm11, zmm11, zmm12
+%endmacro
+
+%macro pack_rgb24 0
+    ; clamps the colors calculated by interpolate_16_pixels to 0-255 and stores them
+    ;  in RGB24 (B, G, R) order in xmm0, xmm13 and xmm15 (48 bytes)
+    vpmovusdb xmm9, zmm9  ; B0-15 (clamped to 0-255)
+    vpmovusdb xmm10, zmm10  ; G0-15
+    vpmovusdb xmm11, zmm11  ; R0-15
+    interleave_chunk xmm0, 0
+    interleave_chunk xmm13, 1
+    interleave_chunk xmm15, 2
+%endmacro
+
+%macro pack_xrgb 0
+    ; clamps the colors calculated by interpolate_16_pixels to 0-255 and stores them
+    ;  as sixteen 0x00RRGGBB dwords in zmm9
+    vpminsd zmm9, zmm9, zmm13
+    vpminsd zmm10, zmm10, zmm13
+    vpminsd zmm11, zmm11, zmm13
+    vpslld zmm10, zmm10, 8
+    vpslld zmm11, zmm11, 16
+    vpord zmm9, zmm9, zmm10
+    vpord zmm9, zmm9, zmm11
+%endmacro
+
+draw_horizontal_line_avx512:
+    ; function arguments
+    ;  [rdi] BYTE *image_data
+    ;  [rsi] struct BITMAPINFOHEADER *info_header
+    ;  [rdx] DWORD line_y
+    ;  [rcx] LONG left_x
+    ;  [r8] LONG right_x
+    ;  [r9] DWORD left_color (0x00RRGGBB)
+    ;  [rsp+8] DWORD right_color (0x00RRGGBB)
+
+    ; function prologue
+    push rbp
+    mov rbp, rsp
+    sub rsp, 64  ; buffer for the last (incomplete) group of pixels
+    and rsp, -64
+
+    ; convert coordinates and colors to double-precision values
+    mov r11d, edx  ; line_y
+    mov edx, r8d  ; right_x
+    vcvtsi2sd xmm0, xmm0, ecx  ; left_x
+    vcvtsi2sd xmm4, xmm4, edx  ; right_x
+    unpack_color r9d, xmm1, xmm2, xmm3  ; left_r, left_g, left_b
+    mov r9d, [rbp+16]  ; right_color
+    unpack_color r9d, xmm5, xmm6, xmm7  ; right_r, right_g, right_b
+
+    ; if right_x < 0, skip drawing
+    test edx, edx
+    js draw_end
+    ; if left_x >= image width, skip drawing
+    mov r10d, [rsi+0x4]  ; info_header->biWidth
+    mov r8d, r10d  ;
+    sar r8d, 31    ;
+    xor r10d, r8d  ;
+    sub r10d, r8d  ; get absolute value of width
+    cmp r10d, ecx
+    jl draw_end
+    ;  [r10d] abs(width)
+
+    ; calculate color steps (zeroed if left_x == right_x)
+    vsubsd xmm8, xmm0, xmm4
+    vsubsd xmm5, xmm1, xmm5
+    vsubsd xmm6, xmm2, xmm6
+    vsubsd xmm7, xmm3, xmm7
+    vxorpd xmm9, xmm9, xmm9
+    vucomisd xmm8, xmm9
+    je zero_steps
+    vdivsd xmm5, xmm5, xmm8
+    vdivsd xmm6, xmm6, xmm8
+    vdivsd xmm7, xmm7, xmm8
+    jmp steps_ready
+zero_steps:
+    vmovapd xmm5, xmm9
+    vmovapd xmm6, xmm9
+    vmovapd xmm7, xmm9
+steps_ready:
+
+    ; broadcast single-precision colors and steps to all lanes
+    vcvtsd2ss xmm1, xmm1, xmm1
+    vcvtsd2ss xmm2, xmm2, xmm2
+    vcvtsd2ss xmm3, xmm3, xmm3
+    vcvtsd2ss xmm5, xmm5, xmm5
+    vcvtsd2ss xmm6, xmm6, xmm6
+    vcvtsd2ss xmm7, xmm7, xmm7
+    vbroadcastss zmm1, xmm1
+    vbroadcastss zmm2, xmm2
+    vbroadcastss zmm3, xmm3
+    vbroadcastss zmm5, xmm5
+    vbroadcastss zmm6, xmm6
+    vbroadcastss zmm7, xmm7
+    ; vector registers layout
+    ;  [zmm1] left_r (x16)
+    ;  [zmm2] left_g (x16)
+    ;  [zmm3] left_b (x16)
+    ;  [zmm5] step_r (x16)
+    ;  [zmm6] step_g (x16)
+    ;  [zmm7] step_b (x16)
+
+    ; prepare general purpose registers for looping
+    xor r8d, r8d
+    mov r9d, r8d
+    sub r9d, ecx
+    cmovg ecx, r8d  ; ecx = max(0, left_x)
+    cmovl r9d, r8d
+    vcvtsi2ss xmm8, xmm8, r9d  ; max(0, 0 - left_x)
+    vbroadcastss zmm8, xmm8
+    vaddps zmm8, zmm8, [rel lane_offsets]
+    ;  [zmm8] distances of the sixteen current pixels from left_x
+    lea r8d, [r10d-1]
+    cmp edx, r8d
+    cmovg edx, r8d  ; edx = min(width - 1, right_x)
+    ; if left_x > right_x, skip drawing
+    cmp ecx, edx
+    jg draw_end
+    ; calculate stride (in 64 bits, so that it does not overflow for very wide bitmaps)
+    movzx r8d, word [rsi+0xe]  ; info_header->biBitCount
+    shr r8d, 3  ; bytes per pixel (3 or 4)
+    mov r9, r10
+    imul r9, r8
+    add r9, 3
+    and r9, -4
+
+    ; calculate memory address (64-bit offset)
+    mov eax, r11d
+    imul rax, r9  ; stride * line_y
+    add rdi, rax
+    mov eax, ecx
+    imul rax, r8  ; left_x multiplied by bytes per pixel
+    add rdi, rax
+
+    ; calculate pixel count
+    sub edx, ecx
+    add edx, 1
+
+    vpxord zmm12, zmm12, zmm12
+    vbroadcastss zmm14, [rel lane_count]
+    cmp r8d, 4
+    je xrgb_setup
+horizontal_loop:
+    ; general purpose registers layout
+    ;  [rdi] current image data pointer
+    ;  [rdx] remaining pixel count
+    ; vector registers layout
+    ;  [zmm8] current distances from left_x
+    ;  [zmm12] 0 (x16)
+    ;  [zmm14] 16.0 (x16)
+    cmp edx, 16
+    jl horizontal_tail
+
+    interpolate_16_pixels
+    pack_rgb24
+    vmovdqu [rdi], xmm0
+    vmovdqu [rdi+16], xmm13
+    vmovdqu [rdi+32], xmm15
+
+    vaddps zmm8, zmm8, zmm14
+    add rdi, 48  ; increment memory destination pointer
+    sub edx, 16
+    jmp horizontal_loop
+
+horizontal_tail:
+    test edx, edx
+    jz draw_end
+    ; interpolate the whole group but copy only the remaining pixels
+    interpolate_16_pixels
+    pack_rgb24
+    vmovdqu [rsp], xmm0
+    vmovdqu [rsp+16], xmm13
+    vmovdqu [rsp+32], xmm15
+    lea ecx, [edx+edx*2]
+    mov rsi, rsp
+    rep movsb
+    jmp draw_end
+
+xrgb_setup:
+    mov eax, 255
+    vpbroadcastd zmm13, eax
+horizontal_loop_xrgb:
+    ; general purpose registers layout
+    ;  [rdi] current image data pointer
+    ;  [rdx] remaining pixel count
+    ; vector registers layout
+    ;  [zmm8] current distances from left_x
+    ;  [zmm12] 0 (x16)
+    ;  [zmm13] 255 (x16)
+    ;  [zmm14] 16.0 (x16)
+    cmp edx, 16
+    jl horizontal_tail_xrgb
+
+    interpolate_16_pixels
+    pack_xrgb
+    vmovdqu32 [rdi], zmm9
+
+    vaddps zmm8, zmm8, zmm14
+    add rdi, 64  ; increment memory destination pointer
+    sub edx, 16
+    jmp horizontal_loop_xrgb
+
+horizontal_tail_xrgb:
+    test edx, edx
+    jz draw_end
+    ; interpolate the whole group but copy only the remaining pixels
+    interpolate_16_pixels
+    pack_xrgb
+    vmovdqu32 [rsp], zmm9
+    lea ecx, [edx*4]
+    mov rsi, rsp
+    rep movsb
+
+draw_end:
+    xor rax, rax
+    vzeroupper
+    ; function epilogue
+    mov rsp, rbp
+    pop rbp
+    ret
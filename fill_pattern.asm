@@ -0,0 +1,65 @@
+; description:   Contains the function for filling a memory block with a repeated 48-byte pattern.
+;                48 bytes hold a whole number of both R8G8B8 and X8R8G8B8 pixels, so a single pattern
+;                of the clear color can be stored with three aligned (optionally non-temporal) stores.
+; author:        Dawid Sygocki
+; last modified: 2026-10-15
+
+section .text
+    global fill_pattern
+
+fill_pattern:
+    ; function arguments
+    ;  [rdi] BYTE *destination
+    ;  [rsi] const BYTE *pattern (the 48-byte pattern repeated twice)
+    ;  [rdx] size_t length
+    ;  [rcx] bool non_temporal
+
+    mov r8d, ecx
+    ; store the bytes preceding the first 16-byte boundary one by one
+    mov rcx, rdi
+    neg rcx
+    and rcx, 15
+    cmp rcx, rdx
+    cmova rcx, rdx
+    sub rdx, rcx
+    lea r9, [rsi+rcx]  ; pattern rotated by the number of bytes stored
+    rep movsb
+    movdqu xmm0, [r9]
+    movdqu xmm1, [r9+16]
+    movdqu xmm2, [r9+32]
+    ; general purpose registers layout
+    ;  [rdi] current (aligned) destination pointer
+    ;  [rdx] remaining length
+    ;  [r9] rotated pattern
+    ; vector registers layout
+    ;  [xmm0-2] rotated pattern
+    test r8b, r8b
+    jz fill_loop
+
+fill_loop_non_temporal:
+    cmp rdx, 48
+    jb fill_tail
+    movntdq [rdi], xmm0
+    movntdq [rdi+16], xmm1
+    movntdq [rdi+32], xmm2
+    add rdi, 48
+    sub rdx, 48
+    jmp fill_loop_non_temporal
+
+fill_loop:
+    cmp rdx, 48
+    jb fill_tail
+    movdqa [rdi], xmm0
+    movdqa [rdi+16], xmm1
+    movdqa [rdi+32], xmm2
+    add rdi, 48
+    sub rdx, 48
+    jmp fill_loop
+
+fill_tail:
+    ; store the remaining (less than 48) bytes
+    mov rsi, r9
+    mov rcx, rdx
+    rep movsb
+    sfence  ; order the non-temporal stores before the following ones
+    ret
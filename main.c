@@ -4,338 +4,606 @@
  *  \date      2020-06-12
  */
 #include <stdio.h>
-#include <stdint.h>
 #include <string.h>
-#include <math.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <ctype.h>
-#include <cpuid.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
 
-//maximal path length for compatibility with MS Windows
-//see https://docs.microsoft.com/en-us/windows/win32/fileio/naming-a-file#maximum-path-length-limitation
-#define MAX_PATH 260
+#include "rgbtri_private.h"
+#include "server.h"
+#include "bench.h"
 
 #define BUF_SIZE 512
 
-typedef uint8_t BYTE;
-typedef int16_t SHORT;
-typedef uint16_t WORD;
-typedef int32_t LONG;
-typedef uint32_t DWORD;
+/*! \brief Prints intoduction to the console interface.
+ */
+void print_help(void)
+{
+    puts("[Interactive RGB triangle drawing]");
+    puts("Use one of the following commands:");
+    puts("  help             prints this message");
+    puts("  draw vertices    draws specified triangle on the bitmap");
+    puts("                    the format of vertices is straightforward:");
+    puts("                    x1 y1 color1 x2 y2 color2 x3 y3 color3");
+    puts("  vertex x y color adds a vertex to the vertex buffer of meshes");
+    puts("  mesh indices     draws triangles formed by each three indices of buffered vertices");
+    puts("  strip indices    draws a strip of triangles, each formed by an index and the two preceding ones");
+    puts("  reset            empties the vertex buffer");
+    puts("  clear [color]    clears the bitmap (the default color is white)");
+    puts("  save [filename]  saves the bitmap to a file");
+    puts("  bsave [filename] saves the bitmap to a file in the background");
+    puts("                    (the result is reported on one of the next prompts)");
+    puts("  frame            saves the bitmap as the next frame of a sequence in the background");
+    puts("                    (to numbered files, e.g. result_000000.bmp for the default location)");
+    puts("  flush            draws the queued triangles and the deferred spans");
+    puts("  stats            prints the counters and timers of drawing, clearing, saving and parsing");
+    puts("  kill             quits the program without saving");
+    puts("  quit             quits the program saving bitmap to the default location\n");
+    puts("Supported color formats:");
+    puts("  #rrggbb          (hexadecimal, 00-ff each)");
+    puts("  red green blue   (decimal, 0-255 each)\n");
+    puts("Examples:");
+    puts("  draw 15 5 #000000 5 10 #000000 25 15 #000000");
+    puts("  vertex 0 0 #ff0000");
+    puts("  strip 0 1 2 3");
+    puts("  clear 255 0 0");
+    puts("  save triangle.bmp\n");
+}
 
-/*! \brief Bitmap header containing image specification.
+/*! \brief Waits until the frames saved from the #CANVAS are written and prints an error if any of them failed.
 
-    For detailed description see https://docs.microsoft.com/en-us/windows/win32/api/wingdi/ns-wingdi-bitmapinfoheader
- */
-typedef struct BITMAPINFOHEADER {
-    DWORD biSize;
-    LONG  biWidth;
-    LONG  biHeight;
-    WORD  biPlanes;
-    WORD  biBitCount;
-    DWORD biCompression;
-    DWORD biSizeImage;
-    LONG  biXPelsPerMeter;
-    LONG  biYPelsPerMeter;
-    DWORD biClrUsed;
-    DWORD biClrImportant;
-} BITMAPINFOHEADER;
-
-/*! \brief Describes XY position and RGB color of a vertex.
+    \param canvas Pointer to the canvas.
  */
-typedef struct VERTEXDATA {
-    LONG posX;
-    LONG posY;
-    BYTE colR;
-    BYTE colG;
-    BYTE colB;
-} VERTEXDATA;
+void report_frames(CANVAS *canvas)
+{
+    if (finish_canvas_frames(canvas) != 0) {
+        puts("Error saving frames!");
+    }
+}
+
+/*! \brief Prints the result of the background save of the #CANVAS if it has been completed.
 
-/*! \brief Generates the BITMAPFILEHEADER structure in the form of array.
+    \param canvas Pointer to the canvas.
+    \param wait Whether to wait for the pending save to be completed.
+ */
+void report_background_save(CANVAS *canvas, const bool wait)
+{
+    LONG result;
+    if (finish_background_save(canvas, wait, &result)) {
+        puts(result == 0 ? "Bitmap saved successfully in the background!" : "Error saving bitmap in the background!");
+    }
+}
 
-    For detailed description see https://docs.microsoft.com/en-us/windows/win32/api/wingdi/ns-wingdi-bitmapfileheader
+/*! \brief Prints the outcome of the commands of a batch file (see run_batch()).
 
-    \param header Pointer to a 14-bytes long array for storing the result.
-    \param file_size Size of the bitmap file (in bytes).
-    \param headers_length The offset from the beginning of the file to the bitmap color data (in bytes).
+    \param report Pointer to the report of the batch.
  */
-void set_file_header(BYTE (*header)[14], const DWORD file_size, const DWORD headers_length)
+void print_batch_report(const BATCHREPORT *report)
 {
-    if (header != NULL) {
-        (*header)[0] = 'B';
-        (*header)[1] = 'M';
-        memcpy(&(*header)[2], &file_size, 4);
-        memset(&(*header)[6], 0, 4);
-        memcpy(&(*header)[10], &headers_length, 4);
+    if (report->restored_command_count >= 0) {
+        printf("Bitmap restored from the render cache (%lld commands skipped)!\n",
+            (long long)report->restored_command_count);
+    }
+    if (report->restore_error) {
+        puts("Error restoring bitmap from the render cache!");
+    }
+    if (report->error_count == 1) {
+        printf("Incorrect command in line %u!\n", report->error_line);
+    } else if (report->error_count > 1) {
+        printf("Incorrect command in line %u (and %u more)!\n", report->error_line, report->error_count - 1);
+    }
+    if (report->store_error) {
+        puts("Error saving bitmap to the render cache!");
+    }
+    if (report->save_count == 1) {
+        puts("Bitmap saved successfully!");
+    } else if (report->save_count > 1) {
+        printf("%u bitmaps saved successfully!\n", report->save_count);
+    }
+    if (report->save_error_count > 0) {
+        puts("Error saving bitmap!");
+    }
+    if (report->frames_saved) {
+        puts(report->frame_error ? "Error saving frames!" : "Frames saved successfully!");
     }
 }
 
-/*! \brief Sets up the #BITMAPINFOHEADER structure.
+//number of records in the ring buffer of parsed commands (a power of two)
+#define COMMAND_RING_SIZE 4096
+//number of records published by the parser before it wakes the main thread up (unless it is about to block)
+#define COMMAND_WAKE_COUNT 64
+//maximal number of consecutive draw commands drawn at once
+#define COMMAND_DRAW_BATCH_SIZE 4096
+//size of the buffer the parser reads the standard input to
+#define COMMAND_INPUT_SIZE 65536
+
+#define COMMAND_HELP 0
+#define COMMAND_STATS 1
+#define COMMAND_DRAW 2
+#define COMMAND_VERTEX 3
+#define COMMAND_RESET 4
+#define COMMAND_MESH 5
+#define COMMAND_STRIP 6
+#define COMMAND_CLEAR 7
+#define COMMAND_SAVE 8
+#define COMMAND_BSAVE 9
+#define COMMAND_FRAME 10
+#define COMMAND_FLUSH 11
+#define COMMAND_KILL 12
+#define COMMAND_QUIT 13
+//end of the input (handled like quit, but ends the session even if saving fails)
+#define COMMAND_END 14
+//incorrect command (the message is printed when its turn comes)
+#define COMMAND_ERROR 15
+
+/*! \brief Command of the interactive mode parsed by the parser thread (see #COMMANDRING).
+ */
+typedef struct COMMANDRECORD {
+    DWORD type;
+    //number of indices of a mesh or strip command
+    DWORD count;
+    union {
+        //triangle of a draw command or vertex of a vertex command
+        VERTEXDATA vertices[3];
+        BYTE color[3];
+        //allocated filename of a save or bsave command (NULL for the default one)
+        char *filename;
+        //allocated indices of a mesh or strip command
+        DWORD *indices;
+        const char *message;
+    } data;
+} COMMANDRECORD;
+
+/*! \brief Lock-free single-producer single-consumer ring buffer passing the commands parsed from the standard input
+    by the parser thread to the main thread, which draws them while the next ones are parsed.
 
-    \param header Pointer to the structure.
-    \param width Width of the bitmap.
-    \param height Height of the bitmap.
+    Each side only writes its own index and blocks on a semaphore only if the ring is full or empty (announcing it
+    with its waiting flag), so passing a command costs no system calls as long as both sides keep up. A full ring
+    blocks the parser, so that it does not read ahead further than #COMMAND_RING_SIZE commands.
  */
-void set_info_header(BITMAPINFOHEADER *header, const LONG width, const LONG height)
+typedef struct COMMANDRING {
+    COMMANDRECORD records[COMMAND_RING_SIZE];
+    //written by the parser thread only
+    DWORD head;
+    DWORD notified_head;
+    bool parser_waiting;
+    BYTE parser_padding[64];
+    //written by the main thread only
+    DWORD tail;
+    bool consumer_waiting;
+    BYTE consumer_padding[64];
+    //posted when records are published or consumed while the other side is waiting
+    sem_t records_published;
+    sem_t records_consumed;
+    //posted by the main thread when quit fails, so that the parser continues, or succeeds (see parser_resumed)
+    sem_t quit_handled;
+    bool parser_resumed;
+    pthread_t thread;
+    //canvas the parsed commands are accounted to (see record_parse_stats())
+    CANVAS *canvas;
+    //input buffer of the parser
+    char input[COMMAND_INPUT_SIZE];
+    size_t input_start;
+    size_t input_end;
+} COMMANDRING;
+
+/*! \brief Wakes the main thread up if it waits for the commands published to the #COMMANDRING.
+
+    \param ring Pointer to the ring.
+ */
+void notify_consumer(COMMANDRING *ring)
 {
-    if (header != NULL) {
-        DWORD stride = (abs(width) * 3 + 3) & 0xfffffffc;
-        header->biSize = sizeof(*header);
-        header->biWidth = width;
-        header->biHeight = height;
-        header->biPlanes = 1;
-        header->biBitCount = 24;
-        header->biCompression = 0;
-        header->biSizeImage = abs(height) * stride;
-        header->biXPelsPerMeter = 0;
-        header->biYPelsPerMeter = 0;
-        header->biClrUsed = 0;
-        header->biClrImportant = 0;
+    ring->notified_head = ring->head;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->consumer_waiting, __ATOMIC_RELAXED)
+        && __atomic_exchange_n(&ring->consumer_waiting, false, __ATOMIC_SEQ_CST)) {
+        sem_post(&ring->records_published);
     }
 }
 
-/*! \brief Sets up the #VERTEXDATA structure.
+/*! \brief Wakes the parser thread up if it waits for a free record of the #COMMANDRING.
 
-    \param pos_x Horizontal position of the vertex.
-    \param pos_y Vertical position of the vertex.
-    \param col_r Intensity of red in the vertex color.
-    \param col_g Intensity of green in the vertex color.
-    \param col_b Intensity of blue in the vertex color.
+    \param ring Pointer to the ring.
  */
-void set_vertex(VERTEXDATA *vertex, const LONG pos_x, const LONG pos_y, const BYTE col_r, const BYTE col_g, const BYTE col_b)
+void notify_parser(COMMANDRING *ring)
 {
-    if (vertex != NULL) {
-        vertex->posX = pos_x;
-        vertex->posY = pos_y;
-        vertex->colR = col_r;
-        vertex->colG = col_g;
-        vertex->colB = col_b;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->parser_waiting, __ATOMIC_RELAXED)
+        && __atomic_exchange_n(&ring->parser_waiting, false, __ATOMIC_SEQ_CST)) {
+        sem_post(&ring->records_consumed);
     }
 }
 
-/*! \brief Paints the bitmap using the given color.
+/*! \brief Returns the next free record of the #COMMANDRING, waiting for the main thread to consume one if needed
+    (called by the parser thread).
+
+    \param ring Pointer to the ring.
 
-    \param image_data Pointer to the bitmap data.
-    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
-    \param red Intensity of red in desired color.
-    \param green Intensity of green in desired color.
-    \param blue Intensity of blue in desired color.
+    \return Pointer to the record.
  */
-void clear_bitmap(BYTE *image_data, BITMAPINFOHEADER *info_header, const BYTE red, const BYTE green, const BYTE blue)
+COMMANDRECORD *reserve_command(COMMANDRING *ring)
 {
-    if (image_data != NULL && info_header != NULL) {
-        DWORD stride = (abs(info_header->biWidth) * 3 + 3) & 0xfffffffc;
-        for (DWORD i = 0; i < abs(info_header->biWidth); i++) {
-            (image_data + i * 3)[0] = blue;
-            (image_data + i * 3)[1] = green;
-            (image_data + i * 3)[2] = red;
-        }
-        for (DWORD i = 1; i < abs(info_header->biHeight); i++) {
-            memcpy(image_data + i * stride, image_data, stride);
+    while (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == COMMAND_RING_SIZE) {
+        notify_consumer(ring);
+        __atomic_store_n(&ring->parser_waiting, true, __ATOMIC_SEQ_CST);
+        //the flag has to be visible before checking the ring again, otherwise the wake-up could be missed
+        if (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == COMMAND_RING_SIZE) {
+            sem_wait(&ring->records_consumed);
         }
+        __atomic_store_n(&ring->parser_waiting, false, __ATOMIC_RELAXED);
     }
+    return &ring->records[ring->head % COMMAND_RING_SIZE];
 }
 
-/*! \brief Swaps two VERTEXDATA structures.
+/*! \brief Passes the reserved record of the #COMMANDRING to the main thread (called by the parser thread).
 
-    \param a Pointer to the first structure.
-    \param b Pointer to the second structure.
+    \param ring Pointer to the ring.
  */
-void swap_vertices(VERTEXDATA *a, VERTEXDATA *b)
+void publish_command(COMMANDRING *ring)
 {
-    if (a != NULL && b != NULL) {
-        VERTEXDATA tmp;
-        memcpy(&tmp, a, sizeof(VERTEXDATA));
-        memcpy(a, b, sizeof(VERTEXDATA));
-        memcpy(b, &tmp, sizeof(VERTEXDATA));
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+    if (ring->head - ring->notified_head >= COMMAND_WAKE_COUNT) {
+        notify_consumer(ring);
     }
 }
 
-/*! \brief Sorts an array of three vertices by their vertical and then horizontal position (ascending).
+/*! \brief Returns the oldest record of the #COMMANDRING which has not been consumed yet (called by the main thread).
+
+    \param ring Pointer to the ring.
+    \param wait Whether to wait for the parser thread to publish a record if there is none.
 
-    \param vertex_data Pointer to an array of three VERTEXDATA structures.
+    \return Pointer to the record or NULL if there is none and waiting is not requested.
  */
-void sort_triangle_vertices(VERTEXDATA (*vertex_data)[3])
+COMMANDRECORD *peek_command(COMMANDRING *ring, const bool wait)
 {
-    if (vertex_data != NULL) {
-        if ((*vertex_data)[1].posY < (*vertex_data)[0].posY) {
-            swap_vertices(&(*vertex_data)[0], &(*vertex_data)[1]);
-        }
-        if ((*vertex_data)[2].posY < (*vertex_data)[1].posY) {
-            swap_vertices(&(*vertex_data)[1], &(*vertex_data)[2]);
+    while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail) {
+        if (!wait) {
+            return NULL;
         }
-        if ((*vertex_data)[1].posY < (*vertex_data)[0].posY) {
-            swap_vertices(&(*vertex_data)[0], &(*vertex_data)[1]);
+        __atomic_store_n(&ring->consumer_waiting, true, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == ring->tail) {
+            sem_wait(&ring->records_published);
         }
+        __atomic_store_n(&ring->consumer_waiting, false, __ATOMIC_RELAXED);
     }
+    return &ring->records[ring->tail % COMMAND_RING_SIZE];
 }
 
-/*! \brief Draws a horizontal line on the bitmap.
-
-    \param image_data Pointer to the bitmap data.
-    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
-    \param line_y Vertical position of both the left and right side fo the line.
-    \param left_x Horizontal position of the left side of the line.
-    \param left_r Proportion of red in the color of the left side of the line.
-    \param left_g Proportion of green in the color of the left side of the line.
-    \param left_b Proportion of blue in the color of the left side of the line.
-    \param right_x Horizontal position of the right side of the line.
-    \param right_r Proportion of red in the color of the right side of the line.
-    \param right_g Proportion of green in the color of the right side of the line.
-    \param right_b Proportion of blue in the color of the right side of the line.
-
-    \warning It is crucial that \a left_x <= \a right_x. All double-precision parameters should
-        contain non-negative integer numbers, especially the color values should be in range (0.0-255.0).
-        Both pointers must be valid. As this function is implemented in assembly and only intended
-        for internal use in draw_triangle(), it performs no input correctness checks.
+/*! \brief Releases the oldest record of the #COMMANDRING (called by the main thread).
+
+    \param ring Pointer to the ring.
  */
-extern void draw_horizontal_line(BYTE *image_data, BITMAPINFOHEADER *info_header, DWORD line_y,
-    double left_x, double left_r, double left_g, double left_b,
-    double right_x, double right_r, double right_g, double right_b);
+void pop_command(COMMANDRING *ring)
+{
+    COMMANDRECORD *command = &ring->records[ring->tail % COMMAND_RING_SIZE];
+    if (command->type == COMMAND_MESH || command->type == COMMAND_STRIP) {
+        free(command->data.indices);
+    } else if (command->type == COMMAND_SAVE || command->type == COMMAND_BSAVE) {
+        free(command->data.filename);
+    }
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+    //the parser is woken up once a part of the ring is free (or the ring is empty, before the main thread waits)
+    if (ring->tail % (COMMAND_RING_SIZE / 4) == 0 || ring->tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+        notify_parser(ring);
+    }
+}
+
+/*! \brief Reads the next line of the standard input into the input buffer of the #COMMANDRING (like fgets()).
 
-/*! \brief Draws a triangle on the bitmap.
+    The rest of a line longer than the buffer is skipped. The main thread is woken up before blocking on the input.
 
-    \param image_data Pointer to the bitmap data.
-    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
-    \param vertex_data Pointer to the sorted array of three VERTEXDATA structures describing a triangle.
+    \param ring Pointer to the ring.
+    \param buffer Buffer for the line, including the newline character if it fits.
 
-    \return Zero on success, -1 if any argument is a null pointer.
+    \return Whether anything has been read (false at the end of the input).
  */
-LONG draw_triangle(BYTE *image_data, BITMAPINFOHEADER *info_header, VERTEXDATA (*vertices)[3])
+bool read_command_line(COMMANDRING *ring, char buffer[BUF_SIZE])
 {
-    if (image_data == NULL || info_header == NULL || vertices == NULL) {
-        return -1;
+    size_t length = 0;
+    bool skipping = false;
+    while (true) {
+        if (ring->input_start == ring->input_end) {
+            notify_consumer(ring);
+            ssize_t bytes_read = read(STDIN_FILENO, ring->input, COMMAND_INPUT_SIZE);
+            if (bytes_read <= 0) {
+                buffer[length] = 0;
+                return length > 0;
+            }
+            ring->input_start = 0;
+            ring->input_end = bytes_read;
+        }
+        char *line_start = ring->input + ring->input_start;
+        char *newline = memchr(line_start, '\n', ring->input_end - ring->input_start);
+        size_t available = newline != NULL ? (size_t)(newline + 1 - line_start) : ring->input_end - ring->input_start;
+        if (!skipping) {
+            size_t copied = available < BUF_SIZE - 1 - length ? available : BUF_SIZE - 1 - length;
+            memcpy(buffer + length, line_start, copied);
+            length += copied;
+            skipping = length == BUF_SIZE - 1;
+        }
+        ring->input_start += available;
+        if (newline != NULL) {
+            buffer[length] = 0;
+            return true;
+        }
     }
+}
 
-    sort_triangle_vertices(vertices);
-    
-    struct VERTEXSTEP {
-        float x, r, g, b;
-    } step[3] = {{}, {}, {}};
-    if ((*vertices)[0].posY != (*vertices)[1].posY) {
-        float difference = (*vertices)[0].posY - (*vertices)[1].posY;
-        step[0].x = ((*vertices)[0].posX - (*vertices)[1].posX) / difference;
-        step[0].r = ((*vertices)[0].colR - (*vertices)[1].colR) / difference;
-        step[0].g = ((*vertices)[0].colG - (*vertices)[1].colG) / difference;
-        step[0].b = ((*vertices)[0].colB - (*vertices)[1].colB) / difference;
-    }
-    if ((*vertices)[0].posY != (*vertices)[2].posY) {
-        float difference = (*vertices)[0].posY - (*vertices)[2].posY;
-        step[1].x = ((*vertices)[0].posX - (*vertices)[2].posX) / difference;
-        step[1].r = ((*vertices)[0].colR - (*vertices)[2].colR) / difference;
-        step[1].g = ((*vertices)[0].colG - (*vertices)[2].colG) / difference;
-        step[1].b = ((*vertices)[0].colB - (*vertices)[2].colB) / difference;
-    }
-    if ((*vertices)[1].posY != (*vertices)[2].posY) {
-        float difference = (*vertices)[1].posY - (*vertices)[2].posY;
-        step[2].x = ((*vertices)[1].posX - (*vertices)[2].posX) / difference;
-        step[2].r = ((*vertices)[1].colR - (*vertices)[2].colR) / difference;
-        step[2].g = ((*vertices)[1].colG - (*vertices)[2].colG) / difference;
-        step[2].b = ((*vertices)[1].colB - (*vertices)[2].colB) / difference;
-    }
-
-    size_t stride = (abs(info_header->biWidth) * 3 + 3) & 0xfffffffc;
-    LONG min_y = (*vertices)[0].posY, max_y = (*vertices)[2].posY;
-    if (min_y < 0) {
-        min_y = 0;
-    }
-    if (max_y >= abs(info_header->biHeight)) {
-        max_y = abs(info_header->biHeight) - 1;
-    }
-
-    for (LONG i = min_y; i <= max_y; i++) {
-        struct VERTEXDATA left = {}, right = {};
-        if (i < (*vertices)[1].posY) {
-            left.posX = round((*vertices)[0].posX + (i - (*vertices)[0].posY) * step[0].x);
-            left.colR = round((*vertices)[0].colR + (i - (*vertices)[0].posY) * step[0].r);
-            left.colG = round((*vertices)[0].colG + (i - (*vertices)[0].posY) * step[0].g);
-            left.colB = round((*vertices)[0].colB + (i - (*vertices)[0].posY) * step[0].b);
+/*! \brief Parses a command of the interactive mode.
+
+    \param buffer Line containing the command (null-terminated).
+    \param command Pointer to the record filled with the command.
+    \param canvas Pointer to the canvas the command is accounted to in the statistics.
+ */
+void parse_command(const char *buffer, COMMANDRECORD *command, CANVAS *canvas)
+{
+    DWORD input_length = strlen(buffer);
+    LONGLONG parse_start_ticks = STATS_TICKS();
+
+    char comparison_buffer[7] = {0, 0, 0, 0, 0, 0, 0};
+    command->type = COMMAND_ERROR;
+    command->data.message = "Incorrect command!";
+    if (input_length < 4) {
+        return;
+    }
+    memcpy(comparison_buffer, buffer, input_length < 6 ? input_length : 6);
+    //'#' also ends the command word so "clear#rrggbb" keeps working
+    for (int i = 0; i < 6; i++) {
+        if (isspace(comparison_buffer[i]) || comparison_buffer[i] == '#') {
+            comparison_buffer[i] = 0;
+            break;
+        }
+    }
+    if (strcmp(comparison_buffer, "help") == 0) {
+        command->type = COMMAND_HELP;
+    } else if (strcmp(comparison_buffer, "stats") == 0) {
+        command->type = COMMAND_STATS;
+    } else if (strcmp(comparison_buffer, "draw") == 0) {
+        bool status_ok = false;
+        VERTEXDATA *vertex_data = command->data.vertices;
+        LONG colors[9];
+        LONG values_read = sscanf(buffer, "draw %d %d #%2hhx%2hhx%2hhx %d %d #%2hhx%2hhx%2hhx %d %d #%2hhx%2hhx%2hhx",
+            &vertex_data[0].posX, &vertex_data[0].posY, &vertex_data[0].colR, &vertex_data[0].colG,
+            &vertex_data[0].colB, &vertex_data[1].posX, &vertex_data[1].posY, &vertex_data[1].colR,
+            &vertex_data[1].colG, &vertex_data[1].colB, &vertex_data[2].posX, &vertex_data[2].posY,
+            &vertex_data[2].colR, &vertex_data[2].colG, &vertex_data[2].colB);
+        if (values_read == 15) {
+            status_ok = true;
+        } else {
+            values_read = sscanf(buffer, "draw %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d",
+                &vertex_data[0].posX, &vertex_data[0].posY, &colors[0], &colors[1], &colors[2],
+                &vertex_data[1].posX, &vertex_data[1].posY, &colors[3], &colors[4], &colors[5],
+                &vertex_data[2].posX, &vertex_data[2].posY, &colors[6], &colors[7], &colors[8]);
+            if (values_read == 15) {
+                status_ok = true;
+                for (DWORD i = 0; i < 9; i++) {
+                    if (colors[i] < 0 || colors[i] > 255) {
+                        status_ok = false;
+                        break;
+                    }
+                }
+            }
+            if (status_ok) {
+                set_vertex(&vertex_data[0], vertex_data[0].posX, vertex_data[0].posY, colors[0], colors[1], colors[2]);
+                set_vertex(&vertex_data[1], vertex_data[1].posX, vertex_data[1].posY, colors[3], colors[4], colors[5]);
+                set_vertex(&vertex_data[2], vertex_data[2].posX, vertex_data[2].posY, colors[6], colors[7], colors[8]);
+            }
+        }
+        record_parse_stats(canvas, parse_start_ticks);
+        if (status_ok) {
+            command->type = COMMAND_DRAW;
+        } else {
+            command->data.message = "Incorrect vertex format!";
+        }
+    } else if (strcmp(comparison_buffer, "vertex") == 0) {
+        bool status_ok = false;
+        VERTEXDATA *vertex = &command->data.vertices[0];
+        LONG colors[3];
+        if (sscanf(buffer, "vertex %d %d #%2hhx%2hhx%2hhx", &vertex->posX, &vertex->posY,
+            &vertex->colR, &vertex->colG, &vertex->colB) == 5) {
+            status_ok = true;
+        } else if (sscanf(buffer, "vertex %d %d %d %d %d", &vertex->posX, &vertex->posY,
+            &colors[0], &colors[1], &colors[2]) == 5) {
+            status_ok = true;
+            for (DWORD i = 0; i < 3; i++) {
+                if (colors[i] < 0 || colors[i] > 255) {
+                    status_ok = false;
+                    break;
+                }
+            }
+            if (status_ok) {
+                set_vertex(vertex, vertex->posX, vertex->posY, colors[0], colors[1], colors[2]);
+            }
+        }
+        record_parse_stats(canvas, parse_start_ticks);
+        if (status_ok) {
+            command->type = COMMAND_VERTEX;
+        } else {
+            command->data.message = "Incorrect vertex format!";
+        }
+    } else if (strcmp(comparison_buffer, "reset") == 0) {
+        command->type = COMMAND_RESET;
+    } else if (strcmp(comparison_buffer, "mesh") == 0 || strcmp(comparison_buffer, "strip") == 0) {
+        bool status_ok = true;
+        DWORD mesh_indices[BUF_SIZE / 2], index_count = 0;
+        const char *cursor = buffer + strlen(comparison_buffer);
+        char *number_end;
+        cursor += strspn(cursor, " \t\n\v\f\r");
+        while (*cursor != 0) {
+            long index = strtol(cursor, &number_end, 10);
+            if (number_end == cursor || index < 0 || index >= (long)MESH_RESTART_INDEX
+                || index_count == BUF_SIZE / 2) {
+                status_ok = false;
+                break;
+            }
+            mesh_indices[index_count++] = index;
+            cursor = number_end + strspn(number_end, " \t\n\v\f\r");
+        }
+        record_parse_stats(canvas, parse_start_ticks);
+        if (status_ok) {
+            command->data.indices = malloc((index_count > 0 ? index_count : 1) * sizeof(DWORD));
+            if (command->data.indices == NULL) {
+                fputs("Error allocating index buffer!\n", stderr);
+                exit(EXIT_FAILURE);
+            }
+            memcpy(command->data.indices, mesh_indices, index_count * sizeof(DWORD));
+            command->count = index_count;
+            command->type = comparison_buffer[0] == 's' ? COMMAND_STRIP : COMMAND_MESH;
+        } else {
+            command->data.message = "Incorrect index format!";
+        }
+    } else if (strcmp(comparison_buffer, "clear") == 0) {
+        bool status_ok = true;
+        //paint white unless a color is given
+        BYTE red = 255, green = 255, blue = 255;
+        //check for non-whitespace characters after the command
+        if (strspn(buffer + 5, " \t\n\v\f\r") + 5 != strlen(buffer)) {
+            LONG values_read = sscanf(buffer, "clear #%2hhx%2hhx%2hhx", &red, &green, &blue);
+            if (values_read != 3) {
+                status_ok = false;
+                LONG colors[3];
+                values_read = sscanf(buffer, "clear %d %d %d", &colors[0], &colors[1], &colors[2]);
+                if (values_read == 3) {
+                    status_ok = true;
+                    for (DWORD i = 0; i < 3; i++) {
+                        if (colors[i] < 0 || colors[i] > 255) {
+                            status_ok = false;
+                            break;
+                        }
+                    }
+                }
+                if (status_ok) {
+                    red = colors[0];
+                    green = colors[1];
+                    blue = colors[2];
+                }
+            }
+        }
+        record_parse_stats(canvas, parse_start_ticks);
+        if (status_ok) {
+            command->type = COMMAND_CLEAR;
+            command->data.color[0] = red;
+            command->data.color[1] = green;
+            command->data.color[2] = blue;
         } else {
-            left.posX = round((*vertices)[1].posX + (i - (*vertices)[1].posY) * step[2].x);
-            left.colR = round((*vertices)[1].colR + (i - (*vertices)[1].posY) * step[2].r);
-            left.colG = round((*vertices)[1].colG + (i - (*vertices)[1].posY) * step[2].g);
-            left.colB = round((*vertices)[1].colB + (i - (*vertices)[1].posY) * step[2].b);
+            command->data.message = "Incorrect color format!";
         }
-        right.posX = round((*vertices)[0].posX + (i - (*vertices)[0].posY) * step[1].x);
-        right.colR = round((*vertices)[0].colR + (i - (*vertices)[0].posY) * step[1].r);
-        right.colG = round((*vertices)[0].colG + (i - (*vertices)[0].posY) * step[1].g);
-        right.colB = round((*vertices)[0].colB + (i - (*vertices)[0].posY) * step[1].b);
-        if (left.posX > right.posX) {
-            swap_vertices(&left, &right);
+    } else if (strcmp(comparison_buffer, "save") == 0 || strcmp(comparison_buffer, "bsave") == 0) {
+        bool background = comparison_buffer[0] == 'b';
+        char filename_buffer[MAX_PATH];
+        command->data.filename = NULL;
+        if (sscanf(buffer, background ? "bsave %259[^\n]" : "save %259[^\n]", filename_buffer) == 1) {
+            command->data.filename = malloc(strlen(filename_buffer) + 1);
+            if (command->data.filename == NULL) {
+                fputs("Error allocating filename!\n", stderr);
+                exit(EXIT_FAILURE);
+            }
+            strcpy(command->data.filename, filename_buffer);
         }
-        draw_horizontal_line(image_data, info_header, (DWORD)i,
-            (double)left.posX, (double)left.colR, (double)left.colG, (double)left.colB,
-            (double)right.posX, (double)right.colR, (double)right.colG, (double)right.colB);
+        record_parse_stats(canvas, parse_start_ticks);
+        command->type = background ? COMMAND_BSAVE : COMMAND_SAVE;
+    } else if (strcmp(comparison_buffer, "frame") == 0) {
+        record_parse_stats(canvas, parse_start_ticks);
+        command->type = COMMAND_FRAME;
+    } else if (strcmp(comparison_buffer, "flush") == 0) {
+        command->type = COMMAND_FLUSH;
+    } else if (strcmp(comparison_buffer, "kill") == 0) {
+        command->type = COMMAND_KILL;
+    } else if (strcmp(comparison_buffer, "quit") == 0) {
+        command->type = COMMAND_QUIT;
     }
-    return 0;
 }
 
-/*! \brief Prints intoduction to the console interface.
+/*! \brief Main function of the parser thread of the interactive mode, which reads the standard input
+    and passes the parsed commands to the main thread through the #COMMANDRING.
+
+    \param argument Pointer to the COMMANDRING structure.
  */
-void print_help(void)
+void *parser_main(void *argument)
 {
-    puts("[Interactive RGB triangle drawing]");
-    puts("Use one of the following commands:");
-    puts("  help             prints this message");
-    puts("  draw vertices    draws specified triangle on the bitmap");
-    puts("                    the format of vertices is straightforward:");
-    puts("                    x1 y1 color1 x2 y2 color2 x3 y3 color3");
-    puts("  clear [color]    clears the bitmap (the default color is white)");
-    puts("  save [filename]  saves the bitmap to a file");
-    puts("  kill             quits the program without saving");
-    puts("  quit             quits the program saving bitmap to the default location\n");
-    puts("Supported color formats:");
-    puts("  #rrggbb          (hexadecimal, 00-ff each)");
-    puts("  red green blue   (decimal, 0-255 each)\n");
-    puts("Examples:");
-    puts("  draw 15 5 #000000 5 10 #000000 25 15 #000000");
-    puts("  clear 255 0 0");
-    puts("  save triangle.bmp\n");
+    COMMANDRING *ring = argument;
+    char buffer[BUF_SIZE];
+    while (true) {
+        COMMANDRECORD *command = reserve_command(ring);
+        if (!read_command_line(ring, buffer)) {
+            command->type = COMMAND_END;
+            publish_command(ring);
+            notify_consumer(ring);
+            break;
+        }
+        parse_command(buffer, command, ring->canvas);
+        DWORD type = command->type;
+        publish_command(ring);
+        if (type == COMMAND_KILL) {
+            notify_consumer(ring);
+            break;
+        } else if (type == COMMAND_QUIT) {
+            //stop reading unless saving fails
+            notify_consumer(ring);
+            sem_wait(&ring->quit_handled);
+            if (!ring->parser_resumed) {
+                break;
+            }
+        }
+    }
+    return NULL;
 }
 
-/*! \brief Saves the bitmap to a file.
+/*! \brief Lets the parser thread continue after a quit command has been handled (see parser_main()).
 
-    \param file_header Pointer to the BITMAPFILEHEADER (in the form of byte array) describing the output file.
-    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
-    \param image_data Pointer to the bitmap data.
-    \param output_filename Output filename.
+    \param ring Pointer to the ring.
+    \param resumed Whether the parser should continue (quit failed) or stop.
+ */
+void resume_parser(COMMANDRING *ring, const bool resumed)
+{
+    ring->parser_resumed = resumed;
+    sem_post(&ring->quit_handled);
+}
+
+/*! \brief Creates the #COMMANDRING and starts the parser thread.
+
+    \param canvas Pointer to the canvas the parsed commands are accounted to in the statistics.
 
-    \return Zero on success, -1 if any argument is a null pointer, -2 on file I/O error.
+    \return Pointer to the ring or NULL on error.
  */
-LONG save_bitmap(BYTE (*file_header)[14], BITMAPINFOHEADER *info_header, BYTE *image_data, const char *output_filename)
+COMMANDRING *create_command_ring(CANVAS *canvas)
 {
-    if (file_header != 0 && info_header != 0 && image_data != 0 && output_filename != 0) {
-        FILE *output_file = fopen(output_filename, "wb");
-        if (output_file == NULL) {
-            return -2;
-        }
-        //write BITMAPFILEHEADER
-        DWORD bytes_to_write = sizeof(*file_header),
-            bytes_written = 0;
-        bytes_written = fwrite(file_header, 1, bytes_to_write, output_file);
-        if (bytes_to_write != bytes_written) {
-            fclose(output_file);
-            return -2;
-        }
-        //write BITMAPINFOHEADER
-        bytes_to_write = sizeof(*info_header);
-        bytes_written = fwrite(info_header, 1, bytes_to_write, output_file);
-        if (bytes_to_write != bytes_written) {
-            fclose(output_file);
-            return -2;
-        }
-        //write bitmap data
-        bytes_to_write = info_header->biSizeImage;
-        bytes_written = fwrite(image_data, 1, bytes_to_write, output_file);
-        fclose(output_file);
-        if (bytes_to_write != bytes_written) {
-            return -2;
-        }
-        return 0;
-    } else {
-        return -1;
+    COMMANDRING *ring = calloc(1, sizeof(COMMANDRING));
+    if (ring == NULL) {
+        return NULL;
     }
+    ring->canvas = canvas;
+    sem_init(&ring->records_published, 0, 0);
+    sem_init(&ring->records_consumed, 0, 0);
+    sem_init(&ring->quit_handled, 0, 0);
+    if (pthread_create(&ring->thread, NULL, parser_main, ring) != 0) {
+        sem_destroy(&ring->quit_handled);
+        sem_destroy(&ring->records_consumed);
+        sem_destroy(&ring->records_published);
+        free(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+/*! \brief Waits for the parser thread to stop (after kill, quit or the end of the input) and frees the #COMMANDRING.
+
+    \param ring Pointer to the ring.
+ */
+void destroy_command_ring(COMMANDRING *ring)
+{
+    pthread_join(ring->thread, NULL);
+    //release the commands the parser has read past the end of the session
+    while (peek_command(ring, false) != NULL) {
+        pop_command(ring);
+    }
+    sem_destroy(&ring->quit_handled);
+    sem_destroy(&ring->records_consumed);
+    sem_destroy(&ring->records_published);
+    free(ring);
 }
 
 int main(int argc, char **argv)
@@ -348,24 +616,17 @@ int main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
-    //check if vector assembly instructions are supported using GCC intrinsics
-    { //source: https://stackoverflow.com/a/7495023/7447673
-        bool SSE2_supported = false;
-        int info[4];
-        __cpuid_count(0, 0, info[0], info[1], info[2], info[3]);
-        int nIds = info[0];
-        if (nIds >= 0x00000001){
-            __cpuid_count(0x00000001, 0, info[0], info[1], info[2], info[3]);
-            if ((info[3] & ((int)1 << 26)) != 0) {
-                SSE2_supported = true;
-            }
-        }
-        if (!SSE2_supported) {
-            fputs("SSE2 instruction set not supported. Please use different CPU!\n", stderr);
-            exit(EXIT_FAILURE);
-        }
+    //check if vector assembly instructions are supported
+    bool line_drawer_supported[LINE_DRAWER_COUNT];
+    bool ssse3_supported;
+    detect_line_drawers(line_drawer_supported, &ssse3_supported);
+    if (!line_drawer_supported[LINE_DRAWER_SSE2]) {
+        fputs("SSE2 instruction set not supported. Please use different CPU!\n", stderr);
+        exit(EXIT_FAILURE);
     }
 
+    reset_stats(NULL);
+
     //settings
     LONG image_width = 256,
         image_height = 256;
@@ -373,26 +634,207 @@ int main(int argc, char **argv)
     strcpy(output_filename, "result.bmp");
     
     //data-related variables created based on user-defined values
-    BYTE file_header[14];
-    BITMAPINFOHEADER info_header;
-    BYTE *image_data;
+    CANVAS *canvas = NULL;
 
     //parsing command-line parameters
     bool interactive_mode = false;
+    LONG line_drawer = -1;
+    LONG rasterizer = RASTERIZER_SCANLINE;
+    LONG output_format = -1;
+    LONG thread_count = 1;
+    const char *batch_filename = NULL;
+    const char *bench_format = NULL;
+    const char *socket_path = NULL;
+    const char *stats_filename = NULL;
+    bool map_output = false;
+    bool xrgb = false;
+    bool reverse_order = false;
+    bool deferred_spans = false;
+    LONG cache_megabytes = 0;
+    const char *render_cache_directory = NULL;
+    LONG render_cache_megabytes = 1024,
+        render_cache_entries = 16,
+        render_cache_min_commands = 1000;
     {
         bool read_interactive = false,
+            read_line_drawer = false,
+            read_rasterizer = false,
+            read_output_format = false,
+            read_thread_count = false,
+            read_render_cache_megabytes = false,
+            read_render_cache_entries = false,
+            read_render_cache_min_commands = false,
             read_filename = false,
             read_width = false,
             read_height = false;
         for (int i = 1; i < argc; i++) {
             bool failure = false;
             if (strcmp(argv[i], "--interactive") == 0) {
-                if (read_width && !read_height || read_interactive) {
+                if (read_width && !read_height || read_interactive || batch_filename != NULL || bench_format != NULL
+                    || socket_path != NULL) {
                     failure = true;
                 } else {
                     interactive_mode = true;
                     read_interactive = true;
                 }
+            } else if (strcmp(argv[i], "--kernel") == 0) {
+                if (read_width && !read_height || read_line_drawer || i + 1 >= argc) {
+                    failure = true;
+                } else {
+                    i++;
+                    line_drawer = find_line_drawer(argv[i]);
+                    if (line_drawer < 0) {
+                        failure = true;
+                    } else if (!line_drawer_supported[line_drawer]) {
+                        fprintf(stderr, "Kernel %s not supported by the CPU!\n", get_line_drawer_name(line_drawer));
+                        exit(EXIT_FAILURE);
+                    }
+                    read_line_drawer = true;
+                }
+            } else if (strcmp(argv[i], "--rasterizer") == 0) {
+                if (read_width && !read_height || read_rasterizer || i + 1 >= argc) {
+                    failure = true;
+                } else {
+                    i++;
+                    rasterizer = find_rasterizer(argv[i]);
+                    if (rasterizer < 0) {
+                        failure = true;
+                    }
+                    read_rasterizer = true;
+                }
+            } else if (strcmp(argv[i], "--format") == 0) {
+                if (read_width && !read_height || read_output_format || i + 1 >= argc) {
+                    failure = true;
+                } else {
+                    i++;
+                    output_format = find_output_format(argv[i]);
+                    if (output_format < 0) {
+                        failure = true;
+                    }
+                    read_output_format = true;
+                }
+            } else if (strcmp(argv[i], "--batch") == 0) {
+                if (read_width && !read_height || read_interactive || batch_filename != NULL || bench_format != NULL
+                    || socket_path != NULL || i + 1 >= argc) {
+                    failure = true;
+                } else {
+                    i++;
+                    batch_filename = argv[i];
+                }
+            } else if (strcmp(argv[i], "--bench") == 0) {
+                if (read_width && !read_height || read_interactive || batch_filename != NULL || bench_format != NULL
+                    || socket_path != NULL || i + 1 >= argc) {
+                    failure = true;
+                } else {
+                    i++;
+                    bench_format = argv[i];
+                    if (strcmp(bench_format, "text") != 0 && strcmp(bench_format, "csv") != 0) {
+                        failure = true;
+                    }
+                }
+            } else if (strcmp(argv[i], "--serve") == 0) {
+                if (read_width && !read_height || read_interactive || batch_filename != NULL || bench_format != NULL
+                    || socket_path != NULL || i + 1 >= argc) {
+                    failure = true;
+                } else {
+                    i++;
+                    socket_path = argv[i];
+                }
+            } else if (strcmp(argv[i], "--stats-json") == 0) {
+                if (read_width && !read_height || stats_filename != NULL || i + 1 >= argc) {
+                    failure = true;
+                } else {
+                    i++;
+                    stats_filename = argv[i];
+                }
+            } else if (strcmp(argv[i], "--map-output") == 0) {
+                if (read_width && !read_height || map_output) {
+                    failure = true;
+                } else {
+                    map_output = true;
+                }
+            } else if (strcmp(argv[i], "--reverse-order") == 0) {
+                if (read_width && !read_height || reverse_order) {
+                    failure = true;
+                } else {
+                    reverse_order = true;
+                }
+            } else if (strcmp(argv[i], "--deferred-spans") == 0) {
+                if (read_width && !read_height || deferred_spans) {
+                    failure = true;
+                } else {
+                    deferred_spans = true;
+                }
+            } else if (strcmp(argv[i], "--xrgb") == 0) {
+                if (read_width && !read_height || xrgb) {
+                    failure = true;
+                } else if (!ssse3_supported) {
+                    fputs("XRGB bitmap requires SSSE3 instruction set support!\n", stderr);
+                    exit(EXIT_FAILURE);
+                } else {
+                    xrgb = true;
+                }
+            } else if (strcmp(argv[i], "--out-of-core") == 0) {
+                if (read_width && !read_height || cache_megabytes > 0 || i + 1 >= argc) {
+                    failure = true;
+                } else {
+                    i++;
+                    cache_megabytes = atoi(argv[i]);
+                    if (cache_megabytes < 1) {
+                        failure = true;
+                    }
+                }
+            } else if (strcmp(argv[i], "--cache") == 0) {
+                if (read_width && !read_height || render_cache_directory != NULL || i + 1 >= argc) {
+                    failure = true;
+                } else {
+                    i++;
+                    render_cache_directory = argv[i];
+                }
+            } else if (strcmp(argv[i], "--cache-size") == 0) {
+                if (read_width && !read_height || read_render_cache_megabytes || i + 1 >= argc) {
+                    failure = true;
+                } else {
+                    i++;
+                    render_cache_megabytes = atoi(argv[i]);
+                    if (render_cache_megabytes < 1) {
+                        failure = true;
+                    }
+                    read_render_cache_megabytes = true;
+                }
+            } else if (strcmp(argv[i], "--cache-entries") == 0) {
+                if (read_width && !read_height || read_render_cache_entries || i + 1 >= argc) {
+                    failure = true;
+                } else {
+                    i++;
+                    render_cache_entries = atoi(argv[i]);
+                    if (render_cache_entries < 1) {
+                        failure = true;
+                    }
+                    read_render_cache_entries = true;
+                }
+            } else if (strcmp(argv[i], "--cache-min-commands") == 0) {
+                if (read_width && !read_height || read_render_cache_min_commands || i + 1 >= argc) {
+                    failure = true;
+                } else {
+                    i++;
+                    render_cache_min_commands = atoi(argv[i]);
+                    if (render_cache_min_commands < 1) {
+                        failure = true;
+                    }
+                    read_render_cache_min_commands = true;
+                }
+            } else if (strcmp(argv[i], "--threads") == 0) {
+                if (read_width && !read_height || read_thread_count || i + 1 >= argc) {
+                    failure = true;
+                } else {
+                    i++;
+                    thread_count = atoi(argv[i]);
+                    if (thread_count < 1) {
+                        failure = true;
+                    }
+                    read_thread_count = true;
+                }
             } else {
                 if (!read_filename) {
                     output_filename[0] = 0;
@@ -408,156 +850,258 @@ int main(int argc, char **argv)
                     failure = true;
                 }
             }
+            //out-of-core bitmaps are drawn on a single thread and cannot be mapped
+            if (cache_megabytes > 0 && (map_output || thread_count > 1)) {
+                failure = true;
+            }
+            //the 32-bit internal bitmap is never stored in a file
+            if (xrgb && (map_output || cache_megabytes > 0)) {
+                failure = true;
+            }
+            //the clients of the server have separate in-memory bitmaps
+            if (socket_path != NULL && (map_output || cache_megabytes > 0)) {
+                failure = true;
+            }
+            //the render cache only applies to batch files
+            if (render_cache_directory != NULL && (read_interactive || bench_format != NULL || socket_path != NULL)) {
+                failure = true;
+            }
+            //the mapped output file is always a bitmap
+            if (map_output && (output_format >= 0 ? output_format : get_output_format(output_filename))
+                != OUTPUT_FORMAT_BMP) {
+                failure = true;
+            }
             if (failure) {
-                fputs("Usage: rgb_triangle [--interactive] [output_filename [bitmap_width bitmap_height]]\n", stderr);
+                fputs("Usage: rgb_triangle [--interactive | --batch filename | --bench text|csv | --serve socket_path] [--kernel sse2|avx2|avx512] [--rasterizer scanline|halfspace] [--format bmp|ppm|qoi] [--reverse-order] [--deferred-spans] [--xrgb] [--threads count] [--map-output | --out-of-core cache_megabytes] [--cache directory [--cache-size megabytes] [--cache-entries count] [--cache-min-commands count]] [--stats-json filename] [output_filename [bitmap_width bitmap_height]]\n", stderr);
+                fputs("Use --kernel sse2 to reproduce the reference result.bmp exactly.\n", stderr);
                 exit(EXIT_FAILURE);
             }
         }
     }
+    //use the most capable line drawing function unless specified otherwise
+    if (line_drawer < 0) {
+        for (LONG j = 0; j < LINE_DRAWER_COUNT; j++) {
+            if (line_drawer_supported[j]) {
+                line_drawer = j;
+            }
+        }
+    }
+    select_line_drawer(line_drawer);
+    select_rasterizer(rasterizer);
+    select_output_format(output_format);
+    set_reverse_order(reverse_order);
+    set_deferred_spans(deferred_spans);
+    if (render_cache_directory != NULL && set_render_cache(render_cache_directory,
+        (size_t)render_cache_megabytes * 1024 * 1024, render_cache_entries, render_cache_min_commands) != 0) {
+        fputs("Error opening the render cache directory!\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    if (bench_format != NULL) {
+        //BENCHMARK MODE
+        if (run_benchmarks(get_line_drawer_name(line_drawer), ssse3_supported, strcmp(bench_format, "csv") == 0) != 0) {
+            fputs("Error running the benchmarks!\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+        return 0;
+    }
     puts("Settings:");
     printf("  default output filename: %.*s\n", MAX_PATH, output_filename);
-    printf("  bitmap size: %dx%d\n\n", image_width, image_height);
+    printf("  bitmap size: %dx%d\n", image_width, image_height);
+    printf("  line drawing kernel: %s\n", get_line_drawer_name(line_drawer));
+    printf("  triangle rasterizer: %s\n", get_rasterizer_name(rasterizer));
+    printf("  batch drawing order: %s\n", reverse_order ? "reverse (overdraw elimination)" : "submission");
+    printf("  deferred row-sorted spans: %s\n", deferred_spans ? "yes" : "no");
+    printf("  output file format: %s\n", output_format >= 0 ? get_output_format_name(output_format) : "by extension");
+    printf("  internal pixel format: %s\n", xrgb ? "xrgb32" : "rgb24");
+    printf("  rendering threads: %d\n", thread_count);
+    printf("  rendering directly into the output file: %s\n", map_output ? "yes" : "no");
+    if (cache_megabytes > 0) {
+        printf("  out-of-core bitmap with tile cache size: %d MiB\n", cache_megabytes);
+    } else {
+        puts("  out-of-core bitmap: no");
+    }
+    if (render_cache_directory != NULL) {
+        printf("  render cache: %s (up to %d MiB in %d entries of at least %d commands)\n\n", render_cache_directory,
+            render_cache_megabytes, render_cache_entries, render_cache_min_commands);
+    } else {
+        puts("  render cache: no\n");
+    }
 
-    //setting the data-related variables
-    set_info_header(&info_header, image_width, image_height);
-    DWORD image_data_size = ((abs(image_width) * 3 + 3) & 0xfffffffc) * abs(image_height);
-    DWORD summed_header_size = sizeof(file_header) + sizeof(info_header);
-    set_file_header(&file_header, image_data_size + summed_header_size, summed_header_size);
-    image_data = malloc(image_data_size * sizeof(BYTE));
+    if (socket_path != NULL) {
+        //SERVER MODE (every client draws on its own bitmap)
+        if (run_server(socket_path, image_width, image_height, output_filename, thread_count, xrgb) != 0) {
+            fputs("Error running the server!\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+        if (stats_filename != NULL && write_stats_json(NULL, stats_filename) != 0) {
+            fputs("Error writing statistics!\n", stderr);
+        }
+        return 0;
+    }
 
-    //set background
-    clear_bitmap(image_data, &info_header, 0xff, 0xff, 0xff);
+    //setting the data-related variables
+    if (create_canvas(&canvas, image_width, image_height, output_filename, thread_count, map_output,
+        (size_t)cache_megabytes * 1024 * 1024, xrgb) != 0) {
+        fputs(map_output || cache_megabytes > 0 ? "Error creating the bitmap file!\n" : "Error allocating bitmap data!\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    if (get_canvas_thread_count(canvas) < thread_count) {
+        puts("Error creating worker threads! Rendering on a single thread.");
+    }
 
     if (interactive_mode) {
         //INTERACTIVE MODE
         print_help();
-        char buffer[BUF_SIZE];
-        //main loop
-        while (true) {
+        COMMANDRING *ring = create_command_ring(canvas);
+        if (ring == NULL) {
+            fputs("Error starting the command parser!\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+        //vertex buffer of the mesh and strip commands
+        VERTEXDATA *mesh_vertices = NULL;
+        DWORD mesh_vertex_count = 0, mesh_vertex_capacity = 0;
+        //consecutive draw commands are drawn at once (before any other command or waiting for the next one)
+        VERTEXDATA (*triangles)[3] = malloc(COMMAND_DRAW_BATCH_SIZE * sizeof(*triangles));
+        DWORD triangle_count = 0;
+        if (triangles == NULL) {
+            fputs("Error allocating triangle buffer!\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+        //main loop (the commands are parsed by the parser thread)
+        bool running = true;
+        while (running) {
+            //the result of the background save is reported on the next prompt
+            report_background_save(canvas, false);
             putchar('>');
-            fgets(buffer, BUF_SIZE, stdin);
-            buffer[BUF_SIZE - 1] = 0;
-            DWORD input_length = strlen(buffer);
-
-            char comparison_buffer[6] = {0, 0, 0, 0, 0, 0};
-            if (input_length < 4) {
-                puts("Incorrect command!");
-                continue;
-            }
-            memcpy(comparison_buffer, buffer, 4);
-            if (input_length > 4) {
-                comparison_buffer[4] = buffer[4];
+            COMMANDRECORD *command = peek_command(ring, false);
+            if (command == NULL) {
+                //no command parsed yet, draw the collected triangles and show the prompt before waiting for it
+                if (draw_canvas_triangles(canvas, triangles, triangle_count) != 0) {
+                    puts("Error drawing triangles!");
+                }
+                triangle_count = 0;
+                fflush(stdout);
+                command = peek_command(ring, true);
             }
-            for (int i = 0; i < 5; i++) {
-                if (isspace(comparison_buffer[i])) {
-                    comparison_buffer[i] = 0;
-                    break;
+            if (command->type != COMMAND_DRAW && triangle_count > 0) {
+                if (draw_canvas_triangles(canvas, triangles, triangle_count) != 0) {
+                    puts("Error drawing triangles!");
                 }
+                triangle_count = 0;
             }
-            if (strcmp(comparison_buffer, "help") == 0) {
+
+            switch (command->type) {
+            case COMMAND_HELP:
                 print_help();
-            } else if (strcmp(comparison_buffer, "draw") == 0) {
-                bool status_ok = false;
-                VERTEXDATA vertex_data[3];
-                LONG colors[9];
-                LONG values_read = sscanf(buffer, "draw %d %d #%2hhx%2hhx%2hhx %d %d #%2hhx%2hhx%2hhx %d %d #%2hhx%2hhx%2hhx",
-                    &vertex_data[0].posX, &vertex_data[0].posY, &vertex_data[0].colR, &vertex_data[0].colG,
-                    &vertex_data[0].colB, &vertex_data[1].posX, &vertex_data[1].posY, &vertex_data[1].colR,
-                    &vertex_data[1].colG, &vertex_data[1].colB, &vertex_data[2].posX, &vertex_data[2].posY,
-                    &vertex_data[2].colR, &vertex_data[2].colG, &vertex_data[2].colB);
-                if (values_read == 15) {
-                    status_ok = true;
-                } else {
-                    values_read = sscanf(buffer, "draw %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d",
-                        &vertex_data[0].posX, &vertex_data[0].posY, &colors[0], &colors[1], &colors[2],
-                        &vertex_data[1].posX, &vertex_data[1].posY, &colors[3], &colors[4], &colors[5],
-                        &vertex_data[2].posX, &vertex_data[2].posY, &colors[6], &colors[7], &colors[8]);
-                    if (values_read == 15) {
-                        status_ok = true;
-                        for (DWORD i = 0; i < 9; i++) {
-                            if (colors[i] < 0 || colors[i] > 255) {
-                                status_ok = false;
-                                break;
-                            }
-                        }
-                    }
-                    if (status_ok) {
-                        set_vertex(&vertex_data[0], vertex_data[0].posX, vertex_data[0].posY, colors[0], colors[1], colors[2]);
-                        set_vertex(&vertex_data[1], vertex_data[1].posX, vertex_data[1].posY, colors[3], colors[4], colors[5]);
-                        set_vertex(&vertex_data[2], vertex_data[2].posX, vertex_data[2].posY, colors[6], colors[7], colors[8]);
+                break;
+            case COMMAND_STATS:
+                //account the queued triangles as well
+                flush_canvas(canvas);
+                print_stats(canvas);
+                break;
+            case COMMAND_DRAW:
+                memcpy(triangles[triangle_count++], command->data.vertices, sizeof(*triangles));
+                if (triangle_count == COMMAND_DRAW_BATCH_SIZE) {
+                    if (draw_canvas_triangles(canvas, triangles, triangle_count) != 0) {
+                        puts("Error drawing triangles!");
                     }
+                    triangle_count = 0;
                 }
-                if (status_ok) {
-                    if (draw_triangle(image_data, &info_header, &vertex_data) != 0) {
-                        puts("Error drawing triangle!");
-                    }
-                } else {
-                    puts("Incorrect vertex format!");
-                }
-            } else if (strcmp(comparison_buffer, "clear") == 0) {
-                //check for non-whitespace characters after the command
-                if (strspn(buffer + 5, " \t\n\v\f\r") + 5 != strlen(buffer)) {
-                    BYTE red = 255, green = 255, blue = 255;
-                    LONG values_read = sscanf(buffer, "clear #%2hhx%2hhx%2hhx", &red, &green, &blue);
-                    if (values_read == 3) {
-                        clear_bitmap(image_data, &info_header, red, green, blue);
-                    } else {
-                        bool status_ok = false;
-                        LONG colors[3];
-                        values_read = sscanf(buffer, "clear %d %d %d", &colors[0], &colors[1], &colors[2]);
-                        if (values_read == 3) {
-                            status_ok = true;
-                            for (DWORD i = 0; i < 3; i++) {
-                                if (colors[i] < 0 || colors[i] > 255) {
-                                    status_ok = false;
-                                    break;
-                                }
-                            }
-                        }
-                        if (status_ok) {
-                            clear_bitmap(image_data, &info_header, colors[0], colors[1], colors[2]);
-                        } else {
-                            puts("Incorrect color format!");
-                        }
+                break;
+            case COMMAND_VERTEX:
+                if (mesh_vertex_count == mesh_vertex_capacity) {
+                    DWORD capacity = mesh_vertex_capacity > 0 ? 2 * mesh_vertex_capacity : 64;
+                    VERTEXDATA *reallocated = realloc(mesh_vertices, capacity * sizeof(VERTEXDATA));
+                    if (reallocated == NULL) {
+                        fputs("Error allocating vertex buffer!\n", stderr);
+                        exit(EXIT_FAILURE);
                     }
-                } else {
-                    //no color argument: paint white
-                    clear_bitmap(image_data, &info_header, 0xff, 0xff, 0xff);
+                    mesh_vertices = reallocated;
+                    mesh_vertex_capacity = capacity;
                 }
-            } else if (strcmp(comparison_buffer, "save") == 0) {
-                char *filename = output_filename;
-                char filename_buffer[MAX_PATH];
-                if (sscanf(buffer, "save %259[^\n]", filename_buffer) == 1) {
-                    filename = filename_buffer;
+                mesh_vertices[mesh_vertex_count++] = command->data.vertices[0];
+                break;
+            case COMMAND_RESET:
+                mesh_vertex_count = 0;
+                break;
+            case COMMAND_MESH:
+            case COMMAND_STRIP: {
+                LONG result = draw_canvas_mesh(canvas, mesh_vertices, mesh_vertex_count, command->data.indices,
+                    command->count, command->type == COMMAND_STRIP);
+                if (result == -3) {
+                    puts("Incorrect indices!");
+                } else if (result != 0) {
+                    puts("Error drawing mesh!");
                 }
-                if (save_bitmap(&file_header, &info_header, image_data, filename) == 0) {
+                break;
+            }
+            case COMMAND_CLEAR:
+                clear_canvas(canvas, command->data.color[0], command->data.color[1], command->data.color[2]);
+                break;
+            case COMMAND_SAVE:
+                report_background_save(canvas, true);
+                if (save_canvas(canvas, command->data.filename) == 0) {
                     puts("Bitmap saved successfully!");
                 } else {
                     puts("Error saving bitmap!");
                 }
-            } else if (strcmp(comparison_buffer, "kill") == 0) {
                 break;
-            } else if (strcmp(comparison_buffer, "quit") == 0) {
-                if (save_bitmap(&file_header, &info_header, image_data, output_filename) == 0) {
+            case COMMAND_BSAVE:
+                //only one save is performed in the background at a time
+                report_background_save(canvas, true);
+                if (save_canvas_background(canvas, command->data.filename) != 0) {
+                    puts("Error saving bitmap!");
+                }
+                break;
+            case COMMAND_FRAME:
+                if (save_canvas_frame(canvas) != 0) {
+                    puts("Error saving frame!");
+                }
+                break;
+            case COMMAND_FLUSH:
+                flush_canvas(canvas);
+                break;
+            case COMMAND_KILL:
+                report_background_save(canvas, true);
+                report_frames(canvas);
+                running = false;
+                break;
+            case COMMAND_QUIT:
+            case COMMAND_END:
+                report_background_save(canvas, true);
+                report_frames(canvas);
+                if (save_canvas(canvas, NULL) == 0) {
                     puts("Bitmap saved successfully!");
-                    break;
+                    running = false;
                 } else {
                     puts("Error saving bitmap!");
+                    //the end of the input ends the session anyway
+                    running = command->type == COMMAND_QUIT;
                 }
-            } else {
-                puts("Incorrect command!");
-            }
-
-            if (input_length > 0) {
-                input_length--;
-                //if the input was too long, skip until the next line
-                if (buffer[input_length] != '\n') {
-                    LONG character = 0;
-                    while (character != '\n' && character != EOF) {
-                        character = getchar();
-                    }
+                //the parser waits for the result of quit (see parser_main())
+                if (command->type == COMMAND_QUIT) {
+                    resume_parser(ring, running);
                 }
+                break;
+            case COMMAND_ERROR:
+                puts(command->data.message);
+                break;
             }
+            pop_command(ring);
+        }
+        destroy_command_ring(ring);
+        free(triangles);
+        free(mesh_vertices);
+    } else if (batch_filename != NULL) {
+        //BATCH MODE
+        BATCHREPORT report;
+        LONG result = run_batch(canvas, batch_filename, &report);
+        print_batch_report(&report);
+        if (result == -2) {
+            puts("Error reading batch file!");
+        } else if (result == -3) {
+            puts("Incorrect batch file!");
         }
     } else {
         //NON-INTERACTIVE MODE
@@ -669,21 +1213,22 @@ int main(int argc, char **argv)
                 {206, 102, 0x30, 0x41, 0x08}
             }
         };
-        for (int i = 0; i < TRIANGLE_COUNT; i++) {
-            if (draw_triangle(image_data, &info_header, &vertices[i]) != 0) {
-                puts("Error drawing triangle!");
-                break;
-            }
+        if (draw_canvas_triangles(canvas, vertices, TRIANGLE_COUNT) != 0) {
+            puts("Error drawing triangles!");
         }
-        if (save_bitmap(&file_header, &info_header, image_data, output_filename) == 0) {
+        if (save_canvas(canvas, NULL) == 0) {
             puts("Bitmap saved successfully!");
         } else {
             puts("Error saving bitmap!");
         }
     }
 
-    //deallocate bitmap data
-    free(image_data);
+    //stop worker threads and deallocate bitmap data
+    destroy_canvas(canvas);
+
+    if (stats_filename != NULL && write_stats_json(NULL, stats_filename) != 0) {
+        fputs("Error writing statistics!\n", stderr);
+    }
 
     return 0;
 }
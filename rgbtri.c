@@ -0,0 +1,6507 @@
+/*!
+ *  \brief     Implementation of librgbtri, the library for drawing RGB triangles on bitmaps (partially in assembly).
+ *  \author    Dawid Sygocki
+ *  \date      2020-06-12
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <cpuid.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <time.h>
+
+#include "rgbtri_private.h"
+
+/*! \brief Generates the BITMAPFILEHEADER structure in the form of array.
+
+    For detailed description see https://docs.microsoft.com/en-us/windows/win32/api/wingdi/ns-wingdi-bitmapfileheader
+
+    \param header Pointer to a 14-bytes long array for storing the result.
+    \param file_size Size of the bitmap file (in bytes).
+    \param headers_length The offset from the beginning of the file to the bitmap color data (in bytes).
+ */
+void set_file_header(BYTE (*header)[14], const DWORD file_size, const DWORD headers_length)
+{
+    if (header != NULL) {
+        (*header)[0] = 'B';
+        (*header)[1] = 'M';
+        memcpy(&(*header)[2], &file_size, 4);
+        memset(&(*header)[6], 0, 4);
+        memcpy(&(*header)[10], &headers_length, 4);
+    }
+}
+
+/*! \brief Calculates the length of a bitmap row in bytes (padded to a multiple of 4 bytes).
+
+    \param width Width of the bitmap.
+    \param bit_count Number of bits per pixel (24 or 32).
+
+    \return Length of a row.
+ */
+size_t get_bitmap_stride(const LONG width, const WORD bit_count)
+{
+    return ((size_t)labs(width) * (bit_count / 8) + 3) & ~(size_t)3;
+}
+
+/*! \brief Calculates the size of the bitmap data in bytes.
+
+    Unlike \a biSizeImage, the result is not limited to 32 bits.
+
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+
+    \return Size of the bitmap data.
+ */
+size_t get_image_data_size(const BITMAPINFOHEADER *info_header)
+{
+    return get_bitmap_stride(info_header->biWidth, info_header->biBitCount) * (size_t)labs(info_header->biHeight);
+}
+
+/*! \brief Sets up the #BITMAPINFOHEADER structure.
+
+    \param header Pointer to the structure.
+    \param width Width of the bitmap.
+    \param height Height of the bitmap.
+    \param bit_count Number of bits per pixel (24 for RGB24 or 32 for XRGB, the latter only used internally).
+ */
+void set_info_header(BITMAPINFOHEADER *header, const LONG width, const LONG height, const WORD bit_count)
+{
+    if (header != NULL) {
+        size_t image_size = get_bitmap_stride(width, bit_count) * (size_t)labs(height);
+        header->biSize = sizeof(*header);
+        header->biWidth = width;
+        header->biHeight = height;
+        header->biPlanes = 1;
+        header->biBitCount = bit_count;
+        header->biCompression = 0;
+        //zero is allowed for uncompressed bitmaps and used if the size does not fit in 32 bits
+        header->biSizeImage = image_size <= UINT32_MAX ? image_size : 0;
+        header->biXPelsPerMeter = 0;
+        header->biYPelsPerMeter = 0;
+        header->biClrUsed = 0;
+        header->biClrImportant = 0;
+    }
+}
+
+/*! \brief Sets up the #VERTEXDATA structure.
+
+    \param pos_x Horizontal position of the vertex.
+    \param pos_y Vertical position of the vertex.
+    \param col_r Intensity of red in the vertex color.
+    \param col_g Intensity of green in the vertex color.
+    \param col_b Intensity of blue in the vertex color.
+ */
+void set_vertex(VERTEXDATA *vertex, const LONG pos_x, const LONG pos_y, const BYTE col_r, const BYTE col_g, const BYTE col_b)
+{
+    if (vertex != NULL) {
+        vertex->posX = pos_x;
+        vertex->posY = pos_y;
+        vertex->colR = col_r;
+        vertex->colG = col_g;
+        vertex->colB = col_b;
+    }
+}
+
+/*! \brief Reads the time stamp counter of the processor.
+ */
+LONGLONG read_tsc(void)
+{
+    DWORD eax, edx;
+    __asm__ volatile ("rdtsc" : "=a"(eax), "=d"(edx));
+    return (LONGLONG)edx << 32 | eax;
+}
+
+/*! \brief Reads a monotonic clock.
+
+    \return Time in seconds.
+ */
+double get_time_seconds(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/*! \brief Counters of a single processing stage.
+ */
+typedef struct STATCOUNTERS {
+    LONGLONG calls;
+    LONGLONG rows;
+    LONGLONG pixels;
+    LONGLONG culled;
+    //time stamp counter cycles (converted to nanoseconds when reported)
+    LONGLONG ticks;
+} STATCOUNTERS;
+
+/*! \brief Runtime statistics of the hot paths (see print_stats()).
+ */
+typedef struct RUNSTATS {
+    //commands parsed in the interactive or batch mode
+    STATCOUNTERS parse;
+    //triangles set up (calls) and scanlines stepped (rows), excluding filling the spans
+    STATCOUNTERS setup;
+    //spans filled (calls), pixels written and spans lying entirely outside the bitmap (culled)
+    STATCOUNTERS spans;
+    STATCOUNTERS clear;
+    STATCOUNTERS save;
+    LONGLONG start_ticks;
+    double start_time;
+} RUNSTATS;
+
+//totals of the destroyed canvases and of the commands parsed without a canvas (see print_stats())
+RUNSTATS stats;
+
+//statistics updated by the calling thread: those of the canvas it works on (see use_canvas_settings())
+__thread RUNSTATS *thread_stats = &stats;
+
+//the counters can be compiled out by defining NO_STATS
+#ifndef NO_STATS
+//adds a value to a statistics counter (the counters are shared by the rendering threads)
+#define STATS_ADD(counter, value) __atomic_fetch_add(&(counter), (value), __ATOMIC_RELAXED)
+#else
+#define STATS_ADD(counter, value) ((void)(counter), (void)(value))
+#endif
+
+/*! \brief Settings of the render cache of text batch files (see set_render_cache()).
+ */
+typedef struct RENDERCACHE {
+    //directory holding the entries (empty if the cache is disabled)
+    char directory[MAX_PATH];
+    //limits of the total size and the number of the entries (the least recently used ones are evicted first)
+    size_t max_bytes;
+    DWORD max_entries;
+    //minimal number of the commands of a cached prefix
+    LONGLONG min_commands;
+} RENDERCACHE;
+
+/*! \brief Drawing, output and render cache settings of a #CANVAS.
+
+    Every canvas starts with a copy of the defaults (see select_line_drawer() and the other process-wide setters)
+    and can change them on its own (see set_canvas_line_drawer() and the other per-canvas setters).
+ */
+typedef struct CANVASSETTINGS {
+    //one of the LINE_DRAWER_* and RASTERIZER_* indices
+    LONG line_drawer;
+    LONG rasterizer;
+    //see set_reverse_order() and set_deferred_spans()
+    bool reverse_order;
+    bool deferred_spans;
+    //one of the OUTPUT_FORMAT_* indices or -1 to choose it by the extension (see select_output_format())
+    LONG output_format;
+    RENDERCACHE render_cache;
+} CANVASSETTINGS;
+
+//settings of the canvases created afterwards
+CANVASSETTINGS default_settings = {LINE_DRAWER_SSE2, RASTERIZER_SCANLINE, false, false, -1, {{0}, 0, 0, 0}};
+
+/*! \brief Fills a memory block with a repeated 48-byte pattern (see fill_pattern.asm).
+
+    \param destination Pointer to the memory block.
+    \param pattern Pointer to the pattern repeated twice (96 bytes).
+    \param length Size of the memory block in bytes.
+    \param non_temporal Whether to bypass the cache (for blocks which are not going to be read soon).
+ */
+extern void fill_pattern(BYTE *destination, const BYTE *pattern, size_t length, bool non_temporal);
+
+#define FILL_PATTERN_BYTES 96
+
+/*! \brief Prepares the pattern of pixels of the given color for fill_bitmap_rows().
+
+    \param pattern Array for storing the pattern.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param red Intensity of red in desired color.
+    \param green Intensity of green in desired color.
+    \param blue Intensity of blue in desired color.
+ */
+void set_fill_pattern(BYTE pattern[FILL_PATTERN_BYTES], const BITMAPINFOHEADER *info_header,
+    const BYTE red, const BYTE green, const BYTE blue)
+{
+    BYTE pixel[4] = {blue, green, red, 0};
+    DWORD pixel_size = info_header->biBitCount / 8;
+    for (DWORD i = 0; i < FILL_PATTERN_BYTES; i++) {
+        pattern[i] = pixel[i % pixel_size];
+    }
+}
+
+/*! \brief Fills a band of scanlines of the bitmap with the pattern (zeroing the padding of the rows).
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param pattern Pattern prepared using set_fill_pattern().
+    \param first_line Vertical position of the first scanline of the band.
+    \param last_line Vertical position of the last scanline of the band.
+    \param non_temporal Whether to bypass the cache.
+ */
+void fill_bitmap_rows(BYTE *image_data, const BITMAPINFOHEADER *info_header, const BYTE pattern[FILL_PATTERN_BYTES],
+    const LONG first_line, const LONG last_line, const bool non_temporal)
+{
+    size_t stride = get_bitmap_stride(info_header->biWidth, info_header->biBitCount),
+        row_size = (size_t)abs(info_header->biWidth) * (info_header->biBitCount / 8);
+    for (LONG i = first_line; i <= last_line; i++) {
+        BYTE *row = image_data + i * stride;
+        fill_pattern(row, pattern, row_size, non_temporal);
+        memset(row + row_size, 0, stride - row_size);
+    }
+}
+
+/*! \brief Paints a band of scanlines of the bitmap using the given color.
+
+    The rows are written with non-temporal stores, as they are not expected to be read soon.
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param red Intensity of red in desired color.
+    \param green Intensity of green in desired color.
+    \param blue Intensity of blue in desired color.
+    \param first_line Vertical position of the first scanline of the band.
+    \param last_line Vertical position of the last scanline of the band.
+ */
+void clear_bitmap_rows(BYTE *image_data, BITMAPINFOHEADER *info_header, const BYTE red, const BYTE green, const BYTE blue,
+    const LONG first_line, const LONG last_line)
+{
+    if (image_data != NULL && info_header != NULL && first_line <= last_line) {
+        LONGLONG start_ticks = STATS_TICKS();
+        BYTE pattern[FILL_PATTERN_BYTES];
+        set_fill_pattern(pattern, info_header, red, green, blue);
+        fill_bitmap_rows(image_data, info_header, pattern, first_line, last_line, true);
+        STATS_ADD(thread_stats->clear.calls, 1);
+        STATS_ADD(thread_stats->clear.rows, last_line - first_line + 1);
+        STATS_ADD(thread_stats->clear.pixels, (LONGLONG)(last_line - first_line + 1) * abs(info_header->biWidth));
+        STATS_ADD(thread_stats->clear.ticks, STATS_TICKS() - start_ticks);
+    }
+}
+
+/*! \brief Paints the bitmap using the given color.
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param red Intensity of red in desired color.
+    \param green Intensity of green in desired color.
+    \param blue Intensity of blue in desired color.
+ */
+void clear_bitmap(BYTE *image_data, BITMAPINFOHEADER *info_header, const BYTE red, const BYTE green, const BYTE blue)
+{
+    if (image_data != NULL && info_header != NULL) {
+        clear_bitmap_rows(image_data, info_header, red, green, blue, 0, abs(info_header->biHeight) - 1);
+    }
+}
+
+/*! \brief Clear of a bitmap postponed until its scanlines are needed.
+
+    Clearing only records the color and advances the generation. A scanline is filled
+    when a span first touches it or when the whole bitmap is needed (e.g. for saving),
+    so the rows overwritten anyway and repeated clears cost nothing.
+ */
+typedef struct DEFERREDCLEAR {
+    //pattern of the clear color (see set_fill_pattern())
+    BYTE pattern[FILL_PATTERN_BYTES];
+    DWORD generation;
+    //generation of the last clear applied to each scanline
+    DWORD *row_generations;
+} DEFERREDCLEAR;
+
+/*! \brief Records a clear of the whole bitmap without touching its data.
+
+    \param deferred_clear Pointer to the DEFERREDCLEAR structure of the bitmap.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param red Intensity of red in desired color.
+    \param green Intensity of green in desired color.
+    \param blue Intensity of blue in desired color.
+ */
+void defer_clear(DEFERREDCLEAR *deferred_clear, const BITMAPINFOHEADER *info_header,
+    const BYTE red, const BYTE green, const BYTE blue)
+{
+    set_fill_pattern(deferred_clear->pattern, info_header, red, green, blue);
+    deferred_clear->generation++;
+    if (deferred_clear->generation == 0) {
+        //wrapped around: restart the numbering with every scanline pending
+        memset(deferred_clear->row_generations, 0, abs(info_header->biHeight) * sizeof(DWORD));
+        deferred_clear->generation = 1;
+    }
+}
+
+/*! \brief Fills the scanlines of the band which the last clear has not been applied to yet.
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param deferred_clear Pointer to the DEFERREDCLEAR structure of the bitmap.
+    \param first_line Vertical position of the first scanline of the band.
+    \param last_line Vertical position of the last scanline of the band.
+    \param non_temporal Whether to bypass the cache (used when the whole bitmap is filled,
+        fills of single scanlines about to be drawn on are counted in the span statistics).
+ */
+void apply_deferred_clear(BYTE *image_data, const BITMAPINFOHEADER *info_header, DEFERREDCLEAR *deferred_clear,
+    const LONG first_line, const LONG last_line, const bool non_temporal)
+{
+    LONGLONG start_ticks = STATS_TICKS(), row_count = 0;
+    for (LONG i = first_line; i <= last_line; i++) {
+        if (deferred_clear->row_generations[i] == deferred_clear->generation) {
+            continue;
+        }
+        //fill the whole run of pending scanlines at once
+        LONG run_first_line = i;
+        while (i <= last_line && deferred_clear->row_generations[i] != deferred_clear->generation) {
+            deferred_clear->row_generations[i] = deferred_clear->generation;
+            i++;
+        }
+        fill_bitmap_rows(image_data, info_header, deferred_clear->pattern, run_first_line, i - 1, non_temporal);
+        row_count += i - run_first_line;
+    }
+    if (non_temporal && row_count > 0) {
+        STATS_ADD(thread_stats->clear.calls, 1);
+        STATS_ADD(thread_stats->clear.rows, row_count);
+        STATS_ADD(thread_stats->clear.pixels, row_count * abs(info_header->biWidth));
+        STATS_ADD(thread_stats->clear.ticks, STATS_TICKS() - start_ticks);
+    }
+}
+
+/*! \brief Swaps two VERTEXDATA structures.
+
+    \param a Pointer to the first structure.
+    \param b Pointer to the second structure.
+ */
+void swap_vertices(VERTEXDATA *a, VERTEXDATA *b)
+{
+    if (a != NULL && b != NULL) {
+        VERTEXDATA tmp;
+        memcpy(&tmp, a, sizeof(VERTEXDATA));
+        memcpy(a, b, sizeof(VERTEXDATA));
+        memcpy(b, &tmp, sizeof(VERTEXDATA));
+    }
+}
+
+/*! \brief Sorts an array of three vertices by their vertical and then horizontal position (ascending).
+
+    \param vertex_data Pointer to an array of three VERTEXDATA structures.
+ */
+void sort_triangle_vertices(VERTEXDATA (*vertex_data)[3])
+{
+    if (vertex_data != NULL) {
+        if ((*vertex_data)[1].posY < (*vertex_data)[0].posY) {
+            swap_vertices(&(*vertex_data)[0], &(*vertex_data)[1]);
+        }
+        if ((*vertex_data)[2].posY < (*vertex_data)[1].posY) {
+            swap_vertices(&(*vertex_data)[1], &(*vertex_data)[2]);
+        }
+        if ((*vertex_data)[1].posY < (*vertex_data)[0].posY) {
+            swap_vertices(&(*vertex_data)[0], &(*vertex_data)[1]);
+        }
+    }
+}
+
+/*! \brief Describes a value changing linearly from scanline to scanline.
+
+    The value is stored in fixed-point form with an exact fraction: \a value + \a remainder / \a denominator,
+    where 0 <= \a remainder < \a denominator. Advancing to the next scanline requires only integer additions.
+ */
+typedef struct EDGEVALUE {
+    LONG value;
+    LONGLONG remainder;
+    LONG step;
+    LONGLONG step_remainder;
+    LONGLONG denominator;
+} EDGEVALUE;
+
+/*! \brief Describes position and color of one edge of a triangle on the current scanline.
+ */
+typedef struct EDGE {
+    EDGEVALUE x, r, g, b;
+} EDGE;
+
+/*! \brief Sets up the #EDGEVALUE structure.
+
+    \param edge_value Pointer to the structure.
+    \param start Value at the beginning of the edge.
+    \param end Value at the end of the edge.
+    \param length Vertical length of the edge (non-negative).
+    \param offset Number of scanlines between the beginning of the edge and the current scanline.
+ */
+void set_edge_value(EDGEVALUE *edge_value, const LONG start, const LONG end, const LONG length, const LONG offset)
+{
+    if (edge_value != NULL) {
+        LONGLONG delta = (LONGLONG)end - start,
+            denominator = length > 0 ? length : 1,
+            step, quotient, remainder;
+        if (length <= 0) {
+            delta = 0;
+        }
+        //floor division (C division truncates towards zero)
+        quotient = delta / denominator;
+        remainder = delta % denominator;
+        if (remainder < 0) {
+            quotient--;
+            remainder += denominator;
+        }
+        step = quotient;
+        edge_value->step = step;
+        edge_value->step_remainder = remainder;
+        edge_value->denominator = denominator;
+        //initial value at the given offset (edges usually start at their upper vertex)
+        if (offset == 0) {
+            edge_value->value = start;
+            edge_value->remainder = 0;
+            return;
+        }
+        //delta * offset may not fit in 64 bits, so the whole steps and the remainders are multiplied separately
+        //(|step| < 2^32, 0 <= step_remainder < denominator < 2^31 and |offset| <= 2^31)
+        LONGLONG remainders = edge_value->step_remainder * offset;
+        quotient = remainders / denominator;
+        remainder = remainders % denominator;
+        if (remainder < 0) {
+            quotient--;
+            remainder += denominator;
+        }
+        edge_value->value = start + step * offset + quotient;
+        edge_value->remainder = remainder;
+    }
+}
+
+/*! \brief Advances the #EDGEVALUE to the next scanline.
+
+    \param edge_value Pointer to the structure.
+ */
+void step_edge_value(EDGEVALUE *edge_value)
+{
+    edge_value->value += edge_value->step;
+    edge_value->remainder += edge_value->step_remainder;
+    if (edge_value->remainder >= edge_value->denominator) {
+        edge_value->value++;
+        edge_value->remainder -= edge_value->denominator;
+    }
+}
+
+/*! \brief Rounds the #EDGEVALUE to the nearest integer (halfway cases away from zero, like round()).
+
+    \param edge_value Pointer to the structure.
+
+    \return Rounded value.
+ */
+LONG round_edge_value(const EDGEVALUE *edge_value)
+{
+    LONGLONG doubled_remainder = 2 * edge_value->remainder;
+    if (doubled_remainder > edge_value->denominator
+        || doubled_remainder == edge_value->denominator && edge_value->value >= 0) {
+        return edge_value->value + 1;
+    }
+    return edge_value->value;
+}
+
+/*! \brief Sets up the #EDGE structure for the given scanline.
+
+    \param edge Pointer to the structure.
+    \param begin Pointer to the upper vertex of the edge.
+    \param end Pointer to the lower vertex of the edge.
+    \param line_y Vertical position of the current scanline.
+ */
+void set_edge(EDGE *edge, const VERTEXDATA *begin, const VERTEXDATA *end, const LONG line_y)
+{
+    if (edge != NULL && begin != NULL && end != NULL) {
+        LONG length = end->posY - begin->posY,
+            offset = line_y - begin->posY;
+        set_edge_value(&edge->x, begin->posX, end->posX, length, offset);
+        set_edge_value(&edge->r, begin->colR, end->colR, length, offset);
+        set_edge_value(&edge->g, begin->colG, end->colG, length, offset);
+        set_edge_value(&edge->b, begin->colB, end->colB, length, offset);
+    }
+}
+
+/*! \brief Advances the #EDGE to the next scanline.
+
+    \param edge Pointer to the structure.
+ */
+void step_edge(EDGE *edge)
+{
+    step_edge_value(&edge->x);
+    step_edge_value(&edge->r);
+    step_edge_value(&edge->g);
+    step_edge_value(&edge->b);
+}
+
+/*! \brief Packs the rounded color of the #EDGE into a DWORD (0x00RRGGBB).
+
+    \param edge Pointer to the structure.
+
+    \return Packed color.
+ */
+DWORD get_edge_color(const EDGE *edge)
+{
+    return (DWORD)round_edge_value(&edge->r) << 16
+        | (DWORD)round_edge_value(&edge->g) << 8
+        | (DWORD)round_edge_value(&edge->b);
+}
+
+/*! \brief Draws a horizontal line on the bitmap.
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param line_y Vertical position of both the left and right side fo the line.
+    \param left_x Horizontal position of the left side of the line.
+    \param right_x Horizontal position of the right side of the line.
+    \param left_color Color of the left side of the line (packed as 0x00RRGGBB).
+    \param right_color Color of the right side of the line (packed as 0x00RRGGBB).
+
+    \warning It is crucial that \a left_x <= \a right_x. Both pointers must be valid. As this function is implemented in assembly and only intended
+        for internal use in draw_triangle(), it performs no input correctness checks.
+ */
+extern void draw_horizontal_line(BYTE *image_data, BITMAPINFOHEADER *info_header, DWORD line_y,
+    LONG left_x, LONG right_x, DWORD left_color, DWORD right_color);
+
+/*! \brief Draws a horizontal line on the bitmap interpolating eight pixels at once (AVX2 variant of draw_horizontal_line()).
+
+    \warning Requires AVX2 instruction support. Color values may differ from the ones produced
+        by draw_horizontal_line() by one due to single-precision interpolation.
+ */
+extern void draw_horizontal_line_avx2(BYTE *image_data, BITMAPINFOHEADER *info_header, DWORD line_y,
+    LONG left_x, LONG right_x, DWORD left_color, DWORD right_color);
+
+/*! \brief Draws a horizontal line on the bitmap interpolating sixteen pixels at once (AVX-512 variant of draw_horizontal_line()).
+
+    \warning Requires AVX-512F instruction support. Color values may differ from the ones produced
+        by draw_horizontal_line() by one due to single-precision interpolation.
+ */
+extern void draw_horizontal_line_avx512(BYTE *image_data, BITMAPINFOHEADER *info_header, DWORD line_y,
+    LONG left_x, LONG right_x, DWORD left_color, DWORD right_color);
+
+/*! \brief Describes one of the available horizontal line drawing functions.
+ */
+typedef struct LINEDRAWER {
+    const char *name;
+    DRAWLINEPROC proc;
+} LINEDRAWER;
+
+//ordered from the least to the most demanding instruction set
+const LINEDRAWER line_drawers[LINE_DRAWER_COUNT] = {
+    {"sse2", draw_horizontal_line},
+    {"avx2", draw_horizontal_line_avx2},
+    {"avx512", draw_horizontal_line_avx512}
+};
+
+//function used by draw_triangle() on the calling thread (the one of the canvas it draws on, see use_canvas_settings())
+__thread DRAWLINEPROC draw_horizontal_line_proc = draw_horizontal_line;
+
+/*! \brief Reads the XCR0 register describing processor states enabled by the operating system.
+
+    \warning Should only be called if CPUID reports OSXSAVE support.
+ */
+DWORD read_xcr0(void)
+{
+    DWORD eax, edx;
+    __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return eax;
+}
+
+/*! \brief Checks which line drawing functions are supported by the CPU using GCC intrinsics.
+
+    \param supported Array for storing whether each of the LINE_DRAWER_* functions is supported.
+    \param ssse3_supported Pointer for storing whether SSSE3 instructions (needed for saving 32-bit bitmaps) are supported.
+ */
+void detect_line_drawers(bool supported[LINE_DRAWER_COUNT], bool *ssse3_supported)
+{
+    for (LONG j = 0; j < LINE_DRAWER_COUNT; j++) {
+        supported[j] = false;
+    }
+    *ssse3_supported = false;
+    //source: https://stackoverflow.com/a/7495023/7447673
+    int info[4];
+    __cpuid_count(0, 0, info[0], info[1], info[2], info[3]);
+    int nIds = info[0];
+    if (nIds >= 0x00000001){
+        __cpuid_count(0x00000001, 0, info[0], info[1], info[2], info[3]);
+        if ((info[3] & ((int)1 << 26)) != 0) {
+            supported[LINE_DRAWER_SSE2] = true;
+        }
+        //needed for converting the 32-bit internal bitmap when saving
+        if ((info[2] & ((int)1 << 9)) != 0) {
+            *ssse3_supported = true;
+        }
+        //wider registers are usable only if the OS saves their state (OSXSAVE and AVX bits)
+        DWORD xcr0 = 0;
+        if ((info[2] & ((int)1 << 27)) != 0 && (info[2] & ((int)1 << 28)) != 0) {
+            xcr0 = read_xcr0();
+        }
+        if (nIds >= 0x00000007 && (xcr0 & 0x06) == 0x06) {
+            __cpuid_count(0x00000007, 0, info[0], info[1], info[2], info[3]);
+            if ((info[1] & ((int)1 << 5)) != 0) {
+                supported[LINE_DRAWER_AVX2] = true;
+                //AVX-512F (the kernel uses AVX2 instructions on narrower registers as well)
+                if ((info[1] & ((int)1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6) {
+                    supported[LINE_DRAWER_AVX512] = true;
+                }
+            }
+        }
+    }
+}
+
+/*! \brief Finds a line drawing function by name.
+
+    \param name Name of the function (sse2, avx2 or avx512).
+
+    \return One of the LINE_DRAWER_* indices or -1 if there is no such function.
+ */
+LONG find_line_drawer(const char *name)
+{
+    for (LONG j = 0; name != NULL && j < LINE_DRAWER_COUNT; j++) {
+        if (strcmp(name, line_drawers[j].name) == 0) {
+            return j;
+        }
+    }
+    return -1;
+}
+
+/*! \brief Provides the name of a line drawing function.
+
+    \param line_drawer One of the LINE_DRAWER_* indices.
+
+    \return Name of the function or NULL if the index is incorrect.
+ */
+const char *get_line_drawer_name(const LONG line_drawer)
+{
+    return line_drawer >= 0 && line_drawer < LINE_DRAWER_COUNT ? line_drawers[line_drawer].name : NULL;
+}
+
+/*! \brief Selects the line drawing function of the canvases created afterwards (see set_canvas_line_drawer()).
+
+    \param line_drawer One of the LINE_DRAWER_* indices (supported by the CPU, see detect_line_drawers()).
+
+    \return Zero on success, -1 if the index is incorrect.
+ */
+LONG select_line_drawer(const LONG line_drawer)
+{
+    if (line_drawer < 0 || line_drawer >= LINE_DRAWER_COUNT) {
+        return -1;
+    }
+    default_settings.line_drawer = line_drawer;
+    return 0;
+}
+/*! \brief Draws a horizontal line of a single color on the bitmap (specialization of draw_horizontal_line()).
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param line_y Vertical position of the line.
+    \param left_x Horizontal position of the left side of the line.
+    \param right_x Horizontal position of the right side of the line.
+    \param pattern Pattern of the color prepared using set_fill_pattern().
+
+    \warning The line is clipped horizontally only.
+ */
+void draw_flat_line(BYTE *image_data, const BITMAPINFOHEADER *info_header, const DWORD line_y,
+    LONG left_x, LONG right_x, const BYTE pattern[FILL_PATTERN_BYTES])
+{
+    LONG width = abs(info_header->biWidth);
+    left_x = left_x > 0 ? left_x : 0;
+    right_x = right_x < width - 1 ? right_x : width - 1;
+    if (left_x <= right_x) {
+        DWORD pixel_size = info_header->biBitCount / 8;
+        BYTE *row = image_data + line_y * get_bitmap_stride(info_header->biWidth, info_header->biBitCount);
+        fill_pattern(row + (size_t)left_x * pixel_size, pattern, (size_t)(right_x - left_x + 1) * pixel_size, false);
+    }
+}
+
+/*! \brief Mask of the pixels of a band of scanlines already claimed by the triangles drawn in reverse order.
+
+    Every triangle of a batch is opaque, so a pixel drawn by a later triangle is final. When the triangles
+    are drawn from the last to the first, each pixel is written only by the first triangle claiming it.
+    The mask is hierarchical: a bit per pixel, a count of unclaimed pixels per scanline
+    (so that the spans on full scanlines are skipped at once) and a count of scanlines with unclaimed pixels
+    (so that the remaining triangles are skipped once the whole band is claimed).
+ */
+typedef struct COVERAGEMASK {
+    LONG first_line;
+    //number of 64-bit words of the mask per scanline
+    size_t line_words;
+    uint64_t *bits;
+    LONG *unclaimed_pixels;
+    LONG unclaimed_lines;
+    //single scanline for drawing the spans which are claimed partially
+    BYTE *scratch_line;
+    BITMAPINFOHEADER scratch_header;
+} COVERAGEMASK;
+
+/*! \brief Allocates the #COVERAGEMASK for bands of up to the given number of scanlines.
+
+    \param coverage Pointer to the mask.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param line_count Maximal number of scanlines in a band.
+
+    \return True on success, false on memory allocation failure.
+ */
+bool create_coverage_mask(COVERAGEMASK *coverage, const BITMAPINFOHEADER *info_header, const LONG line_count)
+{
+    memcpy(&coverage->scratch_header, info_header, sizeof(BITMAPINFOHEADER));
+    coverage->scratch_header.biHeight = 1;
+    coverage->line_words = ((size_t)abs(info_header->biWidth) + 63) / 64;
+    coverage->bits = malloc(coverage->line_words * line_count * sizeof(uint64_t));
+    coverage->unclaimed_pixels = malloc(line_count * sizeof(LONG));
+    coverage->scratch_line = malloc(get_bitmap_stride(info_header->biWidth, info_header->biBitCount));
+    if (coverage->bits == NULL || coverage->unclaimed_pixels == NULL || coverage->scratch_line == NULL) {
+        free(coverage->scratch_line);
+        free(coverage->unclaimed_pixels);
+        free(coverage->bits);
+        return false;
+    }
+    return true;
+}
+
+/*! \brief Marks all the pixels of a band of scanlines as unclaimed in the #COVERAGEMASK.
+
+    \param coverage Pointer to the mask.
+    \param first_line Vertical position of the first scanline of the band.
+    \param line_count Number of scanlines in the band (not greater than the one given to create_coverage_mask()).
+ */
+void reset_coverage_mask(COVERAGEMASK *coverage, const LONG first_line, const LONG line_count)
+{
+    coverage->first_line = first_line;
+    memset(coverage->bits, 0, coverage->line_words * line_count * sizeof(uint64_t));
+    for (LONG i = 0; i < line_count; i++) {
+        coverage->unclaimed_pixels[i] = abs(coverage->scratch_header.biWidth);
+    }
+    coverage->unclaimed_lines = line_count;
+}
+
+/*! \brief Deallocates the #COVERAGEMASK.
+
+    \param coverage Pointer to the mask.
+ */
+void destroy_coverage_mask(COVERAGEMASK *coverage)
+{
+    free(coverage->scratch_line);
+    free(coverage->unclaimed_pixels);
+    free(coverage->bits);
+}
+
+/*! \brief Finds the first pixel of a scanline of the #COVERAGEMASK within the given range which is (un)claimed.
+
+    \param line_bits Pointer to the mask of the scanline.
+    \param x Horizontal position of the first pixel of the range.
+    \param right_x Horizontal position of the last pixel of the range.
+    \param claimed Whether to look for a claimed pixel.
+
+    \return Horizontal position of the pixel or \a right_x + 1 if there is none.
+ */
+LONG find_coverage_bit(const uint64_t *line_bits, LONG x, const LONG right_x, const bool claimed)
+{
+    while (x <= right_x) {
+        uint64_t word = line_bits[x / 64];
+        word = (claimed ? word : ~word) >> (x % 64);
+        if (word != 0) {
+            x += __builtin_ctzll(word);
+            return x <= right_x ? x : right_x + 1;
+        }
+        x = (x | 63) + 1;
+    }
+    return right_x + 1;
+}
+
+/*! \brief Marks a range of pixels of a scanline of the #COVERAGEMASK as claimed.
+
+    \param line_bits Pointer to the mask of the scanline.
+    \param left_x Horizontal position of the first pixel of the range.
+    \param right_x Horizontal position of the last pixel of the range.
+ */
+void set_coverage_bits(uint64_t *line_bits, LONG left_x, const LONG right_x)
+{
+    while (left_x <= right_x) {
+        LONG word_end = (left_x | 63) < right_x ? (left_x | 63) : right_x,
+            length = word_end - left_x + 1;
+        line_bits[left_x / 64] |= (length == 64 ? UINT64_MAX : ((uint64_t)1 << length) - 1) << (left_x % 64);
+        left_x = word_end + 1;
+    }
+}
+
+//number of spans recorded by a #SPANBUFFER before they are drawn
+#define SPAN_BUFFER_CAPACITY (256 * 1024)
+
+/*! \brief Span of a triangle recorded by a #SPANBUFFER (arguments of draw_span()).
+ */
+typedef struct DEFERREDSPAN {
+    DWORD line_y;
+    LONG left_x;
+    LONG right_x;
+    DWORD left_color;
+    DWORD right_color;
+    //whether both ends have the same color (drawn with a pattern)
+    bool single_color;
+} DEFERREDSPAN;
+
+/*! \brief Arena of spans recorded from many triangles instead of drawing them at once.
+
+    On flush, the spans are sorted by scanline (keeping the submission order within each scanline,
+    so that the result is identical) and drawn row by row, so that each scanline of the bitmap is written
+    while it is in cache instead of being revisited by every triangle overlapping it.
+ */
+typedef struct SPANBUFFER {
+    BYTE *image_data;
+    BITMAPINFOHEADER *info_header;
+    //pending clear of the bitmap applied to the scanlines before their spans are drawn (or NULL)
+    DEFERREDCLEAR *deferred_clear;
+    DEFERREDSPAN *spans;
+    //spans sorted by scanline on flush
+    DEFERREDSPAN *sorted_spans;
+    size_t span_count;
+    //offsets of the spans of each scanline within sorted_spans (one more than the number of scanlines)
+    size_t *line_offsets;
+} SPANBUFFER;
+
+/*! \brief Deallocates the #SPANBUFFER (the recorded spans are discarded).
+
+    \param span_buffer Pointer to the buffer (may be NULL).
+ */
+void destroy_span_buffer(SPANBUFFER *span_buffer)
+{
+    if (span_buffer != NULL) {
+        free(span_buffer->line_offsets);
+        free(span_buffer->sorted_spans);
+        free(span_buffer->spans);
+        free(span_buffer);
+    }
+}
+
+/*! \brief Creates a #SPANBUFFER for the bitmap.
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param deferred_clear Pointer to the pending clear of the bitmap or NULL.
+
+    \return Pointer to the buffer or NULL on memory allocation failure.
+ */
+SPANBUFFER *create_span_buffer(BYTE *image_data, BITMAPINFOHEADER *info_header, DEFERREDCLEAR *deferred_clear)
+{
+    SPANBUFFER *span_buffer = calloc(1, sizeof(SPANBUFFER));
+    if (span_buffer == NULL) {
+        return NULL;
+    }
+    span_buffer->image_data = image_data;
+    span_buffer->info_header = info_header;
+    span_buffer->deferred_clear = deferred_clear;
+    span_buffer->spans = malloc(SPAN_BUFFER_CAPACITY * sizeof(DEFERREDSPAN));
+    span_buffer->sorted_spans = malloc(SPAN_BUFFER_CAPACITY * sizeof(DEFERREDSPAN));
+    span_buffer->line_offsets = malloc(((size_t)abs(info_header->biHeight) + 1) * sizeof(size_t));
+    if (span_buffer->spans == NULL || span_buffer->sorted_spans == NULL || span_buffer->line_offsets == NULL) {
+        destroy_span_buffer(span_buffer);
+        return NULL;
+    }
+    return span_buffer;
+}
+
+/*! \brief Draws the spans recorded by the #SPANBUFFER scanline by scanline and empties it
+    (without accounting the time, see flush_span_buffer()).
+
+    \param span_buffer Pointer to the buffer.
+ */
+void draw_recorded_spans(SPANBUFFER *span_buffer)
+{
+    BITMAPINFOHEADER *info_header = span_buffer->info_header;
+    LONG height = abs(info_header->biHeight);
+    size_t *offsets = span_buffer->line_offsets;
+
+    //stable counting sort by scanline
+    memset(offsets, 0, ((size_t)height + 1) * sizeof(size_t));
+    for (size_t i = 0; i < span_buffer->span_count; i++) {
+        offsets[span_buffer->spans[i].line_y + 1]++;
+    }
+    for (LONG i = 0; i < height; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    for (size_t i = 0; i < span_buffer->span_count; i++) {
+        span_buffer->sorted_spans[offsets[span_buffer->spans[i].line_y]++] = span_buffer->spans[i];
+    }
+
+    //draw row by row (the offsets now point at the end of the spans of each scanline)
+    BYTE pattern[FILL_PATTERN_BYTES];
+    DWORD pattern_color = UINT32_MAX;
+    DEFERREDCLEAR *deferred_clear = span_buffer->deferred_clear;
+    size_t first_span = 0;
+    for (LONG i = 0; i < height; i++) {
+        if (first_span == offsets[i]) {
+            continue;
+        }
+        if (deferred_clear != NULL && deferred_clear->row_generations[i] != deferred_clear->generation) {
+            apply_deferred_clear(span_buffer->image_data, info_header, deferred_clear, i, i, false);
+        }
+        for (size_t j = first_span; j < offsets[i]; j++) {
+            const DEFERREDSPAN *span = &span_buffer->sorted_spans[j];
+            if (span->single_color) {
+                if (span->left_color != pattern_color) {
+                    set_fill_pattern(pattern, info_header, span->left_color >> 16, span->left_color >> 8,
+                        span->left_color);
+                    pattern_color = span->left_color;
+                }
+                draw_flat_line(span_buffer->image_data, info_header, span->line_y, span->left_x, span->right_x,
+                    pattern);
+            } else {
+                draw_horizontal_line_proc(span_buffer->image_data, info_header, span->line_y, span->left_x,
+                    span->right_x, span->left_color, span->right_color);
+            }
+        }
+        first_span = offsets[i];
+    }
+    span_buffer->span_count = 0;
+}
+
+/*! \brief Draws the spans recorded by the #SPANBUFFER scanline by scanline and empties it.
+
+    \param span_buffer Pointer to the buffer (may be NULL).
+ */
+void flush_span_buffer(SPANBUFFER *span_buffer)
+{
+    if (span_buffer != NULL && span_buffer->span_count > 0) {
+        LONGLONG start_ticks = STATS_TICKS();
+        draw_recorded_spans(span_buffer);
+        STATS_ADD(thread_stats->spans.ticks, STATS_TICKS() - start_ticks);
+    }
+}
+
+/*! \brief Records a span in the #SPANBUFFER (see draw_span()), drawing the recorded spans first if it is full.
+
+    \param span_buffer Pointer to the buffer.
+    \param line_y Vertical position of the span (within the bitmap).
+    \param left_x Horizontal position of the left side of the span.
+    \param right_x Horizontal position of the right side of the span (not less than \a left_x).
+    \param left_color Color of the left side of the span (packed as 0x00RRGGBB).
+    \param right_color Color of the right side of the span (packed as 0x00RRGGBB).
+    \param single_color Whether the span is drawn with a pattern of \a left_color.
+ */
+void record_span(SPANBUFFER *span_buffer, const DWORD line_y, const LONG left_x, const LONG right_x,
+    const DWORD left_color, const DWORD right_color, const bool single_color)
+{
+    //drawn within the span time of the caller
+    if (span_buffer->span_count == SPAN_BUFFER_CAPACITY) {
+        draw_recorded_spans(span_buffer);
+    }
+    DEFERREDSPAN *span = &span_buffer->spans[span_buffer->span_count++];
+    span->line_y = line_y;
+    span->left_x = left_x;
+    span->right_x = right_x;
+    span->left_color = left_color;
+    span->right_color = right_color;
+    span->single_color = single_color;
+}
+
+/*! \brief Draws a span of a triangle on the bitmap, skipping the pixels claimed by later triangles.
+
+    Spans are drawn by draw_flat_line() if a pattern is given, by the selected line drawing kernel otherwise.
+    With a #SPANBUFFER, the span is recorded to be drawn later instead.
+    A span claimed partially is drawn by the kernel on a scratch scanline, from which the unclaimed pixels are copied,
+    so that their colors are exactly the same as if the whole span were drawn.
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param line_y Vertical position of the span.
+    \param left_x Horizontal position of the left side of the span.
+    \param right_x Horizontal position of the right side of the span (not less than \a left_x).
+    \param left_color Color of the left side of the span (packed as 0x00RRGGBB).
+    \param right_color Color of the right side of the span (packed as 0x00RRGGBB).
+    \param pattern Pattern of the color of the whole span prepared using set_fill_pattern() or NULL.
+    \param coverage Pointer to the mask of the pixels claimed by later triangles (updated) or NULL to draw the whole span.
+    \param span_buffer Pointer to the buffer recording the span instead of drawing it (see #SPANBUFFER) or NULL.
+ */
+void draw_span(BYTE *image_data, BITMAPINFOHEADER *info_header, const DWORD line_y, const LONG left_x, const LONG right_x,
+    const DWORD left_color, const DWORD right_color, const BYTE *pattern, COVERAGEMASK *coverage,
+    SPANBUFFER *span_buffer)
+{
+    if (span_buffer != NULL) {
+        record_span(span_buffer, line_y, left_x, right_x, left_color, right_color, pattern != NULL);
+        return;
+    }
+    LONG line = (LONG)line_y - (coverage != NULL ? coverage->first_line : 0),
+        visible_left = left_x > 0 ? left_x : 0,
+        visible_right = right_x < abs(info_header->biWidth) - 1 ? right_x : abs(info_header->biWidth) - 1;
+    uint64_t *line_bits = NULL;
+    LONG x = visible_left, run_end = visible_right + 1;
+    if (coverage != NULL) {
+        if (visible_left > visible_right || coverage->unclaimed_pixels[line] == 0) {
+            return;
+        }
+        line_bits = coverage->bits + line * coverage->line_words;
+        x = find_coverage_bit(line_bits, visible_left, visible_right, false);
+        if (x > visible_right) {
+            return;
+        }
+        run_end = find_coverage_bit(line_bits, x, visible_right, true);
+    }
+
+    LONG drawn_count = 0;
+    if (x == visible_left && run_end > visible_right) {
+        //no pixel of the span is claimed yet
+        if (pattern != NULL) {
+            draw_flat_line(image_data, info_header, line_y, left_x, right_x, pattern);
+        } else {
+            draw_horizontal_line_proc(image_data, info_header, line_y, left_x, right_x, left_color, right_color);
+        }
+        drawn_count = visible_right - visible_left + 1;
+    } else {
+        size_t pixel_size = info_header->biBitCount / 8;
+        BYTE *line_data = image_data + line_y * get_bitmap_stride(info_header->biWidth, info_header->biBitCount);
+        if (pattern == NULL) {
+            draw_horizontal_line_proc(coverage->scratch_line, &coverage->scratch_header, 0, left_x, right_x,
+                left_color, right_color);
+        }
+        //draw the runs of unclaimed pixels
+        while (x <= visible_right) {
+            if (pattern != NULL) {
+                draw_flat_line(image_data, info_header, line_y, x, run_end - 1, pattern);
+            } else {
+                memcpy(line_data + x * pixel_size, coverage->scratch_line + x * pixel_size, (run_end - x) * pixel_size);
+            }
+            drawn_count += run_end - x;
+            x = find_coverage_bit(line_bits, run_end, visible_right, false);
+            run_end = find_coverage_bit(line_bits, x, visible_right, true);
+        }
+    }
+    if (coverage != NULL) {
+        set_coverage_bits(line_bits, visible_left, visible_right);
+        coverage->unclaimed_pixels[line] -= drawn_count;
+        if (coverage->unclaimed_pixels[line] == 0) {
+            coverage->unclaimed_lines--;
+        }
+    }
+}
+
+//all the vertices have the same color
+#define TRIANGLE_COLORS_FLAT 0
+//the color changes only from scanline to scanline (both ends of every span have the same color)
+#define TRIANGLE_COLORS_VERTICAL 1
+#define TRIANGLE_COLORS_GENERAL 2
+
+/*! \brief Classifies the colors of a triangle, so that its spans can be drawn by a specialized function.
+
+    \param vertex_data Pointer to the sorted array of three VERTEXDATA structures describing a triangle.
+
+    \return One of the TRIANGLE_COLORS_* values.
+ */
+LONG classify_triangle_colors(const VERTEXDATA (*vertices)[3])
+{
+    const VERTEXDATA *v = *vertices;
+    LONGLONG channels[3][3] = {
+        {v[0].colR, v[1].colR, v[2].colR},
+        {v[0].colG, v[1].colG, v[2].colG},
+        {v[0].colB, v[1].colB, v[2].colB}
+    };
+    bool flat = true, vertical = v[0].posY < v[2].posY;
+    for (DWORD i = 0; i < 3; i++) {
+        flat &= channels[i][0] == channels[i][1] && channels[i][0] == channels[i][2];
+        //no horizontal gradient: the middle vertex has the color of the long edge at its scanline
+        //(the exact edge colors are then equal at every scanline, and so are the rounded ones)
+        vertical &= (channels[i][1] - channels[i][0]) * ((LONGLONG)v[2].posY - v[0].posY)
+            == (channels[i][2] - channels[i][0]) * ((LONGLONG)v[1].posY - v[0].posY);
+    }
+    return flat ? TRIANGLE_COLORS_FLAT : vertical ? TRIANGLE_COLORS_VERTICAL : TRIANGLE_COLORS_GENERAL;
+}
+
+/*! \brief Sets up the #EDGE structure for the given scanline, copying the cached setup if the edge begins there.
+
+    \param edge Pointer to the structure.
+    \param cached_edge Pointer to the edge set up for the scanline of its upper vertex (see set_edge()) or NULL.
+    \param begin Pointer to the upper vertex of the edge.
+    \param end Pointer to the lower vertex of the edge.
+    \param line_y Vertical position of the current scanline.
+ */
+void load_edge(EDGE *edge, const EDGE *cached_edge, const VERTEXDATA *begin, const VERTEXDATA *end, const LONG line_y)
+{
+    if (cached_edge != NULL && line_y == begin->posY) {
+        memcpy(edge, cached_edge, sizeof(EDGE));
+    } else {
+        set_edge(edge, begin, end, line_y);
+    }
+}
+
+/*! \brief Draws the part of a triangle lying within the given band of scanlines, reusing the cached setup of its edges.
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param vertex_data Pointer to the sorted array of three VERTEXDATA structures describing a triangle.
+    \param edges Pointer to the array of the cached edges v0-v2, v0-v1 and v1-v2 (see load_edge()) or NULL.
+    \param first_line Vertical position of the first scanline of the band.
+    \param last_line Vertical position of the last scanline of the band.
+    \param deferred_clear Pointer to the pending clear of the bitmap (applied to the scanlines drawn on) or NULL.
+    \param coverage Pointer to the mask of the pixels claimed by later triangles (see draw_span()) or NULL.
+    \param span_buffer Pointer to the buffer recording the spans instead of drawing them (see draw_span()) or NULL.
+
+    \warning Vertices must be sorted using sort_triangle_vertices() and the band must lie within the bitmap.
+        No input correctness checks are performed.
+ */
+void draw_triangle_band_cached(BYTE *image_data, BITMAPINFOHEADER *info_header, VERTEXDATA (*vertices)[3],
+    const EDGE *const *edges, const LONG first_line, const LONG last_line, DEFERREDCLEAR *deferred_clear,
+    COVERAGEMASK *coverage, SPANBUFFER *span_buffer)
+{
+    LONG min_y = (*vertices)[0].posY, max_y = (*vertices)[2].posY;
+    if (min_y < first_line) {
+        min_y = first_line;
+    }
+    if (max_y > last_line) {
+        max_y = last_line;
+    }
+    if (min_y > max_y) {
+        return;
+    }
+    LONGLONG start_ticks = STATS_TICKS(), span_ticks = 0, pixel_count = 0, culled_count = 0;
+    //spans of a single color are filled with a pattern instead of being interpolated
+    bool single_color_spans = classify_triangle_colors(vertices) != TRIANGLE_COLORS_GENERAL;
+    BYTE pattern[FILL_PATTERN_BYTES];
+    DWORD pattern_color = UINT32_MAX;
+
+    //the long edge spans all the scanlines, the short one is switched at the middle vertex
+    EDGE long_edge, short_edge;
+    const EDGE *no_edges[3] = {NULL, NULL, NULL};
+    if (edges == NULL) {
+        edges = no_edges;
+    }
+    load_edge(&long_edge, edges[0], &(*vertices)[0], &(*vertices)[2], min_y);
+    if (min_y < (*vertices)[1].posY) {
+        load_edge(&short_edge, edges[1], &(*vertices)[0], &(*vertices)[1], min_y);
+    } else {
+        load_edge(&short_edge, edges[2], &(*vertices)[1], &(*vertices)[2], min_y);
+    }
+
+    for (LONG i = min_y; i <= max_y; i++) {
+        if (i == (*vertices)[1].posY && i != min_y) {
+            load_edge(&short_edge, edges[2], &(*vertices)[1], &(*vertices)[2], i);
+        }
+        LONG short_x = round_edge_value(&short_edge.x),
+            long_x = round_edge_value(&long_edge.x);
+#ifndef NO_STATS
+        LONGLONG span_start_ticks = read_tsc();
+#endif
+        if (deferred_clear != NULL && deferred_clear->row_generations[i] != deferred_clear->generation) {
+            apply_deferred_clear(image_data, info_header, deferred_clear, i, i, false);
+        }
+        if (single_color_spans) {
+            DWORD color = get_edge_color(&long_edge);
+            if (color != pattern_color) {
+                set_fill_pattern(pattern, info_header, color >> 16, color >> 8, color);
+                pattern_color = color;
+            }
+            draw_span(image_data, info_header, (DWORD)i, short_x < long_x ? short_x : long_x,
+                short_x < long_x ? long_x : short_x, color, color, pattern, coverage, span_buffer);
+        } else if (short_x <= long_x) {
+            draw_span(image_data, info_header, (DWORD)i,
+                short_x, long_x, get_edge_color(&short_edge), get_edge_color(&long_edge), NULL, coverage, span_buffer);
+        } else {
+            draw_span(image_data, info_header, (DWORD)i,
+                long_x, short_x, get_edge_color(&long_edge), get_edge_color(&short_edge), NULL, coverage, span_buffer);
+        }
+#ifndef NO_STATS
+        span_ticks += read_tsc() - span_start_ticks;
+        LONG width = abs(info_header->biWidth);
+        LONG visible_left = short_x < long_x ? short_x : long_x,
+            visible_right = short_x < long_x ? long_x : short_x;
+        visible_left = visible_left > 0 ? visible_left : 0;
+        visible_right = visible_right < width - 1 ? visible_right : width - 1;
+        if (visible_left <= visible_right) {
+            pixel_count += visible_right - visible_left + 1;
+        } else {
+            culled_count++;
+        }
+#endif
+        step_edge(&short_edge);
+        step_edge(&long_edge);
+    }
+    STATS_ADD(thread_stats->setup.calls, 1);
+    STATS_ADD(thread_stats->setup.rows, max_y - min_y + 1);
+    STATS_ADD(thread_stats->setup.ticks, STATS_TICKS() - start_ticks - span_ticks);
+    STATS_ADD(thread_stats->spans.calls, max_y - min_y + 1);
+    STATS_ADD(thread_stats->spans.pixels, pixel_count);
+    STATS_ADD(thread_stats->spans.culled, culled_count);
+    STATS_ADD(thread_stats->spans.ticks, span_ticks);
+}
+
+/*! \brief Draws the part of a triangle lying within the given band of scanlines.
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param vertex_data Pointer to the sorted array of three VERTEXDATA structures describing a triangle.
+    \param first_line Vertical position of the first scanline of the band.
+    \param last_line Vertical position of the last scanline of the band.
+    \param deferred_clear Pointer to the pending clear of the bitmap (applied to the scanlines drawn on) or NULL.
+    \param coverage Pointer to the mask of the pixels claimed by later triangles (see draw_span()) or NULL.
+    \param span_buffer Pointer to the buffer recording the spans instead of drawing them (see draw_span()) or NULL.
+
+    \warning Vertices must be sorted using sort_triangle_vertices() and the band must lie within the bitmap.
+        No input correctness checks are performed.
+ */
+void draw_triangle_band(BYTE *image_data, BITMAPINFOHEADER *info_header, VERTEXDATA (*vertices)[3],
+    const LONG first_line, const LONG last_line, DEFERREDCLEAR *deferred_clear, COVERAGEMASK *coverage,
+    SPANBUFFER *span_buffer)
+{
+    draw_triangle_band_cached(image_data, info_header, vertices, NULL, first_line, last_line, deferred_clear,
+        coverage, span_buffer);
+}
+
+//size of the square blocks of pixels classified at once by draw_triangle_band_halfspace()
+#define HALFSPACE_BLOCK_SIZE 8
+//triangles with larger coordinates are drawn by draw_triangle_band() (the edge functions could overflow)
+#define HALFSPACE_MAX_COORDINATE (1 << 24)
+
+/*! \brief Describes an edge function of a triangle (see draw_triangle_band_halfspace()).
+
+    The function is linear in pixel coordinates: \a constant + \a step_x * x + \a step_y * y,
+    positive for the pixels on the inner side of the edge.
+ */
+typedef struct HALFSPACEEDGE {
+    LONGLONG constant;
+    LONGLONG step_x;
+    LONGLONG step_y;
+    //whether pixels with zero value (except for the first column) lie on the inner side as well
+    bool inclusive;
+} HALFSPACEEDGE;
+
+/*! \brief Sets up the #HALFSPACEEDGE structure.
+
+    The function reproduces the rounding of the edge positions done by draw_triangle_band():
+    for a left edge, it is positive where the rounded position of the edge is not greater than x,
+    for a right edge, where it is not less than x.
+
+    \param edge Pointer to the structure.
+    \param begin Pointer to the upper vertex of the edge.
+    \param end Pointer to the lower vertex of the edge (lying strictly below the upper one).
+    \param right Whether the interior of the triangle lies on the left side of the edge.
+ */
+void set_halfspace_edge(HALFSPACEEDGE *edge, const VERTEXDATA *begin, const VERTEXDATA *end, const bool right)
+{
+    //round(edge_x(y)) <= x  <=>  (2 * x + 1) * dy - 2 * dx * (y - begin_y) - 2 * begin_x * dy > 0
+    LONGLONG dx = (LONGLONG)end->posX - begin->posX,
+        dy = (LONGLONG)end->posY - begin->posY;
+    edge->constant = dy - 2 * begin->posX * dy + 2 * dx * begin->posY;
+    edge->step_x = 2 * dy;
+    edge->step_y = -2 * dx;
+    edge->inclusive = right;
+    if (right) {
+        //x <= round(edge_x(y))  <=>  not round(edge_x(y)) <= x - 1
+        edge->constant = 2 * dy - edge->constant;
+        edge->step_x = -edge->step_x;
+        edge->step_y = -edge->step_y;
+    }
+}
+
+/*! \brief Divides two integers rounding the quotient down (C division truncates towards zero).
+
+    \param dividend Dividend.
+    \param divisor Divisor (positive).
+
+    \return Quotient.
+ */
+LONGLONG floor_divide(const LONGLONG dividend, const LONGLONG divisor)
+{
+    LONGLONG quotient = dividend / divisor;
+    return dividend % divisor < 0 ? quotient - 1 : quotient;
+}
+
+/*! \brief Tests whether a pixel lies inside all the half-spaces bounded by the edges of a triangle.
+
+    \param edges Array of the edge functions.
+    \param edge_count Number of the edge functions.
+    \param values Values of the edge functions at the pixel.
+    \param x Horizontal position of the pixel.
+
+    \return Whether the pixel lies inside the triangle.
+ */
+bool is_inside_halfspaces(const HALFSPACEEDGE *edges, const DWORD edge_count, const LONGLONG *values, const LONG x)
+{
+    for (DWORD k = 0; k < edge_count; k++) {
+        if (values[k] < 0 || values[k] == 0 && (!edges[k].inclusive || x == 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*! \brief Classifies a block of pixels using the edge functions of a triangle and extends the covered parts
+    of its scanlines by the pixels of the block lying inside the triangle.
+
+    \param edges Array of the edge functions.
+    \param edge_count Number of the edge functions.
+    \param block_x Horizontal position of the left column of the block.
+    \param block_y Vertical position of the top scanline of the block.
+    \param max_x Horizontal position of the last column to be considered.
+    \param rows Number of scanlines of the block.
+    \param left Array of the left ends of the covered parts of the scanlines.
+    \param right Array of the right ends of the covered parts of the scanlines.
+
+    \return Whether the block lies entirely inside the triangle.
+ */
+bool cover_halfspace_block(const HALFSPACEEDGE *edges, const DWORD edge_count, const LONG block_x, const LONG block_y,
+    const LONG max_x, const LONG rows, LONG *left, LONG *right)
+{
+    LONG columns = max_x - block_x + 1 < HALFSPACE_BLOCK_SIZE ? max_x - block_x + 1 : HALFSPACE_BLOCK_SIZE;
+    //the extremes of the edge functions lie in the corners of the block
+    bool accepted = true;
+    for (DWORD k = 0; k < edge_count; k++) {
+        const HALFSPACEEDGE *edge = &edges[k];
+        LONGLONG corner = edge->constant + edge->step_x * block_x + edge->step_y * block_y,
+            dx = edge->step_x * (columns - 1), dy = edge->step_y * (rows - 1),
+            minimum = corner + (dx < 0 ? dx : 0) + (dy < 0 ? dy : 0),
+            maximum = corner + (dx > 0 ? dx : 0) + (dy > 0 ? dy : 0);
+        if (maximum < 0) {
+            return false;
+        }
+        accepted &= minimum > 0;
+    }
+    for (LONG j = 0; j < rows; j++) {
+        LONG y = block_y + j;
+        if (accepted) {
+            left[j] = block_x < left[j] ? block_x : left[j];
+            right[j] = block_x + columns - 1 > right[j] ? block_x + columns - 1 : right[j];
+            continue;
+        }
+        //partially covered block: find the first and last pixel of the scanline lying inside
+        LONGLONG values[3];
+        for (DWORD k = 0; k < edge_count; k++) {
+            values[k] = edges[k].constant + edges[k].step_x * block_x + edges[k].step_y * y;
+        }
+        LONG first_x = block_x, last_x = block_x + columns - 1;
+        while (first_x <= last_x && !is_inside_halfspaces(edges, edge_count, values, first_x)) {
+            for (DWORD k = 0; k < edge_count; k++) {
+                values[k] += edges[k].step_x;
+            }
+            first_x++;
+        }
+        if (first_x > last_x) {
+            continue;
+        }
+        for (DWORD k = 0; k < edge_count; k++) {
+            values[k] += edges[k].step_x * (last_x - first_x);
+        }
+        while (!is_inside_halfspaces(edges, edge_count, values, last_x)) {
+            for (DWORD k = 0; k < edge_count; k++) {
+                values[k] -= edges[k].step_x;
+            }
+            last_x--;
+        }
+        left[j] = first_x < left[j] ? first_x : left[j];
+        right[j] = last_x > right[j] ? last_x : right[j];
+    }
+    return accepted;
+}
+
+/*! \brief Draws the part of a triangle lying within the given band of scanlines using edge functions
+    (alternative to draw_triangle_band()).
+
+    The bounding box of the triangle is divided into blocks of #HALFSPACE_BLOCK_SIZE pixels squared.
+    The edge functions are evaluated at the corners of each block, so that blocks lying outside the triangle
+    are skipped and blocks lying inside are accepted without testing their pixels; only the pixels
+    of the remaining blocks are tested one by one. The covered pixels are identical to the ones
+    of draw_triangle_band(). The covered part of each scanline is then filled by the line drawing kernel
+    with colors interpolated across the triangle (barycentric), which may differ from the colors interpolated
+    along the edges by up to 9 per component in narrow triangles with steep color gradients (the bound verified
+    by make check, see HALFSPACE_MAX_ERROR in check.c).
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param vertex_data Pointer to the sorted array of three VERTEXDATA structures describing a triangle.
+    \param first_line Vertical position of the first scanline of the band.
+    \param last_line Vertical position of the last scanline of the band.
+    \param deferred_clear Pointer to the pending clear of the bitmap (applied to the scanlines drawn on) or NULL.
+    \param coverage Pointer to the mask of the pixels claimed by later triangles (see draw_span()) or NULL.
+    \param span_buffer Pointer to the buffer recording the spans instead of drawing them (see draw_span()) or NULL.
+
+    \warning Vertices must be sorted using sort_triangle_vertices() and the band must lie within the bitmap.
+        No input correctness checks are performed.
+ */
+void draw_triangle_band_halfspace(BYTE *image_data, BITMAPINFOHEADER *info_header, VERTEXDATA (*vertices)[3],
+    const LONG first_line, const LONG last_line, DEFERREDCLEAR *deferred_clear, COVERAGEMASK *coverage,
+    SPANBUFFER *span_buffer)
+{
+    const VERTEXDATA *v = *vertices;
+    LONGLONG determinant = ((LONGLONG)v[1].posX - v[0].posX) * ((LONGLONG)v[2].posY - v[0].posY)
+        - ((LONGLONG)v[2].posX - v[0].posX) * ((LONGLONG)v[1].posY - v[0].posY);
+    bool out_of_range = false;
+    for (DWORD i = 0; i < 3; i++) {
+        out_of_range |= abs(v[i].posX) > HALFSPACE_MAX_COORDINATE || abs(v[i].posY) > HALFSPACE_MAX_COORDINATE;
+    }
+    if (determinant == 0 || out_of_range) {
+        //degenerate triangles (drawn as lines) and very large ones are left to the scanline rasterizer
+        draw_triangle_band(image_data, info_header, vertices, first_line, last_line, deferred_clear,
+            coverage, span_buffer);
+        return;
+    }
+
+    //bounding box clipped to the band and bitmap
+    LONG width = abs(info_header->biWidth),
+        min_y = v[0].posY > first_line ? v[0].posY : first_line,
+        max_y = v[2].posY < last_line ? v[2].posY : last_line,
+        min_x = v[0].posX, max_x = v[0].posX;
+    for (DWORD i = 1; i < 3; i++) {
+        min_x = v[i].posX < min_x ? v[i].posX : min_x;
+        max_x = v[i].posX > max_x ? v[i].posX : max_x;
+    }
+    min_x = min_x > 0 ? min_x : 0;
+    max_x = max_x < width - 1 ? max_x : width - 1;
+    if (min_y > max_y || min_x > max_x) {
+        return;
+    }
+    LONGLONG start_ticks = STATS_TICKS(), span_ticks = 0, span_count = 0, pixel_count = 0;
+
+    //the middle vertex lies on the left of the long edge if the determinant is negative
+    HALFSPACEEDGE edges[3];
+    DWORD edge_count = 0;
+    bool middle_left = determinant < 0;
+    set_halfspace_edge(&edges[edge_count++], &v[0], &v[2], middle_left);
+    //horizontal edges only bound the scanlines
+    if (v[0].posY < v[1].posY) {
+        set_halfspace_edge(&edges[edge_count++], &v[0], &v[1], !middle_left);
+    }
+    if (v[1].posY < v[2].posY) {
+        set_halfspace_edge(&edges[edge_count++], &v[1], &v[2], !middle_left);
+    }
+
+    //spans of a single color (zero horizontal gradient) are filled with a pattern
+    bool single_color_spans = classify_triangle_colors(vertices) != TRIANGLE_COLORS_GENERAL;
+    BYTE pattern[FILL_PATTERN_BYTES];
+    DWORD pattern_color = UINT32_MAX;
+
+    //color gradients (plane equations through the vertex colors)
+    double gradient_x[3], gradient_y[3], first_color[3];
+    for (DWORD i = 0; i < 3; i++) {
+        //red, green and blue
+        double c0 = i == 0 ? v[0].colR : i == 1 ? v[0].colG : v[0].colB,
+            c1 = i == 0 ? v[1].colR : i == 1 ? v[1].colG : v[1].colB,
+            c2 = i == 0 ? v[2].colR : i == 1 ? v[2].colG : v[2].colB;
+        gradient_x[i] = ((c1 - c0) * ((double)v[2].posY - v[0].posY) - (c2 - c0) * ((double)v[1].posY - v[0].posY))
+            / determinant;
+        gradient_y[i] = ((c2 - c0) * ((double)v[1].posX - v[0].posX) - (c1 - c0) * ((double)v[2].posX - v[0].posX))
+            / determinant;
+        first_color[i] = c0;
+    }
+
+    for (LONG block_y = min_y; block_y <= max_y; block_y += HALFSPACE_BLOCK_SIZE) {
+        LONG rows = max_y - block_y + 1 < HALFSPACE_BLOCK_SIZE ? max_y - block_y + 1 : HALFSPACE_BLOCK_SIZE;
+        //covered part of each scanline of the block row (empty if left > right)
+        LONG left[HALFSPACE_BLOCK_SIZE], right[HALFSPACE_BLOCK_SIZE];
+        for (LONG j = 0; j < rows; j++) {
+            left[j] = max_x + 1;
+            right[j] = min_x - 1;
+        }
+
+        //skip the blocks rejected by any edge (where its function is negative in the whole column of the block row)
+        LONGLONG first_x = min_x, last_x = max_x;
+        for (DWORD k = 0; k < edge_count; k++) {
+            const HALFSPACEEDGE *edge = &edges[k];
+            LONGLONG row_maximum = edge->constant + edge->step_y * (edge->step_y > 0 ? block_y + rows - 1 : block_y);
+            //the horizontal step is never zero, as the horizontal edges are skipped
+            if (edge->step_x > 0) {
+                LONGLONG x = -floor_divide(row_maximum, edge->step_x);
+                first_x = x > first_x ? x : first_x;
+            } else {
+                LONGLONG x = floor_divide(row_maximum, -edge->step_x);
+                last_x = x < last_x ? x : last_x;
+            }
+        }
+        if (first_x > last_x) {
+            continue;
+        }
+        //the covered part of the block row is convex, so only the blocks at its ends need to be classified:
+        //once a block is accepted from each side, all the blocks between them are accepted as well
+        LONG first_block = (first_x - min_x) / HALFSPACE_BLOCK_SIZE, last_block = (last_x - min_x) / HALFSPACE_BLOCK_SIZE;
+        bool accepted = false;
+        for (; first_block <= last_block && !accepted; first_block++) {
+            accepted = cover_halfspace_block(edges, edge_count, min_x + first_block * HALFSPACE_BLOCK_SIZE, block_y,
+                max_x, rows, left, right);
+        }
+        for (; last_block >= first_block && accepted; last_block--) {
+            if (cover_halfspace_block(edges, edge_count, min_x + last_block * HALFSPACE_BLOCK_SIZE, block_y,
+                max_x, rows, left, right)) {
+                break;
+            }
+        }
+        if (accepted) {
+            LONG end_x = min_x + (last_block + 1) * HALFSPACE_BLOCK_SIZE - 1;
+            end_x = end_x < max_x ? end_x : max_x;
+            for (LONG j = 0; j < rows; j++) {
+                right[j] = end_x > right[j] ? end_x : right[j];
+            }
+        }
+
+        for (LONG j = 0; j < rows; j++) {
+            if (left[j] > right[j]) {
+                continue;
+            }
+            LONG y = block_y + j;
+            DWORD colors[2] = {0, 0};
+            for (DWORD i = 0; i < 3; i++) {
+                for (DWORD k = 0; k < 2; k++) {
+                    //relative to the first vertex, so that the colors do not depend on the translation (see draw_tiled_triangles())
+                    double value = first_color[i] + gradient_x[i] * ((k == 0 ? left[j] : right[j]) - v[0].posX)
+                        + gradient_y[i] * (y - v[0].posY);
+                    value = value < 0 ? 0 : value > 255 ? 255 : value;
+                    colors[k] |= (DWORD)(value + 0.5) << (16 - 8 * i);
+                }
+            }
+#ifndef NO_STATS
+            LONGLONG span_start_ticks = read_tsc();
+#endif
+            if (deferred_clear != NULL && deferred_clear->row_generations[y] != deferred_clear->generation) {
+                apply_deferred_clear(image_data, info_header, deferred_clear, y, y, false);
+            }
+            if (single_color_spans) {
+                if (colors[0] != pattern_color) {
+                    set_fill_pattern(pattern, info_header, colors[0] >> 16, colors[0] >> 8, colors[0]);
+                    pattern_color = colors[0];
+                }
+                draw_span(image_data, info_header, (DWORD)y, left[j], right[j], colors[0], colors[0], pattern,
+                    coverage, span_buffer);
+            } else {
+                draw_span(image_data, info_header, (DWORD)y, left[j], right[j], colors[0], colors[1], NULL,
+                    coverage, span_buffer);
+            }
+#ifndef NO_STATS
+            span_ticks += read_tsc() - span_start_ticks;
+            span_count++;
+            pixel_count += right[j] - left[j] + 1;
+#endif
+        }
+    }
+    STATS_ADD(thread_stats->setup.calls, 1);
+    STATS_ADD(thread_stats->setup.rows, max_y - min_y + 1);
+    STATS_ADD(thread_stats->setup.ticks, STATS_TICKS() - start_ticks - span_ticks);
+    STATS_ADD(thread_stats->spans.calls, span_count);
+    STATS_ADD(thread_stats->spans.pixels, pixel_count);
+    STATS_ADD(thread_stats->spans.ticks, span_ticks);
+}
+
+/*! \brief Pointer to a function with the same signature as draw_triangle_band().
+ */
+typedef void (*DRAWTRIANGLEPROC)(BYTE *image_data, BITMAPINFOHEADER *info_header, VERTEXDATA (*vertices)[3],
+    const LONG first_line, const LONG last_line, DEFERREDCLEAR *deferred_clear, COVERAGEMASK *coverage,
+    SPANBUFFER *span_buffer);
+
+/*! \brief Pointer to a function with the same signature as draw_triangle_band_cached().
+ */
+typedef void (*DRAWCACHEDTRIANGLEPROC)(BYTE *image_data, BITMAPINFOHEADER *info_header, VERTEXDATA (*vertices)[3],
+    const EDGE *const *edges, const LONG first_line, const LONG last_line, DEFERREDCLEAR *deferred_clear,
+    COVERAGEMASK *coverage, SPANBUFFER *span_buffer);
+
+/*! \brief Describes one of the available triangle rasterizers.
+ */
+typedef struct RASTERIZER {
+    const char *name;
+    DRAWTRIANGLEPROC proc;
+    //variant reusing cached edges (NULL if the rasterizer does not step edges)
+    DRAWCACHEDTRIANGLEPROC cached_proc;
+} RASTERIZER;
+
+const RASTERIZER rasterizers[RASTERIZER_COUNT] = {
+    {"scanline", draw_triangle_band, draw_triangle_band_cached},
+    {"halfspace", draw_triangle_band_halfspace, NULL}
+};
+
+//functions used for drawing triangles on the calling thread (those of the canvas it draws on)
+__thread DRAWTRIANGLEPROC draw_triangle_band_proc = draw_triangle_band;
+__thread DRAWCACHEDTRIANGLEPROC draw_triangle_band_cached_proc = draw_triangle_band_cached;
+
+/*! \brief Finds a triangle rasterizer by name.
+
+    \param name Name of the rasterizer (scanline or halfspace).
+
+    \return One of the RASTERIZER_* indices or -1 if there is no such rasterizer.
+ */
+LONG find_rasterizer(const char *name)
+{
+    for (LONG j = 0; name != NULL && j < RASTERIZER_COUNT; j++) {
+        if (strcmp(name, rasterizers[j].name) == 0) {
+            return j;
+        }
+    }
+    return -1;
+}
+
+/*! \brief Provides the name of a triangle rasterizer.
+
+    \param rasterizer One of the RASTERIZER_* indices.
+
+    \return Name of the rasterizer or NULL if the index is incorrect.
+ */
+const char *get_rasterizer_name(const LONG rasterizer)
+{
+    return rasterizer >= 0 && rasterizer < RASTERIZER_COUNT ? rasterizers[rasterizer].name : NULL;
+}
+
+/*! \brief Selects the triangle rasterizer of the canvases created afterwards (see set_canvas_rasterizer()).
+
+    \param rasterizer One of the RASTERIZER_* indices.
+
+    \return Zero on success, -1 if the index is incorrect.
+ */
+LONG select_rasterizer(const LONG rasterizer)
+{
+    if (rasterizer < 0 || rasterizer >= RASTERIZER_COUNT) {
+        return -1;
+    }
+    default_settings.rasterizer = rasterizer;
+    return 0;
+}
+
+/*! \brief Draws a triangle on the bitmap.
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param vertex_data Pointer to the array of three VERTEXDATA structures describing a triangle (sorted in place).
+
+    \return Zero on success, -1 if any argument is a null pointer.
+ */
+LONG draw_triangle(BYTE *image_data, BITMAPINFOHEADER *info_header, VERTEXDATA (*vertices)[3])
+{
+    if (image_data == NULL || info_header == NULL || vertices == NULL) {
+        return -1;
+    }
+
+    sort_triangle_vertices(vertices);
+    draw_triangle_band_proc(image_data, info_header, vertices, 0, abs(info_header->biHeight) - 1, NULL, NULL, NULL);
+    return 0;
+}
+
+/*! \brief Calculates the range of tiles overlapped by the bounding box of a triangle.
+
+    \param vertex_data Pointer to the sorted array of three VERTEXDATA structures describing a triangle.
+    \param width Width of the bitmap.
+    \param first_line Vertical position of the first scanline of the first tile.
+    \param last_line Vertical position of the last scanline of the last tile.
+    \param tile_height Number of scanlines in a tile.
+    \param first_tile Pointer for storing the index of the first overlapped tile.
+    \param last_tile Pointer for storing the index of the last overlapped tile.
+
+    \return False if the triangle lies outside the tiles (or the bitmap), true otherwise.
+ */
+bool get_triangle_tiles(VERTEXDATA (*vertices)[3], const LONG width, const LONG first_line, const LONG last_line,
+    const LONG tile_height, LONG *first_tile, LONG *last_tile)
+{
+    LONG min_x = (*vertices)[0].posX, max_x = (*vertices)[0].posX;
+    for (DWORD i = 1; i < 3; i++) {
+        if ((*vertices)[i].posX < min_x) {
+            min_x = (*vertices)[i].posX;
+        }
+        if ((*vertices)[i].posX > max_x) {
+            max_x = (*vertices)[i].posX;
+        }
+    }
+    LONG min_y = (*vertices)[0].posY, max_y = (*vertices)[2].posY;
+    if (max_x < 0 || min_x >= width || max_y < first_line || min_y > last_line) {
+        return false;
+    }
+    if (min_y < first_line) {
+        min_y = first_line;
+    }
+    if (max_y > last_line) {
+        max_y = last_line;
+    }
+    *first_tile = (min_y - first_line) / tile_height;
+    *last_tile = (max_y - first_line) / tile_height;
+    return true;
+}
+
+//approximate size of a tile (a band of whole scanlines) meant to fit in L2 cache
+#define TILE_BYTES (256 * 1024)
+
+/*! \brief Bins triangles into the tiles overlapped by their bounding boxes.
+
+    Indices of the triangles overlapping tile \a j are stored in submission order
+    in (*bins)[(*bin_offsets)[j]] to (*bins)[(*bin_offsets)[j + 1] - 1].
+
+    \param triangles Pointer to the array of triangles with sorted vertices.
+    \param triangle_count Number of triangles.
+    \param width Width of the bitmap.
+    \param first_line Vertical position of the first scanline of the first tile.
+    \param last_line Vertical position of the last scanline of the last tile.
+    \param tile_height Number of scanlines in a tile.
+    \param tile_count Number of tiles.
+    \param bin_offsets Pointer for storing the array of \a tile_count + 1 bin offsets (to be freed by the caller).
+    \param bins Pointer for storing the array of triangle indices (to be freed by the caller).
+
+    \return True on success, false on memory allocation failure.
+ */
+bool bin_triangles(VERTEXDATA (*triangles)[3], const DWORD triangle_count, const LONG width,
+    const LONG first_line, const LONG last_line, const LONG tile_height, const LONG tile_count,
+    size_t **bin_offsets, DWORD **bins)
+{
+    //count triangles overlapping each tile
+    size_t *offsets = calloc(tile_count + 1, sizeof(size_t));
+    if (offsets == NULL) {
+        return false;
+    }
+    for (DWORD i = 0; i < triangle_count; i++) {
+        LONG first_tile, last_tile;
+        if (get_triangle_tiles(&triangles[i], width, first_line, last_line, tile_height, &first_tile, &last_tile)) {
+            for (LONG j = first_tile; j <= last_tile; j++) {
+                offsets[j + 1]++;
+            }
+        }
+    }
+    for (LONG j = 0; j < tile_count; j++) {
+        offsets[j + 1] += offsets[j];
+    }
+
+    //fill the bins preserving submission order
+    DWORD *indices = malloc((offsets[tile_count] > 0 ? offsets[tile_count] : 1) * sizeof(DWORD));
+    size_t *bin_lengths = calloc(tile_count, sizeof(size_t));
+    if (indices == NULL || bin_lengths == NULL) {
+        free(bin_lengths);
+        free(indices);
+        free(offsets);
+        return false;
+    }
+    for (DWORD i = 0; i < triangle_count; i++) {
+        LONG first_tile, last_tile;
+        if (get_triangle_tiles(&triangles[i], width, first_line, last_line, tile_height, &first_tile, &last_tile)) {
+            for (LONG j = first_tile; j <= last_tile; j++) {
+                indices[offsets[j] + bin_lengths[j]] = i;
+                bin_lengths[j]++;
+            }
+        }
+    }
+    free(bin_lengths);
+    *bin_offsets = offsets;
+    *bins = indices;
+    return true;
+}
+
+/*! \brief Draws the part of one of the triangles lying within the given band of scanlines
+    using the selected rasterizer, reusing the cached edges of the triangle if available.
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param triangles Pointer to the array of triangles with sorted vertices.
+    \param edges Pointer to the array of the cached edges of the triangles (see draw_triangle_band_cached()) or NULL.
+    \param index Index of the triangle.
+    \param first_line Vertical position of the first scanline of the band.
+    \param last_line Vertical position of the last scanline of the band.
+    \param deferred_clear Pointer to the pending clear of the bitmap (see draw_triangle_band()) or NULL.
+    \param coverage Pointer to the mask of the pixels claimed by later triangles (see draw_span()) or NULL.
+    \param span_buffer Pointer to the buffer recording the spans instead of drawing them (see draw_span()) or NULL.
+ */
+void draw_triangle_band_any(BYTE *image_data, BITMAPINFOHEADER *info_header, VERTEXDATA (*triangles)[3],
+    const EDGE *(*edges)[3], const DWORD index, const LONG first_line, const LONG last_line,
+    DEFERREDCLEAR *deferred_clear, COVERAGEMASK *coverage, SPANBUFFER *span_buffer)
+{
+    if (edges != NULL && draw_triangle_band_cached_proc != NULL) {
+        draw_triangle_band_cached_proc(image_data, info_header, &triangles[index], edges[index],
+            first_line, last_line, deferred_clear, coverage, span_buffer);
+    } else {
+        draw_triangle_band_proc(image_data, info_header, &triangles[index], first_line, last_line, deferred_clear,
+            coverage, span_buffer);
+    }
+}
+
+//number of triangles set up at once by setup_triangles()
+#define SETUP_BLOCK_SIZE 8
+//maximal absolute value of the coordinates of the triangles set up by setup_triangles() (so that the deltas fit in 32 bits)
+#define SETUP_MAX_COORDINATE (1 << 24)
+
+/*! \brief Block of triangles stored as structure of arrays for sort_triangles() and setup_triangles().
+
+    The layout is shared with setup_triangles.asm.
+ */
+typedef struct SETUPBLOCK {
+    //channels (y, x, red, green, blue) of the vertices of the triangles
+    LONG vertices[3][5][SETUP_BLOCK_SIZE];
+    //steps of the channels (x, red, green, blue) of the edges v0-v2, v0-v1 and v1-v2 (see #EDGEVALUE)
+    LONG steps[3][4][SETUP_BLOCK_SIZE];
+    LONG step_remainders[3][4][SETUP_BLOCK_SIZE];
+    LONG denominators[3][SETUP_BLOCK_SIZE];
+} SETUPBLOCK;
+
+/*! \brief Sorts the vertices of the triangles of the block like sort_triangle_vertices() using SSE2 instructions
+    (see setup_triangles.asm).
+
+    \param block Pointer to the block.
+ */
+extern void sort_triangles(SETUPBLOCK *block);
+
+/*! \brief Calculates the steps of the edges of the triangles of the block like set_edge_value()
+    using SSE2 instructions (see setup_triangles.asm).
+
+    \param block Pointer to the block.
+
+    \warning Vertices must be sorted and all the coordinates must lie within
+        [-#SETUP_MAX_COORDINATE, #SETUP_MAX_COORDINATE]. No input correctness checks are performed.
+ */
+extern void setup_triangles(SETUPBLOCK *block);
+
+/*! \brief Stores the triangles in the #SETUPBLOCK (unused lanes are filled with degenerate triangles).
+
+    \param block Pointer to the block.
+    \param triangles Pointer to the array of triangles.
+    \param indices Pointer to the array of indices of the triangles stored in consecutive lanes.
+    \param lane_count Number of the triangles (at most #SETUP_BLOCK_SIZE).
+    \param in_range Array for storing whether the coordinates of the triangles lie within #SETUP_MAX_COORDINATE (or NULL).
+ */
+void store_setup_block(SETUPBLOCK *block, VERTEXDATA (*triangles)[3], const DWORD *indices, const DWORD lane_count,
+    bool *in_range)
+{
+    if (lane_count < SETUP_BLOCK_SIZE) {
+        memset(block->vertices, 0, sizeof(block->vertices));
+    }
+    for (DWORD l = 0; l < lane_count; l++) {
+        const VERTEXDATA *vertices = triangles[indices[l]];
+        for (DWORD v = 0; v < 3; v++) {
+            block->vertices[v][0][l] = vertices[v].posY;
+            block->vertices[v][1][l] = vertices[v].posX;
+            block->vertices[v][2][l] = vertices[v].colR;
+            block->vertices[v][3][l] = vertices[v].colG;
+            block->vertices[v][4][l] = vertices[v].colB;
+        }
+        if (in_range != NULL) {
+            in_range[l] = true;
+            for (DWORD v = 0; v < 3; v++) {
+                in_range[l] = in_range[l] && labs(vertices[v].posX) <= SETUP_MAX_COORDINATE
+                    && labs(vertices[v].posY) <= SETUP_MAX_COORDINATE;
+            }
+        }
+    }
+}
+
+/*! \brief Sorts the vertices of an array of triangles (see sort_triangle_vertices()), #SETUP_BLOCK_SIZE triangles at a time.
+
+    \param triangles Pointer to the array of triangles.
+    \param triangle_count Number of triangles.
+ */
+void sort_triangle_array(VERTEXDATA (*triangles)[3], const DWORD triangle_count)
+{
+    SETUPBLOCK block;
+    for (DWORD i = 0; i < triangle_count; i += SETUP_BLOCK_SIZE) {
+        DWORD lane_count = triangle_count - i < SETUP_BLOCK_SIZE ? triangle_count - i : SETUP_BLOCK_SIZE,
+            indices[SETUP_BLOCK_SIZE];
+        for (DWORD l = 0; l < lane_count; l++) {
+            indices[l] = i + l;
+        }
+        store_setup_block(&block, triangles, indices, lane_count, NULL);
+        sort_triangles(&block);
+        for (DWORD l = 0; l < lane_count; l++) {
+            for (DWORD v = 0; v < 3; v++) {
+                triangles[i + l][v].posY = block.vertices[v][0][l];
+                triangles[i + l][v].posX = block.vertices[v][1][l];
+                triangles[i + l][v].colR = block.vertices[v][2][l];
+                triangles[i + l][v].colG = block.vertices[v][3][l];
+                triangles[i + l][v].colB = block.vertices[v][4][l];
+            }
+        }
+    }
+}
+
+/*! \brief Sets up an #EDGEVALUE for the scanline of the upper vertex of an edge from the #SETUPBLOCK.
+
+    \param edge_value Pointer to the structure.
+    \param block Pointer to the block processed by setup_triangles().
+    \param lane Index of the triangle within the block.
+    \param edge Index of the edge (v0-v2, v0-v1 or v1-v2).
+    \param begin Index of the upper vertex of the edge.
+    \param channel Index of the channel (x, red, green or blue).
+ */
+void load_setup_edge_value(EDGEVALUE *edge_value, const SETUPBLOCK *block, const DWORD lane, const DWORD edge,
+    const DWORD begin, const DWORD channel)
+{
+    edge_value->value = block->vertices[begin][channel + 1][lane];
+    edge_value->remainder = 0;
+    edge_value->step = block->steps[edge][channel][lane];
+    edge_value->step_remainder = block->step_remainders[edge][channel][lane];
+    edge_value->denominator = block->denominators[edge][lane];
+}
+
+/*! \brief Sets up the edges of a block of triangles for the scanlines of their upper vertices (see set_edge()).
+
+    Triangles with coordinates beyond #SETUP_MAX_COORDINATE are set up one by one.
+
+    \param triangles Pointer to the array of triangles with sorted vertices.
+    \param indices Pointer to the array of indices of the triangles.
+    \param lane_count Number of the triangles (at most #SETUP_BLOCK_SIZE).
+    \param edges Array for storing the edges v0-v2, v0-v1 and v1-v2 of the triangles.
+ */
+void set_up_triangle_block(VERTEXDATA (*triangles)[3], const DWORD *indices, const DWORD lane_count,
+    EDGE (*edges)[3])
+{
+    const DWORD edge_vertices[3][2] = {{0, 2}, {0, 1}, {1, 2}};
+    SETUPBLOCK block;
+    bool in_range[SETUP_BLOCK_SIZE];
+    store_setup_block(&block, triangles, indices, lane_count, in_range);
+    setup_triangles(&block);
+    for (DWORD l = 0; l < lane_count; l++) {
+        for (DWORD e = 0; e < 3; e++) {
+            if (!in_range[l]) {
+                const VERTEXDATA *vertices = triangles[indices[l]];
+                set_edge(&edges[l][e], &vertices[edge_vertices[e][0]], &vertices[edge_vertices[e][1]],
+                    vertices[edge_vertices[e][0]].posY);
+                continue;
+            }
+            load_setup_edge_value(&edges[l][e].x, &block, l, e, edge_vertices[e][0], 0);
+            load_setup_edge_value(&edges[l][e].r, &block, l, e, edge_vertices[e][0], 1);
+            load_setup_edge_value(&edges[l][e].g, &block, l, e, edge_vertices[e][0], 2);
+            load_setup_edge_value(&edges[l][e].b, &block, l, e, edge_vertices[e][0], 3);
+        }
+    }
+}
+
+//whether batches of triangles are drawn in reverse order on the calling thread (see set_reverse_order())
+__thread bool reverse_order = false;
+
+/*! \brief Selects the order in which batches of triangles are drawn by the canvases created afterwards
+    (see set_canvas_reverse_order()).
+
+    In reverse order, the triangles of a batch are drawn from the last to the first, skipping the pixels
+    claimed by later triangles (see #COVERAGEMASK), so that each pixel is written at most once per batch.
+    The result is identical to the one of drawing in submission order.
+
+    \param reverse Whether to draw in reverse order.
+ */
+void set_reverse_order(const bool reverse)
+{
+    default_settings.reverse_order = reverse;
+}
+
+/*! \brief Selects whether the spans of the triangles drawn by the canvases created afterwards are deferred
+    (see set_canvas_deferred_spans()).
+
+    Deferred spans are recorded in a #SPANBUFFER of the canvas and drawn sorted by scanline when it is full,
+    before the bitmap is saved or read and on flush_canvas(). The result is identical to the one of drawing
+    the triangles at once. This only applies to canvases drawn on the calling thread in submission order
+    (not in reverse order nor with worker threads or an out-of-core bitmap).
+
+    \param deferred Whether to defer the spans.
+ */
+void set_deferred_spans(const bool deferred)
+{
+    default_settings.deferred_spans = deferred;
+}
+
+/*! \brief Selects the drawing settings and the statistics used by the calling thread.
+
+    The drawing functions below the canvas level read the selected line drawing function, rasterizer
+    and drawing order and update the statistics through thread-local variables set here by every function
+    working on a #CANVAS, so that canvases used by different threads do not affect each other.
+
+    \param settings Pointer to the settings.
+    \param run_stats Pointer to the statistics.
+ */
+void use_canvas_settings(const CANVASSETTINGS *settings, RUNSTATS *run_stats)
+{
+    draw_horizontal_line_proc = line_drawers[settings->line_drawer].proc;
+    draw_triangle_band_proc = rasterizers[settings->rasterizer].proc;
+    draw_triangle_band_cached_proc = rasterizers[settings->rasterizer].cached_proc;
+    reverse_order = settings->reverse_order;
+    thread_stats = run_stats;
+}
+
+/*! \brief Selects the default settings and the totals of the statistics for the calling thread, so that
+    the drawing functions below the canvas level can be used without a #CANVAS (see use_canvas_settings()).
+ */
+void use_default_settings(void)
+{
+    use_canvas_settings(&default_settings, &stats);
+}
+
+/*! \brief Draws the parts of a sequence of the triangles lying within the given band of scanlines.
+
+    Triangles without cached edges are set up in blocks by set_up_triangle_block() just before being drawn
+    (unless the selected rasterizer does not step edges).
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param triangles Pointer to the array of triangles with sorted vertices.
+    \param edges Pointer to the array of the cached edges of the triangles (see draw_triangle_band_cached()) or NULL.
+    \param indices Pointer to the array of indices of the triangles in the sequence (NULL for all the triangles).
+    \param count Number of triangles in the sequence.
+    \param first_line Vertical position of the first scanline of the band.
+    \param last_line Vertical position of the last scanline of the band.
+    \param deferred_clear Pointer to the pending clear of the bitmap (see draw_triangle_band()) or NULL.
+    \param coverage Pointer to the mask of the pixels claimed by later triangles (the sequence is then drawn
+        in reverse order until the whole band is claimed, see draw_span()) or NULL.
+    \param span_buffer Pointer to the buffer recording the spans instead of drawing them (see draw_span()) or NULL.
+ */
+void draw_triangle_sequence(BYTE *image_data, BITMAPINFOHEADER *info_header, VERTEXDATA (*triangles)[3],
+    const EDGE *(*edges)[3], const DWORD *indices, const size_t count, const LONG first_line, const LONG last_line,
+    DEFERREDCLEAR *deferred_clear, COVERAGEMASK *coverage, SPANBUFFER *span_buffer)
+{
+    bool set_up = edges == NULL && draw_triangle_band_cached_proc != NULL;
+    EDGE block_edges[SETUP_BLOCK_SIZE][3];
+    for (size_t k = 0; k < count; k += SETUP_BLOCK_SIZE) {
+        DWORD lane_count = count - k < SETUP_BLOCK_SIZE ? count - k : SETUP_BLOCK_SIZE,
+            block_indices[SETUP_BLOCK_SIZE];
+        for (DWORD l = 0; l < lane_count; l++) {
+            size_t position = coverage != NULL ? count - 1 - (k + l) : k + l;
+            block_indices[l] = indices != NULL ? indices[position] : position;
+        }
+        if (set_up) {
+            set_up_triangle_block(triangles, block_indices, lane_count, block_edges);
+        }
+        for (DWORD l = 0; l < lane_count; l++) {
+            if (coverage != NULL && coverage->unclaimed_lines == 0) {
+                return;
+            }
+            if (set_up) {
+                const EDGE *triangle_edges[3] = {&block_edges[l][0], &block_edges[l][1], &block_edges[l][2]};
+                draw_triangle_band_cached_proc(image_data, info_header, &triangles[block_indices[l]], triangle_edges,
+                    first_line, last_line, deferred_clear, coverage, span_buffer);
+            } else {
+                draw_triangle_band_any(image_data, info_header, triangles, edges, block_indices[l],
+                    first_line, last_line, deferred_clear, coverage, span_buffer);
+            }
+        }
+    }
+}
+
+/*! \brief Draws the parts of the triangles lying within the given band of scanlines, tile by tile.
+
+    The band is divided into tiles of whole scanlines. Triangles are binned into the tiles
+    overlapped by their bounding boxes and each tile is completed before the next one is started,
+    so that its pixels stay in cache. Triangles lying entirely outside the bitmap are skipped.
+    Within a tile, triangles are drawn in submission order (or in reverse order with a #COVERAGEMASK,
+    see set_reverse_order()), hence the result is identical to the one of drawing them one by one.
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param triangles Pointer to the array of triangles with sorted vertices.
+    \param edges Pointer to the array of the cached edges of the triangles (see draw_triangle_band_cached()) or NULL.
+    \param triangle_count Number of triangles.
+    \param first_line Vertical position of the first scanline of the band.
+    \param last_line Vertical position of the last scanline of the band.
+    \param deferred_clear Pointer to the pending clear of the bitmap (see draw_triangle_band()) or NULL.
+    \param span_buffer Pointer to the buffer recording the spans instead of drawing them (the triangles are then
+        neither binned nor drawn in reverse order, see #SPANBUFFER) or NULL.
+
+    \warning Vertices must be sorted using sort_triangle_vertices() and the band must lie within the bitmap.
+        No input correctness checks are performed.
+ */
+void draw_triangles_band(BYTE *image_data, BITMAPINFOHEADER *info_header, VERTEXDATA (*triangles)[3],
+    const EDGE *(*edges)[3], const DWORD triangle_count, const LONG first_line, const LONG last_line,
+    DEFERREDCLEAR *deferred_clear, SPANBUFFER *span_buffer)
+{
+    if (first_line > last_line || triangle_count == 0) {
+        return;
+    }
+    size_t stride = get_bitmap_stride(info_header->biWidth, info_header->biBitCount);
+    LONG tile_height = stride < TILE_BYTES ? TILE_BYTES / stride : 1,
+        tile_count = (last_line - first_line) / tile_height + 1;
+
+    size_t *bin_offsets;
+    DWORD *bins;
+    bool binned = span_buffer == NULL && tile_count > 1 && triangle_count > 1
+        && bin_triangles(triangles, triangle_count, abs(info_header->biWidth), first_line, last_line,
+            tile_height, tile_count, &bin_offsets, &bins);
+    //a single triangle cannot be overdrawn (without the bins, the mask would have to span the whole band)
+    COVERAGEMASK coverage_mask, *coverage = NULL;
+    if (reverse_order && span_buffer == NULL && triangle_count > 1 && (binned || tile_count == 1)
+        && create_coverage_mask(&coverage_mask, info_header, binned ? tile_height : last_line - first_line + 1)) {
+        coverage = &coverage_mask;
+    }
+
+    if (!binned) {
+        //a single tile or triangle (or not enough memory for binning): draw the triangles one by one
+        if (coverage != NULL) {
+            reset_coverage_mask(coverage, first_line, last_line - first_line + 1);
+        }
+        draw_triangle_sequence(image_data, info_header, triangles, edges, NULL, triangle_count,
+            first_line, last_line, deferred_clear, coverage, span_buffer);
+    } else {
+        //render tile by tile
+        for (LONG j = 0; j < tile_count; j++) {
+            LONG tile_first_line = first_line + j * tile_height,
+                tile_last_line = tile_first_line + tile_height - 1;
+            if (tile_last_line > last_line) {
+                tile_last_line = last_line;
+            }
+            if (coverage != NULL) {
+                reset_coverage_mask(coverage, tile_first_line, tile_last_line - tile_first_line + 1);
+            }
+            draw_triangle_sequence(image_data, info_header, triangles, edges, &bins[bin_offsets[j]],
+                bin_offsets[j + 1] - bin_offsets[j], tile_first_line, tile_last_line, deferred_clear,
+                    coverage, span_buffer);
+        }
+        free(bins);
+        free(bin_offsets);
+    }
+    if (coverage != NULL) {
+        destroy_coverage_mask(coverage);
+    }
+}
+
+/*! \brief Draws an array of triangles on the bitmap (see draw_triangles_band()).
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param triangles Pointer to the array of triangles (their vertices are sorted in place).
+    \param triangle_count Number of triangles.
+    \param deferred_clear Pointer to the pending clear of the bitmap (see draw_triangle_band()) or NULL.
+    \param span_buffer Pointer to the buffer recording the spans instead of drawing them (see #SPANBUFFER) or NULL.
+
+    \return Zero on success, -1 if any argument is a null pointer.
+ */
+LONG draw_triangles(BYTE *image_data, BITMAPINFOHEADER *info_header, VERTEXDATA (*triangles)[3], const DWORD triangle_count,
+    DEFERREDCLEAR *deferred_clear, SPANBUFFER *span_buffer)
+{
+    if (image_data == NULL || info_header == NULL || triangles == NULL) {
+        return -1;
+    }
+
+    sort_triangle_array(triangles, triangle_count);
+    draw_triangles_band(image_data, info_header, triangles, NULL, triangle_count, 0, abs(info_header->biHeight) - 1,
+        deferred_clear, span_buffer);
+    return 0;
+}
+
+#define RENDER_QUEUE_SIZE 4096
+
+#define RENDER_JOB_TRIANGLES 0
+#define RENDER_JOB_APPLY_CLEAR 1
+
+/*! \brief Pool of worker threads, each rendering a separate horizontal band of the bitmap.
+
+    Triangles are queued and rasterized on flush. As every scanline belongs to exactly one band
+    and each worker processes the queue in submission order, the result is identical to the serial one.
+ */
+typedef struct RENDERPOOL {
+    pthread_t *threads;
+    LONG thread_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_done;
+    DWORD generation;
+    LONG busy_count;
+    bool exiting;
+    //current job
+    LONG job_type;
+    BYTE *image_data;
+    BITMAPINFOHEADER *info_header;
+    DEFERREDCLEAR *deferred_clear;
+    //settings and statistics of the canvas (applied by the workers to every job)
+    const CANVASSETTINGS *settings;
+    RUNSTATS *stats;
+    //queued triangles (with sorted vertices)
+    VERTEXDATA queue[RENDER_QUEUE_SIZE][3];
+    DWORD queue_length;
+} RENDERPOOL;
+
+/*! \brief Describes a worker thread of the #RENDERPOOL.
+ */
+typedef struct RENDERWORKER {
+    RENDERPOOL *pool;
+    LONG index;
+} RENDERWORKER;
+
+/*! \brief Calculates the band of scanlines assigned to a worker thread.
+
+    \param pool Pointer to the pool.
+    \param index Index of the worker.
+    \param first_line Pointer for storing the first scanline of the band.
+    \param last_line Pointer for storing the last scanline of the band (less than \a first_line for an empty band).
+ */
+void get_worker_band(const RENDERPOOL *pool, const LONG index, LONG *first_line, LONG *last_line)
+{
+    LONGLONG height = abs(pool->info_header->biHeight);
+    *first_line = height * index / pool->thread_count;
+    *last_line = height * (index + 1) / pool->thread_count - 1;
+}
+
+/*! \brief Main function of a worker thread of the #RENDERPOOL.
+
+    \param argument Pointer to the RENDERWORKER structure.
+ */
+void *render_worker_main(void *argument)
+{
+    RENDERWORKER *worker = argument;
+    RENDERPOOL *pool = worker->pool;
+    DWORD generation = 0;
+    pthread_mutex_lock(&pool->mutex);
+    while (true) {
+        while (pool->generation == generation && !pool->exiting) {
+            pthread_cond_wait(&pool->job_ready, &pool->mutex);
+        }
+        if (pool->exiting) {
+            break;
+        }
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        LONG first_line, last_line;
+        get_worker_band(pool, worker->index, &first_line, &last_line);
+        use_canvas_settings(pool->settings, pool->stats);
+        if (first_line <= last_line) {
+            if (pool->job_type == RENDER_JOB_APPLY_CLEAR) {
+                apply_deferred_clear(pool->image_data, pool->info_header, pool->deferred_clear,
+                    first_line, last_line, true);
+            } else {
+                draw_triangles_band(pool->image_data, pool->info_header, pool->queue, NULL, pool->queue_length,
+                    first_line, last_line, pool->deferred_clear, NULL);
+            }
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->busy_count--;
+        if (pool->busy_count == 0) {
+            pthread_cond_signal(&pool->job_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    free(worker);
+    return NULL;
+}
+
+/*! \brief Runs the current job of the #RENDERPOOL on all worker threads and waits for its completion.
+
+    \param pool Pointer to the pool.
+ */
+void run_render_job(RENDERPOOL *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->busy_count = pool->thread_count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->job_ready);
+    while (pool->busy_count > 0) {
+        pthread_cond_wait(&pool->job_done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/*! \brief Stops the worker threads and deallocates the #RENDERPOOL.
+
+    Queued triangles are discarded.
+
+    \param pool Pointer to the pool.
+ */
+void destroy_render_pool(RENDERPOOL *pool)
+{
+    if (pool != NULL) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->exiting = true;
+        pthread_cond_broadcast(&pool->job_ready);
+        pthread_mutex_unlock(&pool->mutex);
+        for (LONG i = 0; i < pool->thread_count; i++) {
+            pthread_join(pool->threads[i], NULL);
+        }
+        pthread_cond_destroy(&pool->job_done);
+        pthread_cond_destroy(&pool->job_ready);
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool->threads);
+        free(pool);
+    }
+}
+
+/*! \brief Creates a #RENDERPOOL.
+
+    \param image_data Pointer to the bitmap data.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param deferred_clear Pointer to the pending clear of the bitmap.
+    \param settings Pointer to the settings of the canvas (see use_canvas_settings()).
+    \param run_stats Pointer to the statistics of the canvas.
+    \param thread_count Number of worker threads.
+
+    \return Pointer to the pool or NULL on failure.
+ */
+RENDERPOOL *create_render_pool(BYTE *image_data, BITMAPINFOHEADER *info_header, DEFERREDCLEAR *deferred_clear,
+    const CANVASSETTINGS *settings, RUNSTATS *run_stats, const LONG thread_count)
+{
+    if (image_data == NULL || info_header == NULL || deferred_clear == NULL || settings == NULL || run_stats == NULL
+        || thread_count < 1) {
+        return NULL;
+    }
+    RENDERPOOL *pool = malloc(sizeof(RENDERPOOL));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->threads = malloc(thread_count * sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->job_ready, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+    pool->thread_count = 0;
+    pool->generation = 0;
+    pool->busy_count = 0;
+    pool->exiting = false;
+    pool->job_type = RENDER_JOB_TRIANGLES;
+    pool->image_data = image_data;
+    pool->info_header = info_header;
+    pool->deferred_clear = deferred_clear;
+    pool->settings = settings;
+    pool->stats = run_stats;
+    pool->queue_length = 0;
+    for (LONG i = 0; i < thread_count; i++) {
+        RENDERWORKER *worker = malloc(sizeof(RENDERWORKER));
+        if (worker == NULL) {
+            destroy_render_pool(pool);
+            return NULL;
+        }
+        worker->pool = pool;
+        worker->index = i;
+        if (pthread_create(&pool->threads[i], NULL, render_worker_main, worker) != 0) {
+            free(worker);
+            destroy_render_pool(pool);
+            return NULL;
+        }
+        pool->thread_count++;
+    }
+    return pool;
+}
+
+/*! \brief Rasterizes all the triangles queued in the #RENDERPOOL.
+
+    \param pool Pointer to the pool.
+ */
+void flush_render_pool(RENDERPOOL *pool)
+{
+    if (pool != NULL && pool->queue_length > 0) {
+        pool->job_type = RENDER_JOB_TRIANGLES;
+        run_render_job(pool);
+        pool->queue_length = 0;
+    }
+}
+
+/*! \brief Queues a triangle for drawing by the #RENDERPOOL.
+
+    \param pool Pointer to the pool.
+    \param vertex_data Pointer to the array of three VERTEXDATA structures describing a triangle (sorted in place).
+
+    \return Zero on success, -1 if any argument is a null pointer.
+ */
+LONG queue_triangle(RENDERPOOL *pool, VERTEXDATA (*vertices)[3])
+{
+    if (pool == NULL || vertices == NULL) {
+        return -1;
+    }
+    sort_triangle_vertices(vertices);
+    //skip triangles lying entirely above or below the bitmap
+    if ((*vertices)[2].posY < 0 || (*vertices)[0].posY >= abs(pool->info_header->biHeight)) {
+        return 0;
+    }
+    memcpy(&pool->queue[pool->queue_length], vertices, sizeof(*vertices));
+    pool->queue_length++;
+    if (pool->queue_length == RENDER_QUEUE_SIZE) {
+        flush_render_pool(pool);
+    }
+    return 0;
+}
+
+/*! \brief Fills the scanlines which the pending clear has not been applied to yet,
+    splitting the work between the threads of the #RENDERPOOL.
+
+    \param pool Pointer to the pool.
+ */
+void apply_deferred_clear_parallel(RENDERPOOL *pool)
+{
+    if (pool != NULL) {
+        pool->job_type = RENDER_JOB_APPLY_CLEAR;
+        run_render_job(pool);
+    }
+}
+
+/*! \brief Saves the bitmap to a file.
+
+    \param file_header Pointer to the BITMAPFILEHEADER (in the form of byte array) describing the output file.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param image_data Pointer to the bitmap data.
+    \param output_filename Output filename.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on file I/O error.
+ */
+LONG save_bitmap(BYTE (*file_header)[14], BITMAPINFOHEADER *info_header, BYTE *image_data, const char *output_filename)
+{
+    if (file_header != 0 && info_header != 0 && image_data != 0 && output_filename != 0) {
+        FILE *output_file = fopen(output_filename, "wb");
+        if (output_file == NULL) {
+            return -2;
+        }
+        //write BITMAPFILEHEADER
+        size_t bytes_to_write = sizeof(*file_header),
+            bytes_written = 0;
+        bytes_written = fwrite(file_header, 1, bytes_to_write, output_file);
+        if (bytes_to_write != bytes_written) {
+            fclose(output_file);
+            return -2;
+        }
+        //write BITMAPINFOHEADER
+        bytes_to_write = sizeof(*info_header);
+        bytes_written = fwrite(info_header, 1, bytes_to_write, output_file);
+        if (bytes_to_write != bytes_written) {
+            fclose(output_file);
+            return -2;
+        }
+        //write bitmap data
+        bytes_to_write = get_image_data_size(info_header);
+        bytes_written = fwrite(image_data, 1, bytes_to_write, output_file);
+        fclose(output_file);
+        if (bytes_to_write != bytes_written) {
+            return -2;
+        }
+        return 0;
+    } else {
+        return -1;
+    }
+}
+
+/*! \brief Converts a row of X8R8G8B8 pixels (stored as 0x00RRGGBB dwords) to R8G8B8 ones.
+
+    \param rgb_data Pointer to the destination row (3 bytes per pixel).
+    \param xrgb_data Pointer to the source row (4 bytes per pixel).
+    \param pixel_count Number of pixels to convert.
+
+    \warning Requires SSSE3 instruction support. Writes exactly 3 * \a pixel_count bytes.
+        As this function is implemented in assembly, it performs no input correctness checks.
+ */
+extern void convert_xrgb_to_rgb24(BYTE *rgb_data, const BYTE *xrgb_data, DWORD pixel_count);
+
+/*! \brief Saves the bitmap stored internally with 32 bits per pixel to an RGB24 file.
+
+    Scanlines are converted in batches of roughly #TILE_BYTES into a buffer which is then written to the file.
+
+    \param file_header Pointer to the BITMAPFILEHEADER (in the form of byte array) describing the output file.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap stored in the file (24 bits per pixel).
+    \param frame_data Pointer to the bitmap data (32 bits per pixel).
+    \param output_filename Output filename.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on memory allocation or file I/O error.
+ */
+LONG save_xrgb_bitmap(BYTE (*file_header)[14], BITMAPINFOHEADER *info_header, const BYTE *frame_data, const char *output_filename)
+{
+    if (file_header == NULL || info_header == NULL || frame_data == NULL || output_filename == NULL) {
+        return -1;
+    }
+    DWORD width = abs(info_header->biWidth);
+    LONG height = abs(info_header->biHeight);
+    size_t stride = get_bitmap_stride(width, 24),
+        frame_stride = get_bitmap_stride(width, 32);
+    LONG batch_lines = stride < TILE_BYTES ? TILE_BYTES / stride : 1;
+    //zeroed, so that the padding of the rows stays zero
+    BYTE *buffer = calloc(batch_lines, stride);
+    if (buffer == NULL) {
+        return -2;
+    }
+    FILE *output_file = fopen(output_filename, "wb");
+    if (output_file == NULL) {
+        free(buffer);
+        return -2;
+    }
+    bool status_ok = fwrite(file_header, 1, sizeof(*file_header), output_file) == sizeof(*file_header)
+        && fwrite(info_header, 1, sizeof(*info_header), output_file) == sizeof(*info_header);
+    for (LONG i = 0; i < height && status_ok; i += batch_lines) {
+        LONG lines = height - i < batch_lines ? height - i : batch_lines;
+        for (LONG j = 0; j < lines; j++) {
+            convert_xrgb_to_rgb24(buffer + j * stride, frame_data + (i + j) * frame_stride, width);
+        }
+        status_ok = fwrite(buffer, stride, lines, output_file) == (size_t)lines;
+    }
+    free(buffer);
+    if (fclose(output_file) != 0 || !status_ok) {
+        return -2;
+    }
+    return 0;
+}
+
+/*! \brief Describes a file mapped into memory.
+ */
+typedef struct MAPPEDFILE {
+    BYTE *data;
+    size_t size;
+} MAPPEDFILE;
+
+/*! \brief Maps a file into memory (privately, so that its contents can be modified without affecting the file).
+
+    \param file Pointer to the structure for storing the mapping.
+    \param filename Name of the file.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on file I/O error.
+ */
+LONG map_file(MAPPEDFILE *file, const char *filename)
+{
+    if (file == NULL || filename == NULL) {
+        return -1;
+    }
+    int descriptor = open(filename, O_RDONLY);
+    if (descriptor < 0) {
+        return -2;
+    }
+    struct stat file_status;
+    if (fstat(descriptor, &file_status) != 0) {
+        close(descriptor);
+        return -2;
+    }
+    file->size = file_status.st_size;
+    file->data = NULL;
+    if (file->size > 0) {
+        file->data = mmap(NULL, file->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+        if (file->data == MAP_FAILED) {
+            file->data = NULL;
+            close(descriptor);
+            return -2;
+        }
+        posix_madvise(file->data, file->size, POSIX_MADV_SEQUENTIAL);
+    }
+    close(descriptor);
+    return 0;
+}
+
+/*! \brief Unmaps a file mapped using map_file().
+
+    \param file Pointer to the mapping.
+ */
+void unmap_file(MAPPEDFILE *file)
+{
+    if (file != NULL && file->data != NULL) {
+        munmap(file->data, file->size);
+        file->data = NULL;
+    }
+}
+
+//approximate size of a tile of an out-of-core bitmap (a band of whole scanlines stored on disk)
+#define DISK_TILE_BYTES (4 * 1024 * 1024)
+
+/*! \brief Describes a tile of an out-of-core bitmap held in memory.
+ */
+typedef struct TILESLOT {
+    LONG tile;
+    BYTE *data;
+    bool dirty;
+    LONGLONG last_used;
+} TILESLOT;
+
+/*! \brief Least-recently-used cache of tiles of a bitmap stored in a scratch file.
+
+    Tiles are bands of whole scanlines, laid out in the scratch file in the same way as in memory.
+ */
+typedef struct TILECACHE {
+    int descriptor;
+    size_t stride;
+    LONG height;
+    LONG tile_height;
+    LONG tile_count;
+    size_t tile_bytes;
+    LONG *slot_of_tile;
+    TILESLOT *slots;
+    LONG slot_count;
+    LONGLONG clock;
+} TILECACHE;
+
+/*! \brief Reads exactly the given number of bytes from a file at the given offset.
+
+    \return True on success, false on I/O error or end of file.
+ */
+bool read_fully(int descriptor, BYTE *buffer, size_t length, off_t offset)
+{
+    while (length > 0) {
+        ssize_t result = pread(descriptor, buffer, length, offset);
+        if (result <= 0) {
+            return false;
+        }
+        buffer += result;
+        length -= result;
+        offset += result;
+    }
+    return true;
+}
+
+/*! \brief Writes exactly the given number of bytes to a file at the given offset.
+
+    \return True on success, false on I/O error.
+ */
+bool write_fully(int descriptor, const BYTE *buffer, size_t length, off_t offset)
+{
+    while (length > 0) {
+        ssize_t result = pwrite(descriptor, buffer, length, offset);
+        if (result <= 0) {
+            return false;
+        }
+        buffer += result;
+        length -= result;
+        offset += result;
+    }
+    return true;
+}
+
+/*! \brief Deallocates the #TILECACHE and removes its scratch file.
+
+    \param cache Pointer to the cache.
+ */
+void destroy_tile_cache(TILECACHE *cache)
+{
+    if (cache != NULL) {
+        if (cache->slots != NULL) {
+            for (LONG i = 0; i < cache->slot_count; i++) {
+                free(cache->slots[i].data);
+            }
+        }
+        free(cache->slots);
+        free(cache->slot_of_tile);
+        if (cache->descriptor >= 0) {
+            close(cache->descriptor);
+        }
+        free(cache);
+    }
+}
+
+/*! \brief Creates a #TILECACHE for a bitmap stored in a scratch file.
+
+    The scratch file is created next to the given path and removed immediately,
+    so that it disappears as soon as it is closed.
+
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param cache_size Maximal size of the tiles held in memory (in bytes).
+    \param scratch_path Path used as a prefix of the scratch file name.
+
+    \return Pointer to the cache or NULL on failure.
+ */
+TILECACHE *create_tile_cache(const BITMAPINFOHEADER *info_header, const size_t cache_size, const char *scratch_path)
+{
+    if (info_header == NULL || scratch_path == NULL) {
+        return NULL;
+    }
+    TILECACHE *cache = calloc(1, sizeof(TILECACHE));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->stride = get_bitmap_stride(info_header->biWidth, info_header->biBitCount);
+    cache->height = abs(info_header->biHeight);
+    cache->tile_height = cache->stride < DISK_TILE_BYTES ? DISK_TILE_BYTES / cache->stride : 1;
+    if (cache->tile_height > cache->height && cache->height > 0) {
+        cache->tile_height = cache->height;
+    }
+    cache->tile_count = cache->height > 0 ? (cache->height - 1) / cache->tile_height + 1 : 0;
+    cache->tile_bytes = cache->stride * cache->tile_height;
+    cache->slot_count = cache_size / cache->tile_bytes;
+    if (cache->slot_count < 1) {
+        cache->slot_count = 1;
+    }
+    if (cache->slot_count > cache->tile_count && cache->tile_count > 0) {
+        cache->slot_count = cache->tile_count;
+    }
+    cache->clock = 0;
+
+    char scratch_filename[MAX_PATH + 8];
+    snprintf(scratch_filename, sizeof(scratch_filename), "%s.XXXXXX", scratch_path);
+    cache->descriptor = mkstemp(scratch_filename);
+    if (cache->descriptor < 0) {
+        destroy_tile_cache(cache);
+        return NULL;
+    }
+    unlink(scratch_filename);
+    if (ftruncate(cache->descriptor, (off_t)get_image_data_size(info_header)) != 0) {
+        destroy_tile_cache(cache);
+        return NULL;
+    }
+
+    cache->slot_of_tile = malloc((cache->tile_count > 0 ? cache->tile_count : 1) * sizeof(LONG));
+    cache->slots = calloc(cache->slot_count, sizeof(TILESLOT));
+    if (cache->slot_of_tile == NULL || cache->slots == NULL) {
+        destroy_tile_cache(cache);
+        return NULL;
+    }
+    for (LONG i = 0; i < cache->tile_count; i++) {
+        cache->slot_of_tile[i] = -1;
+    }
+    for (LONG i = 0; i < cache->slot_count; i++) {
+        cache->slots[i].tile = -1;
+        cache->slots[i].data = malloc(cache->tile_bytes);
+        if (cache->slots[i].data == NULL) {
+            destroy_tile_cache(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+/*! \brief Calculates the number of scanlines in a tile of the #TILECACHE.
+
+    \param cache Pointer to the cache.
+    \param tile Index of the tile.
+ */
+LONG get_tile_lines(const TILECACHE *cache, const LONG tile)
+{
+    LONG first_line = tile * cache->tile_height;
+    return cache->height - first_line < cache->tile_height ? cache->height - first_line : cache->tile_height;
+}
+
+/*! \brief Writes a tile back to the scratch file if it was modified.
+
+    \param cache Pointer to the cache.
+    \param slot Pointer to the slot holding the tile.
+
+    \return True on success, false on I/O error.
+ */
+bool write_back_tile(TILECACHE *cache, TILESLOT *slot)
+{
+    if (slot->tile >= 0 && slot->dirty) {
+        if (!write_fully(cache->descriptor, slot->data, cache->stride * get_tile_lines(cache, slot->tile),
+            (off_t)slot->tile * cache->tile_bytes)) {
+            return false;
+        }
+        slot->dirty = false;
+    }
+    return true;
+}
+
+/*! \brief Provides a tile of the #TILECACHE for modification, evicting the least recently used one if needed.
+
+    \param cache Pointer to the cache.
+    \param tile Index of the tile.
+    \param load Whether the tile contents should be loaded (false if it is going to be overwritten entirely).
+
+    \return Pointer to the tile data or NULL on I/O error.
+ */
+BYTE *acquire_tile(TILECACHE *cache, const LONG tile, const bool load)
+{
+    cache->clock++;
+    LONG slot_index = cache->slot_of_tile[tile];
+    if (slot_index < 0) {
+        //find the least recently used slot
+        slot_index = 0;
+        for (LONG i = 1; i < cache->slot_count; i++) {
+            if (cache->slots[i].last_used < cache->slots[slot_index].last_used) {
+                slot_index = i;
+            }
+        }
+        TILESLOT *slot = &cache->slots[slot_index];
+        if (!write_back_tile(cache, slot)) {
+            return NULL;
+        }
+        if (slot->tile >= 0) {
+            cache->slot_of_tile[slot->tile] = -1;
+            slot->tile = -1;
+        }
+        if (load && !read_fully(cache->descriptor, slot->data, cache->stride * get_tile_lines(cache, tile),
+            (off_t)tile * cache->tile_bytes)) {
+            return NULL;
+        }
+        slot->tile = tile;
+        cache->slot_of_tile[tile] = slot_index;
+    }
+    cache->slots[slot_index].dirty = true;
+    cache->slots[slot_index].last_used = cache->clock;
+    return cache->slots[slot_index].data;
+}
+
+/*! \brief Draws an array of triangles on an out-of-core bitmap, tile by tile.
+
+    \param cache Pointer to the cache of the bitmap tiles.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param triangles Pointer to the array of triangles (their vertices are sorted in place).
+    \param triangle_count Number of triangles.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on memory allocation or file I/O error.
+ */
+LONG draw_tiled_triangles(TILECACHE *cache, BITMAPINFOHEADER *info_header, VERTEXDATA (*triangles)[3],
+    const DWORD triangle_count)
+{
+    if (cache == NULL || info_header == NULL || triangles == NULL) {
+        return -1;
+    }
+    if (triangle_count == 0 || cache->tile_count == 0) {
+        return 0;
+    }
+    for (DWORD i = 0; i < triangle_count; i++) {
+        sort_triangle_vertices(&triangles[i]);
+    }
+    size_t *bin_offsets;
+    DWORD *bins;
+    if (!bin_triangles(triangles, triangle_count, abs(info_header->biWidth), 0, cache->height - 1,
+        cache->tile_height, cache->tile_count, &bin_offsets, &bins)) {
+        return -2;
+    }
+    //in reverse order, every tile is drawn from its last triangle (see set_reverse_order())
+    COVERAGEMASK coverage_mask, *coverage = NULL;
+    if (reverse_order && triangle_count > 1 && create_coverage_mask(&coverage_mask, info_header, cache->tile_height)) {
+        coverage = &coverage_mask;
+    }
+    LONG result = 0;
+    for (LONG j = 0; j < cache->tile_count && result == 0; j++) {
+        if (bin_offsets[j] == bin_offsets[j + 1]) {
+            continue;
+        }
+        BYTE *tile_data = acquire_tile(cache, j, true);
+        if (tile_data == NULL) {
+            result = -2;
+            break;
+        }
+        //draw in tile coordinates (edge stepping is invariant to vertical translation)
+        LONG tile_first_line = j * cache->tile_height;
+        if (coverage != NULL) {
+            reset_coverage_mask(coverage, 0, get_tile_lines(cache, j));
+        }
+        for (size_t k = bin_offsets[j]; k < bin_offsets[j + 1]; k++) {
+            if (coverage != NULL && coverage->unclaimed_lines == 0) {
+                break;
+            }
+            VERTEXDATA vertices[3];
+            memcpy(vertices, triangles[bins[coverage != NULL ? bin_offsets[j + 1] - 1 - (k - bin_offsets[j]) : k]],
+                sizeof(vertices));
+            for (DWORD l = 0; l < 3; l++) {
+                vertices[l].posY -= tile_first_line;
+            }
+            draw_triangle_band_proc(tile_data, info_header, &vertices, 0, get_tile_lines(cache, j) - 1, NULL, coverage,
+                NULL);
+        }
+    }
+    if (coverage != NULL) {
+        destroy_coverage_mask(coverage);
+    }
+    free(bins);
+    free(bin_offsets);
+    return result;
+}
+
+/*! \brief Paints an out-of-core bitmap using the given color.
+
+    \param cache Pointer to the cache of the bitmap tiles.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param red Intensity of red in desired color.
+    \param green Intensity of green in desired color.
+    \param blue Intensity of blue in desired color.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on file I/O error.
+ */
+LONG clear_tiled_bitmap(TILECACHE *cache, BITMAPINFOHEADER *info_header, const BYTE red, const BYTE green, const BYTE blue)
+{
+    if (cache == NULL || info_header == NULL) {
+        return -1;
+    }
+    for (LONG j = 0; j < cache->tile_count; j++) {
+        BYTE *tile_data = acquire_tile(cache, j, false);
+        if (tile_data == NULL) {
+            return -2;
+        }
+        clear_bitmap_rows(tile_data, info_header, red, green, blue, 0, get_tile_lines(cache, j) - 1);
+    }
+    return 0;
+}
+
+/*! \brief Saves an out-of-core bitmap to a file, streaming its tiles one by one.
+
+    \param file_header Pointer to the BITMAPFILEHEADER (in the form of byte array) describing the output file.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap.
+    \param cache Pointer to the cache of the bitmap tiles.
+    \param output_filename Output filename.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on file I/O error.
+ */
+LONG save_tiled_bitmap(BYTE (*file_header)[14], BITMAPINFOHEADER *info_header, TILECACHE *cache, const char *output_filename)
+{
+    if (file_header == NULL || info_header == NULL || cache == NULL || output_filename == NULL) {
+        return -1;
+    }
+    FILE *output_file = fopen(output_filename, "wb");
+    if (output_file == NULL) {
+        return -2;
+    }
+    BYTE *buffer = malloc(cache->tile_bytes);
+    bool status_ok = buffer != NULL
+        && fwrite(file_header, 1, sizeof(*file_header), output_file) == sizeof(*file_header)
+        && fwrite(info_header, 1, sizeof(*info_header), output_file) == sizeof(*info_header);
+    for (LONG j = 0; j < cache->tile_count && status_ok; j++) {
+        size_t tile_size = cache->stride * get_tile_lines(cache, j);
+        const BYTE *tile_data = buffer;
+        if (cache->slot_of_tile[j] >= 0) {
+            tile_data = cache->slots[cache->slot_of_tile[j]].data;
+        } else if (!read_fully(cache->descriptor, buffer, tile_size, (off_t)j * cache->tile_bytes)) {
+            status_ok = false;
+            break;
+        }
+        status_ok = fwrite(tile_data, 1, tile_size, output_file) == tile_size;
+    }
+    free(buffer);
+    if (fclose(output_file) != 0 || !status_ok) {
+        return -2;
+    }
+    return 0;
+}
+
+/*! \brief Describes one of the supported output file formats.
+ */
+typedef struct OUTPUTFORMAT {
+    const char *name;
+    //extension of the files saved in this format by default (see get_output_format())
+    const char *extension;
+} OUTPUTFORMAT;
+
+const OUTPUTFORMAT output_formats[OUTPUT_FORMAT_COUNT] = {
+    {"bmp", ".bmp"},
+    {"ppm", ".ppm"},
+    {"qoi", ".qoi"}
+};
+
+/*! \brief Finds an output file format by name.
+
+    \param name Name of the format (bmp, ppm or qoi).
+
+    \return One of the OUTPUT_FORMAT_* indices or -1 if there is no such format.
+ */
+LONG find_output_format(const char *name)
+{
+    for (LONG j = 0; name != NULL && j < OUTPUT_FORMAT_COUNT; j++) {
+        if (strcmp(name, output_formats[j].name) == 0) {
+            return j;
+        }
+    }
+    return -1;
+}
+
+/*! \brief Provides the name of an output file format.
+
+    \param format One of the OUTPUT_FORMAT_* indices.
+
+    \return Name of the format or NULL if the index is incorrect.
+ */
+const char *get_output_format_name(const LONG format)
+{
+    return format >= 0 && format < OUTPUT_FORMAT_COUNT ? output_formats[format].name : NULL;
+}
+
+/*! \brief Selects the format of the files saved by the canvases created afterwards (see set_canvas_output_format()).
+
+    \param format One of the OUTPUT_FORMAT_* indices or -1 to choose the format by the extension of each file.
+
+    \return Zero on success, -1 if the index is incorrect.
+ */
+LONG select_output_format(const LONG format)
+{
+    if (format < -1 || format >= OUTPUT_FORMAT_COUNT) {
+        return -1;
+    }
+    default_settings.output_format = format;
+    return 0;
+}
+
+/*! \brief Determines the format a file is saved in: the given one or the one matching the extension of the file
+    (BMP for unknown extensions).
+
+    \param format One of the OUTPUT_FORMAT_* indices or -1 to choose the format by the extension.
+    \param filename Name of the file.
+
+    \return One of the OUTPUT_FORMAT_* indices.
+ */
+LONG choose_output_format(const LONG format, const char *filename)
+{
+    if (format >= 0 || filename == NULL) {
+        return format >= 0 ? format : OUTPUT_FORMAT_BMP;
+    }
+    const char *extension = strrchr(filename, '.'),
+        *separator = strrchr(filename, '/');
+    if (extension != NULL && (separator == NULL || extension > separator)) {
+        for (LONG j = 0; j < OUTPUT_FORMAT_COUNT; j++) {
+            if (strcasecmp(extension, output_formats[j].extension) == 0) {
+                return j;
+            }
+        }
+    }
+    return OUTPUT_FORMAT_BMP;
+}
+
+/*! \brief Determines the format a file is saved in by the canvases created afterwards: the selected one
+    (see select_output_format()) or the one matching the extension of the file (BMP for unknown extensions).
+
+    \param filename Name of the file.
+
+    \return One of the OUTPUT_FORMAT_* indices.
+ */
+LONG get_output_format(const char *filename)
+{
+    return choose_output_format(default_settings.output_format, filename);
+}
+
+//maximal number of threads encoding the rows of a file at once
+#define ENCODER_MAX_THREADS 8
+//approximate size of the pixels encoded by a thread at once (a chunk of whole scanlines)
+#define ENCODER_CHUNK_BYTES (1024 * 1024)
+
+//QOI operations (see https://qoiformat.org/qoi-specification.pdf)
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_MAX_RUN 62
+#define QOI_HEADER_SIZE 14
+//the specification requires the pixel before the first one to be opaque black
+#define QOI_FIRST_PREVIOUS 0xff000000
+
+/*! \brief Chunk of consecutive scanlines encoded by one thread (see #ROWENCODER).
+ */
+typedef struct ENCODERCHUNK {
+    LONG format;
+    //top scanline of the chunk (the following ones are row_step bytes apart)
+    const BYTE *first_row;
+    ptrdiff_t row_step;
+    LONG lines;
+    DWORD width;
+    //3 for RGB24, 4 for XRGB (blue, green and red bytes come first either way)
+    WORD pixel_bytes;
+    //last pixel preceding the chunk in the file (packed as 0xffRRGGBB, QOI only)
+    DWORD previous_pixel;
+    //buffer of get_chunk_capacity() bytes for the encoded chunk
+    BYTE *output;
+    size_t length;
+} ENCODERCHUNK;
+
+/*! \brief Calculates the maximal size of an encoded chunk of scanlines.
+
+    \param format One of the OUTPUT_FORMAT_* indices (other than BMP).
+    \param width Width of the bitmap.
+    \param lines Number of scanlines.
+
+    \return Size in bytes.
+ */
+size_t get_chunk_capacity(const LONG format, const DWORD width, const LONG lines)
+{
+    //QOI stores at most four bytes per pixel (QOI_OP_RGB), PPM exactly three
+    return (size_t)width * lines * (format == OUTPUT_FORMAT_QOI ? 4 : 3);
+}
+
+/*! \brief Reads a pixel of a scanline.
+
+    \return Pixel packed as 0xffRRGGBB.
+ */
+static inline DWORD read_pixel(const BYTE *pixel)
+{
+    return 0xff000000 | (DWORD)pixel[2] << 16 | (DWORD)pixel[1] << 8 | pixel[0];
+}
+
+/*! \brief Encodes the scanlines of the chunk as PPM pixel data (red, green and blue bytes).
+
+    \param chunk Pointer to the chunk.
+ */
+void encode_ppm_chunk(ENCODERCHUNK *chunk)
+{
+    BYTE *output = chunk->output;
+    const BYTE *row = chunk->first_row;
+    for (LONG i = 0; i < chunk->lines; i++, row += chunk->row_step) {
+        const BYTE *pixel = row;
+        for (DWORD x = 0; x < chunk->width; x++, pixel += chunk->pixel_bytes, output += 3) {
+            output[0] = pixel[2];
+            output[1] = pixel[1];
+            output[2] = pixel[0];
+        }
+    }
+    chunk->length = output - chunk->output;
+}
+
+/*! \brief Encodes the scanlines of the chunk as a part of a QOI stream.
+
+    The encoder starts with an empty index, so it only refers to the pixels of the chunk, and with the last pixel
+    of the preceding chunk, so runs and differences are correct for any decoder. The chunks encoded separately
+    hence form a valid stream, identical to a sequentially encoded one except around the chunk boundaries.
+
+    \param chunk Pointer to the chunk.
+ */
+void encode_qoi_chunk(ENCODERCHUNK *chunk)
+{
+    //empty entries never match as the pixels are opaque
+    DWORD index[64];
+    memset(index, 0, sizeof(index));
+    DWORD previous = chunk->previous_pixel;
+    LONG run = 0;
+    BYTE *output = chunk->output;
+    const BYTE *row = chunk->first_row;
+    for (LONG i = 0; i < chunk->lines; i++, row += chunk->row_step) {
+        const BYTE *pixel = row;
+        for (DWORD x = 0; x < chunk->width; x++, pixel += chunk->pixel_bytes) {
+            DWORD color = read_pixel(pixel);
+            if (color == previous) {
+                if (++run == QOI_MAX_RUN) {
+                    *output++ = QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                *output++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+            BYTE red = color >> 16, green = color >> 8, blue = color;
+            DWORD hash = (red * 3 + green * 5 + blue * 7 + 0xff * 11) % 64;
+            if (index[hash] == color) {
+                *output++ = QOI_OP_INDEX | hash;
+            } else {
+                index[hash] = color;
+                //differences wrap around
+                int8_t delta_red = red - (BYTE)(previous >> 16),
+                    delta_green = green - (BYTE)(previous >> 8),
+                    delta_blue = blue - (BYTE)previous;
+                int8_t luma_red = delta_red - delta_green,
+                    luma_blue = delta_blue - delta_green;
+                if (delta_red >= -2 && delta_red <= 1 && delta_green >= -2 && delta_green <= 1
+                    && delta_blue >= -2 && delta_blue <= 1) {
+                    *output++ = QOI_OP_DIFF | (delta_red + 2) << 4 | (delta_green + 2) << 2 | (delta_blue + 2);
+                } else if (delta_green >= -32 && delta_green <= 31 && luma_red >= -8 && luma_red <= 7
+                    && luma_blue >= -8 && luma_blue <= 7) {
+                    *output++ = QOI_OP_LUMA | (delta_green + 32);
+                    *output++ = (luma_red + 8) << 4 | (luma_blue + 8);
+                } else {
+                    *output++ = QOI_OP_RGB;
+                    *output++ = red;
+                    *output++ = green;
+                    *output++ = blue;
+                }
+            }
+            previous = color;
+        }
+    }
+    if (run > 0) {
+        *output++ = QOI_OP_RUN | (run - 1);
+    }
+    chunk->length = output - chunk->output;
+}
+
+/*! \brief Main function of a thread encoding a chunk of scanlines.
+
+    \param argument Pointer to the ENCODERCHUNK structure.
+ */
+void *encoder_chunk_main(void *argument)
+{
+    ENCODERCHUNK *chunk = argument;
+    if (chunk->format == OUTPUT_FORMAT_QOI) {
+        encode_qoi_chunk(chunk);
+    } else {
+        encode_ppm_chunk(chunk);
+    }
+    return NULL;
+}
+
+/*! \brief Streams the scanlines of a bitmap to a PPM or QOI file.
+
+    Scanlines are encoded in bands of up to #ENCODER_MAX_THREADS chunks of about #ENCODER_CHUNK_BYTES,
+    each encoded by a separate thread into its own buffer; the buffers are then written in order.
+ */
+typedef struct ROWENCODER {
+    FILE *file;
+    LONG thread_count;
+    LONG chunk_lines;
+    ENCODERCHUNK chunks[ENCODER_MAX_THREADS];
+    //last pixel written so far (see #ENCODERCHUNK)
+    DWORD previous_pixel;
+} ROWENCODER;
+
+/*! \brief Encodes consecutive scanlines and writes them to the file of the #ROWENCODER.
+
+    \param encoder Pointer to the encoder.
+    \param first_row Pointer to the top scanline.
+    \param row_step Distance between the following scanlines in bytes (negative for bottom-up data).
+    \param lines Number of scanlines.
+
+    \return True on success, false on file I/O error.
+ */
+bool encode_rows(ROWENCODER *encoder, const BYTE *first_row, const ptrdiff_t row_step, const LONG lines)
+{
+    for (LONG i = 0; i < lines; ) {
+        LONG chunk_count = 0;
+        for (; chunk_count < encoder->thread_count && i < lines; chunk_count++) {
+            ENCODERCHUNK *chunk = &encoder->chunks[chunk_count];
+            chunk->first_row = first_row + i * row_step;
+            chunk->row_step = row_step;
+            chunk->lines = lines - i < encoder->chunk_lines ? lines - i : encoder->chunk_lines;
+            chunk->previous_pixel = encoder->previous_pixel;
+            i += chunk->lines;
+            encoder->previous_pixel = read_pixel(chunk->first_row + (chunk->lines - 1) * row_step
+                + (size_t)(chunk->width - 1) * chunk->pixel_bytes);
+        }
+        //the first chunk is encoded on the calling thread (as are the chunks whose thread could not be started)
+        pthread_t threads[ENCODER_MAX_THREADS];
+        bool started[ENCODER_MAX_THREADS] = {false};
+        for (LONG j = 1; j < chunk_count; j++) {
+            started[j] = pthread_create(&threads[j], NULL, encoder_chunk_main, &encoder->chunks[j]) == 0;
+        }
+        encoder_chunk_main(&encoder->chunks[0]);
+        bool status_ok = true;
+        for (LONG j = 0; j < chunk_count; j++) {
+            if (j > 0 && started[j]) {
+                pthread_join(threads[j], NULL);
+            } else if (j > 0) {
+                encoder_chunk_main(&encoder->chunks[j]);
+            }
+            ENCODERCHUNK *chunk = &encoder->chunks[j];
+            status_ok = status_ok && fwrite(chunk->output, 1, chunk->length, encoder->file) == chunk->length;
+        }
+        if (!status_ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*! \brief Saves the bitmap to a PPM (binary, P6) or QOI (RGB) file, encoding bands of scanlines in parallel.
+
+    The scanlines are read from the bitmap data or the tiles of an out-of-core bitmap as they are encoded,
+    without converting the whole bitmap first.
+
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap (24 bits per pixel).
+    \param frame_data Pointer to the bitmap data (24 or 32 bits per pixel, see \a pixel_bytes) or NULL.
+    \param pixel_bytes Number of bytes per pixel of \a frame_data (3 or 4).
+    \param cache Pointer to the cache of the tiles of an out-of-core bitmap (if \a frame_data is NULL).
+    \param format OUTPUT_FORMAT_PPM or OUTPUT_FORMAT_QOI.
+    \param output_filename Output filename.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on memory allocation or file I/O error,
+        -3 if the format is not supported.
+ */
+LONG save_encoded_bitmap(const BITMAPINFOHEADER *info_header, const BYTE *frame_data, const WORD pixel_bytes,
+    TILECACHE *cache, const LONG format, const char *output_filename)
+{
+    if (info_header == NULL || frame_data == NULL && cache == NULL || output_filename == NULL) {
+        return -1;
+    }
+    if (format != OUTPUT_FORMAT_PPM && format != OUTPUT_FORMAT_QOI) {
+        return -3;
+    }
+    DWORD width = abs(info_header->biWidth);
+    LONG height = abs(info_header->biHeight);
+    //scanlines are stored bottom-up unless the height is negative
+    bool bottom_up = info_header->biHeight > 0;
+    ROWENCODER encoder;
+    encoder.previous_pixel = QOI_FIRST_PREVIOUS;
+    bool empty = width == 0 || height == 0;
+    encoder.chunk_lines = !empty && (size_t)width * 3 < ENCODER_CHUNK_BYTES ? ENCODER_CHUNK_BYTES / (width * 3) : 1;
+    long online_count = sysconf(_SC_NPROCESSORS_ONLN);
+    encoder.thread_count = online_count < 1 ? 1
+        : online_count < ENCODER_MAX_THREADS ? online_count : ENCODER_MAX_THREADS;
+    //no more threads than chunks
+    LONG chunk_count = (height + encoder.chunk_lines - 1) / encoder.chunk_lines;
+    if (encoder.thread_count > chunk_count) {
+        encoder.thread_count = chunk_count > 0 ? chunk_count : 1;
+    }
+    size_t capacity = get_chunk_capacity(format, width, encoder.chunk_lines);
+    bool status_ok = true;
+    for (LONG j = 0; j < encoder.thread_count; j++) {
+        encoder.chunks[j].format = format;
+        encoder.chunks[j].width = width;
+        encoder.chunks[j].pixel_bytes = frame_data != NULL ? pixel_bytes : 3;
+        encoder.chunks[j].output = malloc(capacity > 0 ? capacity : 1);
+        status_ok = status_ok && encoder.chunks[j].output != NULL;
+    }
+    BYTE *buffer = frame_data == NULL ? malloc(cache->tile_bytes) : NULL;
+    encoder.file = status_ok && (frame_data != NULL || buffer != NULL) ? fopen(output_filename, "wb") : NULL;
+    if (encoder.file == NULL) {
+        for (LONG j = 0; j < encoder.thread_count; j++) {
+            free(encoder.chunks[j].output);
+        }
+        free(buffer);
+        return -2;
+    }
+
+    //header
+    if (format == OUTPUT_FORMAT_QOI) {
+        BYTE header[QOI_HEADER_SIZE] = {'q', 'o', 'i', 'f', width >> 24, width >> 16, width >> 8, width,
+            height >> 24, height >> 16, height >> 8, height, 3, 0};
+        status_ok = fwrite(header, 1, sizeof(header), encoder.file) == sizeof(header);
+    } else {
+        status_ok = fprintf(encoder.file, "P6\n%u %d\n255\n", width, height) > 0;
+    }
+
+    //scanlines from the top one
+    if (frame_data != NULL) {
+        ptrdiff_t stride = get_bitmap_stride(width, pixel_bytes * 8);
+        const BYTE *first_row = bottom_up ? frame_data + (height - 1) * stride : frame_data;
+        status_ok = status_ok && (empty || encode_rows(&encoder, first_row, bottom_up ? -stride : stride, height));
+    } else if (!empty) {
+        ptrdiff_t stride = cache->stride;
+        for (LONG k = 0; k < cache->tile_count && status_ok; k++) {
+            LONG j = bottom_up ? cache->tile_count - 1 - k : k,
+                tile_lines = get_tile_lines(cache, j);
+            const BYTE *tile_data = buffer;
+            if (cache->slot_of_tile[j] >= 0) {
+                tile_data = cache->slots[cache->slot_of_tile[j]].data;
+            } else if (!read_fully(cache->descriptor, buffer, cache->stride * tile_lines,
+                (off_t)j * cache->tile_bytes)) {
+                status_ok = false;
+                break;
+            }
+            const BYTE *first_row = bottom_up ? tile_data + (tile_lines - 1) * stride : tile_data;
+            status_ok = encode_rows(&encoder, first_row, bottom_up ? -stride : stride, tile_lines);
+        }
+    }
+
+    if (format == OUTPUT_FORMAT_QOI) {
+        static const BYTE end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+        status_ok = status_ok && fwrite(end_marker, 1, sizeof(end_marker), encoder.file) == sizeof(end_marker);
+    }
+    for (LONG j = 0; j < encoder.thread_count; j++) {
+        free(encoder.chunks[j].output);
+    }
+    free(buffer);
+    if (fclose(encoder.file) != 0 || !status_ok) {
+        return -2;
+    }
+    return 0;
+}
+
+/*! \brief Saves the bitmap to a file in the given format.
+
+    \param file_header Pointer to the BITMAPFILEHEADER (in the form of byte array) describing the output file.
+    \param info_header Pointer to the BITMAPINFOHEADER describing the bitmap stored in the file (24 bits per pixel).
+    \param frame_header Pointer to the BITMAPINFOHEADER describing the bitmap data (24 or 32 bits per pixel).
+    \param frame_data Pointer to the bitmap data.
+    \param format One of the OUTPUT_FORMAT_* indices.
+    \param output_filename Output filename.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on memory allocation or file I/O error.
+ */
+LONG save_bitmap_file(BYTE (*file_header)[14], BITMAPINFOHEADER *info_header, const BITMAPINFOHEADER *frame_header,
+    BYTE *frame_data, const LONG format, const char *output_filename)
+{
+    if (frame_header == NULL) {
+        return -1;
+    }
+    if (format != OUTPUT_FORMAT_BMP) {
+        return save_encoded_bitmap(info_header, frame_data, frame_header->biBitCount / 8, NULL, format,
+            output_filename);
+    } else if (frame_header->biBitCount == 32) {
+        return save_xrgb_bitmap(file_header, info_header, frame_data, output_filename);
+    } else {
+        return save_bitmap(file_header, info_header, frame_data, output_filename);
+    }
+}
+
+/*! \brief Save of a snapshot of the bitmap performed by a background thread (see save_canvas_background()).
+ */
+typedef struct BACKGROUNDSAVE {
+    pthread_t thread;
+    //whether a save has been started and its result not collected yet
+    bool pending;
+    //whether the save is performed by the thread (false if it was completed synchronously)
+    bool threaded;
+    //set by the thread when the save is completed
+    bool finished;
+    LONG result;
+    //copy of the bitmap data (kept allocated for the following saves)
+    BYTE *snapshot;
+    BYTE file_header[14];
+    BITMAPINFOHEADER info_header;
+    //describes snapshot
+    BITMAPINFOHEADER frame_header;
+    char filename[MAX_PATH];
+    //one of the OUTPUT_FORMAT_* indices
+    LONG format;
+    //statistics of the canvas
+    RUNSTATS *stats;
+    //identity of the written file (see saved_status of #CANVAS) and whether it could be read
+    struct stat file_status;
+    bool identified;
+} BACKGROUNDSAVE;
+
+//number of frame snapshots waiting for or being written by the frame writer (see save_canvas_frame())
+#define FRAME_SNAPSHOT_COUNT 3
+
+/*! \brief Thread writing the frames of a sequence to numbered files (see save_canvas_frame()).
+
+    Snapshots are kept allocated and reused as a ring of #FRAME_SNAPSHOT_COUNT buffers,
+    so that saving a frame costs a copy of the bitmap unless the writer falls behind.
+ */
+typedef struct FRAMEWRITER {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    //signalled when a snapshot is queued or the writer should exit
+    pthread_cond_t frame_ready;
+    //signalled when a snapshot has been written
+    pthread_cond_t frame_written;
+    bool exiting;
+    //ring of the snapshots waiting for or being written (first_frame is written first)
+    DWORD first_frame;
+    DWORD frame_count;
+    BYTE *snapshots[FRAME_SNAPSHOT_COUNT];
+    char filenames[FRAME_SNAPSHOT_COUNT][MAX_PATH];
+    //OUTPUT_FORMAT_* indices of the files
+    LONG formats[FRAME_SNAPSHOT_COUNT];
+    //result of the first failed write (zero if none) since the last call to finish_canvas_frames()
+    LONG result;
+    //describe the snapshots (the same for all the frames of a canvas)
+    BYTE file_header[14];
+    BITMAPINFOHEADER info_header;
+    BITMAPINFOHEADER frame_header;
+    //statistics of the canvas
+    RUNSTATS *stats;
+} FRAMEWRITER;
+
+/*! \brief Describes the bitmap being drawn together with the resources used for rendering and storing it.
+ */
+struct CANVAS {
+    BYTE file_header[14];
+    BITMAPINFOHEADER info_header;
+    //describes image_data (the same as info_header unless the bitmap is stored internally with 32 bits per pixel)
+    BITMAPINFOHEADER frame_header;
+    BYTE *image_data;
+    //worker threads (NULL if drawing on the calling thread)
+    RENDERPOOL *pool;
+    //mapping of the default output file (data is NULL unless the bitmap is rendered directly into the file)
+    MAPPEDFILE output_mapping;
+    //tiles of an out-of-core bitmap (NULL unless the bitmap is kept on disk, image_data is NULL then)
+    TILECACHE *tile_cache;
+    char output_filename[MAX_PATH];
+    //clear of image_data not applied to all the scanlines yet (row_generations is NULL for out-of-core bitmaps)
+    DEFERREDCLEAR deferred_clear;
+    //flags of the scanlines modified since the bitmap was saved to saved_filename (NULL if not tracked)
+    BYTE *dirty_rows;
+    //file holding the bitmap as of the last save (empty if none)
+    char saved_filename[MAX_PATH];
+    //device, inode, modification time and size of that file right after it was written
+    //(it is only updated incrementally if they still match, so that changes made by others are overwritten)
+    struct stat saved_status;
+    BACKGROUNDSAVE background_save;
+    //writer of the frame sequence (NULL until the first frame is saved)
+    FRAMEWRITER *frame_writer;
+    //number of the next frame of the sequence
+    DWORD frame_number;
+    //spans recorded instead of being drawn at once (NULL until needed, see set_deferred_spans())
+    SPANBUFFER *span_buffer;
+    //whether nothing has been drawn since the last clear and its color (see create_cache_lookup())
+    bool cleared;
+    BYTE clear_color[3];
+    CANVASSETTINGS settings;
+    //statistics of the work done on the canvas (see print_stats())
+    RUNSTATS stats;
+};
+
+/*! \brief Creates and maps the output file, so that the bitmap can be rendered directly into it.
+
+    \param canvas Pointer to the canvas with set up headers and output filename.
+
+    \return Zero on success, -2 on file I/O error.
+ */
+LONG map_output_file(CANVAS *canvas)
+{
+    size_t file_size = sizeof(canvas->file_header) + sizeof(canvas->info_header) + get_image_data_size(&canvas->info_header);
+    int descriptor = open(canvas->output_filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (descriptor < 0) {
+        return -2;
+    }
+    if (ftruncate(descriptor, (off_t)file_size) != 0) {
+        close(descriptor);
+        return -2;
+    }
+    BYTE *data = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+    if (data == MAP_FAILED) {
+        return -2;
+    }
+    memcpy(data, canvas->file_header, sizeof(canvas->file_header));
+    memcpy(data + sizeof(canvas->file_header), &canvas->info_header, sizeof(canvas->info_header));
+    canvas->output_mapping.data = data;
+    canvas->output_mapping.size = file_size;
+    canvas->image_data = data + sizeof(canvas->file_header) + sizeof(canvas->info_header);
+    return 0;
+}
+
+/*! \brief Marks a range of scanlines of the #CANVAS as modified since the last save.
+
+    \param canvas Pointer to the canvas.
+    \param first_line Vertical position of the first modified scanline (clamped to the bitmap).
+    \param last_line Vertical position of the last modified scanline (clamped to the bitmap).
+ */
+void mark_dirty_rows(CANVAS *canvas, LONG first_line, LONG last_line)
+{
+    if (canvas->dirty_rows != NULL) {
+        LONG height = abs(canvas->info_header.biHeight);
+        first_line = first_line > 0 ? first_line : 0;
+        last_line = last_line < height - 1 ? last_line : height - 1;
+        if (first_line <= last_line) {
+            memset(canvas->dirty_rows + first_line, 1, last_line - first_line + 1);
+        }
+    }
+}
+
+/*! \brief Marks the scanlines covered by the triangles as modified since the last save of the #CANVAS.
+
+    \param canvas Pointer to the canvas.
+    \param triangles Pointer to the array of triangles.
+    \param triangle_count Number of triangles.
+ */
+void mark_triangle_rows(CANVAS *canvas, VERTEXDATA (*triangles)[3], const DWORD triangle_count)
+{
+    for (DWORD i = 0; i < triangle_count && canvas->dirty_rows != NULL; i++) {
+        LONG min_y = triangles[i][0].posY, max_y = triangles[i][0].posY;
+        for (DWORD j = 1; j < 3; j++) {
+            min_y = triangles[i][j].posY < min_y ? triangles[i][j].posY : min_y;
+            max_y = triangles[i][j].posY > max_y ? triangles[i][j].posY : max_y;
+        }
+        mark_dirty_rows(canvas, min_y, max_y);
+    }
+}
+
+/*! \brief Returns the #SPANBUFFER to record the spans drawn on the #CANVAS in, creating it if needed.
+
+    If the spans are not deferred (see set_deferred_spans()), the spans recorded so far are drawn first.
+
+    \param canvas Pointer to the canvas drawn on the calling thread.
+
+    \return Pointer to the buffer or NULL if the spans should be drawn at once.
+ */
+SPANBUFFER *get_canvas_span_buffer(CANVAS *canvas)
+{
+    if (!canvas->settings.deferred_spans || canvas->settings.reverse_order) {
+        flush_span_buffer(canvas->span_buffer);
+        return NULL;
+    }
+    if (canvas->span_buffer == NULL) {
+        canvas->span_buffer = create_span_buffer(canvas->image_data, &canvas->frame_header, &canvas->deferred_clear);
+    }
+    return canvas->span_buffer;
+}
+
+/*! \brief Draws an array of triangles on the #CANVAS, using its worker threads if available.
+
+    \param canvas Pointer to the canvas.
+    \param triangles Pointer to the array of triangles (their vertices are sorted in place).
+    \param triangle_count Number of triangles.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on file I/O error (out-of-core bitmap).
+ */
+LONG draw_canvas_triangles(CANVAS *canvas, VERTEXDATA (*triangles)[3], const DWORD triangle_count)
+{
+    if (canvas == NULL || triangles == NULL) {
+        return -1;
+    }
+    use_canvas_settings(&canvas->settings, &canvas->stats);
+    canvas->cleared = false;
+    if (canvas->tile_cache != NULL) {
+        return draw_tiled_triangles(canvas->tile_cache, &canvas->frame_header, triangles, triangle_count);
+    }
+    mark_triangle_rows(canvas, triangles, triangle_count);
+    if (canvas->pool == NULL) {
+        //the pending clear is applied when the deferred spans are drawn
+        SPANBUFFER *span_buffer = get_canvas_span_buffer(canvas);
+        return draw_triangles(canvas->image_data, &canvas->frame_header, triangles, triangle_count,
+            span_buffer == NULL ? &canvas->deferred_clear : NULL, span_buffer);
+    }
+    for (DWORD i = 0; i < triangle_count; i++) {
+        queue_triangle(canvas->pool, &triangles[i]);
+    }
+    return 0;
+}
+
+//number of mesh triangles collected before drawing them
+#define MESH_CHUNK_SIZE 1024
+//number of slots of the edge cache (a power of two, so that it is at most 3/4 full with the edges of a chunk)
+#define MESH_EDGE_SLOTS 4096
+
+/*! \brief Edge of a mesh set up for the scanline of its upper vertex, keyed by the indices of its vertices.
+ */
+typedef struct MESHEDGE {
+    DWORD begin;
+    DWORD end;
+    EDGE edge;
+} MESHEDGE;
+
+/*! \brief Chunk of mesh triangles being collected for drawing together with the setup of their edges.
+
+    Edges are stored in an open addressing hash table, so that the triangles sharing an edge
+    (two of them for every inner edge of a mesh) set it up only once.
+ */
+typedef struct MESHCHUNK {
+    //triangles with sorted vertices
+    VERTEXDATA triangles[MESH_CHUNK_SIZE][3];
+    //edges v0-v2, v0-v1 and v1-v2 of the triangles (unused if the triangles are drawn by draw_canvas_triangles())
+    const EDGE *triangle_edges[MESH_CHUNK_SIZE][3];
+    DWORD triangle_count;
+    bool cache_edges;
+    MESHEDGE edges[MESH_EDGE_SLOTS];
+    bool used_slots[MESH_EDGE_SLOTS];
+} MESHCHUNK;
+
+/*! \brief Finds the edge between two vertices of a mesh in the #MESHCHUNK, setting it up if it is not cached yet.
+
+    \param chunk Pointer to the chunk.
+    \param vertices Pointer to the vertex buffer of the mesh.
+    \param begin Index of the upper vertex of the edge.
+    \param end Index of the lower vertex of the edge.
+
+    \return Pointer to the edge set up for the scanline of its upper vertex.
+ */
+const EDGE *get_mesh_edge(MESHCHUNK *chunk, const VERTEXDATA *vertices, const DWORD begin, const DWORD end)
+{
+    //triangles sharing edges have close indices in typical meshes, so their slots are kept close as well
+    DWORD slot = (begin * 4 + end) & (MESH_EDGE_SLOTS - 1);
+    while (chunk->used_slots[slot]) {
+        if (chunk->edges[slot].begin == begin && chunk->edges[slot].end == end) {
+            return &chunk->edges[slot].edge;
+        }
+        slot = (slot + 1) & (MESH_EDGE_SLOTS - 1);
+    }
+    chunk->used_slots[slot] = true;
+    chunk->edges[slot].begin = begin;
+    chunk->edges[slot].end = end;
+    set_edge(&chunk->edges[slot].edge, &vertices[begin], &vertices[end], vertices[begin].posY);
+    return &chunk->edges[slot].edge;
+}
+
+/*! \brief Draws the triangles collected in the #MESHCHUNK on the #CANVAS and empties the chunk.
+
+    \param canvas Pointer to the canvas.
+    \param chunk Pointer to the chunk.
+
+    \return Zero on success, -2 on file I/O error (out-of-core bitmap).
+ */
+LONG draw_mesh_chunk(CANVAS *canvas, MESHCHUNK *chunk)
+{
+    LONG result = 0;
+    if (!chunk->cache_edges) {
+        result = draw_canvas_triangles(canvas, chunk->triangles, chunk->triangle_count);
+    } else if (chunk->triangle_count > 0) {
+        mark_triangle_rows(canvas, chunk->triangles, chunk->triangle_count);
+        SPANBUFFER *span_buffer = get_canvas_span_buffer(canvas);
+        draw_triangles_band(canvas->image_data, &canvas->frame_header, chunk->triangles, chunk->triangle_edges,
+            chunk->triangle_count, 0, abs(canvas->frame_header.biHeight) - 1,
+            span_buffer == NULL ? &canvas->deferred_clear : NULL, span_buffer);
+        memset(chunk->used_slots, 0, sizeof(chunk->used_slots));
+    }
+    chunk->triangle_count = 0;
+    return result;
+}
+
+/*! \brief Adds a triangle of a mesh to the #MESHCHUNK, drawing the collected triangles first if the chunk is full.
+
+    \param canvas Pointer to the canvas.
+    \param chunk Pointer to the chunk.
+    \param vertices Pointer to the vertex buffer of the mesh.
+    \param indices Pointer to the array of three indices of the vertices of the triangle.
+
+    \return Zero on success, -2 on file I/O error (out-of-core bitmap).
+ */
+LONG add_mesh_triangle(CANVAS *canvas, MESHCHUNK *chunk, const VERTEXDATA *vertices, const DWORD *indices)
+{
+    //sort the indices just like sort_triangle_vertices() sorts the vertices
+    DWORD sorted[3] = {indices[0], indices[1], indices[2]}, swapped;
+    if (vertices[sorted[1]].posY < vertices[sorted[0]].posY) {
+        swapped = sorted[0], sorted[0] = sorted[1], sorted[1] = swapped;
+    }
+    if (vertices[sorted[2]].posY < vertices[sorted[1]].posY) {
+        swapped = sorted[1], sorted[1] = sorted[2], sorted[2] = swapped;
+    }
+    if (vertices[sorted[1]].posY < vertices[sorted[0]].posY) {
+        swapped = sorted[0], sorted[0] = sorted[1], sorted[1] = swapped;
+    }
+    if (chunk->cache_edges
+        && (vertices[sorted[2]].posY < 0 || vertices[sorted[0]].posY >= abs(canvas->frame_header.biHeight))) {
+        //the triangle lies entirely above or below the bitmap
+        return 0;
+    }
+    DWORD k = chunk->triangle_count;
+    for (DWORD i = 0; i < 3; i++) {
+        memcpy(&chunk->triangles[k][i], &vertices[sorted[i]], sizeof(VERTEXDATA));
+    }
+    if (chunk->cache_edges) {
+        chunk->triangle_edges[k][0] = get_mesh_edge(chunk, vertices, sorted[0], sorted[2]);
+        chunk->triangle_edges[k][1] = get_mesh_edge(chunk, vertices, sorted[0], sorted[1]);
+        chunk->triangle_edges[k][2] = get_mesh_edge(chunk, vertices, sorted[1], sorted[2]);
+    }
+    chunk->triangle_count++;
+    return chunk->triangle_count == MESH_CHUNK_SIZE ? draw_mesh_chunk(canvas, chunk) : 0;
+}
+
+/*! \brief Draws an indexed mesh (a triangle list or strip) on the #CANVAS.
+
+    Triangles are drawn in order, hence the result is identical to the one of drawing the equivalent
+    array of triangles with draw_canvas_triangles(). On a single-threaded canvas kept in memory,
+    each edge shared by triangles of a chunk is set up only once and reused by all of them.
+
+    \param canvas Pointer to the canvas.
+    \param vertices Pointer to the vertex buffer.
+    \param vertex_count Number of vertices.
+    \param indices Pointer to the index buffer: three indices per triangle for a list; for a strip,
+        every index after the first two of a strip adds a triangle formed with the two preceding ones
+        and #MESH_RESTART_INDEX starts a new strip.
+    \param index_count Number of indices.
+    \param strip Whether the indices describe a triangle strip.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on memory allocation or file I/O error,
+        -3 on incorrect indices (nothing is drawn then).
+ */
+LONG draw_canvas_mesh(CANVAS *canvas, const VERTEXDATA *vertices, const DWORD vertex_count, const DWORD *indices,
+    const DWORD index_count, const bool strip)
+{
+    if (canvas == NULL || (vertices == NULL && vertex_count > 0) || (indices == NULL && index_count > 0)) {
+        return -1;
+    }
+    if (!strip && index_count % 3 != 0) {
+        return -3;
+    }
+    for (DWORD i = 0; i < index_count; i++) {
+        if (indices[i] >= vertex_count && !(strip && indices[i] == MESH_RESTART_INDEX)) {
+            return -3;
+        }
+    }
+    if (index_count < 3) {
+        return 0;
+    }
+    use_canvas_settings(&canvas->settings, &canvas->stats);
+    canvas->cleared = false;
+    MESHCHUNK *chunk = malloc(sizeof(MESHCHUNK));
+    if (chunk == NULL) {
+        return -2;
+    }
+    chunk->triangle_count = 0;
+    //worker threads and out-of-core tiles draw the triangles without the cached edges
+    chunk->cache_edges = canvas->pool == NULL && canvas->tile_cache == NULL;
+    memset(chunk->used_slots, 0, sizeof(chunk->used_slots));
+
+    LONG result = 0;
+    if (!strip) {
+        for (DWORD i = 0; i < index_count && result == 0; i += 3) {
+            result = add_mesh_triangle(canvas, chunk, vertices, &indices[i]);
+        }
+    } else {
+        DWORD strip_length = 0;
+        for (DWORD i = 0; i < index_count && result == 0; i++) {
+            if (indices[i] == MESH_RESTART_INDEX) {
+                strip_length = 0;
+            } else if (++strip_length >= 3) {
+                result = add_mesh_triangle(canvas, chunk, vertices, &indices[i - 2]);
+            }
+        }
+    }
+    if (result == 0) {
+        result = draw_mesh_chunk(canvas, chunk);
+    }
+    free(chunk);
+    return result;
+}
+
+/*! \brief Draws an indexed mesh stored as a mesh record (see #MESH_RECORD_HEADER_SIZE) on the #CANVAS.
+
+    \param canvas Pointer to the canvas.
+    \param record Pointer to the record (need not be aligned).
+    \param length Length of the record in bytes.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on memory allocation or file I/O error,
+        -3 on incorrect record.
+ */
+LONG draw_canvas_mesh_record(CANVAS *canvas, const BYTE *record, const size_t length)
+{
+    if (canvas == NULL || record == NULL) {
+        return -1;
+    }
+    DWORD header[3];
+    if (sizeof(VERTEXDATA) != 12 || length < MESH_RECORD_HEADER_SIZE) {
+        return -3;
+    }
+    memcpy(header, record, sizeof(header));
+    if ((header[2] & ~(DWORD)MESH_FLAG_STRIP) != 0
+        || length != sizeof(header) + (size_t)header[0] * sizeof(VERTEXDATA) + (size_t)header[1] * sizeof(DWORD)) {
+        return -3;
+    }
+    const BYTE *data = record + sizeof(header);
+    BYTE *copy = NULL;
+    if ((uintptr_t)data % sizeof(DWORD) != 0) {
+        //vertices and indices have to be aligned first
+        copy = malloc(length - sizeof(header) > 0 ? length - sizeof(header) : 1);
+        if (copy == NULL) {
+            return -2;
+        }
+        memcpy(copy, data, length - sizeof(header));
+        data = copy;
+    }
+    LONG result = draw_canvas_mesh(canvas, (const VERTEXDATA *)data, header[0],
+        (const DWORD *)(data + (size_t)header[0] * sizeof(VERTEXDATA)), header[1], (header[2] & MESH_FLAG_STRIP) != 0);
+    free(copy);
+    return result;
+}
+
+/*! \brief Paints the #CANVAS using the given color.
+
+    Unless the bitmap is kept on disk, the clear is only recorded (see #DEFERREDCLEAR).
+
+    \param canvas Pointer to the canvas.
+    \param red Intensity of red in desired color.
+    \param green Intensity of green in desired color.
+    \param blue Intensity of blue in desired color.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on file I/O error (out-of-core bitmap).
+ */
+LONG clear_canvas(CANVAS *canvas, const BYTE red, const BYTE green, const BYTE blue)
+{
+    if (canvas == NULL) {
+        return -1;
+    }
+    use_canvas_settings(&canvas->settings, &canvas->stats);
+    canvas->clear_color[0] = red;
+    canvas->clear_color[1] = green;
+    canvas->clear_color[2] = blue;
+    if (canvas->tile_cache != NULL) {
+        LONG result = clear_tiled_bitmap(canvas->tile_cache, &canvas->frame_header, red, green, blue);
+        canvas->cleared = result == 0;
+        return result;
+    }
+    canvas->cleared = true;
+    //the queued triangles and deferred spans would be painted over anyway
+    if (canvas->pool != NULL) {
+        canvas->pool->queue_length = 0;
+    }
+    if (canvas->span_buffer != NULL) {
+        canvas->span_buffer->span_count = 0;
+    }
+    mark_dirty_rows(canvas, 0, abs(canvas->info_header.biHeight) - 1);
+    defer_clear(&canvas->deferred_clear, &canvas->frame_header, red, green, blue);
+    return 0;
+}
+
+/*! \brief Brings the bitmap data of the #CANVAS up to date by rasterizing the queued triangles
+    and applying the pending clear to the remaining scanlines.
+
+    \param canvas Pointer to the canvas.
+ */
+void complete_canvas(CANVAS *canvas)
+{
+    flush_render_pool(canvas->pool);
+    flush_span_buffer(canvas->span_buffer);
+    if (canvas->deferred_clear.row_generations != NULL) {
+        if (canvas->pool != NULL) {
+            apply_deferred_clear_parallel(canvas->pool);
+        } else {
+            apply_deferred_clear(canvas->image_data, &canvas->frame_header, &canvas->deferred_clear,
+                0, abs(canvas->frame_header.biHeight) - 1, true);
+        }
+    }
+}
+
+/*! \brief Rasterizes the triangles queued for the worker threads of the #CANVAS and draws its deferred spans.
+
+    \param canvas Pointer to the canvas.
+ */
+void flush_canvas(CANVAS *canvas)
+{
+    if (canvas != NULL) {
+        use_canvas_settings(&canvas->settings, &canvas->stats);
+        flush_render_pool(canvas->pool);
+        flush_span_buffer(canvas->span_buffer);
+    }
+}
+
+/*! \brief Provides the number of threads rendering on the #CANVAS.
+
+    \param canvas Pointer to the canvas.
+
+    \return Number of the worker threads or one if the canvas is drawn on by the calling thread (also when
+        the worker threads requested from create_canvas() could not be started), zero if the argument is a null pointer.
+ */
+LONG get_canvas_thread_count(const CANVAS *canvas)
+{
+    if (canvas == NULL) {
+        return 0;
+    }
+    return canvas->pool != NULL ? canvas->pool->thread_count : 1;
+}
+
+/*! \brief Calculates the size of the bitmap data of the #CANVAS provided by read_canvas_data().
+
+    \param canvas Pointer to the canvas.
+
+    \return Size of the data in bytes (zero if the argument is a null pointer).
+ */
+size_t get_canvas_data_size(const CANVAS *canvas)
+{
+    return canvas != NULL ? get_image_data_size(&canvas->info_header) : 0;
+}
+
+/*! \brief Copies the bitmap data of the #CANVAS, so that it can be used without saving it to a file.
+
+    The data is stored as in a bitmap file: bottom-up R8G8B8 scanlines padded to multiples of four bytes.
+
+    \param canvas Pointer to the canvas.
+    \param destination Pointer to the buffer of get_canvas_data_size() bytes.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on file I/O error (out-of-core bitmap).
+ */
+LONG read_canvas_data(CANVAS *canvas, BYTE *destination)
+{
+    if (canvas == NULL || destination == NULL) {
+        return -1;
+    }
+    use_canvas_settings(&canvas->settings, &canvas->stats);
+    complete_canvas(canvas);
+    DWORD width = abs(canvas->info_header.biWidth);
+    LONG height = abs(canvas->info_header.biHeight);
+    size_t stride = get_bitmap_stride(width, 24);
+    if (canvas->tile_cache != NULL) {
+        TILECACHE *cache = canvas->tile_cache;
+        for (LONG j = 0; j < cache->tile_count; j++) {
+            size_t tile_size = cache->stride * get_tile_lines(cache, j);
+            BYTE *tile_destination = destination + (size_t)j * cache->tile_bytes;
+            if (cache->slot_of_tile[j] >= 0) {
+                memcpy(tile_destination, cache->slots[cache->slot_of_tile[j]].data, tile_size);
+            } else if (!read_fully(cache->descriptor, tile_destination, tile_size, (off_t)j * cache->tile_bytes)) {
+                return -2;
+            }
+        }
+    } else if (canvas->frame_header.biBitCount == 32) {
+        size_t frame_stride = get_bitmap_stride(width, 32);
+        for (LONG i = 0; i < height; i++) {
+            BYTE *row = destination + i * stride;
+            convert_xrgb_to_rgb24(row, canvas->image_data + i * frame_stride, width);
+            memset(row + (size_t)width * 3, 0, stride - (size_t)width * 3);
+        }
+    } else {
+        memcpy(destination, canvas->image_data, stride * height);
+    }
+    return 0;
+}
+
+/*! \brief Replaces the bitmap data of the #CANVAS (the inverse of read_canvas_data()).
+
+    The queued triangles and deferred spans are discarded (they would be painted over anyway)
+    and the pending clear is applied first, so that drawing can continue as usual afterwards.
+
+    \param canvas Pointer to the canvas.
+    \param source Pointer to get_canvas_data_size() bytes of data laid out as by read_canvas_data().
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on file I/O error (out-of-core bitmap).
+ */
+LONG write_canvas_data(CANVAS *canvas, const BYTE *source)
+{
+    if (canvas == NULL || source == NULL) {
+        return -1;
+    }
+    use_canvas_settings(&canvas->settings, &canvas->stats);
+    canvas->cleared = false;
+    if (canvas->pool != NULL) {
+        canvas->pool->queue_length = 0;
+    }
+    if (canvas->span_buffer != NULL) {
+        canvas->span_buffer->span_count = 0;
+    }
+    complete_canvas(canvas);
+    DWORD width = abs(canvas->info_header.biWidth);
+    LONG height = abs(canvas->info_header.biHeight);
+    size_t stride = get_bitmap_stride(width, 24);
+    if (canvas->tile_cache != NULL) {
+        TILECACHE *cache = canvas->tile_cache;
+        for (LONG j = 0; j < cache->tile_count; j++) {
+            BYTE *tile_data = acquire_tile(cache, j, false);
+            if (tile_data == NULL) {
+                return -2;
+            }
+            memcpy(tile_data, source + (size_t)j * cache->tile_bytes, cache->stride * get_tile_lines(cache, j));
+        }
+    } else if (canvas->frame_header.biBitCount == 32) {
+        size_t frame_stride = get_bitmap_stride(width, 32);
+        for (LONG i = 0; i < height; i++) {
+            const BYTE *row = source + i * stride;
+            BYTE *frame_row = canvas->image_data + i * frame_stride;
+            for (DWORD x = 0; x < width; x++) {
+                memcpy(frame_row + 4 * x, row + 3 * x, 3);
+                frame_row[4 * x + 3] = 0;
+            }
+        }
+    } else {
+        memcpy(canvas->image_data, source, stride * height);
+    }
+    mark_dirty_rows(canvas, 0, height - 1);
+    return 0;
+}
+
+/*! \brief Calculates the size of the bitmap file of the #CANVAS provided by read_canvas_file().
+
+    \param canvas Pointer to the canvas.
+
+    \return Size of the file in bytes (zero if the argument is a null pointer).
+ */
+size_t get_canvas_file_size(const CANVAS *canvas)
+{
+    return canvas != NULL ? sizeof(canvas->file_header) + sizeof(canvas->info_header) + get_canvas_data_size(canvas) : 0;
+}
+
+/*! \brief Copies the bitmap of the #CANVAS in the form of a bitmap file (the bytes written by save_canvas()).
+
+    \param canvas Pointer to the canvas.
+    \param destination Pointer to the buffer of get_canvas_file_size() bytes.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on file I/O error (out-of-core bitmap).
+ */
+LONG read_canvas_file(CANVAS *canvas, BYTE *destination)
+{
+    if (canvas == NULL || destination == NULL) {
+        return -1;
+    }
+    memcpy(destination, canvas->file_header, sizeof(canvas->file_header));
+    memcpy(destination + sizeof(canvas->file_header), &canvas->info_header, sizeof(canvas->info_header));
+    return read_canvas_data(canvas, destination + sizeof(canvas->file_header) + sizeof(canvas->info_header));
+}
+
+/*! \brief Checks if a file is the one written by the last save of a #CANVAS and has not been modified since.
+
+    \param status Pointer to the current status of the file.
+    \param saved_status Pointer to the status of the file recorded after the last save.
+ */
+bool is_saved_file_unchanged(const struct stat *status, const struct stat *saved_status)
+{
+    return status->st_dev == saved_status->st_dev && status->st_ino == saved_status->st_ino
+        && status->st_mtim.tv_sec == saved_status->st_mtim.tv_sec
+        && status->st_mtim.tv_nsec == saved_status->st_mtim.tv_nsec && status->st_size == saved_status->st_size;
+}
+
+/*! \brief Writes the scanlines of the #CANVAS modified since the last save into the previously saved file.
+
+    Runs of modified scanlines are written in place (after the headers) using positioned writes.
+    The status of the file is recorded afterwards (see saved_status of #CANVAS).
+
+    \param canvas Pointer to the canvas with tracked modifications and a previously saved file.
+    \param rows_written Pointer for storing the number of written scanlines.
+
+    \return Zero on success, -2 on memory allocation or file I/O error,
+        -3 if the file does not match the bitmap (so that it has to be saved as a whole).
+ */
+LONG save_dirty_rows(CANVAS *canvas, LONG *rows_written)
+{
+    DWORD width = abs(canvas->info_header.biWidth);
+    LONG height = abs(canvas->info_header.biHeight);
+    size_t stride = get_bitmap_stride(width, 24),
+        frame_stride = get_bitmap_stride(width, canvas->frame_header.biBitCount);
+    off_t data_offset = sizeof(canvas->file_header) + sizeof(canvas->info_header);
+    int descriptor = open(canvas->saved_filename, O_WRONLY);
+    if (descriptor < 0) {
+        return -3;
+    }
+    struct stat file_status;
+    if (fstat(descriptor, &file_status) != 0 || !S_ISREG(file_status.st_mode)
+        || file_status.st_size != data_offset + (off_t)get_image_data_size(&canvas->info_header)
+        || !is_saved_file_unchanged(&file_status, &canvas->saved_status)) {
+        close(descriptor);
+        return -3;
+    }
+    //32-bit internal bitmaps are converted in batches of scanlines
+    BYTE *buffer = NULL;
+    LONG batch_lines = height;
+    if (canvas->frame_header.biBitCount == 32) {
+        batch_lines = stride < TILE_BYTES ? TILE_BYTES / stride : 1;
+        buffer = calloc(batch_lines, stride);
+        if (buffer == NULL) {
+            close(descriptor);
+            return -2;
+        }
+    }
+    bool status_ok = true;
+    *rows_written = 0;
+    for (LONG i = 0; i < height && status_ok; ) {
+        if (!canvas->dirty_rows[i]) {
+            i++;
+            continue;
+        }
+        LONG first_line = i;
+        while (i < height && canvas->dirty_rows[i] && i - first_line < batch_lines) {
+            i++;
+        }
+        LONG lines = i - first_line;
+        const BYTE *data = canvas->image_data + first_line * frame_stride;
+        if (buffer != NULL) {
+            for (LONG j = 0; j < lines; j++) {
+                convert_xrgb_to_rgb24(buffer + j * stride, data + j * frame_stride, width);
+            }
+            data = buffer;
+        }
+        status_ok = write_fully(descriptor, data, lines * stride, data_offset + first_line * stride);
+        *rows_written += lines;
+    }
+    free(buffer);
+    status_ok = status_ok && fstat(descriptor, &canvas->saved_status) == 0;
+    if (close(descriptor) != 0 || !status_ok) {
+        return -2;
+    }
+    return 0;
+}
+
+/*! \brief Saves the #CANVAS to a file in its output format (see set_canvas_output_format()).
+
+    If the bitmap is rendered directly into the (memory-mapped) file, the mapping is only flushed.
+    If it is saved to the same BMP file as the last time and nothing else has modified or replaced the file since,
+    only the scanlines modified since then are rewritten.
+
+    \param canvas Pointer to the canvas.
+    \param filename Output filename (or NULL for the default one).
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on file I/O error.
+ */
+LONG save_canvas(CANVAS *canvas, const char *filename)
+{
+    if (canvas == NULL) {
+        return -1;
+    }
+    if (filename == NULL) {
+        filename = canvas->output_filename;
+    }
+    use_canvas_settings(&canvas->settings, &canvas->stats);
+    //queued triangles and the pending clear are applied first (outside of the measured time)
+    complete_canvas(canvas);
+    LONGLONG start_ticks = STATS_TICKS();
+    LONG result = -3, rows_written = 0,
+        format = choose_output_format(canvas->settings.output_format, filename);
+    if (canvas->dirty_rows != NULL && format == OUTPUT_FORMAT_BMP && strcmp(filename, canvas->saved_filename) == 0) {
+        result = save_dirty_rows(canvas, &rows_written);
+    }
+    bool whole_file = result == -3;
+    if (whole_file) {
+        //the file has to be written as a whole
+        rows_written = abs(canvas->info_header.biHeight);
+        if (canvas->tile_cache != NULL && format != OUTPUT_FORMAT_BMP) {
+            result = save_encoded_bitmap(&canvas->info_header, NULL, 3, canvas->tile_cache, format, filename);
+        } else if (canvas->tile_cache != NULL) {
+            result = save_tiled_bitmap(&canvas->file_header, &canvas->info_header, canvas->tile_cache, filename);
+        } else if (canvas->output_mapping.data != NULL && strcmp(filename, canvas->output_filename) == 0) {
+            //the mapped file is a bitmap regardless of the output format
+            result = msync(canvas->output_mapping.data, canvas->output_mapping.size, MS_SYNC) != 0 ? -2 : 0;
+        } else {
+            result = save_bitmap_file(&canvas->file_header, &canvas->info_header, &canvas->frame_header,
+                canvas->image_data, format, filename);
+        }
+    }
+    if (canvas->dirty_rows != NULL) {
+        //the file is up to date now (or in an unknown state after an error)
+        if (result == 0 && (!whole_file || stat(filename, &canvas->saved_status) == 0)) {
+            memset(canvas->dirty_rows, 0, abs(canvas->info_header.biHeight));
+            canvas->saved_filename[0] = 0;
+            strncat(canvas->saved_filename, filename, MAX_PATH - 1);
+        } else {
+            canvas->saved_filename[0] = 0;
+        }
+    }
+    STATS_ADD(thread_stats->save.calls, 1);
+    STATS_ADD(thread_stats->save.rows, rows_written);
+    STATS_ADD(thread_stats->save.pixels, (LONGLONG)rows_written * abs(canvas->info_header.biWidth));
+    STATS_ADD(thread_stats->save.ticks, STATS_TICKS() - start_ticks);
+    return result;
+}
+
+/*! \brief Main function of the thread saving a snapshot of the bitmap (see save_canvas_background()).
+
+    \param argument Pointer to the BACKGROUNDSAVE structure.
+ */
+void *background_save_main(void *argument)
+{
+    BACKGROUNDSAVE *save = argument;
+    thread_stats = save->stats;
+    LONGLONG start_ticks = STATS_TICKS();
+    save->result = save_bitmap_file(&save->file_header, &save->info_header, &save->frame_header, save->snapshot,
+        save->format, save->filename);
+    save->identified = save->result == 0 && stat(save->filename, &save->file_status) == 0;
+    STATS_ADD(thread_stats->save.calls, 1);
+    STATS_ADD(thread_stats->save.rows, abs(save->info_header.biHeight));
+    STATS_ADD(thread_stats->save.pixels, (LONGLONG)abs(save->info_header.biHeight) * abs(save->info_header.biWidth));
+    STATS_ADD(thread_stats->save.ticks, STATS_TICKS() - start_ticks);
+    __atomic_store_n(&save->finished, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/*! \brief Collects the result of the background save of the #CANVAS.
+
+    \param canvas Pointer to the canvas.
+    \param wait Whether to wait for the save to be completed.
+    \param result Pointer for storing the result of the save (see save_canvas()).
+
+    \return Whether a save has been completed (and \a result set).
+ */
+bool finish_background_save(CANVAS *canvas, const bool wait, LONG *result)
+{
+    BACKGROUNDSAVE *save = &canvas->background_save;
+    if (!save->pending || !wait && !__atomic_load_n(&save->finished, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    if (save->threaded) {
+        pthread_join(save->thread, NULL);
+    }
+    save->pending = false;
+    //the scanlines modified since the snapshot are marked, so the file can be updated incrementally
+    if (save->threaded && save->identified && canvas->dirty_rows != NULL) {
+        canvas->saved_filename[0] = 0;
+        strncat(canvas->saved_filename, save->filename, MAX_PATH - 1);
+        canvas->saved_status = save->file_status;
+    }
+    *result = save->result;
+    return true;
+}
+
+/*! \brief Starts saving the #CANVAS to a file on a background thread.
+
+    The bitmap data is copied to a second buffer first, so that drawing can continue at once.
+    The result has to be collected using finish_background_save() before the next save.
+    Out-of-core bitmaps and bitmaps rendered directly into the file are saved synchronously.
+
+    \param canvas Pointer to the canvas without a pending background save.
+    \param filename Output filename (or NULL for the default one).
+
+    \return Zero if the save has been started, -1 if any argument is a null pointer,
+        -2 on memory allocation error or if the thread could not be started.
+ */
+LONG save_canvas_background(CANVAS *canvas, const char *filename)
+{
+    if (canvas == NULL) {
+        return -1;
+    }
+    if (filename == NULL) {
+        filename = canvas->output_filename;
+    }
+    BACKGROUNDSAVE *save = &canvas->background_save;
+    save->filename[0] = 0;
+    strncat(save->filename, filename, MAX_PATH - 1);
+    save->finished = false;
+    if (canvas->tile_cache != NULL || canvas->output_mapping.data != NULL && strcmp(filename, canvas->output_filename) == 0) {
+        save->threaded = false;
+        save->result = save_canvas(canvas, filename);
+        save->finished = true;
+        save->pending = true;
+        return 0;
+    }
+
+    //take the snapshot
+    use_canvas_settings(&canvas->settings, &canvas->stats);
+    complete_canvas(canvas);
+    if (save->snapshot == NULL) {
+        save->snapshot = malloc(get_image_data_size(&canvas->frame_header));
+        if (save->snapshot == NULL) {
+            return -2;
+        }
+    }
+    memcpy(save->snapshot, canvas->image_data, get_image_data_size(&canvas->frame_header));
+    memcpy(save->file_header, canvas->file_header, sizeof(save->file_header));
+    memcpy(&save->info_header, &canvas->info_header, sizeof(save->info_header));
+    memcpy(&save->frame_header, &canvas->frame_header, sizeof(save->frame_header));
+    save->format = choose_output_format(canvas->settings.output_format, filename);
+    save->stats = &canvas->stats;
+    if (canvas->dirty_rows != NULL) {
+        //the snapshot holds the modifications made so far, the file is in an unknown state until the save is completed
+        memset(canvas->dirty_rows, 0, abs(canvas->info_header.biHeight));
+        canvas->saved_filename[0] = 0;
+    }
+    save->threaded = true;
+    if (pthread_create(&save->thread, NULL, background_save_main, save) != 0) {
+        //nothing has been saved
+        mark_dirty_rows(canvas, 0, abs(canvas->info_header.biHeight) - 1);
+        return -2;
+    }
+    save->pending = true;
+    return 0;
+}
+
+/*! \brief Builds the filename of a frame of a sequence by appending its number to the base filename
+    (before the extension), e.g. result_000042.bmp.
+
+    \param buffer Buffer for storing the filename.
+    \param filename Base filename.
+    \param frame_number Number of the frame.
+ */
+void get_frame_filename(char buffer[MAX_PATH], const char *filename, const DWORD frame_number)
+{
+    const char *extension = strrchr(filename, '.'),
+        *separator = strrchr(filename, '/');
+    if (extension == NULL || separator != NULL && extension < separator) {
+        extension = filename + strlen(filename);
+    }
+    snprintf(buffer, MAX_PATH, "%.*s_%06u%s", (int)(extension - filename), filename, frame_number, extension);
+}
+
+/*! \brief Main function of the thread of the #FRAMEWRITER.
+
+    \param argument Pointer to the FRAMEWRITER structure.
+ */
+void *frame_writer_main(void *argument)
+{
+    FRAMEWRITER *writer = argument;
+    thread_stats = writer->stats;
+    pthread_mutex_lock(&writer->mutex);
+    while (true) {
+        while (writer->frame_count == 0 && !writer->exiting) {
+            pthread_cond_wait(&writer->frame_ready, &writer->mutex);
+        }
+        if (writer->frame_count == 0) {
+            break;
+        }
+        DWORD index = writer->first_frame;
+        pthread_mutex_unlock(&writer->mutex);
+
+        LONGLONG start_ticks = STATS_TICKS();
+        LONG result = save_bitmap_file(&writer->file_header, &writer->info_header, &writer->frame_header,
+            writer->snapshots[index], writer->formats[index], writer->filenames[index]);
+        STATS_ADD(thread_stats->save.calls, 1);
+        STATS_ADD(thread_stats->save.rows, abs(writer->info_header.biHeight));
+        STATS_ADD(thread_stats->save.pixels, (LONGLONG)abs(writer->info_header.biHeight) * abs(writer->info_header.biWidth));
+        STATS_ADD(thread_stats->save.ticks, STATS_TICKS() - start_ticks);
+
+        pthread_mutex_lock(&writer->mutex);
+        if (result != 0 && writer->result == 0) {
+            writer->result = result;
+        }
+        writer->first_frame = (writer->first_frame + 1) % FRAME_SNAPSHOT_COUNT;
+        writer->frame_count--;
+        pthread_cond_signal(&writer->frame_written);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+    return NULL;
+}
+
+/*! \brief Writes the queued frames, stops the thread and deallocates the #FRAMEWRITER.
+
+    \param writer Pointer to the writer (may be NULL).
+ */
+void destroy_frame_writer(FRAMEWRITER *writer)
+{
+    if (writer != NULL) {
+        pthread_mutex_lock(&writer->mutex);
+        writer->exiting = true;
+        pthread_cond_signal(&writer->frame_ready);
+        pthread_mutex_unlock(&writer->mutex);
+        pthread_join(writer->thread, NULL);
+        for (DWORD i = 0; i < FRAME_SNAPSHOT_COUNT; i++) {
+            free(writer->snapshots[i]);
+        }
+        pthread_cond_destroy(&writer->frame_written);
+        pthread_cond_destroy(&writer->frame_ready);
+        pthread_mutex_destroy(&writer->mutex);
+        free(writer);
+    }
+}
+
+/*! \brief Allocates a #FRAMEWRITER for the #CANVAS and starts its thread.
+
+    \param canvas Pointer to the canvas.
+
+    \return Pointer to the writer or NULL on memory allocation error or if the thread could not be started.
+ */
+FRAMEWRITER *create_frame_writer(CANVAS *canvas)
+{
+    FRAMEWRITER *writer = calloc(1, sizeof(FRAMEWRITER));
+    if (writer == NULL) {
+        return NULL;
+    }
+    size_t snapshot_size = get_image_data_size(&canvas->frame_header);
+    for (DWORD i = 0; i < FRAME_SNAPSHOT_COUNT; i++) {
+        writer->snapshots[i] = malloc(snapshot_size > 0 ? snapshot_size : 1);
+        if (writer->snapshots[i] == NULL) {
+            for (DWORD j = 0; j < i; j++) {
+                free(writer->snapshots[j]);
+            }
+            free(writer);
+            return NULL;
+        }
+    }
+    memcpy(writer->file_header, canvas->file_header, sizeof(writer->file_header));
+    memcpy(&writer->info_header, &canvas->info_header, sizeof(writer->info_header));
+    memcpy(&writer->frame_header, &canvas->frame_header, sizeof(writer->frame_header));
+    writer->stats = &canvas->stats;
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_cond_init(&writer->frame_ready, NULL);
+    pthread_cond_init(&writer->frame_written, NULL);
+    if (pthread_create(&writer->thread, NULL, frame_writer_main, writer) != 0) {
+        for (DWORD i = 0; i < FRAME_SNAPSHOT_COUNT; i++) {
+            free(writer->snapshots[i]);
+        }
+        pthread_cond_destroy(&writer->frame_written);
+        pthread_cond_destroy(&writer->frame_ready);
+        pthread_mutex_destroy(&writer->mutex);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+/*! \brief Saves the #CANVAS as the next frame of a sequence of numbered files (see get_frame_filename()).
+
+    The bitmap is copied to a free snapshot buffer and written by the frame writer thread, so that the next frame
+    can be drawn at once (this blocks only while all the #FRAME_SNAPSHOT_COUNT snapshots are being written).
+    Errors are reported by finish_canvas_frames(). Out-of-core bitmaps are saved synchronously.
+
+    \param canvas Pointer to the canvas.
+
+    \return Zero if the frame has been queued (or saved), -1 if the argument is a null pointer,
+        -2 on memory allocation or file I/O error or if the writer thread could not be started.
+ */
+LONG save_canvas_frame(CANVAS *canvas)
+{
+    if (canvas == NULL) {
+        return -1;
+    }
+    char filename[MAX_PATH];
+    get_frame_filename(filename, canvas->output_filename, canvas->frame_number);
+    if (canvas->tile_cache != NULL) {
+        LONG result = save_canvas(canvas, filename);
+        canvas->frame_number += result == 0;
+        return result;
+    }
+    if (canvas->frame_writer == NULL) {
+        canvas->frame_writer = create_frame_writer(canvas);
+        if (canvas->frame_writer == NULL) {
+            return -2;
+        }
+    }
+    FRAMEWRITER *writer = canvas->frame_writer;
+    pthread_mutex_lock(&writer->mutex);
+    while (writer->frame_count == FRAME_SNAPSHOT_COUNT) {
+        pthread_cond_wait(&writer->frame_written, &writer->mutex);
+    }
+    DWORD index = (writer->first_frame + writer->frame_count) % FRAME_SNAPSHOT_COUNT;
+    pthread_mutex_unlock(&writer->mutex);
+
+    //the snapshot is not accessed by the writer until it is queued
+    use_canvas_settings(&canvas->settings, &canvas->stats);
+    complete_canvas(canvas);
+    memcpy(writer->snapshots[index], canvas->image_data, get_image_data_size(&canvas->frame_header));
+    memcpy(writer->filenames[index], filename, MAX_PATH);
+    writer->formats[index] = choose_output_format(canvas->settings.output_format, filename);
+    canvas->frame_number++;
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->frame_count++;
+    pthread_cond_signal(&writer->frame_ready);
+    pthread_mutex_unlock(&writer->mutex);
+    return 0;
+}
+
+/*! \brief Waits until all the frames queued by save_canvas_frame() are written.
+
+    \param canvas Pointer to the canvas.
+
+    \return Zero if all the frames have been written successfully, -1 if the argument is a null pointer,
+        -2 on file I/O error while writing any of them (since the previous call).
+ */
+LONG finish_canvas_frames(CANVAS *canvas)
+{
+    if (canvas == NULL) {
+        return -1;
+    }
+    FRAMEWRITER *writer = canvas->frame_writer;
+    if (writer == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&writer->mutex);
+    while (writer->frame_count > 0) {
+        pthread_cond_wait(&writer->frame_written, &writer->mutex);
+    }
+    LONG result = writer->result;
+    writer->result = 0;
+    pthread_mutex_unlock(&writer->mutex);
+    return result;
+}
+
+/*! \brief Resets the runtime statistics and starts calibrating the time stamp counter.
+
+    \param run_stats Pointer to the statistics.
+ */
+void reset_run_stats(RUNSTATS *run_stats)
+{
+    memset(run_stats, 0, sizeof(*run_stats));
+    run_stats->start_ticks = read_tsc();
+    run_stats->start_time = get_time_seconds();
+}
+
+/*! \brief Adds the counters of the runtime statistics to other ones.
+
+    \param total Pointer to the statistics the counters are added to.
+    \param run_stats Pointer to the statistics.
+ */
+void add_run_stats(RUNSTATS *total, const RUNSTATS *run_stats)
+{
+    STATCOUNTERS *total_counters[5] = {&total->parse, &total->setup, &total->spans, &total->clear, &total->save};
+    const STATCOUNTERS *counters[5] = {&run_stats->parse, &run_stats->setup, &run_stats->spans, &run_stats->clear,
+        &run_stats->save};
+    for (DWORD i = 0; i < 5; i++) {
+        STATS_ADD(total_counters[i]->calls, counters[i]->calls);
+        STATS_ADD(total_counters[i]->rows, counters[i]->rows);
+        STATS_ADD(total_counters[i]->pixels, counters[i]->pixels);
+        STATS_ADD(total_counters[i]->culled, counters[i]->culled);
+        STATS_ADD(total_counters[i]->ticks, counters[i]->ticks);
+    }
+}
+
+/*! \brief Resets the runtime statistics of the #CANVAS and starts calibrating the time stamp counter.
+
+    \param canvas Pointer to the canvas or NULL for the totals (see print_stats()).
+ */
+void reset_stats(CANVAS *canvas)
+{
+    reset_run_stats(canvas != NULL ? &canvas->stats : &stats);
+}
+
+/*! \brief Accounts a parsed command in the statistics of the #CANVAS.
+
+    \param canvas Pointer to the canvas or NULL for the totals (see print_stats()).
+    \param start_ticks Time stamp counter value read before parsing the command.
+ */
+void record_parse_stats(CANVAS *canvas, const LONGLONG start_ticks)
+{
+    RUNSTATS *run_stats = canvas != NULL ? &canvas->stats : &stats;
+    STATS_ADD(run_stats->parse.calls, 1);
+    STATS_ADD(run_stats->parse.ticks, STATS_TICKS() - start_ticks);
+}
+
+/*! \brief Calculates the duration of a time stamp counter cycle, calibrated over the lifetime of the statistics.
+
+    \param run_stats Pointer to the statistics.
+
+    \return Duration of a cycle in nanoseconds.
+ */
+double get_tick_nanoseconds(const RUNSTATS *run_stats)
+{
+    LONGLONG ticks = read_tsc() - run_stats->start_ticks;
+    double seconds = get_time_seconds() - run_stats->start_time;
+    return ticks > 0 ? seconds * 1e9 / ticks : 0.0;
+}
+
+/*! \brief Prints the runtime statistics of the hot paths of the #CANVAS.
+
+    Every canvas gathers its own statistics (from its creation or the last reset_stats()), which are added
+    to the totals when it is destroyed.
+
+    \param canvas Pointer to the canvas or NULL for the totals of the destroyed canvases and of the commands parsed
+        without a canvas.
+ */
+void print_stats(const CANVAS *canvas)
+{
+#ifndef NO_STATS
+    const RUNSTATS *run_stats = canvas != NULL ? &canvas->stats : &stats;
+    const char *names[5] = {"parse", "setup", "spans", "clear", "save"};
+    const STATCOUNTERS *counters[5] = {&run_stats->parse, &run_stats->setup, &run_stats->spans, &run_stats->clear,
+        &run_stats->save};
+    double tick_nanoseconds = get_tick_nanoseconds(run_stats);
+    puts("[Statistics]");
+    printf("  %-6s %12s %12s %15s %12s %12s\n", "stage", "calls", "rows", "pixels", "culled", "time [ms]");
+    for (DWORD i = 0; i < 5; i++) {
+        printf("  %-6s %12lld %12lld %15lld %12lld %12.3f\n", names[i], (long long)counters[i]->calls,
+            (long long)counters[i]->rows, (long long)counters[i]->pixels, (long long)counters[i]->culled,
+            counters[i]->ticks * tick_nanoseconds * 1e-6);
+    }
+    putchar('\n');
+#else
+    (void)canvas;
+    puts("Statistics are disabled in this build (NO_STATS).");
+#endif
+}
+
+/*! \brief Writes the runtime statistics of the hot paths of the #CANVAS to a JSON file.
+
+    \param canvas Pointer to the canvas or NULL for the totals (see print_stats()).
+    \param filename Output filename.
+
+    \return Zero on success, -1 if the filename is a null pointer, -2 on file I/O error.
+ */
+LONG write_stats_json(const CANVAS *canvas, const char *filename)
+{
+    if (filename == NULL) {
+        return -1;
+    }
+    FILE *output_file = fopen(filename, "w");
+    if (output_file == NULL) {
+        return -2;
+    }
+    const RUNSTATS *run_stats = canvas != NULL ? &canvas->stats : &stats;
+    const char *names[5] = {"parse", "setup", "spans", "clear", "save"};
+    const STATCOUNTERS *counters[5] = {&run_stats->parse, &run_stats->setup, &run_stats->spans, &run_stats->clear,
+        &run_stats->save};
+    double tick_nanoseconds = get_tick_nanoseconds(run_stats);
+#ifndef NO_STATS
+    fputs("{\n  \"enabled\": true", output_file);
+#else
+    fputs("{\n  \"enabled\": false", output_file);
+#endif
+    for (DWORD i = 0; i < 5; i++) {
+        fprintf(output_file, ",\n  \"%s\": {\"calls\": %lld, \"rows\": %lld, \"pixels\": %lld, \"culled\": %lld, \"nanoseconds\": %.0f}",
+            names[i], (long long)counters[i]->calls, (long long)counters[i]->rows, (long long)counters[i]->pixels,
+            (long long)counters[i]->culled, counters[i]->ticks * tick_nanoseconds);
+    }
+    fputs("\n}\n", output_file);
+    if (fclose(output_file) != 0) {
+        return -2;
+    }
+    return 0;
+}
+
+/*! \brief Sets up the #CANVAS structure, allocates the bitmap and paints it white.
+
+    \param canvas Pointer to the structure.
+    \param width Width of the bitmap.
+    \param height Height of the bitmap.
+    \param output_filename Default output filename.
+    \param thread_count Number of rendering threads (one means drawing on the calling thread).
+    \param map_output Whether the bitmap should be rendered directly into the memory-mapped default output file.
+    \param cache_size Size of the tile cache in bytes if the bitmap should be kept on disk (out-of-core), zero otherwise.
+    \param xrgb Whether the bitmap should be stored internally with 32 bits per pixel (converted to RGB24 when saved).
+        Not supported together with \a map_output or \a cache_size.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on memory allocation or file I/O error.
+ */
+LONG set_up_canvas(CANVAS *canvas, const LONG width, const LONG height, const char *output_filename,
+    const LONG thread_count, const bool map_output, const size_t cache_size, const bool xrgb)
+{
+    if (canvas == NULL || output_filename == NULL) {
+        return -1;
+    }
+    set_info_header(&canvas->info_header, width, height, 24);
+    if (xrgb && !map_output && cache_size == 0) {
+        set_info_header(&canvas->frame_header, width, height, 32);
+    } else {
+        memcpy(&canvas->frame_header, &canvas->info_header, sizeof(canvas->frame_header));
+    }
+    size_t image_data_size = get_image_data_size(&canvas->frame_header);
+    DWORD summed_header_size = sizeof(canvas->file_header) + sizeof(canvas->info_header);
+    //the file size field is limited to 32 bits (zeroed if exceeded)
+    size_t file_size = get_image_data_size(&canvas->info_header) + summed_header_size;
+    set_file_header(&canvas->file_header, file_size <= UINT32_MAX ? file_size : 0, summed_header_size);
+    canvas->output_filename[0] = 0;
+    strncat(canvas->output_filename, output_filename, MAX_PATH - 1);
+    canvas->output_mapping.data = NULL;
+    canvas->tile_cache = NULL;
+    canvas->image_data = NULL;
+    canvas->pool = NULL;
+    canvas->dirty_rows = NULL;
+    canvas->saved_filename[0] = 0;
+    canvas->deferred_clear.generation = 0;
+    canvas->deferred_clear.row_generations = NULL;
+    canvas->background_save.pending = false;
+    canvas->background_save.snapshot = NULL;
+    canvas->frame_writer = NULL;
+    canvas->frame_number = 0;
+    canvas->span_buffer = NULL;
+    canvas->cleared = false;
+    memcpy(&canvas->settings, &default_settings, sizeof(canvas->settings));
+    reset_run_stats(&canvas->stats);
+
+    if (cache_size > 0) {
+        canvas->tile_cache = create_tile_cache(&canvas->info_header, cache_size, output_filename);
+        if (canvas->tile_cache == NULL) {
+            return -2;
+        }
+        return clear_canvas(canvas, 0xff, 0xff, 0xff);
+    }
+    //no scanline has been cleared yet
+    canvas->deferred_clear.row_generations = calloc(abs(height) > 0 ? abs(height) : 1, sizeof(DWORD));
+    if (canvas->deferred_clear.row_generations == NULL) {
+        return -2;
+    }
+    if (map_output) {
+        if (map_output_file(canvas) != 0) {
+            return -2;
+        }
+    } else {
+        canvas->image_data = malloc(image_data_size > 0 ? image_data_size : 1);
+        //modified scanlines are tracked for incremental saving
+        canvas->dirty_rows = calloc(abs(height) > 0 ? abs(height) : 1, 1);
+        if (canvas->image_data == NULL || canvas->dirty_rows == NULL) {
+            return -2;
+        }
+    }
+
+    //start worker threads (if requested, drawing falls back to the calling thread if they cannot be started)
+    if (thread_count > 1) {
+        canvas->pool = create_render_pool(canvas->image_data, &canvas->frame_header, &canvas->deferred_clear,
+            &canvas->settings, &canvas->stats, thread_count);
+    }
+
+    //set background
+    return clear_canvas(canvas, 0xff, 0xff, 0xff);
+}
+
+/*! \brief Allocates a #CANVAS and sets it up (see set_up_canvas()).
+
+    \param canvas Pointer for storing the canvas (set to NULL on failure). It should be destroyed using destroy_canvas().
+    \param width Width of the bitmap.
+    \param height Height of the bitmap.
+    \param output_filename Default output filename.
+    \param thread_count Number of rendering threads (one means drawing on the calling thread,
+        which is also used if the worker threads cannot be started, see get_canvas_thread_count()).
+    \param map_output Whether the bitmap should be rendered directly into the memory-mapped default output file.
+    \param cache_size Size of the tile cache in bytes if the bitmap should be kept on disk (out-of-core), zero otherwise.
+    \param xrgb Whether the bitmap should be stored internally with 32 bits per pixel.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on memory allocation or file I/O error.
+ */
+LONG create_canvas(CANVAS **canvas, const LONG width, const LONG height, const char *output_filename,
+    const LONG thread_count, const bool map_output, const size_t cache_size, const bool xrgb)
+{
+    if (canvas == NULL || output_filename == NULL) {
+        return -1;
+    }
+    *canvas = malloc(sizeof(CANVAS));
+    if (*canvas == NULL) {
+        return -2;
+    }
+    LONG result = set_up_canvas(*canvas, width, height, output_filename, thread_count, map_output, cache_size, xrgb);
+    if (result != 0) {
+        destroy_canvas(*canvas);
+        *canvas = NULL;
+    }
+    return result;
+}
+
+/*! \brief Stops the worker threads, deallocates (or unmaps) the bitmap of the #CANVAS and the canvas itself.
+
+    \param canvas Pointer to the canvas created using create_canvas() (may be NULL).
+ */
+void destroy_canvas(CANVAS *canvas)
+{
+    if (canvas != NULL) {
+        //the result of a pending background save is discarded
+        LONG save_result;
+        finish_background_save(canvas, true, &save_result);
+        free(canvas->background_save.snapshot);
+        canvas->background_save.snapshot = NULL;
+        //the queued frames are written first
+        destroy_frame_writer(canvas->frame_writer);
+        canvas->frame_writer = NULL;
+        if (canvas->output_mapping.data != NULL) {
+            //the mapped file should hold the whole bitmap
+            use_canvas_settings(&canvas->settings, &canvas->stats);
+            complete_canvas(canvas);
+        }
+        destroy_span_buffer(canvas->span_buffer);
+        canvas->span_buffer = NULL;
+        destroy_render_pool(canvas->pool);
+        canvas->pool = NULL;
+        destroy_tile_cache(canvas->tile_cache);
+        canvas->tile_cache = NULL;
+        free(canvas->dirty_rows);
+        canvas->dirty_rows = NULL;
+        free(canvas->deferred_clear.row_generations);
+        canvas->deferred_clear.row_generations = NULL;
+        if (canvas->output_mapping.data != NULL) {
+            unmap_file(&canvas->output_mapping);
+        } else {
+            free(canvas->image_data);
+        }
+        add_run_stats(&stats, &canvas->stats);
+        //the calling thread must not keep referring to the statistics
+        if (thread_stats == &canvas->stats) {
+            use_canvas_settings(&default_settings, &stats);
+        }
+        free(canvas);
+    }
+}
+
+/*! \brief Selects the line drawing function of the #CANVAS (see select_line_drawer()).
+
+    The triangles drawn so far are rasterized first, so the function only applies to the ones drawn afterwards.
+
+    \param canvas Pointer to the canvas.
+    \param line_drawer One of the LINE_DRAWER_* indices (supported by the CPU, see detect_line_drawers()).
+
+    \return Zero on success, -1 if the canvas is a null pointer or the index is incorrect.
+ */
+LONG set_canvas_line_drawer(CANVAS *canvas, const LONG line_drawer)
+{
+    if (canvas == NULL || line_drawer < 0 || line_drawer >= LINE_DRAWER_COUNT) {
+        return -1;
+    }
+    flush_canvas(canvas);
+    canvas->settings.line_drawer = line_drawer;
+    return 0;
+}
+
+/*! \brief Selects the triangle rasterizer of the #CANVAS (see select_rasterizer()).
+
+    \param canvas Pointer to the canvas.
+    \param rasterizer One of the RASTERIZER_* indices.
+
+    \return Zero on success, -1 if the canvas is a null pointer or the index is incorrect.
+ */
+LONG set_canvas_rasterizer(CANVAS *canvas, const LONG rasterizer)
+{
+    if (canvas == NULL || rasterizer < 0 || rasterizer >= RASTERIZER_COUNT) {
+        return -1;
+    }
+    flush_canvas(canvas);
+    canvas->settings.rasterizer = rasterizer;
+    return 0;
+}
+
+/*! \brief Selects the order in which the batches of triangles are drawn on the #CANVAS (see set_reverse_order()).
+
+    \param canvas Pointer to the canvas.
+    \param reverse Whether to draw in reverse order.
+
+    \return Zero on success, -1 if the canvas is a null pointer.
+ */
+LONG set_canvas_reverse_order(CANVAS *canvas, const bool reverse)
+{
+    if (canvas == NULL) {
+        return -1;
+    }
+    flush_canvas(canvas);
+    canvas->settings.reverse_order = reverse;
+    return 0;
+}
+
+/*! \brief Selects whether the spans of the triangles drawn on the #CANVAS are deferred (see set_deferred_spans()).
+
+    \param canvas Pointer to the canvas.
+    \param deferred Whether to defer the spans.
+
+    \return Zero on success, -1 if the canvas is a null pointer.
+ */
+LONG set_canvas_deferred_spans(CANVAS *canvas, const bool deferred)
+{
+    if (canvas == NULL) {
+        return -1;
+    }
+    flush_canvas(canvas);
+    canvas->settings.deferred_spans = deferred;
+    return 0;
+}
+
+/*! \brief Selects the format of the files saved by the #CANVAS (see select_output_format()).
+
+    \param canvas Pointer to the canvas.
+    \param format One of the OUTPUT_FORMAT_* indices or -1 to choose the format by the extension of each file.
+
+    \return Zero on success, -1 if the canvas is a null pointer or the index is incorrect.
+ */
+LONG set_canvas_output_format(CANVAS *canvas, const LONG format)
+{
+    if (canvas == NULL || format < -1 || format >= OUTPUT_FORMAT_COUNT) {
+        return -1;
+    }
+    canvas->settings.output_format = format;
+    return 0;
+}
+
+//beginning of a binary batch file, followed by records of three VERTEXDATA structures
+#define BATCH_MAGIC "RGBTRI01"
+#define BATCH_MAGIC_LENGTH 8
+//beginning of a binary mesh batch file, followed by a mesh record (see #MESH_RECORD_HEADER_SIZE)
+#define BATCH_MESH_MAGIC "RGBMSH01"
+//beginning of a binary frames batch file, followed by frame records, each consisting of a DWORD triangle count,
+//BYTE flags (see #BATCH_FRAME_CLEAR), BYTE red, BYTE green, BYTE blue and the triangles (as in binary batch files)
+#define BATCH_FRAMES_MAGIC "RGBFRM01"
+#define BATCH_FRAME_HEADER_SIZE 8
+//clears the canvas with the color of the frame record before drawing its triangles
+#define BATCH_FRAME_CLEAR 1
+
+/*! \brief Skips spaces and tabs.
+
+    \param cursor Pointer to the current position in the text.
+    \param end End of the text.
+
+    \return Position of the first character which is not a space nor a tab.
+ */
+const char *skip_blanks(const char *cursor, const char *end)
+{
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\v' || *cursor == '\f')) {
+        cursor++;
+    }
+    return cursor;
+}
+
+/*! \brief Checks if the cursor points at the end of a token.
+
+    \param cursor Pointer to the current position in the text.
+    \param end End of the text.
+ */
+bool is_token_end(const char *cursor, const char *end)
+{
+    return cursor == end || isspace((unsigned char)*cursor);
+}
+
+/*! \brief Reads a word (a token consisting of the given characters) and advances the cursor past it.
+
+    \param cursor Pointer to the pointer to the current position in the text.
+    \param end End of the text.
+    \param word Expected word.
+
+    \return True if the word was read, false otherwise (the cursor is left unchanged).
+ */
+bool parse_word(const char **cursor, const char *end, const char *word)
+{
+    const char *position = skip_blanks(*cursor, end);
+    while (*word != 0) {
+        if (position == end || *position != *word) {
+            return false;
+        }
+        position++;
+        word++;
+    }
+    if (!is_token_end(position, end)) {
+        return false;
+    }
+    *cursor = position;
+    return true;
+}
+
+/*! \brief Reads a decimal integer and advances the cursor past it.
+
+    \param cursor Pointer to the pointer to the current position in the text.
+    \param end End of the text.
+    \param value Pointer for storing the result.
+
+    \return True if a number fitting in LONG was read, false otherwise.
+ */
+bool parse_long(const char **cursor, const char *end, LONG *value)
+{
+    const char *position = skip_blanks(*cursor, end);
+    bool negative = false;
+    if (position < end && (*position == '-' || *position == '+')) {
+        negative = *position == '-';
+        position++;
+    }
+    if (position == end || !isdigit((unsigned char)*position)) {
+        return false;
+    }
+    LONGLONG result = 0;
+    while (position < end && isdigit((unsigned char)*position)) {
+        result = result * 10 + (*position - '0');
+        if (result > (LONGLONG)INT32_MAX + 1) {
+            return false;
+        }
+        position++;
+    }
+    if (negative) {
+        result = -result;
+    }
+    if (result > INT32_MAX || !is_token_end(position, end)) {
+        return false;
+    }
+    *value = (LONG)result;
+    *cursor = position;
+    return true;
+}
+
+/*! \brief Converts a hexadecimal digit to its value.
+
+    \return Value of the digit or -1 if the character is not a hexadecimal digit.
+ */
+LONG hex_digit_value(const char character)
+{
+    if (character >= '0' && character <= '9') {
+        return character - '0';
+    } else if (character >= 'a' && character <= 'f') {
+        return character - 'a' + 10;
+    } else if (character >= 'A' && character <= 'F') {
+        return character - 'A' + 10;
+    }
+    return -1;
+}
+
+/*! \brief Reads a color (in #rrggbb or "red green blue" format) and advances the cursor past it.
+
+    \param cursor Pointer to the pointer to the current position in the text.
+    \param end End of the text.
+    \param red Pointer for storing intensity of red.
+    \param green Pointer for storing intensity of green.
+    \param blue Pointer for storing intensity of blue.
+
+    \return True if the color was read, false otherwise.
+ */
+bool parse_color(const char **cursor, const char *end, BYTE *red, BYTE *green, BYTE *blue)
+{
+    const char *position = skip_blanks(*cursor, end);
+    if (position < end && *position == '#') {
+        LONG digits[6];
+        if (end - position < 7) {
+            return false;
+        }
+        for (DWORD i = 0; i < 6; i++) {
+            digits[i] = hex_digit_value(position[i + 1]);
+            if (digits[i] < 0) {
+                return false;
+            }
+        }
+        position += 7;
+        if (!is_token_end(position, end)) {
+            return false;
+        }
+        *red = digits[0] << 4 | digits[1];
+        *green = digits[2] << 4 | digits[3];
+        *blue = digits[4] << 4 | digits[5];
+    } else {
+        LONG colors[3];
+        for (DWORD i = 0; i < 3; i++) {
+            if (!parse_long(&position, end, &colors[i]) || colors[i] < 0 || colors[i] > 255) {
+                return false;
+            }
+        }
+        *red = colors[0];
+        *green = colors[1];
+        *blue = colors[2];
+    }
+    *cursor = position;
+    return true;
+}
+
+/*! \brief Reads a vertex (x y color) and advances the cursor past it.
+
+    \param cursor Pointer to the pointer to the current position in the text.
+    \param end End of the text.
+    \param vertex Pointer for storing the result.
+
+    \return True if the vertex was read, false otherwise.
+ */
+bool parse_vertex(const char **cursor, const char *end, VERTEXDATA *vertex)
+{
+    return parse_long(cursor, end, &vertex->posX)
+        && parse_long(cursor, end, &vertex->posY)
+        && parse_color(cursor, end, &vertex->colR, &vertex->colG, &vertex->colB);
+}
+
+/*! \brief Checks if only blank characters are left in the line.
+
+    \param cursor Pointer to the current position in the text.
+    \param end End of the line.
+ */
+bool is_line_end(const char *cursor, const char *end)
+{
+    return skip_blanks(cursor, end) == end;
+}
+
+/*! \brief Reads mesh indices until the end of the line.
+
+    \param cursor Pointer to the pointer to the current position in the text.
+    \param end End of the line.
+    \param indices Pointer to the pointer to the growable array of indices (reallocated as needed).
+    \param index_capacity Pointer to the capacity of the array.
+    \param index_count Pointer for storing the number of indices read.
+
+    \return Zero on success, -2 on memory allocation error, -3 if anything but non-negative numbers was found.
+ */
+LONG parse_mesh_indices(const char **cursor, const char *end, DWORD **indices, DWORD *index_capacity,
+    DWORD *index_count)
+{
+    *index_count = 0;
+    while (!is_line_end(*cursor, end)) {
+        LONG index;
+        if (!parse_long(cursor, end, &index) || index < 0) {
+            return -3;
+        }
+        if (*index_count == *index_capacity) {
+            DWORD capacity = *index_capacity > 0 ? 2 * *index_capacity : 64;
+            DWORD *reallocated = realloc(*indices, capacity * sizeof(DWORD));
+            if (reallocated == NULL) {
+                return -2;
+            }
+            *indices = reallocated;
+            *index_capacity = capacity;
+        }
+        (*indices)[(*index_count)++] = index;
+    }
+    return 0;
+}
+
+//signature of the header files of the render cache entries (see #RENDERCACHEENTRY)
+#define RENDER_CACHE_MAGIC "RGBCCH02"
+//extension of the header file of an entry (named after the key of the entry in hexadecimal)
+#define RENDER_CACHE_EXTENSION ".rgbc"
+//extension of the snapshot of the bitmap of an entry (a plain bitmap file)
+#define RENDER_CACHE_SNAPSHOT_EXTENSION ".bmp"
+//number of the hashes of the prefixes of the commands kept by an entry (of the first 1, 2, 4, 8, ... commands)
+#define RENDER_CACHE_CHECKPOINTS 64
+
+/*! \brief Header file of an entry of the render cache, followed by the vertex buffer of the mesh commands
+    and by the parsed commands.
+
+    An entry holds the state of the canvas after the commands of the cacheable prefix of a text batch file
+    (all the commands before the first one with other effects than drawing: save, frame, stats, kill, quit
+    or an incorrect one) executed on a freshly cleared canvas. It is keyed by the hash of the settings affecting
+    the pixels, of the clear color and of the parsed commands (so comments, blank lines, formatting of numbers
+    and colors and flush commands do not matter). The parsed commands themselves are compared as well
+    before the entry is restored. The snapshot of the bitmap is stored next to it.
+ */
+typedef struct RENDERCACHEENTRY {
+    char magic[8];
+    //settings affecting the pixels (hashed as well)
+    LONG width;
+    LONG height;
+    LONG line_drawer;
+    LONG rasterizer;
+    BYTE clear_color[4];
+    //number of the hashed commands and the hash of the settings and all of them
+    LONGLONG command_count;
+    uint64_t key;
+    //hashes of the settings and the first 2^k commands
+    uint64_t checkpoints[RENDER_CACHE_CHECKPOINTS];
+    DWORD vertex_count;
+    //size of the parsed commands (see hash_pipeline_command())
+    uint64_t commands_size;
+} RENDERCACHEENTRY;
+
+/*! \brief Sets up the settings of a render cache.
+
+    \param cache Pointer to the settings.
+    \param directory Directory of the entries (created if needed) or NULL to disable the cache.
+    \param max_bytes Limit of the total size of the entries.
+    \param max_entries Limit of the number of the entries.
+    \param min_commands Minimal number of the commands of a prefix worth caching.
+
+    \return Zero on success, -1 if any limit is zero, -2 if the directory cannot be created, -3 if its name is too long.
+ */
+LONG configure_render_cache(RENDERCACHE *cache, const char *directory, const size_t max_bytes,
+    const DWORD max_entries, const LONGLONG min_commands)
+{
+    if (directory == NULL) {
+        cache->directory[0] = 0;
+        return 0;
+    }
+    if (max_bytes == 0 || max_entries == 0 || min_commands < 1) {
+        return -1;
+    }
+    //leave room for the names of the entries
+    if (strlen(directory) > MAX_PATH - 40) {
+        return -3;
+    }
+    struct stat directory_status;
+    mkdir(directory, 0777);
+    if (stat(directory, &directory_status) != 0 || !S_ISDIR(directory_status.st_mode)) {
+        return -2;
+    }
+    strcpy(cache->directory, directory);
+    cache->max_bytes = max_bytes;
+    cache->max_entries = max_entries;
+    cache->min_commands = min_commands;
+    return 0;
+}
+
+/*! \brief Selects the directory of the render cache used by run_batch() for text batch files
+    on the canvases created afterwards (see set_canvas_render_cache()).
+
+    A text batch file whose commands start with the cacheable prefix of a previously executed one
+    (see #RENDERCACHEENTRY) restores the bitmap and the vertex buffer saved after it instead of drawing it
+    and only executes the remaining commands. The cacheable prefix of every executed file is saved
+    unless it was restored as a whole, evicting the least recently used entries beyond the limits.
+    The cache is only used for the files executed on a canvas with nothing drawn since it was cleared.
+
+    \param directory Directory of the entries (created if needed) or NULL to disable the cache.
+    \param max_bytes Limit of the total size of the entries.
+    \param max_entries Limit of the number of the entries.
+    \param min_commands Minimal number of the commands of a prefix worth caching
+        (shorter ones are neither saved nor matched).
+
+    \return Zero on success, -1 if any limit is zero, -2 if the directory cannot be created, -3 if its name is too long.
+ */
+LONG set_render_cache(const char *directory, const size_t max_bytes, const DWORD max_entries,
+    const LONGLONG min_commands)
+{
+    return configure_render_cache(&default_settings.render_cache, directory, max_bytes, max_entries, min_commands);
+}
+
+/*! \brief Selects the directory of the render cache used by run_batch() for the text batch files executed
+    on the #CANVAS (see set_render_cache()).
+
+    \param canvas Pointer to the canvas.
+    \param directory Directory of the entries (created if needed) or NULL to disable the cache.
+    \param max_bytes Limit of the total size of the entries.
+    \param max_entries Limit of the number of the entries.
+    \param min_commands Minimal number of the commands of a prefix worth caching.
+
+    \return Zero on success, -1 if the canvas is a null pointer or any limit is zero, -2 if the directory cannot
+        be created, -3 if its name is too long.
+ */
+LONG set_canvas_render_cache(CANVAS *canvas, const char *directory, const size_t max_bytes, const DWORD max_entries,
+    const LONGLONG min_commands)
+{
+    if (canvas == NULL) {
+        return -1;
+    }
+    return configure_render_cache(&canvas->settings.render_cache, directory, max_bytes, max_entries, min_commands);
+}
+
+/*! \brief Mixes a value into the hash of the render cache (see #RENDERCACHEENTRY).
+
+    \param hash Current hash.
+    \param value Value to be mixed in.
+
+    \return Updated hash.
+ */
+uint64_t mix_cache_hash(uint64_t hash, const uint64_t value)
+{
+    hash ^= value * 0x9e3779b97f4a7c15;
+    return (hash << 31 | hash >> 33) * 0xbf58476d1ce4e5b9;
+}
+
+/*! \brief Prepares the header of a render cache entry describing the settings and the clear color of the #CANVAS
+    and no commands.
+
+    \param canvas Pointer to the canvas.
+    \param entry Pointer for storing the header (its key is the hash of the settings).
+ */
+void init_cache_entry(const CANVAS *canvas, RENDERCACHEENTRY *entry)
+{
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->magic, RENDER_CACHE_MAGIC, sizeof(entry->magic));
+    entry->width = abs(canvas->info_header.biWidth);
+    entry->height = abs(canvas->info_header.biHeight);
+    //the kernels and the rasterizers may differ in colors
+    entry->line_drawer = canvas->settings.line_drawer;
+    entry->rasterizer = canvas->settings.rasterizer;
+    memcpy(entry->clear_color, canvas->clear_color, sizeof(canvas->clear_color));
+    uint64_t magic;
+    memcpy(&magic, RENDER_CACHE_MAGIC, sizeof(magic));
+    uint64_t hash = mix_cache_hash(0, magic);
+    hash = mix_cache_hash(hash, (uint64_t)entry->width << 32 | (DWORD)entry->height);
+    hash = mix_cache_hash(hash, (uint64_t)entry->line_drawer << 32 | (DWORD)entry->rasterizer);
+    entry->key = mix_cache_hash(hash,
+        entry->clear_color[0] | entry->clear_color[1] << 8 | entry->clear_color[2] << 16);
+}
+
+/*! \brief Builds the name of a file of a render cache entry.
+
+    \param cache Pointer to the settings of the cache.
+    \param path Buffer of MAX_PATH characters for storing the name.
+    \param key Key of the entry.
+    \param extension Extension of the file.
+ */
+void get_cache_path(const RENDERCACHE *cache, char path[MAX_PATH], const uint64_t key, const char *extension)
+{
+    snprintf(path, MAX_PATH, "%s/%016llx%s", cache->directory, (unsigned long long)key, extension);
+}
+
+/*! \brief Checks if a directory entry is the header file of a render cache entry.
+
+    \param name Name of the directory entry.
+ */
+bool is_cache_entry_name(const char *name)
+{
+    size_t length = strlen(name);
+    return length == 16 + strlen(RENDER_CACHE_EXTENSION) && strspn(name, "0123456789abcdef") == 16
+        && strcmp(name + 16, RENDER_CACHE_EXTENSION) == 0;
+}
+
+/*! \brief Reads the header of a render cache entry and checks if it matches the settings of the canvas.
+
+    \param cache Pointer to the settings of the cache.
+    \param path Name of the header file.
+    \param settings Pointer to the header describing the settings of the canvas (see init_cache_entry()).
+    \param entry Pointer for storing the header.
+
+    \return The opened file positioned at the vertices of the entry or NULL if the entry does not match.
+ */
+FILE *open_cache_entry(const RENDERCACHE *cache, const char *path, const RENDERCACHEENTRY *settings,
+    RENDERCACHEENTRY *entry)
+{
+    FILE *entry_file = fopen(path, "rb");
+    if (entry_file == NULL) {
+        return NULL;
+    }
+    if (fread(entry, sizeof(*entry), 1, entry_file) != 1
+        || memcmp(entry->magic, settings->magic, sizeof(entry->magic)) != 0
+        || entry->width != settings->width || entry->height != settings->height
+        || entry->line_drawer != settings->line_drawer || entry->rasterizer != settings->rasterizer
+        || memcmp(entry->clear_color, settings->clear_color, sizeof(entry->clear_color)) != 0
+        || entry->command_count < cache->min_commands) {
+        fclose(entry_file);
+        return NULL;
+    }
+    return entry_file;
+}
+
+/*! \brief Describes a render cache entry while the least recently used ones are being evicted.
+ */
+typedef struct CACHEEVICTION {
+    char name[32];
+    struct timespec last_used;
+    size_t size;
+} CACHEEVICTION;
+
+/*! \brief Orders render cache entries from the most recently used one (see qsort()).
+ */
+int compare_cache_evictions(const void *first, const void *second)
+{
+    const struct timespec *first_time = &((const CACHEEVICTION *)first)->last_used,
+        *second_time = &((const CACHEEVICTION *)second)->last_used;
+    if (first_time->tv_sec != second_time->tv_sec) {
+        return first_time->tv_sec < second_time->tv_sec ? 1 : -1;
+    }
+    return first_time->tv_nsec < second_time->tv_nsec ? 1 : first_time->tv_nsec > second_time->tv_nsec ? -1 : 0;
+}
+
+/*! \brief Removes the least recently used render cache entries (by the modification time of their header files,
+    which is updated when they are restored) until the limits of the cache are met.
+
+    \param cache Pointer to the settings of the cache.
+
+    \return Zero on success, -2 on memory allocation or file I/O error.
+ */
+LONG evict_render_cache(const RENDERCACHE *cache)
+{
+    DIR *directory = opendir(cache->directory);
+    if (directory == NULL) {
+        return -2;
+    }
+    CACHEEVICTION *entries = NULL;
+    size_t entry_count = 0, entry_capacity = 0;
+    LONG result = 0;
+    struct dirent *directory_entry;
+    while ((directory_entry = readdir(directory)) != NULL) {
+        if (!is_cache_entry_name(directory_entry->d_name)) {
+            continue;
+        }
+        if (entry_count == entry_capacity) {
+            entry_capacity = entry_capacity > 0 ? 2 * entry_capacity : 64;
+            CACHEEVICTION *reallocated = realloc(entries, entry_capacity * sizeof(CACHEEVICTION));
+            if (reallocated == NULL) {
+                result = -2;
+                break;
+            }
+            entries = reallocated;
+        }
+        CACHEEVICTION *entry = &entries[entry_count];
+        char path[MAX_PATH];
+        struct stat header_status, snapshot_status;
+        strcpy(entry->name, directory_entry->d_name);
+        snprintf(path, MAX_PATH, "%s/%s", cache->directory, entry->name);
+        if (stat(path, &header_status) != 0) {
+            continue;
+        }
+        strcpy(path + strlen(path) - strlen(RENDER_CACHE_EXTENSION), RENDER_CACHE_SNAPSHOT_EXTENSION);
+        entry->last_used = header_status.st_mtim;
+        entry->size = header_status.st_size + (stat(path, &snapshot_status) == 0 ? snapshot_status.st_size : 0);
+        entry_count++;
+    }
+    closedir(directory);
+
+    if (result == 0 && entry_count > 0) {
+        qsort(entries, entry_count, sizeof(CACHEEVICTION), compare_cache_evictions);
+        size_t total_size = 0;
+        for (size_t i = 0; i < entry_count; i++) {
+            total_size += entries[i].size;
+            if (total_size > cache->max_bytes || i >= cache->max_entries) {
+                char path[MAX_PATH];
+                snprintf(path, MAX_PATH, "%s/%s", cache->directory, entries[i].name);
+                unlink(path);
+                strcpy(path + strlen(path) - strlen(RENDER_CACHE_EXTENSION), RENDER_CACHE_SNAPSHOT_EXTENSION);
+                unlink(path);
+            }
+        }
+    }
+    free(entries);
+    return result;
+}
+
+/*! \brief Saves the state of the #CANVAS after the cacheable prefix of a text batch file as a render cache entry
+    and evicts the least recently used entries beyond the limits of the cache.
+
+    The files are written under temporary names and renamed, the snapshot first, so that concurrent runs
+    never see an incomplete entry.
+
+    \param canvas Pointer to the canvas.
+    \param entry Pointer to the header of the entry (with the number of the vertices and the size of the commands).
+    \param vertices Pointer to the vertex buffer of the mesh commands.
+    \param commands Pointer to the parsed commands (see hash_pipeline_command()).
+
+    \return Zero on success (or if the entry would not fit in the cache), -2 on memory allocation or file I/O error.
+ */
+LONG store_render_cache_entry(CANVAS *canvas, const RENDERCACHEENTRY *entry, const VERTEXDATA *vertices,
+    const BYTE *commands)
+{
+    const RENDERCACHE *cache = &canvas->settings.render_cache;
+    size_t vertices_size = (size_t)entry->vertex_count * sizeof(VERTEXDATA);
+    if (sizeof(*entry) + vertices_size + entry->commands_size + get_canvas_file_size(canvas) > cache->max_bytes) {
+        return 0;
+    }
+    char path[MAX_PATH], temporary_path[MAX_PATH];
+    //the snapshot is a bitmap file regardless of the selected output format
+    use_canvas_settings(&canvas->settings, &canvas->stats);
+    complete_canvas(canvas);
+    get_cache_path(cache, temporary_path, entry->key, ".bmp.tmp");
+    LONG result;
+    if (canvas->tile_cache != NULL) {
+        result = save_tiled_bitmap(&canvas->file_header, &canvas->info_header, canvas->tile_cache, temporary_path);
+    } else if (canvas->frame_header.biBitCount == 32) {
+        result = save_xrgb_bitmap(&canvas->file_header, &canvas->info_header, canvas->image_data, temporary_path);
+    } else {
+        result = save_bitmap(&canvas->file_header, &canvas->info_header, canvas->image_data, temporary_path);
+    }
+    get_cache_path(cache, path, entry->key, RENDER_CACHE_SNAPSHOT_EXTENSION);
+    if (result != 0 || rename(temporary_path, path) != 0) {
+        unlink(temporary_path);
+        return -2;
+    }
+
+    get_cache_path(cache, temporary_path, entry->key, ".rgbc.tmp");
+    FILE *entry_file = fopen(temporary_path, "wb");
+    if (entry_file == NULL) {
+        return -2;
+    }
+    bool written = fwrite(entry, sizeof(*entry), 1, entry_file) == 1
+        && (vertices_size == 0 || fwrite(vertices, vertices_size, 1, entry_file) == 1)
+        && (entry->commands_size == 0 || fwrite(commands, entry->commands_size, 1, entry_file) == 1);
+    get_cache_path(cache, path, entry->key, RENDER_CACHE_EXTENSION);
+    if (fclose(entry_file) != 0 || !written || rename(temporary_path, path) != 0) {
+        unlink(temporary_path);
+        return -2;
+    }
+    return evict_render_cache(cache);
+}
+
+/*! \brief Render cache entry loaded for restoring the state of a canvas.
+ */
+typedef struct CACHEDSNAPSHOT {
+    RENDERCACHEENTRY entry;
+    //vertex buffer of the mesh commands
+    VERTEXDATA *vertices;
+    //mapped bitmap file
+    MAPPEDFILE bitmap;
+} CACHEDSNAPSHOT;
+
+/*! \brief Checks if the parsed commands stored in a render cache entry start the given ones.
+
+    \param entry_file File of the entry positioned at its commands.
+    \param commands_size Size of the commands of the entry.
+    \param commands Pointer to the parsed commands (see hash_pipeline_command()).
+    \param commands_length Length of the parsed commands.
+ */
+bool compare_cached_commands(FILE *entry_file, const uint64_t commands_size, const BYTE *commands,
+    const size_t commands_length)
+{
+    if (commands == NULL || commands_size > commands_length) {
+        return false;
+    }
+    BYTE buffer[65536];
+    for (uint64_t offset = 0; offset < commands_size;) {
+        size_t length = commands_size - offset < sizeof(buffer) ? commands_size - offset : sizeof(buffer);
+        if (fread(buffer, length, 1, entry_file) != 1 || memcmp(buffer, commands + offset, length) != 0) {
+            return false;
+        }
+        offset += length;
+    }
+    return true;
+}
+
+/*! \brief Loads a render cache entry matching the #CANVAS and marks it as the most recently used one.
+
+    \param canvas Pointer to the canvas.
+    \param candidate Pointer to the header of the entry found when the cache was searched.
+    \param commands Pointer to the parsed commands, which have to start with the ones of the entry
+        (so that the entry is not trusted on a collision of the hashes).
+    \param commands_length Length of the parsed commands.
+
+    \return Pointer to the loaded entry (to be freed by restore_cached_snapshot()) or NULL if it cannot be used.
+ */
+CACHEDSNAPSHOT *load_cached_snapshot(const CANVAS *canvas, const RENDERCACHEENTRY *candidate, const BYTE *commands,
+    const size_t commands_length)
+{
+    CACHEDSNAPSHOT *snapshot = calloc(1, sizeof(CACHEDSNAPSHOT));
+    if (snapshot == NULL) {
+        return NULL;
+    }
+    const RENDERCACHE *cache = &canvas->settings.render_cache;
+    char path[MAX_PATH];
+    get_cache_path(cache, path, candidate->key, RENDER_CACHE_EXTENSION);
+    FILE *entry_file = open_cache_entry(cache, path, candidate, &snapshot->entry);
+    if (entry_file == NULL || snapshot->entry.key != candidate->key
+        || snapshot->entry.command_count != candidate->command_count) {
+        if (entry_file != NULL) {
+            fclose(entry_file);
+        }
+        free(snapshot);
+        return NULL;
+    }
+    size_t vertices_size = (size_t)snapshot->entry.vertex_count * sizeof(VERTEXDATA);
+    snapshot->vertices = malloc(vertices_size > 0 ? vertices_size : 1);
+    bool loaded = snapshot->vertices != NULL
+        && (vertices_size == 0 || fread(snapshot->vertices, vertices_size, 1, entry_file) == 1)
+        && compare_cached_commands(entry_file, snapshot->entry.commands_size, commands, commands_length);
+    fclose(entry_file);
+    //the snapshot has to describe exactly the same bitmap
+    char snapshot_path[MAX_PATH];
+    get_cache_path(cache, snapshot_path, candidate->key, RENDER_CACHE_SNAPSHOT_EXTENSION);
+    if (!loaded || map_file(&snapshot->bitmap, snapshot_path) != 0
+        || snapshot->bitmap.size != get_canvas_file_size(canvas)
+        || memcmp(snapshot->bitmap.data, canvas->file_header, sizeof(canvas->file_header)) != 0
+        || memcmp(snapshot->bitmap.data + sizeof(canvas->file_header), &canvas->info_header,
+            sizeof(canvas->info_header)) != 0) {
+        unmap_file(&snapshot->bitmap);
+        free(snapshot->vertices);
+        free(snapshot);
+        return NULL;
+    }
+    utimensat(AT_FDCWD, path, NULL, 0);
+    return snapshot;
+}
+
+/*! \brief Render cache entry which may match the commands being parsed.
+ */
+typedef struct CACHECANDIDATE {
+    RENDERCACHEENTRY entry;
+    //false once the commands are known not to start with the prefix of the entry
+    bool alive;
+} CACHECANDIDATE;
+
+/*! \brief Search of the render cache for the longest prefix of the commands of a text batch file.
+
+    The parsed commands are hashed until the end of the cacheable prefix (see #RENDERCACHEENTRY).
+    The candidate entries are compared at the checkpoints (so that most mismatching ones are dropped early)
+    and at their lengths. While a candidate longer than the parsed commands is left, the parsed commands
+    are held in the chunk being collected instead of being rendered, so that the ones covered by a match
+    can be replaced by restoring the entry.
+ */
+typedef struct CACHELOOKUP {
+    //settings of the cache (those of the canvas)
+    const RENDERCACHE *cache;
+    //header of the entry of the commands parsed so far (its key is their running hash)
+    RENDERCACHEENTRY prefix;
+    CACHECANDIDATE *candidates;
+    DWORD candidate_count;
+    //number of the commands at which the candidates are compared next
+    LONGLONG next_check;
+    //whether the parsed commands are held in the chunk being collected
+    bool holding;
+    //whether the end of the cacheable prefix has been reached
+    bool ended;
+    //longest matching candidate (-1 if none) and the offset of the commands following it in the collected chunk
+    LONG match;
+    size_t match_offset;
+    //parsed commands of the prefix (NULL once they would not fit in the cache, see hash_pipeline_command())
+    BYTE *commands;
+    size_t commands_length;
+    size_t commands_capacity;
+} CACHELOOKUP;
+
+/*! \brief Starts searching the render cache for the commands of a text batch file executed on the #CANVAS.
+
+    \param canvas Pointer to the canvas.
+
+    \return Pointer to the lookup (to be freed by destroy_cache_lookup()), NULL if the cache is disabled,
+        something has been drawn on the canvas since it was cleared (its contents are not part of the key)
+        or on memory allocation error.
+ */
+CACHELOOKUP *create_cache_lookup(const CANVAS *canvas)
+{
+    const RENDERCACHE *cache = &canvas->settings.render_cache;
+    if (cache->directory[0] == 0 || !canvas->cleared) {
+        return NULL;
+    }
+    CACHELOOKUP *lookup = calloc(1, sizeof(CACHELOOKUP));
+    if (lookup == NULL) {
+        return NULL;
+    }
+    lookup->cache = cache;
+    lookup->commands_capacity = 65536;
+    lookup->commands = malloc(lookup->commands_capacity);
+    init_cache_entry(canvas, &lookup->prefix);
+    lookup->match = -1;
+    DIR *directory = opendir(cache->directory);
+    struct dirent *directory_entry;
+    DWORD candidate_capacity = 0;
+    while (directory != NULL && (directory_entry = readdir(directory)) != NULL) {
+        if (!is_cache_entry_name(directory_entry->d_name)) {
+            continue;
+        }
+        if (lookup->candidate_count == candidate_capacity) {
+            candidate_capacity = candidate_capacity > 0 ? 2 * candidate_capacity : 16;
+            CACHECANDIDATE *reallocated = realloc(lookup->candidates, candidate_capacity * sizeof(CACHECANDIDATE));
+            if (reallocated == NULL) {
+                break;
+            }
+            lookup->candidates = reallocated;
+        }
+        char path[MAX_PATH];
+        snprintf(path, MAX_PATH, "%s/%s", cache->directory, directory_entry->d_name);
+        CACHECANDIDATE *candidate = &lookup->candidates[lookup->candidate_count];
+        FILE *entry_file = open_cache_entry(cache, path, &lookup->prefix, &candidate->entry);
+        if (entry_file != NULL) {
+            fclose(entry_file);
+            candidate->alive = true;
+            lookup->candidate_count++;
+        }
+    }
+    if (directory != NULL) {
+        closedir(directory);
+    }
+    lookup->holding = lookup->candidate_count > 0;
+    lookup->next_check = 1;
+    return lookup;
+}
+
+/*! \brief Frees the #CACHELOOKUP.
+
+    \param lookup Pointer to the lookup (can be NULL).
+ */
+void destroy_cache_lookup(CACHELOOKUP *lookup)
+{
+    if (lookup != NULL) {
+        free(lookup->candidates);
+        free(lookup->commands);
+        free(lookup);
+    }
+}
+
+//size of the commands collected from a text batch file before passing them to the rendering stage
+#define PIPELINE_CHUNK_BYTES (2 * 1024 * 1024)
+//number of chunks of commands being collected, waiting for or being rendered
+#define PIPELINE_CHUNK_COUNT 3
+
+//commands passed from the parsing to the rendering stage of a text batch (see #PIPELINECOMMAND)
+//payload: triangles (consecutive draw commands are merged)
+#define PIPELINE_DRAW 0
+//payload: vertices appended to the vertex buffer (consecutive vertex commands are merged)
+#define PIPELINE_VERTEX 1
+//no payload; empties the vertex buffer
+#define PIPELINE_RESET 2
+//payload: DWORD strip flag, DWORD indices
+#define PIPELINE_MESH 3
+//payload: BYTE red, BYTE green, BYTE blue
+#define PIPELINE_CLEAR 4
+//payload: null-terminated filename (empty for the default one)
+#define PIPELINE_SAVE 5
+//no payload; prints the statistics
+#define PIPELINE_STATS 6
+//no payload; saves the bitmap as the next frame of the sequence (see save_canvas_frame())
+#define PIPELINE_FRAME 7
+//no payload; draws the queued triangles and the deferred spans (see flush_canvas())
+#define PIPELINE_FLUSH 8
+//payload: pointer to the CACHEDSNAPSHOT replacing the bitmap and the vertex buffer (see #CACHELOOKUP)
+#define PIPELINE_RESTORE 9
+//payload: RENDERCACHEENTRY of the commands so far, which are saved in the render cache,
+//followed by the pointer to the parsed commands (freed afterwards, see #CACHELOOKUP)
+#define PIPELINE_STORE 10
+//no payload; records an incorrect command in the report (see report_incorrect_command())
+#define PIPELINE_ERROR 11
+
+/*! \brief Header of a command passed from the parsing to the rendering stage of a text batch.
+ */
+typedef struct PIPELINECOMMAND {
+    DWORD type;
+    DWORD line_number;
+    //length of the payload following the header (a multiple of four bytes)
+    DWORD length;
+} PIPELINECOMMAND;
+
+/*! \brief Chunk of commands passed from the parsing to the rendering stage of a text batch.
+ */
+typedef struct PIPELINECHUNK {
+    BYTE *data;
+    size_t length;
+    size_t capacity;
+} PIPELINECHUNK;
+
+/*! \brief Two-stage pipeline executing a text batch file.
+
+    The calling thread parses the commands into chunks, which are executed by the rendering thread
+    in order, so that parsing overlaps with drawing (and with writing frames, see save_canvas_frame()).
+    The outcome of the commands is recorded in the #BATCHREPORT by the rendering thread (which also prints
+    the statistics of the stats commands, in the order of the commands).
+ */
+typedef struct BATCHPIPELINE {
+    CANVAS *canvas;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    //signalled when a chunk is passed to the rendering thread or the batch is finished
+    pthread_cond_t chunk_ready;
+    //signalled when a chunk has been rendered
+    pthread_cond_t chunk_done;
+    bool finished;
+    //ring of the chunks waiting for or being rendered (first_chunk is rendered first), followed by the one being collected
+    PIPELINECHUNK chunks[PIPELINE_CHUNK_COUNT];
+    DWORD first_chunk;
+    DWORD chunk_count;
+    //offset of the last command of the chunk being collected (SIZE_MAX if none)
+    size_t last_command;
+    //result of the rendering stage (see run_batch())
+    LONG result;
+    //outcome of the commands (updated by the rendering thread)
+    BATCHREPORT *report;
+    //vertex buffer of the mesh commands (owned by the rendering thread)
+    VERTEXDATA *vertices;
+    DWORD vertex_count;
+    DWORD vertex_capacity;
+    //search of the render cache (owned by the calling thread, NULL if the cache is disabled)
+    CACHELOOKUP *cache_lookup;
+} BATCHPIPELINE;
+
+/*! \brief Records an incorrect command of a batch file in the #BATCHREPORT.
+
+    \param report Pointer to the report.
+    \param line_number Number of the line of the command.
+ */
+void report_incorrect_command(BATCHREPORT *report, const DWORD line_number)
+{
+    if (report->error_count == 0) {
+        report->error_line = line_number;
+    }
+    report->error_count++;
+}
+
+/*! \brief Executes a command of a text batch on the rendering thread of the #BATCHPIPELINE.
+
+    \param pipeline Pointer to the pipeline.
+    \param command Pointer to the command followed by its payload.
+ */
+void execute_pipeline_command(BATCHPIPELINE *pipeline, const PIPELINECOMMAND *command)
+{
+    CANVAS *canvas = pipeline->canvas;
+    BYTE *payload = (BYTE *)(command + 1);
+    switch (command->type) {
+    case PIPELINE_DRAW:
+        if (draw_canvas_triangles(canvas, (VERTEXDATA (*)[3])payload, command->length / sizeof(VERTEXDATA[3])) != 0) {
+            pipeline->result = -2;
+        }
+        break;
+    case PIPELINE_VERTEX: {
+        DWORD count = command->length / sizeof(VERTEXDATA);
+        if (pipeline->vertex_count + count > pipeline->vertex_capacity) {
+            DWORD capacity = pipeline->vertex_capacity > 0 ? pipeline->vertex_capacity : 64;
+            while (capacity < pipeline->vertex_count + count) {
+                capacity *= 2;
+            }
+            VERTEXDATA *reallocated = realloc(pipeline->vertices, (size_t)capacity * sizeof(VERTEXDATA));
+            if (reallocated == NULL) {
+                pipeline->result = -2;
+                break;
+            }
+            pipeline->vertices = reallocated;
+            pipeline->vertex_capacity = capacity;
+        }
+        memcpy(&pipeline->vertices[pipeline->vertex_count], payload, (size_t)count * sizeof(VERTEXDATA));
+        pipeline->vertex_count += count;
+        break;
+    }
+    case PIPELINE_RESET:
+        pipeline->vertex_count = 0;
+        break;
+    case PIPELINE_MESH: {
+        DWORD flags;
+        memcpy(&flags, payload, sizeof(flags));
+        LONG draw_result = draw_canvas_mesh(canvas, pipeline->vertices, pipeline->vertex_count,
+            (const DWORD *)(payload + sizeof(flags)), (command->length - sizeof(flags)) / sizeof(DWORD), flags != 0);
+        if (draw_result == -3) {
+            report_incorrect_command(pipeline->report, command->line_number);
+        }
+        if (draw_result != 0) {
+            pipeline->result = draw_result;
+        }
+        break;
+    }
+    case PIPELINE_CLEAR:
+        if (clear_canvas(canvas, payload[0], payload[1], payload[2]) != 0) {
+            pipeline->result = -2;
+        }
+        break;
+    case PIPELINE_SAVE:
+        if (save_canvas(canvas, payload[0] != 0 ? (const char *)payload : NULL) == 0) {
+            pipeline->report->save_count++;
+        } else {
+            pipeline->report->save_error_count++;
+            pipeline->result = -2;
+        }
+        break;
+    case PIPELINE_STATS:
+        //account the queued triangles as well
+        flush_canvas(canvas);
+        print_stats(canvas);
+        break;
+    case PIPELINE_FRAME:
+        if (save_canvas_frame(canvas) != 0) {
+            pipeline->report->frame_error = true;
+        }
+        pipeline->report->frames_saved = true;
+        break;
+    case PIPELINE_FLUSH:
+        flush_canvas(canvas);
+        break;
+    case PIPELINE_RESTORE: {
+        CACHEDSNAPSHOT *snapshot;
+        memcpy(&snapshot, payload, sizeof(snapshot));
+        if (write_canvas_data(canvas, snapshot->bitmap.data + sizeof(canvas->file_header) + sizeof(canvas->info_header))
+            == 0) {
+            pipeline->report->restored_command_count = snapshot->entry.command_count;
+        } else {
+            pipeline->report->restore_error = true;
+            pipeline->result = -2;
+        }
+        free(pipeline->vertices);
+        pipeline->vertices = snapshot->vertices;
+        pipeline->vertex_count = snapshot->entry.vertex_count;
+        pipeline->vertex_capacity = snapshot->entry.vertex_count;
+        unmap_file(&snapshot->bitmap);
+        free(snapshot);
+        break;
+    }
+    case PIPELINE_STORE: {
+        //a failure only costs the next run the time of drawing
+        RENDERCACHEENTRY entry;
+        BYTE *commands;
+        memcpy(&entry, payload, sizeof(entry));
+        memcpy(&commands, payload + sizeof(entry), sizeof(commands));
+        entry.vertex_count = pipeline->vertex_count;
+        if (store_render_cache_entry(canvas, &entry, pipeline->vertices, commands) != 0) {
+            pipeline->report->store_error = true;
+        }
+        free(commands);
+        break;
+    }
+    case PIPELINE_ERROR:
+        report_incorrect_command(pipeline->report, command->line_number);
+        pipeline->result = -3;
+        break;
+    }
+}
+
+/*! \brief Main function of the rendering thread of the #BATCHPIPELINE.
+
+    \param argument Pointer to the BATCHPIPELINE structure.
+ */
+void *pipeline_render_main(void *argument)
+{
+    BATCHPIPELINE *pipeline = argument;
+    pthread_mutex_lock(&pipeline->mutex);
+    while (true) {
+        while (pipeline->chunk_count == 0 && !pipeline->finished) {
+            pthread_cond_wait(&pipeline->chunk_ready, &pipeline->mutex);
+        }
+        if (pipeline->chunk_count == 0) {
+            break;
+        }
+        PIPELINECHUNK *chunk = &pipeline->chunks[pipeline->first_chunk];
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        for (size_t offset = 0; offset < chunk->length;) {
+            const PIPELINECOMMAND *command = (const PIPELINECOMMAND *)(chunk->data + offset);
+            execute_pipeline_command(pipeline, command);
+            offset += sizeof(PIPELINECOMMAND) + command->length;
+        }
+
+        pthread_mutex_lock(&pipeline->mutex);
+        pipeline->first_chunk = (pipeline->first_chunk + 1) % PIPELINE_CHUNK_COUNT;
+        pipeline->chunk_count--;
+        pthread_cond_signal(&pipeline->chunk_done);
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    return NULL;
+}
+
+/*! \brief Passes the chunk being collected to the rendering thread of the #BATCHPIPELINE
+    and starts collecting the next one (waiting for a free chunk if needed).
+
+    \param pipeline Pointer to the pipeline.
+ */
+void submit_pipeline_chunk(BATCHPIPELINE *pipeline)
+{
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->chunk_count++;
+    pthread_cond_signal(&pipeline->chunk_ready);
+    while (pipeline->chunk_count == PIPELINE_CHUNK_COUNT) {
+        pthread_cond_wait(&pipeline->chunk_done, &pipeline->mutex);
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    pipeline->chunks[(pipeline->first_chunk + pipeline->chunk_count) % PIPELINE_CHUNK_COUNT].length = 0;
+    pipeline->last_command = SIZE_MAX;
+}
+
+/*! \brief Adds a command to the chunk being collected by the #BATCHPIPELINE (see #PIPELINECOMMAND).
+
+    The payload of a draw or vertex command is appended to the preceding command of the same type if possible.
+    The chunk is not passed to the rendering thread while the commands are held by the render cache lookup.
+
+    \param pipeline Pointer to the pipeline.
+    \param type Type of the command (one of the PIPELINE_* values).
+    \param line_number Number of the line of the command.
+    \param length Length of the payload.
+
+    \return Pointer to the space for the payload or NULL on memory allocation error.
+ */
+BYTE *add_pipeline_command(BATCHPIPELINE *pipeline, const DWORD type, const DWORD line_number, const size_t length)
+{
+    PIPELINECHUNK *chunk = &pipeline->chunks[(pipeline->first_chunk + pipeline->chunk_count) % PIPELINE_CHUNK_COUNT];
+    if (chunk->length >= PIPELINE_CHUNK_BYTES && (pipeline->cache_lookup == NULL || !pipeline->cache_lookup->holding)) {
+        submit_pipeline_chunk(pipeline);
+        chunk = &pipeline->chunks[(pipeline->first_chunk + pipeline->chunk_count) % PIPELINE_CHUNK_COUNT];
+    }
+    size_t padded_length = (length + 3) & ~(size_t)3;
+    bool merged = (type == PIPELINE_DRAW || type == PIPELINE_VERTEX) && pipeline->last_command != SIZE_MAX
+        && ((PIPELINECOMMAND *)(chunk->data + pipeline->last_command))->type == type;
+    size_t required_length = chunk->length + (merged ? 0 : sizeof(PIPELINECOMMAND)) + padded_length;
+    if (required_length > chunk->capacity) {
+        size_t capacity = required_length > PIPELINE_CHUNK_BYTES ? 2 * required_length : 2 * PIPELINE_CHUNK_BYTES;
+        BYTE *reallocated = realloc(chunk->data, capacity);
+        if (reallocated == NULL) {
+            return NULL;
+        }
+        chunk->data = reallocated;
+        chunk->capacity = capacity;
+    }
+    if (!merged) {
+        PIPELINECOMMAND header = {type, line_number, 0};
+        memcpy(chunk->data + chunk->length, &header, sizeof(header));
+        pipeline->last_command = chunk->length;
+        chunk->length += sizeof(header);
+    }
+    ((PIPELINECOMMAND *)(chunk->data + pipeline->last_command))->length += padded_length;
+    BYTE *payload = chunk->data + chunk->length;
+    chunk->length += padded_length;
+    return payload;
+}
+
+/*! \brief Discards the triangles collected by the #BATCHPIPELINE since the last command of another type
+    (they would be painted over or never saved anyway).
+
+    \param pipeline Pointer to the pipeline.
+ */
+void discard_pipeline_triangles(BATCHPIPELINE *pipeline)
+{
+    PIPELINECHUNK *chunk = &pipeline->chunks[(pipeline->first_chunk + pipeline->chunk_count) % PIPELINE_CHUNK_COUNT];
+    if (pipeline->last_command != SIZE_MAX
+        && ((PIPELINECOMMAND *)(chunk->data + pipeline->last_command))->type == PIPELINE_DRAW) {
+        chunk->length = pipeline->last_command;
+        pipeline->last_command = SIZE_MAX;
+    }
+}
+
+/*! \brief Stops holding the commands parsed by the #BATCHPIPELINE, replacing the ones covered by the longest
+    matching render cache entry (if any) with restoring it (see #CACHELOOKUP).
+
+    If the entry cannot be loaded, all the commands are kept (so only the time of drawing them is lost)
+    and the entry is saved again at the end of the prefix.
+
+    \param pipeline Pointer to the pipeline.
+ */
+void release_pipeline_commands(BATCHPIPELINE *pipeline)
+{
+    CACHELOOKUP *lookup = pipeline->cache_lookup;
+    if (!lookup->holding) {
+        return;
+    }
+    lookup->holding = false;
+    if (lookup->match < 0) {
+        return;
+    }
+    CACHEDSNAPSHOT *snapshot = load_cached_snapshot(pipeline->canvas, &lookup->candidates[lookup->match].entry,
+        lookup->commands, lookup->commands_length);
+    if (snapshot == NULL) {
+        lookup->match = -1;
+        return;
+    }
+    PIPELINECHUNK *chunk = &pipeline->chunks[(pipeline->first_chunk + pipeline->chunk_count) % PIPELINE_CHUNK_COUNT];
+    PIPELINECOMMAND header = {PIPELINE_RESTORE, 0, (sizeof(snapshot) + 3) & ~(size_t)3};
+    size_t restore_length = sizeof(header) + header.length,
+        remaining_length = chunk->length - lookup->match_offset;
+    if (restore_length + remaining_length > chunk->capacity) {
+        BYTE *reallocated = realloc(chunk->data, restore_length + remaining_length);
+        if (reallocated == NULL) {
+            unmap_file(&snapshot->bitmap);
+            free(snapshot->vertices);
+            free(snapshot);
+            lookup->match = -1;
+            return;
+        }
+        chunk->data = reallocated;
+        chunk->capacity = restore_length + remaining_length;
+    }
+    memmove(chunk->data + restore_length, chunk->data + lookup->match_offset, remaining_length);
+    memcpy(chunk->data, &header, sizeof(header));
+    memcpy(chunk->data + sizeof(header), &snapshot, sizeof(snapshot));
+    if (pipeline->last_command != SIZE_MAX) {
+        pipeline->last_command = pipeline->last_command - lookup->match_offset + restore_length;
+    }
+    chunk->length = restore_length + remaining_length;
+}
+
+/*! \brief Compares the render cache candidates of the #BATCHPIPELINE with the commands parsed so far
+    (see #CACHELOOKUP).
+
+    \param pipeline Pointer to the pipeline.
+ */
+void check_cache_candidates(BATCHPIPELINE *pipeline)
+{
+    CACHELOOKUP *lookup = pipeline->cache_lookup;
+    LONGLONG command_count = lookup->prefix.command_count;
+    bool checkpoint = (command_count & (command_count - 1)) == 0;
+    LONGLONG next_checkpoint = (LONGLONG)1 << (64 - __builtin_clzll(command_count));
+    lookup->next_check = 0;
+    for (DWORD i = 0; i < lookup->candidate_count; i++) {
+        CACHECANDIDATE *candidate = &lookup->candidates[i];
+        if (!candidate->alive) {
+            continue;
+        }
+        if (candidate->entry.command_count == command_count) {
+            candidate->alive = false;
+            if (candidate->entry.key == lookup->prefix.key) {
+                //the following commands are never merged with the covered ones
+                lookup->match = i;
+                lookup->match_offset =
+                    pipeline->chunks[(pipeline->first_chunk + pipeline->chunk_count) % PIPELINE_CHUNK_COUNT].length;
+                pipeline->last_command = SIZE_MAX;
+            }
+        } else if (checkpoint && candidate->entry.checkpoints[__builtin_ctzll(command_count)]
+            != lookup->prefix.checkpoints[__builtin_ctzll(command_count)]) {
+            candidate->alive = false;
+        } else {
+            LONGLONG check = candidate->entry.command_count < next_checkpoint
+                ? candidate->entry.command_count : next_checkpoint;
+            if (lookup->next_check == 0 || check < lookup->next_check) {
+                lookup->next_check = check;
+            }
+        }
+    }
+    if (lookup->next_check == 0) {
+        release_pipeline_commands(pipeline);
+    }
+}
+
+/*! \brief Appends the values of a command parsed by the #BATCHPIPELINE to the commands of its cacheable prefix
+    (see #CACHELOOKUP), dropping them once they would not fit in the cache.
+
+    \param lookup Pointer to the lookup.
+    \param values Pointer to the values.
+    \param length Length of the values.
+ */
+void record_cache_command(CACHELOOKUP *lookup, const void *values, const size_t length)
+{
+    if (lookup->commands == NULL) {
+        return;
+    }
+    if (sizeof(RENDERCACHEENTRY) + lookup->commands_length + length > lookup->cache->max_bytes) {
+        free(lookup->commands);
+        lookup->commands = NULL;
+        return;
+    }
+    if (lookup->commands_length + length > lookup->commands_capacity) {
+        size_t capacity = 2 * (lookup->commands_length + length);
+        BYTE *reallocated = realloc(lookup->commands, capacity);
+        if (reallocated == NULL) {
+            free(lookup->commands);
+            lookup->commands = NULL;
+            return;
+        }
+        lookup->commands = reallocated;
+        lookup->commands_capacity = capacity;
+    }
+    memcpy(lookup->commands + lookup->commands_length, values, length);
+    lookup->commands_length += length;
+}
+
+/*! \brief Adds a command parsed by the #BATCHPIPELINE to the hash and to the commands of its cacheable prefix
+    (see #CACHELOOKUP).
+
+    \param pipeline Pointer to the pipeline.
+    \param type Type of the command (draw, vertex, reset, mesh or clear).
+    \param payload Pointer to the payload of the command.
+    \param length Length of the payload.
+ */
+void hash_pipeline_command(BATCHPIPELINE *pipeline, const DWORD type, const BYTE *payload, const size_t length)
+{
+    CACHELOOKUP *lookup = pipeline->cache_lookup;
+    if (lookup == NULL || lookup->ended) {
+        return;
+    }
+    uint64_t hash = mix_cache_hash(lookup->prefix.key, (uint64_t)length << 32 | type);
+    DWORD header[2] = {type, (DWORD)length};
+    record_cache_command(lookup, header, sizeof(header));
+    if (type == PIPELINE_DRAW || type == PIPELINE_VERTEX) {
+        //the padding of the vertices is neither hashed nor recorded
+        const VERTEXDATA *vertices = (const VERTEXDATA *)payload;
+        for (size_t i = 0; i < length / sizeof(VERTEXDATA); i++) {
+            DWORD values[3] = {vertices[i].posX, vertices[i].posY,
+                vertices[i].colR | vertices[i].colG << 8 | vertices[i].colB << 16};
+            hash = mix_cache_hash(hash, (uint64_t)values[0] << 32 | values[1]);
+            hash = mix_cache_hash(hash, values[2]);
+            record_cache_command(lookup, values, sizeof(values));
+        }
+    } else {
+        for (size_t i = 0; i < length; i += sizeof(DWORD)) {
+            DWORD value = 0;
+            memcpy(&value, payload + i, length - i < sizeof(value) ? length - i : sizeof(value));
+            hash = mix_cache_hash(hash, value);
+        }
+        record_cache_command(lookup, payload, length);
+    }
+    lookup->prefix.key = hash;
+    LONGLONG command_count = ++lookup->prefix.command_count;
+    if ((command_count & (command_count - 1)) == 0) {
+        lookup->prefix.checkpoints[__builtin_ctzll(command_count)] = hash;
+    }
+    if (command_count == lookup->next_check) {
+        check_cache_candidates(pipeline);
+    }
+}
+
+/*! \brief Ends the cacheable prefix of the commands parsed by the #BATCHPIPELINE before a command with other effects
+    than drawing or at the end of the file (see #CACHELOOKUP).
+
+    \param pipeline Pointer to the pipeline.
+    \param store Whether the state after the prefix should be saved in the render cache (unless it was restored
+        as a whole or it is too short).
+ */
+void end_cacheable_prefix(BATCHPIPELINE *pipeline, const bool store)
+{
+    CACHELOOKUP *lookup = pipeline->cache_lookup;
+    if (lookup == NULL || lookup->ended) {
+        return;
+    }
+    lookup->ended = true;
+    release_pipeline_commands(pipeline);
+    bool restored_whole = lookup->match >= 0
+        && lookup->candidates[lookup->match].entry.command_count == lookup->prefix.command_count;
+    if (store && lookup->prefix.command_count >= lookup->cache->min_commands && !restored_whole
+        && lookup->commands != NULL) {
+        //saved by the rendering thread once the prefix is drawn
+        lookup->prefix.commands_size = lookup->commands_length;
+        BYTE *payload = add_pipeline_command(pipeline, PIPELINE_STORE, 0,
+            sizeof(lookup->prefix) + sizeof(lookup->commands));
+        if (payload != NULL) {
+            memcpy(payload, &lookup->prefix, sizeof(lookup->prefix));
+            memcpy(payload + sizeof(lookup->prefix), &lookup->commands, sizeof(lookup->commands));
+            lookup->commands = NULL;
+        }
+    }
+}
+
+/*! \brief Executes a text batch file on the #CANVAS using a #BATCHPIPELINE (see run_batch()).
+
+    \param canvas Pointer to the canvas.
+    \param text Pointer to the contents of the file.
+    \param size Size of the file.
+    \param save_at_end Pointer for storing whether the bitmap should be saved to the default output file afterwards.
+    \param report Pointer to the report of the commands (see run_batch()).
+
+    \return Zero on success, -2 on memory allocation or file I/O error, -3 on incorrect commands.
+ */
+LONG run_text_batch(CANVAS *canvas, const char *text, const size_t size, bool *save_at_end, BATCHREPORT *report)
+{
+    BATCHPIPELINE *pipeline = calloc(1, sizeof(BATCHPIPELINE));
+    if (pipeline == NULL) {
+        return -2;
+    }
+    pipeline->canvas = canvas;
+    pipeline->report = report;
+    pipeline->last_command = SIZE_MAX;
+    pipeline->cache_lookup = create_cache_lookup(canvas);
+    pthread_mutex_init(&pipeline->mutex, NULL);
+    pthread_cond_init(&pipeline->chunk_ready, NULL);
+    pthread_cond_init(&pipeline->chunk_done, NULL);
+    if (pthread_create(&pipeline->thread, NULL, pipeline_render_main, pipeline) != 0) {
+        destroy_cache_lookup(pipeline->cache_lookup);
+        pthread_cond_destroy(&pipeline->chunk_done);
+        pthread_cond_destroy(&pipeline->chunk_ready);
+        pthread_mutex_destroy(&pipeline->mutex);
+        free(pipeline);
+        return -2;
+    }
+
+    LONG result = 0;
+    //indices of the current mesh command and the number of vertices in the buffer
+    DWORD *mesh_indices = NULL;
+    DWORD mesh_vertex_count = 0, mesh_index_capacity = 0;
+    const char *cursor = text,
+        *file_end = text + size;
+    DWORD line_number = 0;
+    while (cursor < file_end) {
+        const char *line_end = memchr(cursor, '\n', file_end - cursor);
+        if (line_end == NULL) {
+            line_end = file_end;
+        }
+        line_number++;
+        LONGLONG parse_start_ticks = STATS_TICKS();
+
+        bool status_ok = true;
+        BYTE *payload = NULL;
+        if (is_line_end(cursor, line_end) || parse_word(&cursor, line_end, "help")) {
+            //nothing to do
+        } else if (parse_word(&cursor, line_end, "stats")) {
+            status_ok = is_line_end(cursor, line_end);
+            if (status_ok) {
+                end_cacheable_prefix(pipeline, true);
+                if (add_pipeline_command(pipeline, PIPELINE_STATS, line_number, 0) == NULL) {
+                    result = -2;
+                    break;
+                }
+            }
+        } else if (parse_word(&cursor, line_end, "draw")) {
+            VERTEXDATA triangle[3];
+            status_ok = parse_vertex(&cursor, line_end, &triangle[0])
+                && parse_vertex(&cursor, line_end, &triangle[1])
+                && parse_vertex(&cursor, line_end, &triangle[2])
+                && is_line_end(cursor, line_end);
+            record_parse_stats(canvas, parse_start_ticks);
+            if (status_ok) {
+                payload = add_pipeline_command(pipeline, PIPELINE_DRAW, line_number, sizeof(triangle));
+                if (payload == NULL) {
+                    result = -2;
+                    break;
+                }
+                memcpy(payload, triangle, sizeof(triangle));
+                hash_pipeline_command(pipeline, PIPELINE_DRAW, payload, sizeof(triangle));
+            }
+        } else if (parse_word(&cursor, line_end, "vertex")) {
+            VERTEXDATA vertex;
+            status_ok = parse_vertex(&cursor, line_end, &vertex) && is_line_end(cursor, line_end)
+                && mesh_vertex_count < MESH_RESTART_INDEX;
+            record_parse_stats(canvas, parse_start_ticks);
+            if (status_ok) {
+                payload = add_pipeline_command(pipeline, PIPELINE_VERTEX, line_number, sizeof(vertex));
+                if (payload == NULL) {
+                    result = -2;
+                    break;
+                }
+                memcpy(payload, &vertex, sizeof(vertex));
+                hash_pipeline_command(pipeline, PIPELINE_VERTEX, payload, sizeof(vertex));
+                mesh_vertex_count++;
+            }
+        } else if (parse_word(&cursor, line_end, "reset")) {
+            status_ok = is_line_end(cursor, line_end);
+            if (status_ok) {
+                if (add_pipeline_command(pipeline, PIPELINE_RESET, line_number, 0) == NULL) {
+                    result = -2;
+                    break;
+                }
+                hash_pipeline_command(pipeline, PIPELINE_RESET, NULL, 0);
+                mesh_vertex_count = 0;
+            }
+        } else if (parse_word(&cursor, line_end, "mesh") || parse_word(&cursor, line_end, "strip")) {
+            DWORD strip = cursor[-1] == 'p';
+            DWORD index_count;
+            LONG parse_result = parse_mesh_indices(&cursor, line_end, &mesh_indices, &mesh_index_capacity,
+                &index_count);
+            record_parse_stats(canvas, parse_start_ticks);
+            if (parse_result == -2) {
+                result = -2;
+                break;
+            }
+            status_ok = parse_result == 0;
+            if (status_ok) {
+                //the indices are validated when the mesh is drawn
+                payload = add_pipeline_command(pipeline, PIPELINE_MESH, line_number,
+                    sizeof(strip) + (size_t)index_count * sizeof(DWORD));
+                if (payload == NULL) {
+                    result = -2;
+                    break;
+                }
+                memcpy(payload, &strip, sizeof(strip));
+                memcpy(payload + sizeof(strip), mesh_indices, (size_t)index_count * sizeof(DWORD));
+                hash_pipeline_command(pipeline, PIPELINE_MESH, payload,
+                    sizeof(strip) + (size_t)index_count * sizeof(DWORD));
+            }
+        } else if (parse_word(&cursor, line_end, "clear")) {
+            BYTE red = 0xff, green = 0xff, blue = 0xff;
+            if (!is_line_end(cursor, line_end)) {
+                status_ok = parse_color(&cursor, line_end, &red, &green, &blue) && is_line_end(cursor, line_end);
+            }
+            record_parse_stats(canvas, parse_start_ticks);
+            if (status_ok) {
+                discard_pipeline_triangles(pipeline);
+                payload = add_pipeline_command(pipeline, PIPELINE_CLEAR, line_number, 3);
+                if (payload == NULL) {
+                    result = -2;
+                    break;
+                }
+                payload[0] = red;
+                payload[1] = green;
+                payload[2] = blue;
+                hash_pipeline_command(pipeline, PIPELINE_CLEAR, payload, 3);
+            }
+        } else if (parse_word(&cursor, line_end, "frame")) {
+            status_ok = is_line_end(cursor, line_end);
+            if (status_ok) {
+                end_cacheable_prefix(pipeline, true);
+                if (add_pipeline_command(pipeline, PIPELINE_FRAME, line_number, 0) == NULL) {
+                    result = -2;
+                    break;
+                }
+            }
+        } else if (parse_word(&cursor, line_end, "flush")) {
+            status_ok = is_line_end(cursor, line_end);
+            if (status_ok && add_pipeline_command(pipeline, PIPELINE_FLUSH, line_number, 0) == NULL) {
+                result = -2;
+                break;
+            }
+        } else if (parse_word(&cursor, line_end, "save") || parse_word(&cursor, line_end, "quit")) {
+            bool quit = memcmp(cursor - 4, "quit", 4) == 0;
+            size_t filename_length = 0;
+            cursor = skip_blanks(cursor, line_end);
+            if (!quit && cursor < line_end) {
+                //the rest of the line is the filename (with trailing blanks removed)
+                const char *filename_end = line_end;
+                while (filename_end > cursor && isspace((unsigned char)filename_end[-1])) {
+                    filename_end--;
+                }
+                filename_length = filename_end - cursor;
+                if (filename_length > MAX_PATH - 1) {
+                    filename_length = MAX_PATH - 1;
+                }
+            } else if (!is_line_end(cursor, line_end)) {
+                status_ok = false;
+            }
+            record_parse_stats(canvas, parse_start_ticks);
+            if (status_ok) {
+                end_cacheable_prefix(pipeline, true);
+                payload = add_pipeline_command(pipeline, PIPELINE_SAVE, line_number, filename_length + 1);
+                if (payload == NULL) {
+                    result = -2;
+                    break;
+                }
+                memcpy(payload, cursor, filename_length);
+                payload[filename_length] = 0;
+                if (quit) {
+                    *save_at_end = false;
+                    break;
+                }
+            }
+        } else if (parse_word(&cursor, line_end, "kill")) {
+            end_cacheable_prefix(pipeline, false);
+            discard_pipeline_triangles(pipeline);
+            *save_at_end = false;
+            break;
+        } else {
+            status_ok = false;
+        }
+        if (!status_ok) {
+            end_cacheable_prefix(pipeline, true);
+            if (add_pipeline_command(pipeline, PIPELINE_ERROR, line_number, 0) == NULL) {
+                result = -2;
+                break;
+            }
+        }
+        cursor = line_end + 1;
+    }
+    free(mesh_indices);
+    end_cacheable_prefix(pipeline, result == 0);
+
+    //render the remaining commands
+    if (pipeline->chunks[(pipeline->first_chunk + pipeline->chunk_count) % PIPELINE_CHUNK_COUNT].length > 0) {
+        submit_pipeline_chunk(pipeline);
+    }
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->finished = true;
+    pthread_cond_signal(&pipeline->chunk_ready);
+    pthread_mutex_unlock(&pipeline->mutex);
+    pthread_join(pipeline->thread, NULL);
+    if (pipeline->result != 0) {
+        result = pipeline->result;
+    }
+    if (report->frames_saved && finish_canvas_frames(canvas) != 0) {
+        report->frame_error = true;
+    }
+    if (report->frame_error) {
+        result = -2;
+    }
+
+    for (DWORD i = 0; i < PIPELINE_CHUNK_COUNT; i++) {
+        free(pipeline->chunks[i].data);
+    }
+    free(pipeline->vertices);
+    destroy_cache_lookup(pipeline->cache_lookup);
+    pthread_cond_destroy(&pipeline->chunk_done);
+    pthread_cond_destroy(&pipeline->chunk_ready);
+    pthread_mutex_destroy(&pipeline->mutex);
+    free(pipeline);
+    return result;
+}
+
+/*! \brief Draws the frames of a binary frames batch file on the #CANVAS, saving each of them
+    as the next frame of the sequence (see save_canvas_frame()).
+
+    \param canvas Pointer to the canvas.
+    \param data Pointer to the frame records (following the signature).
+    \param size Size of the frame records.
+    \param report Pointer to the report of the frames (see run_batch()).
+
+    \return Zero on success, -2 on file I/O error, -3 on incorrect records (nothing is drawn then).
+ */
+LONG run_frames_batch(CANVAS *canvas, BYTE *data, const size_t size, BATCHREPORT *report)
+{
+    //validate the records first
+    size_t offset = 0;
+    while (offset < size) {
+        DWORD triangle_count;
+        if (sizeof(VERTEXDATA) != 12 || size - offset < BATCH_FRAME_HEADER_SIZE) {
+            return -3;
+        }
+        memcpy(&triangle_count, data + offset, sizeof(triangle_count));
+        offset += BATCH_FRAME_HEADER_SIZE;
+        if ((size - offset) / (3 * sizeof(VERTEXDATA)) < triangle_count) {
+            return -3;
+        }
+        offset += (size_t)triangle_count * 3 * sizeof(VERTEXDATA);
+    }
+
+    LONG result = 0;
+    for (offset = 0; offset < size && result == 0;) {
+        DWORD triangle_count;
+        memcpy(&triangle_count, data + offset, sizeof(triangle_count));
+        const BYTE *flags = data + offset + sizeof(triangle_count);
+        offset += BATCH_FRAME_HEADER_SIZE;
+        if (flags[0] & BATCH_FRAME_CLEAR) {
+            result = clear_canvas(canvas, flags[1], flags[2], flags[3]);
+        }
+        //draw the triangles straight from the (private) mapping
+        if (result == 0) {
+            result = draw_canvas_triangles(canvas, (VERTEXDATA (*)[3])(data + offset), triangle_count);
+        }
+        offset += (size_t)triangle_count * 3 * sizeof(VERTEXDATA);
+        if (result == 0 && save_canvas_frame(canvas) != 0) {
+            result = -2;
+        }
+    }
+    report->frames_saved = true;
+    if (finish_canvas_frames(canvas) != 0 || result != 0) {
+        report->frame_error = true;
+        result = -2;
+    }
+    return result;
+}
+
+/*! \brief Executes commands from a batch file.
+
+    Text batch files use the commands of the interactive mode, one per line (help is ignored).
+    Binary batch files start with #BATCH_MAGIC followed by records of three VERTEXDATA structures
+    (12 bytes each: little-endian x and y, red, green, blue and a padding byte), which are drawn in place.
+    Binary mesh batch files start with #BATCH_MESH_MAGIC followed by a single mesh record
+    (see draw_canvas_mesh_record()).
+    Binary frames batch files start with #BATCH_FRAMES_MAGIC followed by frame records, each of which
+    is saved as the next frame of the sequence (see save_canvas_frame()) instead of saving the bitmap at the end.
+    Unless the batch is ended with kill or quit, the bitmap is saved to the default file afterwards.
+    Nothing is printed: the saves, frames, uses of the render cache and incorrect commands are recorded
+    in the report instead.
+
+    \param canvas Pointer to the canvas.
+    \param batch_filename Name of the batch file.
+    \param report Pointer to the report of the commands (filled in even on failure) or NULL.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on file I/O error, -3 on incorrect batch file.
+ */
+LONG run_batch(CANVAS *canvas, const char *batch_filename, BATCHREPORT *report)
+{
+    BATCHREPORT ignored_report;
+    if (report == NULL) {
+        report = &ignored_report;
+    }
+    memset(report, 0, sizeof(*report));
+    report->restored_command_count = -1;
+    if (canvas == NULL || batch_filename == NULL) {
+        return -1;
+    }
+    MAPPEDFILE batch_file;
+    if (map_file(&batch_file, batch_filename) != 0) {
+        return -2;
+    }
+
+    bool save_at_end = true;
+    LONG result = 0;
+    if (batch_file.size >= BATCH_MAGIC_LENGTH && memcmp(batch_file.data, BATCH_MAGIC, BATCH_MAGIC_LENGTH) == 0) {
+        //binary batch: draw the triangles straight from the mapping
+        size_t records_size = batch_file.size - BATCH_MAGIC_LENGTH;
+        if (sizeof(VERTEXDATA) != 12 || records_size % (3 * sizeof(VERTEXDATA)) != 0) {
+            unmap_file(&batch_file);
+            return -3;
+        }
+        VERTEXDATA (*triangles)[3] = (VERTEXDATA (*)[3])(batch_file.data + BATCH_MAGIC_LENGTH);
+        size_t triangle_count = records_size / (3 * sizeof(VERTEXDATA));
+        while (triangle_count > 0 && result == 0) {
+            DWORD count = triangle_count > UINT32_MAX ? UINT32_MAX : triangle_count;
+            result = draw_canvas_triangles(canvas, triangles, count);
+            triangles += count;
+            triangle_count -= count;
+        }
+        if (result != 0) {
+            unmap_file(&batch_file);
+            return result;
+        }
+    } else if (batch_file.size >= BATCH_MAGIC_LENGTH
+        && memcmp(batch_file.data, BATCH_MESH_MAGIC, BATCH_MAGIC_LENGTH) == 0) {
+        //binary mesh batch: draw the mesh straight from the mapping
+        result = draw_canvas_mesh_record(canvas, batch_file.data + BATCH_MAGIC_LENGTH,
+            batch_file.size - BATCH_MAGIC_LENGTH);
+        if (result != 0) {
+            unmap_file(&batch_file);
+            return result;
+        }
+    } else if (batch_file.size >= BATCH_MAGIC_LENGTH
+        && memcmp(batch_file.data, BATCH_FRAMES_MAGIC, BATCH_MAGIC_LENGTH) == 0) {
+        //binary frames batch: every frame is saved to its own file
+        result = run_frames_batch(canvas, batch_file.data + BATCH_MAGIC_LENGTH, batch_file.size - BATCH_MAGIC_LENGTH,
+            report);
+        unmap_file(&batch_file);
+        return result;
+    } else {
+        //text batch: parse the commands while the previous ones are drawn
+        result = run_text_batch(canvas, (const char *)batch_file.data, batch_file.size, &save_at_end, report);
+    }
+    unmap_file(&batch_file);
+
+    if (save_at_end) {
+        if (save_canvas(canvas, NULL) == 0) {
+            report->save_count++;
+        } else {
+            report->save_error_count++;
+            result = -2;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,141 @@
+/*!
+ *  \brief     Public interface of librgbtri, the library for drawing RGB triangles on bitmaps (partially in assembly).
+ *  \author    Dawid Sygocki
+ *  \date      2026-10-15
+ */
+#ifndef RGBTRI_H
+#define RGBTRI_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+//fixed-width integers of the interface (see rgbtri_private.h for the names used inside the library)
+typedef uint8_t rgbtri_uint8;
+typedef int32_t rgbtri_int32;
+typedef uint32_t rgbtri_uint32;
+typedef int64_t rgbtri_int64;
+
+/*! \brief Describes XY position and RGB color of a vertex.
+ */
+typedef struct VERTEXDATA {
+    rgbtri_int32 posX;
+    rgbtri_int32 posY;
+    rgbtri_uint8 colR;
+    rgbtri_uint8 colG;
+    rgbtri_uint8 colB;
+} VERTEXDATA;
+
+/*! \brief Bitmap being drawn together with the resources used for rendering and storing it (see create_canvas()).
+
+    The structure is opaque. A canvas can be cleared, drawn on and saved any number of times.
+ */
+typedef struct CANVAS CANVAS;
+
+#define LINE_DRAWER_SSE2 0
+#define LINE_DRAWER_AVX2 1
+#define LINE_DRAWER_AVX512 2
+#define LINE_DRAWER_COUNT 3
+
+#define RASTERIZER_SCANLINE 0
+#define RASTERIZER_HALFSPACE 1
+#define RASTERIZER_COUNT 2
+
+#define OUTPUT_FORMAT_BMP 0
+#define OUTPUT_FORMAT_PPM 1
+#define OUTPUT_FORMAT_QOI 2
+#define OUTPUT_FORMAT_COUNT 3
+
+//index starting a new triangle strip (see draw_canvas_mesh())
+#define MESH_RESTART_INDEX UINT32_MAX
+
+/* Mesh record (as in binary mesh batch files, all the integers are little-endian):
+ *  32-bit vertex count, 32-bit index count, 32-bit flags (MESH_FLAG_*),
+ *  vertex records (12 bytes each: x and y, red, green, blue and a padding byte), 32-bit indices
+ */
+#define MESH_RECORD_HEADER_SIZE 12
+//the indices describe a triangle strip rather than a list
+#define MESH_FLAG_STRIP 1
+
+/*! \brief Outcome of the commands of a batch file, reported by run_batch() for the caller to present.
+ */
+typedef struct BATCHREPORT {
+    //line of the first incorrect command of a text batch file (zero if there is none) and the number of such lines
+    rgbtri_uint32 error_line;
+    rgbtri_uint32 error_count;
+    //numbers of the successful and the failed saves of the bitmap (including the one at the end of the batch)
+    rgbtri_uint32 save_count;
+    rgbtri_uint32 save_error_count;
+    //whether any frame has been saved and whether saving any of them has failed
+    bool frames_saved;
+    bool frame_error;
+    //number of the commands skipped by restoring the bitmap from the render cache (-1 if it has not been restored)
+    rgbtri_int64 restored_command_count;
+    //whether restoring the bitmap from the render cache or storing it there has failed
+    bool restore_error;
+    bool store_error;
+} BATCHREPORT;
+
+//drawing functions (the defaults of the canvases created afterwards, see set_canvas_line_drawer() and below)
+void detect_line_drawers(bool supported[LINE_DRAWER_COUNT], bool *ssse3_supported);
+rgbtri_int32 find_line_drawer(const char *name);
+const char *get_line_drawer_name(const rgbtri_int32 line_drawer);
+rgbtri_int32 select_line_drawer(const rgbtri_int32 line_drawer);
+rgbtri_int32 find_rasterizer(const char *name);
+const char *get_rasterizer_name(const rgbtri_int32 rasterizer);
+rgbtri_int32 select_rasterizer(const rgbtri_int32 rasterizer);
+void set_reverse_order(const bool reverse);
+void set_deferred_spans(const bool deferred);
+
+//output files (the format is the default of the canvases created afterwards)
+rgbtri_int32 find_output_format(const char *name);
+const char *get_output_format_name(const rgbtri_int32 format);
+rgbtri_int32 select_output_format(const rgbtri_int32 format);
+rgbtri_int32 get_output_format(const char *filename);
+
+void set_vertex(VERTEXDATA *vertex, const rgbtri_int32 pos_x, const rgbtri_int32 pos_y, const rgbtri_uint8 col_r,
+    const rgbtri_uint8 col_g, const rgbtri_uint8 col_b);
+
+//canvases
+rgbtri_int32 create_canvas(CANVAS **canvas, const rgbtri_int32 width, const rgbtri_int32 height,
+    const char *output_filename, const rgbtri_int32 thread_count, const bool map_output, const size_t cache_size,
+    const bool xrgb);
+void destroy_canvas(CANVAS *canvas);
+rgbtri_int32 clear_canvas(CANVAS *canvas, const rgbtri_uint8 red, const rgbtri_uint8 green, const rgbtri_uint8 blue);
+rgbtri_int32 draw_canvas_triangles(CANVAS *canvas, VERTEXDATA (*triangles)[3], const rgbtri_uint32 triangle_count);
+rgbtri_int32 draw_canvas_mesh(CANVAS *canvas, const VERTEXDATA *vertices, const rgbtri_uint32 vertex_count,
+    const rgbtri_uint32 *indices, const rgbtri_uint32 index_count, const bool strip);
+rgbtri_int32 draw_canvas_mesh_record(CANVAS *canvas, const rgbtri_uint8 *record, const size_t length);
+void flush_canvas(CANVAS *canvas);
+rgbtri_int32 get_canvas_thread_count(const CANVAS *canvas);
+size_t get_canvas_data_size(const CANVAS *canvas);
+rgbtri_int32 read_canvas_data(CANVAS *canvas, rgbtri_uint8 *destination);
+rgbtri_int32 write_canvas_data(CANVAS *canvas, const rgbtri_uint8 *source);
+size_t get_canvas_file_size(const CANVAS *canvas);
+rgbtri_int32 read_canvas_file(CANVAS *canvas, rgbtri_uint8 *destination);
+rgbtri_int32 save_canvas(CANVAS *canvas, const char *filename);
+rgbtri_int32 save_canvas_background(CANVAS *canvas, const char *filename);
+bool finish_background_save(CANVAS *canvas, const bool wait, rgbtri_int32 *result);
+rgbtri_int32 save_canvas_frame(CANVAS *canvas);
+rgbtri_int32 finish_canvas_frames(CANVAS *canvas);
+
+//settings of a single canvas (starting with the defaults selected above)
+rgbtri_int32 set_canvas_line_drawer(CANVAS *canvas, const rgbtri_int32 line_drawer);
+rgbtri_int32 set_canvas_rasterizer(CANVAS *canvas, const rgbtri_int32 rasterizer);
+rgbtri_int32 set_canvas_reverse_order(CANVAS *canvas, const bool reverse);
+rgbtri_int32 set_canvas_deferred_spans(CANVAS *canvas, const bool deferred);
+rgbtri_int32 set_canvas_output_format(CANVAS *canvas, const rgbtri_int32 format);
+rgbtri_int32 set_canvas_render_cache(CANVAS *canvas, const char *directory, const size_t max_bytes,
+    const rgbtri_uint32 max_entries, const rgbtri_int64 min_commands);
+
+//command files
+rgbtri_int32 set_render_cache(const char *directory, const size_t max_bytes, const rgbtri_uint32 max_entries,
+    const rgbtri_int64 min_commands);
+rgbtri_int32 run_batch(CANVAS *canvas, const char *batch_filename, BATCHREPORT *report);
+
+//statistics of the hot paths (gathered by every canvas, NULL for the totals of the destroyed ones)
+void reset_stats(CANVAS *canvas);
+void print_stats(const CANVAS *canvas);
+rgbtri_int32 write_stats_json(const CANVAS *canvas, const char *filename);
+
+#endif
@@ -0,0 +1,73 @@
+/*!
+ *  \brief     Declarations shared by librgbtri and the rgb_triangle tool which are not a part of the public interface.
+ *  \author    Dawid Sygocki
+ *  \date      2026-10-16
+ */
+#ifndef RGBTRI_PRIVATE_H
+#define RGBTRI_PRIVATE_H
+
+#include "rgbtri.h"
+
+//maximal path length for compatibility with MS Windows
+//see https://docs.microsoft.com/en-us/windows/win32/fileio/naming-a-file#maximum-path-length-limitation
+#define MAX_PATH 260
+
+typedef rgbtri_uint8 BYTE;
+typedef int16_t SHORT;
+typedef uint16_t WORD;
+typedef rgbtri_int32 LONG;
+typedef rgbtri_uint32 DWORD;
+typedef rgbtri_int64 LONGLONG;
+
+/*! \brief Bitmap header containing image specification.
+
+    For detailed description see https://docs.microsoft.com/en-us/windows/win32/api/wingdi/ns-wingdi-bitmapinfoheader
+ */
+typedef struct BITMAPINFOHEADER {
+    DWORD biSize;
+    LONG  biWidth;
+    LONG  biHeight;
+    WORD  biPlanes;
+    WORD  biBitCount;
+    DWORD biCompression;
+    DWORD biSizeImage;
+    LONG  biXPelsPerMeter;
+    LONG  biYPelsPerMeter;
+    DWORD biClrUsed;
+    DWORD biClrImportant;
+} BITMAPINFOHEADER;
+
+//the counters can be compiled out by defining NO_STATS (for the library and the tool alike)
+#ifndef NO_STATS
+//reads the time stamp counter for measuring durations
+#define STATS_TICKS() read_tsc()
+#else
+#define STATS_TICKS() 0
+#endif
+
+LONGLONG read_tsc(void);
+void record_parse_stats(CANVAS *canvas, const LONGLONG start_ticks);
+
+/*! \brief Pointer to a function with the same signature as draw_horizontal_line().
+ */
+typedef void (*DRAWLINEPROC)(BYTE *image_data, BITMAPINFOHEADER *info_header, DWORD line_y,
+    LONG left_x, LONG right_x, DWORD left_color, DWORD right_color);
+
+//functions below the canvas level (measured by the benchmark suite of the tool, see bench.c)
+struct DEFERREDCLEAR;
+struct SPANBUFFER;
+extern __thread DRAWLINEPROC draw_horizontal_line_proc;
+void use_default_settings(void);
+double get_time_seconds(void);
+void set_file_header(BYTE (*header)[14], const DWORD file_size, const DWORD headers_length);
+size_t get_image_data_size(const BITMAPINFOHEADER *info_header);
+void set_info_header(BITMAPINFOHEADER *header, const LONG width, const LONG height, const WORD bit_count);
+void clear_bitmap(BYTE *image_data, BITMAPINFOHEADER *info_header, const BYTE red, const BYTE green, const BYTE blue);
+LONG draw_triangle(BYTE *image_data, BITMAPINFOHEADER *info_header, VERTEXDATA (*vertices)[3]);
+LONG draw_triangles(BYTE *image_data, BITMAPINFOHEADER *info_header, VERTEXDATA (*triangles)[3],
+    const DWORD triangle_count, struct DEFERREDCLEAR *deferred_clear, struct SPANBUFFER *span_buffer);
+LONG save_bitmap(BYTE (*file_header)[14], BITMAPINFOHEADER *info_header, BYTE *image_data, const char *output_filename);
+LONG save_xrgb_bitmap(BYTE (*file_header)[14], BITMAPINFOHEADER *info_header, const BYTE *frame_data,
+    const char *output_filename);
+
+#endif
@@ -0,0 +1,641 @@
+/*!
+ *  \brief     Socket server serving many clients drawing on their own canvases, driven by an epoll event loop.
+ *  \author    Dawid Sygocki
+ *  \date      2026-10-15
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+//maximal number of events handled by a single iteration of the event loop
+#define SERVER_MAX_EVENTS 64
+
+//amount of unsent response data above which the requests of a client are not executed
+#define SERVER_OUTPUT_LIMIT (16 * 1024 * 1024)
+
+//minimal free space of the input buffer when receiving
+#define SERVER_RECEIVE_BYTES (64 * 1024)
+
+//number of misaligned triangles copied at once before drawing them
+#define SERVER_DRAW_CHUNK 256
+
+/*! \brief Growing buffer of received requests or unsent responses.
+ */
+typedef struct SERVERBUFFER {
+    BYTE *data;
+    //beginning of the data not processed (or sent) yet
+    size_t offset;
+    //end of the data
+    size_t length;
+    size_t capacity;
+} SERVERBUFFER;
+
+/*! \brief Describes a connection of a client together with its canvas.
+ */
+typedef struct SERVERCLIENT {
+    int descriptor;
+    //created on the first request needing it
+    CANVAS *canvas;
+    //default output filename of the canvas (see set_client_output_filename())
+    char output_filename[MAX_PATH];
+    SERVERBUFFER input;
+    SERVERBUFFER output;
+    //events the connection is watched for
+    DWORD events;
+    //whether the client stopped sending (the connection is closed once the responses are sent)
+    bool closing;
+    struct SERVERCLIENT *previous;
+    struct SERVERCLIENT *next;
+} SERVERCLIENT;
+
+/*! \brief Describes the state of the server.
+ */
+typedef struct SERVER {
+    int listen_descriptor;
+    int epoll_descriptor;
+    SERVERCLIENT *clients;
+    //settings of the canvases of the clients
+    LONG width;
+    LONG height;
+    const char *output_filename;
+    LONG thread_count;
+    bool xrgb;
+    //number of the accepted connections (used for numbering the default output files)
+    DWORD connection_count;
+    //directory of the default output file, which holds all the files saved by the clients
+    char output_directory[MAX_PATH];
+} SERVER;
+
+//set by the signal handler when the server should stop
+volatile sig_atomic_t server_stopping = 0;
+
+/*! \brief Requests stopping the server (used as SIGINT and SIGTERM handler).
+
+    \param signal_number Number of the signal.
+ */
+void stop_server(int signal_number)
+{
+    (void)signal_number;
+    server_stopping = 1;
+}
+
+/*! \brief Makes room for appending data to a #SERVERBUFFER, discarding its processed part first.
+
+    \param buffer Pointer to the buffer.
+    \param length Number of bytes to be appended.
+
+    \return True on success, false on memory allocation error.
+ */
+bool reserve_server_buffer(SERVERBUFFER *buffer, const size_t length)
+{
+    if (buffer->capacity - buffer->length >= length) {
+        return true;
+    }
+    if (buffer->offset > 0) {
+        memmove(buffer->data, buffer->data + buffer->offset, buffer->length - buffer->offset);
+        buffer->length -= buffer->offset;
+        buffer->offset = 0;
+        if (buffer->capacity - buffer->length >= length) {
+            return true;
+        }
+    }
+    size_t capacity = buffer->length + length > 2 * buffer->capacity ? buffer->length + length : 2 * buffer->capacity;
+    BYTE *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        return false;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+/*! \brief Appends a response to the unsent ones of a #SERVERCLIENT.
+
+    \param client Pointer to the client.
+    \param result Result of the request.
+    \param payload Pointer to the payload (or NULL if there is none).
+    \param length Length of the payload.
+
+    \return True on success, false on memory allocation error.
+ */
+bool append_response(SERVERCLIENT *client, const LONG result, const BYTE *payload, const DWORD length)
+{
+    if (!reserve_server_buffer(&client->output, SERVER_HEADER_SIZE + (size_t)length)) {
+        return false;
+    }
+    BYTE *response = client->output.data + client->output.length;
+    memcpy(response, &length, sizeof(length));
+    memcpy(response + sizeof(length), &result, sizeof(result));
+    if (length > 0) {
+        memcpy(response + SERVER_HEADER_SIZE, payload, length);
+    }
+    client->output.length += SERVER_HEADER_SIZE + (size_t)length;
+    return true;
+}
+
+/*! \brief Sets the default output filename of a #SERVERCLIENT: the one of the server with the number
+    of the connection appended to its name (before the extension), so that the clients do not overwrite each other.
+
+    \param server Pointer to the server.
+    \param client Pointer to the client.
+ */
+void set_client_output_filename(SERVER *server, SERVERCLIENT *client)
+{
+    const char *name = strrchr(server->output_filename, '/');
+    name = name != NULL ? name + 1 : server->output_filename;
+    const char *extension = strrchr(name, '.');
+    if (extension == NULL || extension == name) {
+        extension = name + strlen(name);
+    }
+    snprintf(client->output_filename, MAX_PATH, "%.*s_%u%s", (int)(extension - server->output_filename),
+        server->output_filename, server->connection_count, extension);
+}
+
+/*! \brief Builds the path of a file saved by a client in the output directory of the server.
+
+    \param server Pointer to the server.
+    \param filename Pointer to the filename relative to the output directory (null-terminated).
+    \param path Buffer of MAX_PATH characters for storing the path.
+
+    \return Zero on success, -3 if the filename is absolute, contains a ".." component or the path is too long.
+ */
+LONG get_client_output_path(const SERVER *server, const char *filename, char path[MAX_PATH])
+{
+    if (filename[0] == '/') {
+        return -3;
+    }
+    for (const char *component = filename; component != NULL;) {
+        const char *component_end = strchr(component, '/');
+        size_t length = component_end != NULL ? (size_t)(component_end - component) : strlen(component);
+        if (length == 2 && memcmp(component, "..", 2) == 0) {
+            return -3;
+        }
+        component = component_end != NULL ? component_end + 1 : NULL;
+    }
+    if (snprintf(path, MAX_PATH, "%s/%s", server->output_directory, filename) >= MAX_PATH) {
+        return -3;
+    }
+    return 0;
+}
+
+/*! \brief Replaces the canvas of a #SERVERCLIENT with a new one (kept if the new one cannot be created).
+
+    \param server Pointer to the server.
+    \param client Pointer to the client.
+    \param width Width of the bitmap.
+    \param height Height of the bitmap.
+
+    \return Zero on success, -2 on memory allocation error, -3 if the bitmap file would exceed #SERVER_MAX_BITMAP_SIZE.
+ */
+LONG replace_client_canvas(SERVER *server, SERVERCLIENT *client, const LONG width, const LONG height)
+{
+    //the stride of scanlines is checked first, so that the product cannot overflow
+    uint64_t stride = ((uint64_t)width * 3 + 3) & ~(uint64_t)3;
+    if (stride > SERVER_MAX_BITMAP_SIZE || 54 + stride * height > SERVER_MAX_BITMAP_SIZE) {
+        return -3;
+    }
+    CANVAS *canvas;
+    LONG result = create_canvas(&canvas, width, height, client->output_filename, server->thread_count, false, 0,
+        server->xrgb);
+    if (result == 0) {
+        if (get_canvas_thread_count(canvas) < server->thread_count) {
+            puts("Error creating worker threads! Rendering on a single thread.");
+        }
+        destroy_canvas(client->canvas);
+        client->canvas = canvas;
+    }
+    return result;
+}
+
+/*! \brief Draws triangles received as vertex records (see #SERVER_COMMAND_DRAW).
+
+    \param canvas Pointer to the canvas.
+    \param records Pointer to the records (modified in place).
+    \param triangle_count Number of triangles.
+
+    \return Zero on success, -2 on memory allocation or file I/O error.
+ */
+LONG draw_triangle_records(CANVAS *canvas, BYTE *records, const DWORD triangle_count)
+{
+    if ((uintptr_t)records % sizeof(LONG) == 0) {
+        return draw_canvas_triangles(canvas, (VERTEXDATA (*)[3])records, triangle_count);
+    }
+    //records following a request of odd length have to be aligned first
+    VERTEXDATA chunk[SERVER_DRAW_CHUNK][3];
+    LONG result = 0;
+    for (DWORD i = 0; i < triangle_count && result == 0; i += SERVER_DRAW_CHUNK) {
+        DWORD count = triangle_count - i < SERVER_DRAW_CHUNK ? triangle_count - i : SERVER_DRAW_CHUNK;
+        memcpy(chunk, records + (size_t)i * sizeof(chunk[0]), count * sizeof(chunk[0]));
+        result = draw_canvas_triangles(canvas, chunk, count);
+    }
+    return result;
+}
+
+/*! \brief Executes a request of a #SERVERCLIENT and appends the response.
+
+    \param server Pointer to the server.
+    \param client Pointer to the client.
+    \param command One of the SERVER_COMMAND_* values.
+    \param payload Pointer to the payload (may be modified).
+    \param length Length of the payload.
+
+    \return True on success, false on memory allocation error.
+ */
+bool execute_request(SERVER *server, SERVERCLIENT *client, const DWORD command, BYTE *payload, const DWORD length)
+{
+    LONG result = -3;
+    if (command == SERVER_COMMAND_SIZE) {
+        LONG size[2];
+        if (length == sizeof(size)) {
+            memcpy(size, payload, sizeof(size));
+            if (size[0] > 0 && size[1] > 0) {
+                result = replace_client_canvas(server, client, size[0], size[1]);
+            }
+        }
+        return append_response(client, result, NULL, 0);
+    }
+    if (command < SERVER_COMMAND_CLEAR || command > SERVER_COMMAND_MESH) {
+        return append_response(client, result, NULL, 0);
+    }
+    //the canvas has the default size unless the client asks for another one first
+    if (client->canvas == NULL) {
+        result = replace_client_canvas(server, client, server->width, server->height);
+        if (result != 0) {
+            return append_response(client, result, NULL, 0);
+        }
+        result = -3;
+    }
+    if (command == SERVER_COMMAND_CLEAR) {
+        if (length == 3) {
+            result = clear_canvas(client->canvas, payload[0], payload[1], payload[2]);
+        }
+    } else if (command == SERVER_COMMAND_DRAW) {
+        if (sizeof(VERTEXDATA) == 12 && length % (3 * sizeof(VERTEXDATA)) == 0) {
+            result = draw_triangle_records(client->canvas, payload, length / (3 * sizeof(VERTEXDATA)));
+        }
+    } else if (command == SERVER_COMMAND_MESH) {
+        result = draw_canvas_mesh_record(client->canvas, payload, length);
+    } else if (command == SERVER_COMMAND_SAVE) {
+        if (length < MAX_PATH && memchr(payload, 0, length) == NULL) {
+            char filename[MAX_PATH], path[MAX_PATH];
+            memcpy(filename, payload, length);
+            filename[length] = 0;
+            if (length == 0) {
+                result = save_canvas(client->canvas, NULL);
+            } else if (get_client_output_path(server, filename, path) == 0) {
+                result = save_canvas(client->canvas, path);
+            }
+        }
+    } else if (length == 0) {
+        //the bitmap file is copied straight into the response
+        size_t file_size = get_canvas_file_size(client->canvas);
+        if (file_size <= UINT32_MAX) {
+            if (!reserve_server_buffer(&client->output, SERVER_HEADER_SIZE + file_size)) {
+                return false;
+            }
+            result = read_canvas_file(client->canvas, client->output.data + client->output.length + SERVER_HEADER_SIZE);
+            if (result == 0) {
+                DWORD payload_length = file_size;
+                BYTE *response = client->output.data + client->output.length;
+                memcpy(response, &payload_length, sizeof(payload_length));
+                memcpy(response + sizeof(payload_length), &result, sizeof(result));
+                client->output.length += SERVER_HEADER_SIZE + file_size;
+                return true;
+            }
+        }
+    }
+    return append_response(client, result, NULL, 0);
+}
+
+/*! \brief Executes the complete requests received from a #SERVERCLIENT (until its unsent responses reach the limit).
+
+    \param server Pointer to the server.
+    \param client Pointer to the client.
+
+    \return True on success, false on memory allocation error or incorrect request.
+ */
+bool execute_requests(SERVER *server, SERVERCLIENT *client)
+{
+    SERVERBUFFER *input = &client->input;
+    while (input->length - input->offset >= SERVER_HEADER_SIZE
+        && client->output.length - client->output.offset < SERVER_OUTPUT_LIMIT) {
+        LONGLONG parse_start_ticks = STATS_TICKS();
+        DWORD header[2];
+        memcpy(header, input->data + input->offset, SERVER_HEADER_SIZE);
+        if (header[0] > SERVER_MAX_PAYLOAD) {
+            return false;
+        }
+        if (input->length - input->offset - SERVER_HEADER_SIZE < header[0]) {
+            break;
+        }
+        //the payload stays in place until the next reception
+        BYTE *payload = input->data + input->offset + SERVER_HEADER_SIZE;
+        input->offset += SERVER_HEADER_SIZE + (size_t)header[0];
+        record_parse_stats(client->canvas, parse_start_ticks);
+        if (!execute_request(server, client, header[1], payload, header[0])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*! \brief Checks whether a complete request of a #SERVERCLIENT is waiting for execution.
+
+    \param client Pointer to the client.
+ */
+bool has_complete_request(const SERVERCLIENT *client)
+{
+    const SERVERBUFFER *input = &client->input;
+    if (input->length - input->offset < SERVER_HEADER_SIZE) {
+        return false;
+    }
+    DWORD length;
+    memcpy(&length, input->data + input->offset, sizeof(length));
+    return input->length - input->offset - SERVER_HEADER_SIZE >= length;
+}
+
+/*! \brief Receives the available data from a #SERVERCLIENT (at most a buffer at once, so that clients are served fairly).
+
+    \param client Pointer to the client.
+
+    \return Zero on success, one at the end of the stream, -2 on memory allocation or socket I/O error.
+ */
+LONG receive_requests(SERVERCLIENT *client)
+{
+    if (!reserve_server_buffer(&client->input, SERVER_RECEIVE_BYTES)) {
+        return -2;
+    }
+    SERVERBUFFER *input = &client->input;
+    ssize_t received = recv(client->descriptor, input->data + input->length, input->capacity - input->length, 0);
+    if (received > 0) {
+        input->length += received;
+    } else if (received == 0) {
+        return 1;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        return -2;
+    }
+    return 0;
+}
+
+/*! \brief Sends the responses of a #SERVERCLIENT until the socket buffer is full.
+
+    \param client Pointer to the client.
+
+    \return True on success, false on socket I/O error.
+ */
+bool send_responses(SERVERCLIENT *client)
+{
+    SERVERBUFFER *output = &client->output;
+    while (output->offset < output->length) {
+        ssize_t sent = send(client->descriptor, output->data + output->offset, output->length - output->offset, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return false;
+        }
+        output->offset += sent;
+    }
+    if (output->offset == output->length) {
+        output->offset = 0;
+        output->length = 0;
+    }
+    return true;
+}
+
+/*! \brief Closes the connection of a #SERVERCLIENT and destroys its canvas.
+
+    \param server Pointer to the server.
+    \param client Pointer to the client.
+ */
+void close_client(SERVER *server, SERVERCLIENT *client)
+{
+    close(client->descriptor);
+    destroy_canvas(client->canvas);
+    free(client->input.data);
+    free(client->output.data);
+    if (client->previous != NULL) {
+        client->previous->next = client->next;
+    } else {
+        server->clients = client->next;
+    }
+    if (client->next != NULL) {
+        client->next->previous = client->previous;
+    }
+    free(client);
+}
+
+/*! \brief Handles the events of a #SERVERCLIENT connection: receives and executes its requests and sends the responses.
+
+    \param server Pointer to the server.
+    \param client Pointer to the client.
+    \param events Events reported for the connection.
+
+    \return True if the connection should be kept, false if it should be closed.
+ */
+bool serve_client(SERVER *server, SERVERCLIENT *client, const DWORD events)
+{
+    if ((events & EPOLLERR) != 0) {
+        return false;
+    }
+    if ((events & EPOLLIN) != 0) {
+        LONG result = receive_requests(client);
+        if (result < 0) {
+            return false;
+        }
+        //the responses to the received requests are sent nevertheless
+        client->closing = client->closing || result == 1;
+    } else if ((events & EPOLLHUP) != 0) {
+        return false;
+    }
+    do {
+        if (!execute_requests(server, client) || !send_responses(client)) {
+            return false;
+        }
+    } while (client->output.length - client->output.offset < SERVER_OUTPUT_LIMIT && has_complete_request(client));
+
+    //watch for more requests unless too many responses are waiting
+    size_t unsent_length = client->output.length - client->output.offset;
+    if (client->closing && unsent_length == 0) {
+        return false;
+    }
+    DWORD watched_events = (!client->closing && unsent_length < SERVER_OUTPUT_LIMIT ? EPOLLIN : 0)
+        | (unsent_length > 0 ? EPOLLOUT : 0);
+    if (watched_events != client->events) {
+        struct epoll_event event;
+        event.events = watched_events;
+        event.data.ptr = client;
+        if (epoll_ctl(server->epoll_descriptor, EPOLL_CTL_MOD, client->descriptor, &event) != 0) {
+            return false;
+        }
+        client->events = watched_events;
+    }
+    return true;
+}
+
+/*! \brief Accepts the pending connections.
+
+    \param server Pointer to the server.
+ */
+void accept_clients(SERVER *server)
+{
+    while (true) {
+        int descriptor = accept(server->listen_descriptor, NULL, NULL);
+        if (descriptor < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            //no more pending connections (or too many open files)
+            break;
+        }
+        SERVERCLIENT *client = calloc(1, sizeof(SERVERCLIENT));
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = client;
+        if (client == NULL || fcntl(descriptor, F_SETFL, O_NONBLOCK) != 0
+            || epoll_ctl(server->epoll_descriptor, EPOLL_CTL_ADD, descriptor, &event) != 0) {
+            close(descriptor);
+            free(client);
+            continue;
+        }
+        client->descriptor = descriptor;
+        client->events = EPOLLIN;
+        server->connection_count++;
+        set_client_output_filename(server, client);
+        client->next = server->clients;
+        if (server->clients != NULL) {
+            server->clients->previous = client;
+        }
+        server->clients = client;
+    }
+}
+
+/*! \brief Serves clients connecting to a Unix domain socket until SIGINT or SIGTERM is received.
+
+    Every client draws on its own canvas. Requests are decoded and executed by an epoll event loop
+    which queues the triangles for the rendering threads of the canvases (if there are any).
+    The protocol is described in server.h. The clients can only save files in the directory of the default
+    output file, and each of them has its own default output file (see set_client_output_filename()).
+
+    \param socket_path Path of the socket (an existing socket is replaced).
+    \param width Default width of the bitmaps.
+    \param height Default height of the bitmaps.
+    \param output_filename Default output filename (suffixed with the number of the connection).
+    \param thread_count Number of rendering threads of each canvas.
+    \param xrgb Whether the bitmaps should be stored internally with 32 bits per pixel.
+
+    \return Zero on success, -1 if any argument is a null pointer, -2 on socket error,
+        -3 if the path of the socket or the output filename is too long.
+ */
+LONG run_server(const char *socket_path, const LONG width, const LONG height, const char *output_filename,
+    const LONG thread_count, const bool xrgb)
+{
+    if (socket_path == NULL || output_filename == NULL) {
+        return -1;
+    }
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        return -3;
+    }
+    strcpy(address.sun_path, socket_path);
+    //leave room for the numbers of the connections
+    if (strlen(output_filename) > MAX_PATH - 16) {
+        return -3;
+    }
+    SERVER server = {-1, -1, NULL, width, height, output_filename, thread_count, xrgb, 0, {0}};
+    const char *name = strrchr(output_filename, '/');
+    if (name == NULL) {
+        strcpy(server.output_directory, ".");
+    } else if (name == output_filename) {
+        strcpy(server.output_directory, "/");
+    } else {
+        memcpy(server.output_directory, output_filename, name - output_filename);
+    }
+
+    //a socket left by a previous server is replaced
+    struct stat file_status;
+    if (lstat(socket_path, &file_status) == 0 && S_ISSOCK(file_status.st_mode)) {
+        unlink(socket_path);
+    }
+    server.listen_descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.listen_descriptor < 0) {
+        return -2;
+    }
+    if (bind(server.listen_descriptor, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(server.listen_descriptor);
+        return -2;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    server.epoll_descriptor = epoll_create1(0);
+    if (listen(server.listen_descriptor, SOMAXCONN) != 0 || fcntl(server.listen_descriptor, F_SETFL, O_NONBLOCK) != 0
+        || server.epoll_descriptor < 0
+        || epoll_ctl(server.epoll_descriptor, EPOLL_CTL_ADD, server.listen_descriptor, &event) != 0) {
+        if (server.epoll_descriptor >= 0) {
+            close(server.epoll_descriptor);
+        }
+        close(server.listen_descriptor);
+        unlink(socket_path);
+        return -2;
+    }
+
+    //the signals interrupt waiting for events
+    struct sigaction action, old_interrupt_action, old_terminate_action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_server;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, &old_interrupt_action);
+    sigaction(SIGTERM, &action, &old_terminate_action);
+    server_stopping = 0;
+    printf("Serving on %s (press Ctrl+C to stop)...\n", socket_path);
+    fflush(stdout);
+
+    LONG result = 0;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!server_stopping) {
+        int event_count = epoll_wait(server.epoll_descriptor, events, SERVER_MAX_EVENTS, -1);
+        if (event_count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result = -2;
+            break;
+        }
+        for (int i = 0; i < event_count; i++) {
+            SERVERCLIENT *client = events[i].data.ptr;
+            if (client == NULL) {
+                accept_clients(&server);
+            } else if (!serve_client(&server, client, events[i].events)) {
+                close_client(&server, client);
+            }
+        }
+    }
+
+    while (server.clients != NULL) {
+        close_client(&server, server.clients);
+    }
+    close(server.epoll_descriptor);
+    close(server.listen_descriptor);
+    unlink(socket_path);
+    sigaction(SIGINT, &old_interrupt_action, NULL);
+    sigaction(SIGTERM, &old_terminate_action, NULL);
+    return result;
+}
@@ -0,0 +1,42 @@
+/*!
+ *  \brief     Socket server serving many clients drawing on their own canvases (see run_server()).
+ *  \author    Dawid Sygocki
+ *  \date      2026-10-15
+ */
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "rgbtri_private.h"
+
+/* Protocol (all the integers are little-endian):
+ *  request:  DWORD payload length, DWORD command, payload
+ *  response: DWORD payload length, LONG result (as returned by the library), payload
+ * Requests are executed in order and each of them is answered by a single response.
+ */
+
+//payload: LONG width, LONG height; replaces the canvas of the client with a new (white) one
+//(at most #SERVER_MAX_BITMAP_SIZE bytes large as a bitmap file)
+#define SERVER_COMMAND_SIZE 1
+//payload: BYTE red, BYTE green, BYTE blue
+#define SERVER_COMMAND_CLEAR 2
+//payload: triangles, each consisting of three 12-byte vertex records (as in binary batch files)
+#define SERVER_COMMAND_DRAW 3
+//payload: output filename relative to the directory of the default output file of the server
+//(without a terminating null character, neither absolute nor containing "..", empty for the default one of the client)
+#define SERVER_COMMAND_SAVE 4
+//no payload; the response payload is the bitmap file (the bytes written by save)
+#define SERVER_COMMAND_FETCH 5
+//payload: indexed mesh as a mesh record (see #MESH_RECORD_HEADER_SIZE)
+#define SERVER_COMMAND_MESH 6
+
+//size of the request and response headers in bytes
+#define SERVER_HEADER_SIZE 8
+//maximal request payload length (longer requests close the connection)
+#define SERVER_MAX_PAYLOAD (64 * 1024 * 1024)
+//maximal size of the bitmap file of a canvas (a fetch response payload), larger sizes are rejected
+#define SERVER_MAX_BITMAP_SIZE SERVER_MAX_PAYLOAD
+
+LONG run_server(const char *socket_path, const LONG width, const LONG height, const char *output_filename,
+    const LONG thread_count, const bool xrgb);
+
+#endif
@@ -0,0 +1,151 @@
+; description:   Contains the functions for setting up blocks of eight triangles stored as structure of arrays.
+;                Vertices of all the triangles are sorted at once with a compare-and-swap network
+;                and the exact fixed-point steps of their edges (see set_edge_value() in rgbtri.c)
+;                are calculated two triangles at a time using double-precision division.
+; author:        Dawid Sygocki
+; last modified: 2026-10-16
+
+; layout of the SETUPBLOCK structure (all the arrays hold LONG values of eight triangles)
+;  [0]    vertices[3][5][8] (channels: y, x, red, green, blue)
+;  [480]  steps[3][4][8] (edges: v0-v2, v0-v1, v1-v2; channels: x, red, green, blue)
+;  [864]  step_remainders[3][4][8]
+;  [1248] denominators[3][8]
+
+%macro swap_channel 3
+    ; swaps a channel of two vertices of four triangles where the mask in xmm0 is set
+    ; parameters:
+    ;  %1 index of the first vertex
+    ;  %2 index of the second vertex
+    ;  %3 index of the channel
+    movdqu xmm1, [rdi+r8+(%1*5+%3)*32]
+    movdqu xmm2, [rdi+r8+(%2*5+%3)*32]
+    movdqa xmm3, xmm1
+    pxor xmm3, xmm2
+    pand xmm3, xmm0
+    pxor xmm1, xmm3
+    pxor xmm2, xmm3
+    movdqu [rdi+r8+(%1*5+%3)*32], xmm1
+    movdqu [rdi+r8+(%2*5+%3)*32], xmm2
+%endmacro
+
+%macro compare_swap 2
+    ; swaps two vertices of four triangles if the second one lies higher (like sort_triangle_vertices())
+    ; parameters:
+    ;  %1 index of the first vertex
+    ;  %2 index of the second vertex
+    movdqu xmm0, [rdi+r8+%1*5*32]
+    movdqu xmm1, [rdi+r8+%2*5*32]
+    pcmpgtd xmm0, xmm1
+    swap_channel %1, %2, 0
+    swap_channel %1, %2, 1
+    swap_channel %1, %2, 2
+    swap_channel %1, %2, 3
+    swap_channel %1, %2, 4
+%endmacro
+
+%macro setup_channel 4
+    ; calculates the step of a channel of an edge of two triangles
+    ;  (floor division of the delta by the denominator and its remainder)
+    ; parameters:
+    ;  %1 index of the edge
+    ;  %2 index of the upper vertex of the edge
+    ;  %3 index of the lower vertex of the edge
+    ;  %4 index of the channel (x, red, green or blue)
+    movq xmm0, [rdi+r8+(%2*5+%4+1)*32]
+    movq xmm1, [rdi+r8+(%3*5+%4+1)*32]
+    psubd xmm1, xmm0
+    pand xmm1, xmm13  ; zero delta for horizontal edges
+    cvtdq2pd xmm1, xmm1
+    ; the quotient of integers below 2^26 is rounded by less than its distance to the nearest other integer,
+    ; so its floor is exact: truncate it and decrement the negative ones which were not integers
+    movapd xmm2, xmm1
+    divpd xmm2, xmm14
+    cvttpd2dq xmm3, xmm2
+    cvtdq2pd xmm3, xmm3
+    cmpltpd xmm2, xmm3
+    andpd xmm2, xmm12
+    subpd xmm3, xmm2
+    movapd xmm2, xmm3  ; quotient
+    mulpd xmm3, xmm14
+    subpd xmm1, xmm3  ; remainder
+    cvttpd2dq xmm2, xmm2
+    cvttpd2dq xmm1, xmm1
+    movq [rdi+r8+480+(%1*4+%4)*32], xmm2
+    movq [rdi+r8+864+(%1*4+%4)*32], xmm1
+%endmacro
+
+%macro setup_edge 3
+    ; calculates the denominator and the steps of all the channels of an edge of two triangles
+    ; parameters:
+    ;  %1 index of the edge
+    ;  %2 index of the upper vertex of the edge
+    ;  %3 index of the lower vertex of the edge
+    movq xmm0, [rdi+r8+%2*5*32]
+    movq xmm13, [rdi+r8+%3*5*32]
+    psubd xmm13, xmm0  ; vertical length of the edge
+    movdqa xmm0, xmm13
+    pcmpgtd xmm13, xmm15
+    movdqa xmm1, xmm13
+    pandn xmm1, xmm11
+    por xmm0, xmm1  ; denominator (one for horizontal edges)
+    movq [rdi+r8+1248+%1*32], xmm0
+    cvtdq2pd xmm14, xmm0
+    setup_channel %1, %2, %3, 0
+    setup_channel %1, %2, %3, 1
+    setup_channel %1, %2, %3, 2
+    setup_channel %1, %2, %3, 3
+%endmacro
+
+section .text
+    global sort_triangles
+    global setup_triangles
+
+sort_triangles:
+    ; function arguments
+    ;  [rdi] SETUPBLOCK *block
+
+    ; general purpose registers layout
+    ;  [r8] offset of the current triangles within the arrays
+    ; vector registers layout
+    ;  [xmm0] mask of the triangles whose vertices are swapped
+    ;  [xmm1-3] temporary values
+
+    ; sort the vertices four triangles at a time
+    xor r8d, r8d
+sort_loop:
+    compare_swap 0, 1
+    compare_swap 1, 2
+    compare_swap 0, 1
+    add r8, 16
+    cmp r8, 32
+    jb sort_loop
+    ret
+
+setup_triangles:
+    ; function arguments
+    ;  [rdi] SETUPBLOCK *block (with sorted vertices)
+
+    ; general purpose registers layout
+    ;  [r8] offset of the current triangles within the arrays
+    ; vector registers layout
+    ;  [xmm0-3] temporary values
+    ;  [xmm11] ones (integers)
+    ;  [xmm12] ones (double-precision)
+    ;  [xmm13] mask of the edges which are not horizontal
+    ;  [xmm14] denominators (double-precision)
+    ;  [xmm15] zeros
+    pxor xmm15, xmm15
+    pcmpeqd xmm11, xmm11
+    psrld xmm11, 31
+    cvtdq2pd xmm12, xmm11
+
+    ; set up the edges two triangles at a time
+    xor r8d, r8d
+setup_loop:
+    setup_edge 0, 0, 2
+    setup_edge 1, 0, 1
+    setup_edge 2, 1, 2
+    add r8, 8
+    cmp r8, 32
+    jb setup_loop
+    ret